@@ -113,7 +113,7 @@ api_service_streams
   ( access_t *perm, void *opaque, const char *op, htsmsg_t *args, htsmsg_t **resp )
 {
   const char *uuid;
-  htsmsg_t *e, *st, *stf, *hbbtv = NULL;
+  htsmsg_t *e, *st, *stf, *hbbtv = NULL, *csa;
   service_t *s;
   elementary_stream_t *es;
 
@@ -159,12 +159,15 @@ api_service_streams
   htsmsg_add_str(*resp, "name", s->s_nicename);
   if (s->s_hbbtv)
     hbbtv = htsmsg_copy(s->s_hbbtv);
+  csa = descrambler_csa_stats(s);
   tvh_mutex_unlock(&s->s_stream_mutex);
 
   htsmsg_add_msg(*resp, "streams", st);
   htsmsg_add_msg(*resp, "fstreams", stf);
   if (hbbtv)
     htsmsg_add_msg(*resp, "hbbtv", hbbtv);
+  if (csa)
+    htsmsg_add_msg(*resp, "descramble", csa);
 
   /* Done */
   tvh_mutex_unlock(&global_lock);
@@ -276,6 +276,26 @@ atomic_exchange_ptr(atomic_refptr_t ptr, void *val)
 #endif
 }
 
+/*
+ * Atomic compare and swap operation
+ */
+
+static inline int
+atomic_cas_ptr(atomic_refptr_t ptr, void *oldval, void *newval)
+{
+#if ENABLE_ATOMIC_PTR
+  return __sync_bool_compare_and_swap(ptr, oldval, newval);
+#else
+  int ret;
+  tvh_mutex_lock(&atomic_lock);
+  ret = *ptr == oldval;
+  if (ret)
+    *ptr = newval;
+  tvh_mutex_unlock(&atomic_lock);
+  return ret;
+#endif
+}
+
 /*
  * Atomic get operation
  */
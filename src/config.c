@@ -1712,6 +1712,7 @@ config_boot
   config.ticket_expires = 5 * 60;
   config.dscp = -1;
   config.descrambler_buffer = 9000;
+  config.descrambler_latency = 250;
   config.epg_compress = 1;
   config.epg_cut_window = 5*60;
   config.epg_update_window = 24*3600;
@@ -2538,6 +2539,41 @@ const idclass_t config_class = {
       .off    = offsetof(config_t, iptv_tpool_count),
       .group  = 7,
     },
+    {
+      .type   = PT_INT,
+      .id     = "demux_tpool",
+      .name   = N_("Demux threads"),
+      .desc   = N_("Set the number of threads used to demultiplex the "
+                   "inputs carrying many muxes (IPTV), 0 means one "
+                   "thread per CPU. The value is used when the first "
+                   "mux is started."),
+      .off    = offsetof(config_t, demux_tpool_count),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
+    {
+      .type   = PT_INT,
+      .id     = "htsp_io_threads",
+      .name   = N_("HTSP I/O threads"),
+      .desc   = N_("Set the number of threads serving all HTSP "
+                   "connections (the requests are processed by a "
+                   "small worker pool). 0 means two threads for "
+                   "each connection. The change requires a restart."),
+      .off    = offsetof(config_t, htsp_io_threads),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
+    {
+      .type   = PT_INT,
+      .id     = "htsp_io_workers",
+      .name   = N_("HTSP workers"),
+      .desc   = N_("Set the number of threads processing the HTSP "
+                   "requests when the I/O threads are used, 0 means "
+                   "four threads. The change requires a restart."),
+      .off    = offsetof(config_t, htsp_io_workers),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
     {
       .type   = PT_INT,
       .id     = "dscp",
@@ -2565,6 +2601,45 @@ const idclass_t config_class = {
       .opts   = PO_EXPERT,
       .group  = 7,
     },
+    {
+      .type   = PT_INT,
+      .id     = "descrambler_tpool",
+      .name   = N_("Descrambler threads"),
+      .desc   = N_("Set the number of threads used to descramble the "
+                   "CSA services. The packet batches are decrypted "
+                   "in parallel and delivered in order. 0 means "
+                   "descrambling in the input thread. The value is "
+                   "used when the first service is descrambled."),
+      .off    = offsetof(config_t, descrambler_tpool_count),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
+    {
+      .type   = PT_U32,
+      .id     = "descrambler_latency",
+      .name   = N_("Descrambler latency (ms)"),
+      .desc   = N_("The maximum time the CSA scrambled packets wait "
+                   "for a full batch. The batch is decrypted earlier "
+                   "when the input rate is too low to fill it in time "
+                   "(radio, SD services). 0 means always wait for "
+                   "a full batch."),
+      .off    = offsetof(config_t, descrambler_latency),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
+    {
+      .type   = PT_INT,
+      .id     = "descrambler_standby",
+      .name   = N_("Standby descrambled services"),
+      .desc   = N_("The number of scrambled services kept running "
+                   "in advance on the tuned muxes (the channel "
+                   "neighbours of the watched channels and the "
+                   "upcoming recordings), so the channel change does "
+                   "not wait for the control words. 0 disables it."),
+      .off    = offsetof(config_t, descrambler_standby),
+      .opts   = PO_EXPERT,
+      .group  = 7,
+    },
     {
       .type   = PT_BOOL,
       .id     = "parser_backlog",
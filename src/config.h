@@ -62,12 +62,18 @@ typedef struct config {
   uint32_t cookie_expires;
   int dscp;
   uint32_t descrambler_buffer;
+  int descrambler_tpool_count;
+  uint32_t descrambler_latency;
+  int descrambler_standby;
   int caclient_ui;
   int parser_backlog;
   int epg_compress;
   uint32_t epg_cut_window;
   uint32_t epg_update_window;
   int iptv_tpool_count;
+  int demux_tpool_count;
+  int htsp_io_threads;
+  int htsp_io_workers;
   char *date_mask;
   int label_formatting;
   uint32_t ticket_expires;
@@ -0,0 +1,388 @@
+/*
+ *  Tvheadend - MPEG-2 CRC32 kernels
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "tvheadend.h"
+#include "crc32.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && ENABLE_SSE2 && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define CRC32_X86 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && \
+    BYTE_ORDER == LITTLE_ENDIAN && (defined(__clang__) || __GNUC__ >= 6)
+#define CRC32_ARM 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/**
+ * Byte-wise table
+ */
+static const uint32_t crc_tab[256] = {
+  0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 0x130476dc, 0x17c56b6b,
+  0x1a864db2, 0x1e475005, 0x2608edb8, 0x22c9f00f, 0x2f8ad6d6, 0x2b4bcb61,
+  0x350c9b64, 0x31cd86d3, 0x3c8ea00a, 0x384fbdbd, 0x4c11db70, 0x48d0c6c7,
+  0x4593e01e, 0x4152fda9, 0x5f15adac, 0x5bd4b01b, 0x569796c2, 0x52568b75,
+  0x6a1936c8, 0x6ed82b7f, 0x639b0da6, 0x675a1011, 0x791d4014, 0x7ddc5da3,
+  0x709f7b7a, 0x745e66cd, 0x9823b6e0, 0x9ce2ab57, 0x91a18d8e, 0x95609039,
+  0x8b27c03c, 0x8fe6dd8b, 0x82a5fb52, 0x8664e6e5, 0xbe2b5b58, 0xbaea46ef,
+  0xb7a96036, 0xb3687d81, 0xad2f2d84, 0xa9ee3033, 0xa4ad16ea, 0xa06c0b5d,
+  0xd4326d90, 0xd0f37027, 0xddb056fe, 0xd9714b49, 0xc7361b4c, 0xc3f706fb,
+  0xceb42022, 0xca753d95, 0xf23a8028, 0xf6fb9d9f, 0xfbb8bb46, 0xff79a6f1,
+  0xe13ef6f4, 0xe5ffeb43, 0xe8bccd9a, 0xec7dd02d, 0x34867077, 0x30476dc0,
+  0x3d044b19, 0x39c556ae, 0x278206ab, 0x23431b1c, 0x2e003dc5, 0x2ac12072,
+  0x128e9dcf, 0x164f8078, 0x1b0ca6a1, 0x1fcdbb16, 0x018aeb13, 0x054bf6a4,
+  0x0808d07d, 0x0cc9cdca, 0x7897ab07, 0x7c56b6b0, 0x71159069, 0x75d48dde,
+  0x6b93dddb, 0x6f52c06c, 0x6211e6b5, 0x66d0fb02, 0x5e9f46bf, 0x5a5e5b08,
+  0x571d7dd1, 0x53dc6066, 0x4d9b3063, 0x495a2dd4, 0x44190b0d, 0x40d816ba,
+  0xaca5c697, 0xa864db20, 0xa527fdf9, 0xa1e6e04e, 0xbfa1b04b, 0xbb60adfc,
+  0xb6238b25, 0xb2e29692, 0x8aad2b2f, 0x8e6c3698, 0x832f1041, 0x87ee0df6,
+  0x99a95df3, 0x9d684044, 0x902b669d, 0x94ea7b2a, 0xe0b41de7, 0xe4750050,
+  0xe9362689, 0xedf73b3e, 0xf3b06b3b, 0xf771768c, 0xfa325055, 0xfef34de2,
+  0xc6bcf05f, 0xc27dede8, 0xcf3ecb31, 0xcbffd686, 0xd5b88683, 0xd1799b34,
+  0xdc3abded, 0xd8fba05a, 0x690ce0ee, 0x6dcdfd59, 0x608edb80, 0x644fc637,
+  0x7a089632, 0x7ec98b85, 0x738aad5c, 0x774bb0eb, 0x4f040d56, 0x4bc510e1,
+  0x46863638, 0x42472b8f, 0x5c007b8a, 0x58c1663d, 0x558240e4, 0x51435d53,
+  0x251d3b9e, 0x21dc2629, 0x2c9f00f0, 0x285e1d47, 0x36194d42, 0x32d850f5,
+  0x3f9b762c, 0x3b5a6b9b, 0x0315d626, 0x07d4cb91, 0x0a97ed48, 0x0e56f0ff,
+  0x1011a0fa, 0x14d0bd4d, 0x19939b94, 0x1d528623, 0xf12f560e, 0xf5ee4bb9,
+  0xf8ad6d60, 0xfc6c70d7, 0xe22b20d2, 0xe6ea3d65, 0xeba91bbc, 0xef68060b,
+  0xd727bbb6, 0xd3e6a601, 0xdea580d8, 0xda649d6f, 0xc423cd6a, 0xc0e2d0dd,
+  0xcda1f604, 0xc960ebb3, 0xbd3e8d7e, 0xb9ff90c9, 0xb4bcb610, 0xb07daba7,
+  0xae3afba2, 0xaafbe615, 0xa7b8c0cc, 0xa379dd7b, 0x9b3660c6, 0x9ff77d71,
+  0x92b45ba8, 0x9675461f, 0x8832161a, 0x8cf30bad, 0x81b02d74, 0x857130c3,
+  0x5d8a9099, 0x594b8d2e, 0x5408abf7, 0x50c9b640, 0x4e8ee645, 0x4a4ffbf2,
+  0x470cdd2b, 0x43cdc09c, 0x7b827d21, 0x7f436096, 0x7200464f, 0x76c15bf8,
+  0x68860bfd, 0x6c47164a, 0x61043093, 0x65c52d24, 0x119b4be9, 0x155a565e,
+  0x18197087, 0x1cd86d30, 0x029f3d35, 0x065e2082, 0x0b1d065b, 0x0fdc1bec,
+  0x3793a651, 0x3352bbe6, 0x3e119d3f, 0x3ad08088, 0x2497d08d, 0x2056cd3a,
+  0x2d15ebe3, 0x29d4f654, 0xc5a92679, 0xc1683bce, 0xcc2b1d17, 0xc8ea00a0,
+  0xd6ad50a5, 0xd26c4d12, 0xdf2f6bcb, 0xdbee767c, 0xe3a1cbc1, 0xe760d676,
+  0xea23f0af, 0xeee2ed18, 0xf0a5bd1d, 0xf464a0aa, 0xf9278673, 0xfde69bc4,
+  0x89b8fd09, 0x8d79e0be, 0x803ac667, 0x84fbdbd0, 0x9abc8bd5, 0x9e7d9662,
+  0x933eb0bb, 0x97ffad0c, 0xafb010b1, 0xab710d06, 0xa6322bdf, 0xa2f33668,
+  0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
+};
+
+static uint32_t
+crc32_run_byte ( const uint8_t *data, size_t datalen, uint32_t crc )
+{
+  while(datalen--)
+    crc = (crc << 8) ^ crc_tab[((crc >> 24) ^ *data++) & 0xff];
+
+  return crc;
+}
+
+/**
+ * Slicing-by-8
+ *
+ * crc_slice[k][b] is the CRC of byte b followed by k zero bytes,
+ * the rows are built from crc_tab in crc32_init().
+ */
+static uint32_t crc_slice[8][256];
+
+static uint32_t
+crc32_run_slice8 ( const uint8_t *data, size_t datalen, uint32_t crc )
+{
+  uint32_t a;
+
+  while (datalen >= 8) {
+    a = crc ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+               ((uint32_t)data[2] << 8) | data[3]);
+    crc = crc_slice[7][a >> 24] ^ crc_slice[6][(a >> 16) & 0xff] ^
+          crc_slice[5][(a >> 8) & 0xff] ^ crc_slice[4][a & 0xff] ^
+          crc_slice[3][data[4]] ^ crc_slice[2][data[5]] ^
+          crc_slice[1][data[6]] ^ crc_slice[0][data[7]];
+    data += 8;
+    datalen -= 8;
+  }
+  while (datalen--)
+    crc = (crc << 8) ^ crc_slice[0][(crc >> 24) ^ *data++];
+  return crc;
+}
+
+/*
+ * x^n mod P, used for the folding constants
+ */
+static uint32_t
+crc32_xpow ( int n )
+{
+  uint64_t r = 1;
+
+  while (n-- > 0) {
+    r <<= 1;
+    if (r & 0x100000000ULL)
+      r ^= 0x104c11db7ULL;
+  }
+  return r;
+}
+
+#if CRC32_X86
+
+/**
+ * Carry-less multiply folding (PCLMULQDQ)
+ *
+ * The data is loaded as big-endian 128-bit polynomials. Each accumulator
+ * is folded forward by d bits as hi * (x^(d+64) mod P) ^ lo * (x^d mod P),
+ * which keeps it congruent to the message modulo P. The final 128 bits
+ * and the tail are finished with the table code.
+ */
+static uint64_t crc_fold512[2], crc_fold128[2];
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i
+crc32_fold ( __m128i x, __m128i k )
+{
+  return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+                       _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint32_t
+crc32_run_pclmul ( const uint8_t *data, size_t datalen, uint32_t crc )
+{
+  const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                      7, 6, 5, 4, 3, 2, 1, 0);
+  __m128i x0, x1, x2, x3, k;
+  uint8_t last[16];
+
+  if (datalen < 128)
+    return crc32_run_slice8(data, datalen, crc);
+
+#define LOAD(o) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + (o))), bswap)
+  x0 = _mm_xor_si128(LOAD(0), _mm_set_epi32(crc, 0, 0, 0));
+  x1 = LOAD(16);
+  x2 = LOAD(32);
+  x3 = LOAD(48);
+  data += 64;
+  datalen -= 64;
+
+  k = _mm_set_epi64x(crc_fold512[1], crc_fold512[0]);
+  while (datalen >= 64) {
+    x0 = _mm_xor_si128(crc32_fold(x0, k), LOAD(0));
+    x1 = _mm_xor_si128(crc32_fold(x1, k), LOAD(16));
+    x2 = _mm_xor_si128(crc32_fold(x2, k), LOAD(32));
+    x3 = _mm_xor_si128(crc32_fold(x3, k), LOAD(48));
+    data += 64;
+    datalen -= 64;
+  }
+
+  k = _mm_set_epi64x(crc_fold128[1], crc_fold128[0]);
+  x1 = _mm_xor_si128(crc32_fold(x0, k), x1);
+  x2 = _mm_xor_si128(crc32_fold(x1, k), x2);
+  x3 = _mm_xor_si128(crc32_fold(x2, k), x3);
+  while (datalen >= 16) {
+    x3 = _mm_xor_si128(crc32_fold(x3, k), LOAD(0));
+    data += 16;
+    datalen -= 16;
+  }
+#undef LOAD
+
+  _mm_storeu_si128((__m128i *)last, _mm_shuffle_epi8(x3, bswap));
+  crc = crc32_run_slice8(last, 16, 0);
+  return crc32_run_slice8(data, datalen, crc);
+}
+
+static int
+crc32_have_pclmul ( void )
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (ecx & bit_PCLMUL) && (ecx & bit_SSSE3);
+}
+
+#endif /* CRC32_X86 */
+
+#if CRC32_ARM
+
+/**
+ * ARMv8 CRC32 instructions
+ *
+ * The instructions implement the bit-reflected CRC-32 with the same
+ * polynomial. Reversing the bits of every input byte and of the register
+ * maps the MPEG-2 (MSB-first) CRC onto it.
+ */
+__attribute__((target("+crc")))
+static uint32_t
+crc32_run_armv8 ( const uint8_t *data, size_t datalen, uint32_t crc )
+{
+  uint64_t w;
+
+  crc = __rbit(crc);
+  while (datalen >= 8) {
+    memcpy(&w, data, 8);
+    crc = __crc32d(crc, __rbitll(__revll(w)));
+    data += 8;
+    datalen -= 8;
+  }
+  while (datalen--)
+    crc = __crc32b(crc, __rbit(*data++) >> 24);
+  return __rbit(crc);
+}
+
+#endif /* CRC32_ARM */
+
+/**
+ * Dispatch
+ */
+static const crc32_kernel_t crc32_byte   = { "table",  crc32_run_byte };
+static const crc32_kernel_t crc32_slice8 = { "slice8", crc32_run_slice8 };
+#if CRC32_X86
+static const crc32_kernel_t crc32_pclmul = { "pclmul", crc32_run_pclmul };
+#endif
+#if CRC32_ARM
+static const crc32_kernel_t crc32_armv8  = { "armv8",  crc32_run_armv8 };
+#endif
+
+/* usable before crc32_init(), the byte-wise table is static */
+const crc32_kernel_t *crc32_kernel = &crc32_byte;
+
+static void
+crc32_tables ( void )
+{
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+    crc_slice[0][i] = crc_tab[i];
+  for (k = 1; k < 8; k++)
+    for (i = 0; i < 256; i++)
+      crc_slice[k][i] = (crc_slice[k-1][i] << 8) ^
+                        crc_tab[crc_slice[k-1][i] >> 24];
+#if CRC32_X86
+  crc_fold512[0] = crc32_xpow(512);
+  crc_fold512[1] = crc32_xpow(512 + 64);
+  crc_fold128[0] = crc32_xpow(128);
+  crc_fold128[1] = crc32_xpow(128 + 64);
+#endif
+}
+
+static const crc32_kernel_t *
+crc32_select ( void )
+{
+#if CRC32_X86
+  if (crc32_have_pclmul())
+    return &crc32_pclmul;
+#endif
+#if CRC32_ARM
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+    return &crc32_armv8;
+#endif
+  return &crc32_slice8;
+}
+
+#ifndef CRC32_BENCH
+
+void
+crc32_init ( void )
+{
+  crc32_tables();
+  crc32_kernel = crc32_select();
+  tvhdebug(LS_MAIN, "CRC32 kernel: %s", crc32_kernel->name);
+}
+
+#endif
+
+uint32_t
+tvh_crc32(const uint8_t *data, size_t datalen, uint32_t crc)
+{
+  return crc32_kernel->run(data, datalen, crc);
+}
+
+#ifdef CRC32_BENCH
+
+/*
+ * Microbenchmark, compile and run:
+ *   gcc -O2 -o crc32bench -DCRC32_BENCH -Isrc -Ibuild.linux src/crc32.c
+ *   ./crc32bench [megabytes]
+ * Every kernel is checked against the byte-wise table first.
+ */
+
+#include <time.h>
+
+static const crc32_kernel_t *crc32_bench_kernels[] = {
+  &crc32_byte,
+  &crc32_slice8,
+#if CRC32_X86
+  &crc32_pclmul,
+#endif
+#if CRC32_ARM
+  &crc32_armv8,
+#endif
+  NULL
+};
+
+static double
+crc32_bench_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+  static const size_t sizes[] = { 12, 188, 1024, 4096, 65536 };
+  const crc32_kernel_t **kp, *k;
+  size_t mb = argc > 1 ? atol(argv[1]) : 256, i, j, len, loops;
+  uint8_t *buf = malloc(65536 + 16);
+  uint32_t crc, ref;
+  double t;
+
+  crc32_tables();
+  srand(1);
+  for (i = 0; i < 65536 + 16; i++)
+    buf[i] = rand();
+  for (kp = crc32_bench_kernels; (k = *kp) != NULL; kp++)
+    for (len = 0; len <= 1024; len++)
+      for (j = 0; j < 4; j++) {
+        ref = crc32_run_byte(buf + j, len, 0xffffffff - j);
+        if ((crc = k->run(buf + j, len, 0xffffffff - j)) != ref) {
+          printf("%s: mismatch len %zu offset %zu (%08x != %08x)\n",
+                 k->name, len, j, crc, ref);
+          return 1;
+        }
+      }
+  printf("selected: %s\n", crc32_select()->name);
+  for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+    len = sizes[i];
+    loops = (mb << 20) / len;
+    printf("%6zu bytes:", len);
+    for (kp = crc32_bench_kernels; (k = *kp) != NULL; kp++) {
+      crc = 0xffffffff;
+      t = crc32_bench_now();
+      for (j = 0; j < loops; j++)
+        crc = k->run(buf + (j & 15), len, crc);
+      t = crc32_bench_now() - t;
+      printf("  %s %8.1f MB/s", k->name, (loops * len) / t / 1048576.0);
+      buf[0] ^= crc;
+    }
+    printf("\n");
+  }
+  free(buf);
+  return 0;
+}
+
+#endif /* CRC32_BENCH */
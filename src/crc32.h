@@ -0,0 +1,42 @@
+/*
+ *  Tvheadend - MPEG-2 CRC32 kernels
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_CRC32_H__
+#define __TVH_CRC32_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * All kernels compute the same MSB-first CRC (polynomial 0x04C11DB7,
+ * no reflection, no final xor) continuing from the given register value.
+ */
+typedef uint32_t (*crc32_run_t)
+  ( const uint8_t *data, size_t datalen, uint32_t crc );
+
+typedef struct crc32_kernel {
+  const char   *name;
+  crc32_run_t   run;
+} crc32_kernel_t;
+
+extern const crc32_kernel_t *crc32_kernel;
+
+void crc32_init ( void );
+
+#endif /* __TVH_CRC32_H__ */
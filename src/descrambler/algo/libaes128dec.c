@@ -11,24 +11,45 @@
 #include <stdlib.h>
 
 #include "openssl/aes.h"
+#include "openssl/evp.h"
 
 #include "libaes128dec.h"
 
+/* packets gathered for one EVP call */
+#define AES128_BATCH 32
+
 /* key structure */
 typedef struct aes128_priv {
   AES_KEY keys[2]; /* 0 = even, 1 = odd */
+  EVP_CIPHER_CTX *ctx[2];
+  /* batch */
+  int fill;
+  int parity;
+  uint8_t *pkt[AES128_BATCH];
+  uint8_t len[AES128_BATCH];
+  uint8_t buf[AES128_BATCH * 176];
 } aes128_priv_t;
 
+static void aes128_set_key(aes128_priv_t *priv, int parity, const uint8_t *pk)
+{
+  AES_set_decrypt_key(pk, 128, &priv->keys[parity]);
+  if (priv->ctx[parity] &&
+      !EVP_DecryptInit_ex(priv->ctx[parity], NULL, NULL, pk, NULL)) {
+    EVP_CIPHER_CTX_free(priv->ctx[parity]);
+    priv->ctx[parity] = NULL;
+  }
+}
+
 /* even cw represents one full 128-bit AES key */
 void aes128_set_even_control_word(void *keys, const uint8_t *pk)
 {
-  AES_set_decrypt_key(pk, 128, &((aes128_priv_t *) keys)->keys[0]);
+  aes128_set_key(keys, 0, pk);
 }
 
 /* odd cw represents one full 128-bit AES key */
 void aes128_set_odd_control_word(void *keys, const uint8_t *pk)
 {
-  AES_set_decrypt_key(pk, 128, &((aes128_priv_t *) keys)->keys[1]);
+  aes128_set_key(keys, 1, pk);
 }
 
 /* set control words */
@@ -36,18 +57,28 @@ void aes128_set_control_words(void *keys,
                            const uint8_t *ev,
                            const uint8_t *od)
 {
-  AES_set_decrypt_key(ev, 128, &((aes128_priv_t *) keys)->keys[0]);
-  AES_set_decrypt_key(od, 128, &((aes128_priv_t *) keys)->keys[1]);
+  aes128_set_key(keys, 0, ev);
+  aes128_set_key(keys, 1, od);
 }
 
 /* allocate key structure */
 void * aes128_get_priv_struct(void)
 {
   aes128_priv_t *keys;
+  int i;
 
-  keys = (aes128_priv_t *) malloc(sizeof(aes128_priv_t));
+  keys = (aes128_priv_t *) calloc(1, sizeof(aes128_priv_t));
   if (keys) {
     static const uint8_t pk[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (i = 0; i < 2; i++) {
+      keys->ctx[i] = EVP_CIPHER_CTX_new();
+      if (keys->ctx[i] &&
+          (!EVP_DecryptInit_ex(keys->ctx[i], EVP_aes_128_ecb(), NULL, pk, NULL) ||
+           !EVP_CIPHER_CTX_set_padding(keys->ctx[i], 0))) {
+        EVP_CIPHER_CTX_free(keys->ctx[i]);
+        keys->ctx[i] = NULL;
+      }
+    }
     aes128_set_control_words(keys, pk, pk);
   }
   return keys;
@@ -56,6 +87,12 @@ void * aes128_get_priv_struct(void)
 /* free key structure */
 void aes128_free_priv_struct(void *keys)
 {
+  aes128_priv_t *priv = keys;
+
+  if (priv) {
+    EVP_CIPHER_CTX_free(priv->ctx[0]);
+    EVP_CIPHER_CTX_free(priv->ctx[1]);
+  }
   free(keys);
 }
 
@@ -86,3 +123,60 @@ void aes128_decrypt_packet(void *keys, const uint8_t *pkt)
     AES_ecb_encrypt(pkt + offset, (uint8_t *)(pkt + offset), k, AES_DECRYPT);
   }
 }
+
+/* decrypt the gathered payloads with one EVP call */
+static void aes128_flush(aes128_priv_t *priv)
+{
+  EVP_CIPHER_CTX *ctx = priv->ctx[priv->parity];
+  AES_KEY *k = &priv->keys[priv->parity];
+  uint8_t *p;
+  int i, l, total = 0;
+
+  for (i = 0; i < priv->fill; i++) {
+    memcpy(priv->buf + total, priv->pkt[i], priv->len[i]);
+    total += priv->len[i];
+  }
+  if (ctx == NULL || !EVP_DecryptUpdate(ctx, priv->buf, &l, priv->buf, total) ||
+      l != total) {
+    for (p = priv->buf; p < priv->buf + total; p += 16)
+      AES_ecb_encrypt(p, p, k, AES_DECRYPT);
+  }
+  for (i = 0, total = 0; i < priv->fill; i++) {
+    memcpy(priv->pkt[i], priv->buf + total, priv->len[i]);
+    total += priv->len[i];
+  }
+  priv->fill = 0;
+}
+
+/* decrypt a run of packets, the payloads with the same parity are batched */
+void aes128_decrypt_packets(void *keys, const uint8_t *tsb, int len)
+{
+  aes128_priv_t *priv = keys;
+  const uint8_t *end = tsb + len;
+  uint8_t *pkt;
+  uint_fast8_t ev_od, xc0, offset;
+
+  for (; tsb < end; tsb += 188) {
+    pkt = (uint8_t *)tsb;
+    // skip reserved and not encrypted pkt
+    if (((xc0 = pkt[3]) & 0x80) == 0)
+      continue;
+    ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
+    pkt[3] = xc0 & 0x3f;  // consider it decrypted now
+    if (xc0 & 0x20) { // incomplete packet
+      offset = 4 + pkt[4] + 1;
+      if (offset + 16 > 188) // decrypted==encrypted!
+        continue;
+    } else {
+      offset = 4;
+    }
+    if (priv->fill && (priv->parity != ev_od || priv->fill == AES128_BATCH))
+      aes128_flush(priv);
+    priv->parity = ev_od;
+    priv->pkt[priv->fill] = pkt + offset;
+    priv->len[priv->fill] = (188 - offset) & ~15;
+    priv->fill++;
+  }
+  if (priv->fill)
+    aes128_flush(priv);
+}
@@ -19,6 +19,7 @@ void aes128_set_control_words(void *keys, const uint8_t *even, const uint8_t *od
 void aes128_set_even_control_word(void *keys, const uint8_t *even);
 void aes128_set_odd_control_word(void *keys, const uint8_t *odd);
 void aes128_decrypt_packet(void *keys, const uint8_t *pkt);
+void aes128_decrypt_packets(void *keys, const uint8_t *tsb, int len);
 
 #else
 
@@ -29,6 +30,7 @@ static inline void aes128_set_control_words(void *keys, const uint8_t *even, con
 static inline void aes128_set_even_control_word(void *keys, const uint8_t *even) { return; };
 static inline void aes128_set_odd_control_word(void *keys, const uint8_t *odd) { return; };
 static inline void aes128_decrypt_packet(void *keys, const uint8_t *pkt) { return; };
+static inline void aes128_decrypt_packets(void *keys, const uint8_t *tsb, int len) { return; };
 
 #endif
 
@@ -19,6 +19,8 @@
 #include "tvheadend.h"
 #include "settings.h"
 #include "caclient.h"
+#include "descrambler.h"
+#include "memoryinfo.h"
 #include "dvbcam.h"
 
 const idclass_t *caclient_classes[] = {
@@ -415,6 +417,203 @@ caclient_foreach(void (*cb)(caclient_t *))
   tvh_mutex_unlock(&caclients_mutex);
 }
 
+/*
+ * Shared ECM response cache
+ *
+ * The entries are keyed by CAID, provider and the whole ECM section.
+ * The first requester creates the entry in the pending state, the other
+ * requesters of the same ECM wait for the reply (they look up the cache
+ * again when the ECM section repeats). The control words stay valid
+ * until a newer ECM of the same parity (table id) for the same CAID and
+ * provider is answered, or until the TTL expires.
+ */
+
+#define CACLIENT_ECM_HASH_SIZE    256
+#define CACLIENT_ECM_MAX          512
+#define CACLIENT_ECM_TTL          sec2mono(30)
+#define CACLIENT_ECM_PENDING_TTL  sec2mono(5)
+
+typedef struct caclient_ecm {
+  LIST_ENTRY(caclient_ecm)  ce_hash_link;
+  TAILQ_ENTRY(caclient_ecm) ce_link;      /* oldest first */
+  uint32_t ce_hash;
+  uint32_t ce_ticket;
+  uint32_t ce_provid;
+  uint16_t ce_caid;
+  uint8_t  ce_parity;
+  uint8_t  ce_resolved;
+  int64_t  ce_time;
+  caclient_ecm_keys_t ce_keys;
+  int      ce_len;
+  uint8_t  ce_data[0];
+} caclient_ecm_t;
+
+static tvh_mutex_t caclient_ecm_lock = TVH_THREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(, caclient_ecm) caclient_ecm_hash[CACLIENT_ECM_HASH_SIZE];
+static TAILQ_HEAD(caclient_ecm_queue, caclient_ecm) caclient_ecm_entries =
+  TAILQ_HEAD_INITIALIZER(caclient_ecm_entries);
+static int caclient_ecm_count;
+static uint32_t caclient_ecm_ticket;
+static uint64_t caclient_ecm_hits;
+static uint64_t caclient_ecm_misses;
+static uint64_t caclient_ecm_coalesced;
+
+static memoryinfo_t caclient_ecm_memoryinfo = { .my_name = "ECM cache" };
+
+static void
+caclient_ecm_destroy(caclient_ecm_t *ce)
+{
+  LIST_REMOVE(ce, ce_hash_link);
+  TAILQ_REMOVE(&caclient_ecm_entries, ce, ce_link);
+  caclient_ecm_count--;
+  memoryinfo_free(&caclient_ecm_memoryinfo, sizeof(*ce) + ce->ce_len);
+  free(ce);
+}
+
+static void
+caclient_ecm_touch(caclient_ecm_t *ce, int64_t now)
+{
+  ce->ce_time = now;
+  TAILQ_REMOVE(&caclient_ecm_entries, ce, ce_link);
+  TAILQ_INSERT_TAIL(&caclient_ecm_entries, ce, ce_link);
+}
+
+static caclient_ecm_t *
+caclient_ecm_find_ticket(uint32_t ticket)
+{
+  caclient_ecm_t *ce;
+
+  /* the pending entries are the youngest ones */
+  TAILQ_FOREACH_REVERSE(ce, &caclient_ecm_entries, caclient_ecm_queue, ce_link)
+    if (ce->ce_ticket == ticket)
+      return ce->ce_resolved ? NULL : ce;
+  return NULL;
+}
+
+int
+caclient_ecm_lookup(uint16_t caid, uint32_t provid,
+                    const uint8_t *data, int len,
+                    caclient_ecm_keys_t *keys, uint32_t *ticket)
+{
+  caclient_ecm_t *ce;
+  uint32_t hash;
+  int64_t now = mclk();
+  int r;
+
+  *ticket = 0;
+  if (len <= 0)
+    return CACLIENT_ECM_MISS;
+  hash = tvh_crc32(data, len, 0xffffffff) ^ caid ^ provid;
+
+  tvh_mutex_lock(&caclient_ecm_lock);
+  while ((ce = TAILQ_FIRST(&caclient_ecm_entries)) != NULL &&
+         (now - ce->ce_time > CACLIENT_ECM_TTL ||
+          caclient_ecm_count >= CACLIENT_ECM_MAX))
+    caclient_ecm_destroy(ce);
+
+  LIST_FOREACH(ce, &caclient_ecm_hash[hash % CACLIENT_ECM_HASH_SIZE], ce_hash_link)
+    if (ce->ce_hash == hash && ce->ce_caid == caid &&
+        ce->ce_provid == provid && ce->ce_len == len &&
+        memcmp(ce->ce_data, data, len) == 0)
+      break;
+
+  if (ce && ce->ce_resolved) {
+    *keys = ce->ce_keys;
+    caclient_ecm_hits++;
+    r = CACLIENT_ECM_HIT;
+    goto end;
+  }
+  if (ce && now - ce->ce_time < CACLIENT_ECM_PENDING_TTL) {
+    caclient_ecm_coalesced++;
+    r = CACLIENT_ECM_PENDING;
+    goto end;
+  }
+  if (ce == NULL) {
+    ce = malloc(sizeof(*ce) + len);
+    ce->ce_hash = hash;
+    ce->ce_caid = caid;
+    ce->ce_provid = provid;
+    ce->ce_parity = data[0];
+    ce->ce_resolved = 0;
+    ce->ce_len = len;
+    memcpy(ce->ce_data, data, len);
+    LIST_INSERT_HEAD(&caclient_ecm_hash[hash % CACLIENT_ECM_HASH_SIZE],
+                     ce, ce_hash_link);
+    TAILQ_INSERT_TAIL(&caclient_ecm_entries, ce, ce_link);
+    caclient_ecm_count++;
+    memoryinfo_alloc(&caclient_ecm_memoryinfo, sizeof(*ce) + len);
+  }
+  /* new request or the previous owner did not answer, take over */
+  if (++caclient_ecm_ticket == 0)
+    caclient_ecm_ticket = 1;
+  ce->ce_ticket = caclient_ecm_ticket;
+  caclient_ecm_touch(ce, now);
+  *ticket = ce->ce_ticket;
+  caclient_ecm_misses++;
+  r = CACLIENT_ECM_MISS;
+end:
+  tvh_mutex_unlock(&caclient_ecm_lock);
+  return r;
+}
+
+void
+caclient_ecm_store(uint32_t ticket, int type,
+                   const uint8_t *even, const uint8_t *odd)
+{
+  caclient_ecm_t *ce, *ce2, *next;
+  int keylen = DESCRAMBLER_KEY_SIZE(type);
+
+  if (ticket == 0)
+    return;
+  tvh_mutex_lock(&caclient_ecm_lock);
+  if ((ce = caclient_ecm_find_ticket(ticket)) != NULL) {
+    /* the keys for the older ECM of this parity are gone now */
+    for (ce2 = TAILQ_FIRST(&caclient_ecm_entries); ce2; ce2 = next) {
+      next = TAILQ_NEXT(ce2, ce_link);
+      if (ce2 != ce && ce2->ce_resolved &&
+          ce2->ce_caid == ce->ce_caid && ce2->ce_provid == ce->ce_provid &&
+          ce2->ce_parity == ce->ce_parity)
+        caclient_ecm_destroy(ce2);
+    }
+    memset(&ce->ce_keys, 0, sizeof(ce->ce_keys));
+    ce->ce_keys.type = type;
+    memcpy(ce->ce_keys.even, even, keylen);
+    memcpy(ce->ce_keys.odd, odd, keylen);
+    ce->ce_resolved = 1;
+    caclient_ecm_touch(ce, mclk());
+  }
+  tvh_mutex_unlock(&caclient_ecm_lock);
+}
+
+void
+caclient_ecm_fail(uint32_t ticket)
+{
+  caclient_ecm_t *ce;
+
+  if (ticket == 0)
+    return;
+  tvh_mutex_lock(&caclient_ecm_lock);
+  /* the waiters will send their own requests */
+  if ((ce = caclient_ecm_find_ticket(ticket)) != NULL)
+    caclient_ecm_destroy(ce);
+  tvh_mutex_unlock(&caclient_ecm_lock);
+}
+
+static void
+caclient_ecm_done(void)
+{
+  caclient_ecm_t *ce;
+
+  tvh_mutex_lock(&caclient_ecm_lock);
+  if (caclient_ecm_hits + caclient_ecm_misses)
+    tvhdebug(LS_CACLIENT, "ECM cache: %"PRIu64" hits, %"PRIu64" misses, "
+                          "%"PRIu64" coalesced",
+             caclient_ecm_hits, caclient_ecm_misses, caclient_ecm_coalesced);
+  while ((ce = TAILQ_FIRST(&caclient_ecm_entries)) != NULL)
+    caclient_ecm_destroy(ce);
+  tvh_mutex_unlock(&caclient_ecm_lock);
+}
+
 /*
  *  Initialize
  */
@@ -427,6 +626,7 @@ caclient_init(void)
 
   tvh_mutex_init(&caclients_mutex, NULL);
   TAILQ_INIT(&caclients);
+  memoryinfo_register(&caclient_ecm_memoryinfo);
   idclass_register(&caclient_class);
 #if ENABLE_TSDEBUG
   tsdebugcw_init();
@@ -474,5 +674,7 @@ caclient_done(void)
   tvh_mutex_lock(&global_lock);
   while ((cac = TAILQ_FIRST(&caclients)) != NULL)
     caclient_delete(cac, 0);
+  memoryinfo_unregister(&caclient_ecm_memoryinfo);
   tvh_mutex_unlock(&global_lock);
+  caclient_ecm_done();
 }
@@ -73,6 +73,26 @@ typedef struct caclient {
                           uint16_t pid, int valid);
 } caclient_t;
 
+/*
+ * Shared ECM response cache
+ */
+#define CACLIENT_ECM_MISS     0 /* not cached, the caller owns the request */
+#define CACLIENT_ECM_HIT      1 /* the keys are returned */
+#define CACLIENT_ECM_PENDING  2 /* the same request is in flight */
+
+typedef struct caclient_ecm_keys {
+  int     type;
+  uint8_t even[16];
+  uint8_t odd[16];
+} caclient_ecm_keys_t;
+
+int  caclient_ecm_lookup(uint16_t caid, uint32_t provid,
+                         const uint8_t *data, int len,
+                         caclient_ecm_keys_t *keys, uint32_t *ticket);
+void caclient_ecm_store(uint32_t ticket, int type,
+                        const uint8_t *even, const uint8_t *odd);
+void caclient_ecm_fail(uint32_t ticket);
+
 caclient_t *caclient_create
   (const char *uuid, htsmsg_t *conf, int save);
 
@@ -352,6 +352,8 @@ cc_ecm_reply(cc_service_t *ct, cc_ecm_section_t *es,
   if (key_even == NULL || key_odd == NULL) {
 
     /* ERROR */
+    caclient_ecm_fail(es->es_cache_ticket);
+    es->es_cache_ticket = 0;
     if (es->es_nok < CC_MAX_NOKS)
       es->es_nok++;
 
@@ -419,6 +421,9 @@ forbid:
 
   } else {
 
+    if (!es->es_cached)
+      caclient_ecm_store(es->es_cache_ticket, key_type, key_even, key_odd);
+    es->es_cache_ticket = 0;
     es->es_nok = 0;
     ct->cs_capid = es->es_capid;
     ct->ecm_state = ECM_VALID;
@@ -433,9 +438,10 @@ forbid:
     }
 
     tvhdebug(cc->cc_subsys,
-             "%s: Received ECM reply%s for service \"%s\" [%d] "
+             "%s: %s ECM reply%s for service \"%s\" [%d] "
              "(seqno: %d Req delay: %"PRId64" ms)",
-             cc->cc_name, chaninfo, t->s_dvb_svcname, es->es_section, seq, delay);
+             cc->cc_name, es->es_cached ? "Cached" : "Received",
+             chaninfo, t->s_dvb_svcname, es->es_section, seq, delay);
 
     if(es->es_keystate != ES_RESOLVED)
       tvhdebug(cc->cc_subsys,
@@ -452,7 +458,7 @@ forbid:
                        es3.es_caid, es3.es_provid,
                        caid2name(es3.es_caid),
                        es3.es_capid, delay,
-                       1, "", chaninfo, cc->cc_id);
+                       1, es3.es_cached ? "cache" : "", chaninfo, cc->cc_id);
     tvh_mutex_lock(&cc->cc_mutex);
   }
 }
@@ -856,6 +862,8 @@ cc_table_input(void *opaque, int pid, const uint8_t *data, int len, int emm)
   caid_t *c;
   uint16_t caid;
   uint32_t provid;
+  caclient_ecm_keys_t keys;
+  int cached = 0;
 
   if (data == NULL)
     return;
@@ -958,7 +966,8 @@ found:
       es->es_section = section;
       LIST_INSERT_HEAD(&ep->ep_sections, es, es_link);
     }
-    if (es->es_data_len == len && memcmp(es->es_data, data, len) == 0)
+    if (es->es_data_len == len && memcmp(es->es_data, data, len) == 0 &&
+        !es->es_coalesced)
       goto end;
     if (es->es_data_len < len) {
       free(es->es_data);
@@ -989,6 +998,27 @@ found:
       goto end;
     }
 
+    /* a newer ECM, drop our previous request from the cache */
+    caclient_ecm_fail(es->es_cache_ticket);
+    es->es_cache_ticket = 0;
+    es->es_cached = es->es_coalesced = 0;
+    switch (caclient_ecm_lookup(caid, provid, data, len,
+                                &keys, &es->es_cache_ticket)) {
+    case CACLIENT_ECM_HIT:
+      es->es_cached = cached = 1;
+      es->es_time = getfastmonoclock();
+      goto end;
+    case CACLIENT_ECM_PENDING:
+      /* the same ECM is in flight, look again when it repeats */
+      tvhtrace(cc->cc_subsys,
+               "%s: Waiting for the same ECM%s section=%d/%d for service \"%s\"",
+               cc->cc_name, chaninfo, section,
+               ep->ep_last_section, t->s_dvb_svcname);
+      es->es_coalesced = 1;
+      es->es_pending = 0;
+      goto end;
+    }
+
     if (cc->cc_send_ecm(cc, ct, es, pcard, data, len) == 0) {
       tvhdebug(cc->cc_subsys,
                "%s: Sending ECM%s section=%d/%d for service \"%s\" (seqno: %d)",
@@ -997,6 +1027,8 @@ found:
       es->es_time = getfastmonoclock();
     } else {
       es->es_pending = 0;
+      caclient_ecm_fail(es->es_cache_ticket);
+      es->es_cache_ticket = 0;
     }
   } else {
     if (cc->cc_forward_emm && data[0] >= 0x82 && data[0] <= 0x92) {
@@ -1010,6 +1042,8 @@ found:
 
 end:
   tvh_mutex_unlock(&t->s_stream_mutex);
+  if (cached)
+    cc_ecm_reply(ct, es, keys.type, keys.even, keys.odd, es->es_seq);
   tvh_mutex_unlock(&cc->cc_mutex);
 }
 
@@ -55,6 +55,9 @@ typedef struct cc_ecm_section {
   uint8_t  es_nok;
   uint8_t  es_pending;
   uint8_t  es_resolved;
+  uint8_t  es_cached;     // keys taken from the ECM cache
+  uint8_t  es_coalesced;  // waiting for the same request from others
+  uint32_t es_cache_ticket;
   int64_t  es_time;  // time request was sent
 
 } cc_ecm_section_t;
@@ -28,6 +28,7 @@
 #include "input/mpegts/tsdemux.h"
 #include "dvbcam.h"
 #include "streaming.h"
+#include "memoryinfo.h"
 
 #if 0
 #define DEBUG2 1
@@ -45,7 +46,8 @@
 typedef struct th_descrambler_data {
   TAILQ_ENTRY(th_descrambler_data) dd_link;
   int64_t dd_timestamp;
-  sbuf_t dd_sbuf;
+  uint32_t dd_off;                      /* offset in dr_ring */
+  uint32_t dd_len;                      /* zero for the key markers */
   th_descrambler_key_t *dd_key;
   uint8_t dd_key_changed;
 } th_descrambler_data_t;
@@ -60,12 +62,16 @@ typedef struct th_descrambler_hint {
   uint32_t dh_constcw: 1;
   uint32_t dh_quickecm: 1;
   uint32_t dh_multipid: 1;
+  uint32_t dh_standby: 1;
 } th_descrambler_hint_t;
 
 TAILQ_HEAD(th_descrambler_queue, th_descrambler_data);
 static TAILQ_HEAD( , th_descrambler_hint) ca_hints;
 
 static int ca_hints_quickecm;
+static int ca_hints_standby;
+
+static memoryinfo_t descrambler_queue_memoryinfo = { .my_name = "Descrambler queues" };
 
 /*
  *
@@ -86,19 +92,77 @@ static inline const char *keystr(const uint8_t *tsb)
 #endif
 
 /*
- *
+ * The TS packets waiting for the keys are stored in a ring buffer
+ * (dr_ring), the queue entries describe the contiguous runs of packets
+ * with the same key and the key change markers (dd_len is zero). The
+ * data entries are always released in order from the ring head, one
+ * entry never crosses the end of the ring.
  */
+static inline uint32_t
+descrambler_data_ring_size(void)
+{
+  uint32_t dbuflen = MAX(300, config.descrambler_buffer);
+  /* the extra space is for the postponed key changes */
+  return (dbuflen + dbuflen / 10) * 188;
+}
+
+static inline uint32_t
+descrambler_data_ring_tail(th_descrambler_runtime_t *dr)
+{
+  uint32_t tail = dr->dr_ring_head + dr->dr_queue_total;
+  return tail >= dr->dr_ring_size ? tail - dr->dr_ring_size : tail;
+}
+
+static inline uint8_t *
+descrambler_data_ptr(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd)
+{
+  return dd->dd_len ? dr->dr_ring + dd->dd_off : NULL;
+}
+
+static void
+descrambler_data_release(th_descrambler_runtime_t *dr)
+{
+  if (dr->dr_ring) {
+    memoryinfo_free(&descrambler_queue_memoryinfo, dr->dr_ring_size);
+    free(dr->dr_ring);
+    dr->dr_ring = NULL;
+    dr->dr_ring_size = 0;
+  }
+}
+
+static th_descrambler_data_t *
+descrambler_data_alloc(th_descrambler_runtime_t *dr)
+{
+  th_descrambler_data_t *dd;
+
+  if ((dd = TAILQ_FIRST(&dr->dr_queue_free)) != NULL) {
+    TAILQ_REMOVE(&dr->dr_queue_free, dd, dd_link);
+  } else {
+    dd = malloc(sizeof(*dd));
+    memoryinfo_append(&descrambler_queue_memoryinfo, sizeof(*dd));
+  }
+  memset(dd, 0, sizeof(*dd));
+  return dd;
+}
+
 static void
 descrambler_data_destroy(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd, int skip)
 {
   if (dd) {
-    if (skip && dr->dr_skip)
-      ts_skip_packet2((mpegts_service_t *)dr->dr_service,
-                      dd->dd_sbuf.sb_data, dd->dd_sbuf.sb_ptr);
-    dr->dr_queue_total -= dd->dd_sbuf.sb_ptr;
+    if (dd->dd_len) {
+#if ENABLE_TRACE
+      assert(dd->dd_off == dr->dr_ring_head);
+#endif
+      if (skip && dr->dr_skip)
+        ts_skip_packet2((mpegts_service_t *)dr->dr_service,
+                        dr->dr_ring + dd->dd_off, dd->dd_len);
+      dr->dr_ring_head = dd->dd_off + dd->dd_len;
+      if (dr->dr_ring_head >= dr->dr_ring_size)
+        dr->dr_ring_head = 0;
+      dr->dr_queue_total -= dd->dd_len;
+    }
     TAILQ_REMOVE(&dr->dr_queue, dd, dd_link);
-    sbuf_free(&dd->dd_sbuf);
-    free(dd);
+    TAILQ_INSERT_HEAD(&dr->dr_queue_free, dd, dd_link);
 #if ENABLE_TRACE
     if (TAILQ_EMPTY(&dr->dr_queue))
       assert(dr->dr_queue_total == 0);
@@ -106,40 +170,92 @@ descrambler_data_destroy(th_descrambler_runtime_t *dr, th_descrambler_data_t *dd
   }
 }
 
+static void descrambler_data_cut(th_descrambler_runtime_t *dr, int len);
+
+/*
+ * Make room for the new packets, the oldest packets are dropped
+ * when the ring is full
+ */
+static int
+descrambler_data_reserve(th_descrambler_runtime_t *dr, const uint8_t **tsb, int *len)
+{
+  uint32_t size = descrambler_data_ring_size(), l;
+
+  if (dr->dr_queue_total == 0) {
+    dr->dr_ring_head = 0;
+    if (dr->dr_ring_size != size)
+      descrambler_data_release(dr);
+  }
+  if (dr->dr_ring == NULL) {
+    dr->dr_ring = malloc(size);
+    if (dr->dr_ring == NULL)
+      return -1;
+    dr->dr_ring_size = size;
+    memoryinfo_alloc(&descrambler_queue_memoryinfo, size);
+  }
+  size = dr->dr_ring_size;
+  if (*len > size) {
+    l = *len - size;
+    if (dr->dr_skip)
+      ts_skip_packet2((mpegts_service_t *)dr->dr_service, *tsb, l);
+    dr->dr_queue_drops += l / 188;
+    *tsb += l;
+    *len = size;
+  }
+  if (dr->dr_queue_total + *len > size) {
+    l = dr->dr_queue_total + *len - size;
+    dr->dr_queue_drops += l / 188;
+    descrambler_data_cut(dr, l);
+  }
+  dr->dr_ring_used = mclk();
+  return 0;
+}
+
 static void
 descrambler_data_append(th_descrambler_runtime_t *dr, const uint8_t *tsb, int len)
 {
   th_descrambler_data_t *dd;
   const uint8_t *tsb0;
   uint16_t pid1, pid2;
+  uint32_t tail, l;
 
   if (len == 0)
     return;
-  dd = TAILQ_LAST(&dr->dr_queue, th_descrambler_queue);
-  if (dd && (tsb0 = dd->dd_sbuf.sb_data) != NULL) {
-    if (dr->dr_key_multipid) {
-      pid1 = extractpid(tsb0);
-      pid2 = extractpid(tsb);
-    } else {
-      pid1 = pid2 = 0;
-    }
-    if (dd && monocmpfastsec(dd->dd_timestamp, mclk()) &&
-        (tsb0[3] & 0xc0) == (tsb[3] & 0xc0) && /* key match */
-        pid1 == pid2) {
-      debug2("%p: data append %d, timestamp %ld, %s[%d]", dr, len, dd->dd_timestamp, keystr(tsb0), extractpid(tsb0));
-      sbuf_append(&dd->dd_sbuf, tsb, len);
-      dr->dr_queue_total += len;
-      return;
+  if (descrambler_data_reserve(dr, &tsb, &len))
+    return;
+  for ( ; len > 0; tsb += l, len -= l) {
+    tail = descrambler_data_ring_tail(dr);
+    l = MIN(len, dr->dr_ring_size - tail);
+    dd = TAILQ_LAST(&dr->dr_queue, th_descrambler_queue);
+    if (dd && (tsb0 = descrambler_data_ptr(dr, dd)) != NULL &&
+        dd->dd_off + dd->dd_len == tail) {
+      if (dr->dr_key_multipid) {
+        pid1 = extractpid(tsb0);
+        pid2 = extractpid(tsb);
+      } else {
+        pid1 = pid2 = 0;
+      }
+      if (monocmpfastsec(dd->dd_timestamp, mclk()) &&
+          (tsb0[3] & 0xc0) == (tsb[3] & 0xc0) && /* key match */
+          pid1 == pid2) {
+        debug2("%p: data append %d, timestamp %ld, %s[%d]", dr, l, dd->dd_timestamp, keystr(tsb0), extractpid(tsb0));
+        memcpy(dr->dr_ring + tail, tsb, l);
+        dd->dd_len += l;
+        dr->dr_queue_total += l;
+        continue;
+      }
     }
+    dd = descrambler_data_alloc(dr);
+    dd->dd_timestamp = mclk();
+    dd->dd_off = tail;
+    dd->dd_len = l;
+    debug2("%p: data append2 %d, timestamp %ld, %s[%d]", dr, l, dd->dd_timestamp, keystr(tsb), extractpid(tsb));
+    memcpy(dr->dr_ring + tail, tsb, l);
+    TAILQ_INSERT_TAIL(&dr->dr_queue, dd, dd_link);
+    dr->dr_queue_total += l;
   }
-  dd = malloc(sizeof(*dd));
-  dd->dd_key = NULL;
-  dd->dd_timestamp = mclk();
-  debug2("%p: data append2 %d, timestamp %ld, %s[%d]", dr, len, dd->dd_timestamp, keystr(tsb), extractpid(tsb));
-  sbuf_init(&dd->dd_sbuf);
-  sbuf_append(&dd->dd_sbuf, tsb, len);
-  TAILQ_INSERT_TAIL(&dr->dr_queue, dd, dd_link);
-  dr->dr_queue_total += len;
+  if (dr->dr_queue_total > dr->dr_queue_peak)
+    dr->dr_queue_peak = dr->dr_queue_total;
 }
 
 static void
@@ -147,7 +263,7 @@ descrambler_data_add_key(th_descrambler_runtime_t *dr, th_descrambler_key_t *tk,
 {
   th_descrambler_data_t *dd;
 
-  dd = calloc(1, sizeof(*dd));
+  dd = descrambler_data_alloc(dr);
   dd->dd_timestamp = mclk();
   dd->dd_key = tk;
   dd->dd_key_changed = change;
@@ -165,18 +281,20 @@ descrambler_data_cut(th_descrambler_runtime_t *dr, int len)
 
   while (len > 0) {
     TAILQ_FOREACH(dd, &dr->dr_queue, dd_link)
-      if (dd && dd->dd_sbuf.sb_data) break;
+      if (dd->dd_len) break;
     if (dd == NULL) return;
     if (dr->dr_skip)
       ts_skip_packet2((mpegts_service_t *)dr->dr_service,
-                      dd->dd_sbuf.sb_data, MIN(len, dd->dd_sbuf.sb_ptr));
-    if (len < dd->dd_sbuf.sb_ptr) {
-      sbuf_cut(&dd->dd_sbuf, len);
+                      dr->dr_ring + dd->dd_off, MIN(len, dd->dd_len));
+    if (len < dd->dd_len) {
+      dd->dd_off += len;
+      dd->dd_len -= len;
+      dr->dr_ring_head = dd->dd_off;
       dr->dr_queue_total -= len;
       break;
     }
-    len -= dd->dd_sbuf.sb_ptr;
-    descrambler_data_destroy(dr, dd, 1);
+    len -= dd->dd_len;
+    descrambler_data_destroy(dr, dd, 0);
   }
 }
 
@@ -184,18 +302,20 @@ static int
 descrambler_data_key_check(th_descrambler_runtime_t *dr, uint8_t key, int len)
 {
   th_descrambler_data_t *dd;
+  const uint8_t *tsb;
   int off = 0, l;
   uint_fast8_t ki;
 
   if ((dd = TAILQ_FIRST(&dr->dr_queue)) == NULL)
     return len;
   while (len > 0) {
-    while (dd && dd->dd_sbuf.sb_data == NULL)
+    while (dd && dd->dd_len == 0)
       dd = TAILQ_NEXT(dd, dd_link);
     if (dd == NULL) break;
-    l = dd->dd_sbuf.sb_ptr;
-    for (off = 0; off < l && len > 0; off += 188, l -= 188) {
-      ki = dd->dd_sbuf.sb_data[off + 3];
+    tsb = dr->dr_ring + dd->dd_off;
+    l = dd->dd_len;
+    for (off = 0; off < l && len > 0; off += 188) {
+      ki = tsb[off + 3];
       if (ki == 0) continue;
       if ((ki & 0xc0) != key) return -1;
       len -= 188;
@@ -214,10 +334,10 @@ descrambler_data_analyze(th_descrambler_runtime_t *dr,
   int packets = 0, blocks = 0;
 
   for (dd2 = TAILQ_NEXT(dd, dd_link); dd2; dd2 = TAILQ_NEXT(dd2, dd_link)) {
-    tsb0 = dd->dd_sbuf.sb_data;
-    if (tsb0 == NULL || dd->dd_sbuf.sb_ptr == 0) continue;
+    tsb0 = descrambler_data_ptr(dr, dd);
+    if (tsb0 == NULL) continue;
     if ((tsb0[3] & 0x80) != 0 && (tsb0[3] & 0x40) == (ki & 0x40)) {
-      packets += dd2->dd_sbuf.sb_ptr;
+      packets += dd2->dd_len;
       if (packets >= dr->dr_paritycheck)
         return 1;
     } else {
@@ -306,14 +426,16 @@ descrambler_load_hints(htsmsg_t *m)
     hint.dh_constcw = htsmsg_get_bool_or_default(e, "constcw", 0);
     hint.dh_quickecm = htsmsg_get_bool_or_default(e, "quickecm", 0);
     hint.dh_multipid = htsmsg_get_bool_or_default(e, "multipid", 0);
+    hint.dh_standby = htsmsg_get_bool_or_default(e, "standby", 0);
     hint.dh_interval = htsmsg_get_s32_or_default(e, "interval", 10000);
     hint.dh_paritycheck = htsmsg_get_s32_or_default(e, "paritycheck", 20);
     hint.dh_ecmparity = str2val_def(htsmsg_get_str(e, "ecmparity"), ecmparitytab, ECM_PARITY_DEFAULT);
-    tvhinfo(LS_DESCRAMBLER, "adding CAID %04X/%04X as%s%s%s interval %ums pc %d ep %s (%s)",
+    tvhinfo(LS_DESCRAMBLER, "adding CAID %04X/%04X as%s%s%s%s interval %ums pc %d ep %s (%s)",
                             hint.dh_caid, hint.dh_mask,
                             hint.dh_constcw ? " ConstCW" : "",
                             hint.dh_quickecm ? " QuickECM" : "",
                             hint.dh_multipid ? " MultiPID" : "",
+                            hint.dh_standby ? " Standby" : "",
                             hint.dh_interval,
                             hint.dh_paritycheck,
                             val2str(hint.dh_ecmparity, ecmparitytab),
@@ -322,6 +444,7 @@ descrambler_load_hints(htsmsg_t *m)
     *dhint = hint;
     TAILQ_INSERT_TAIL(&ca_hints, dhint, dh_link);
     if (hint.dh_quickecm) ca_hints_quickecm++;
+    if (hint.dh_standby) ca_hints_standby++;
   }
 }
 
@@ -335,8 +458,10 @@ descrambler_init ( void )
 
   TAILQ_INIT(&ca_hints);
   ca_hints_quickecm = 0;
+  ca_hints_standby = 0;
 
   caclient_init();
+  memoryinfo_register(&descrambler_queue_memoryinfo);
 
   if ((c = hts_settings_load("descrambler")) != NULL) {
     m = htsmsg_get_list(c, "caid");
@@ -344,6 +469,8 @@ descrambler_init ( void )
       descrambler_load_hints(m);
     htsmsg_destroy(c);
   }
+
+  descrambler_standby_init();
 }
 
 void
@@ -351,7 +478,12 @@ descrambler_done ( void )
 {
   th_descrambler_hint_t *hint;
 
+  descrambler_standby_done();
   caclient_done();
+  tvhcsa_pool_done();
+  tvh_mutex_lock(&global_lock);
+  memoryinfo_unregister(&descrambler_queue_memoryinfo);
+  tvh_mutex_unlock(&global_lock);
   while ((hint = TAILQ_FIRST(&ca_hints)) != NULL) {
     TAILQ_REMOVE(&ca_hints, hint, dh_link);
     free(hint);
@@ -384,6 +516,27 @@ descrambler_quick_ecm ( mpegts_service_t *t, int pid )
   return 0;
 }
 
+/*
+ * Decide, if the service can be descrambled in advance (standby),
+ * when no CAID is marked as standby in the hints, all services can
+ */
+int
+descrambler_standby_allowed ( service_t *t )
+{
+  elementary_stream_t *st;
+  th_descrambler_hint_t *hint;
+  caid_t *ca;
+
+  if (!ca_hints_standby)
+    return 1;
+  TAILQ_FOREACH(st, &t->s_components.set_all, es_link)
+    LIST_FOREACH(ca, &st->es_caids, link)
+      TAILQ_FOREACH(hint, &ca_hints, dh_link)
+        if (hint->dh_standby && hint->dh_caid == (ca->caid & hint->dh_mask))
+          return 1;
+  return 0;
+}
+
 /*
  * This routine is called from two places
  * a) start a new service
@@ -444,6 +597,7 @@ descrambler_service_start ( service_t *t )
     t->s_descramble = dr = calloc(1, sizeof(th_descrambler_runtime_t));
     dr->dr_service = t;
     TAILQ_INIT(&dr->dr_queue);
+    TAILQ_INIT(&dr->dr_queue_free);
     for (i = 0; i < DESCRAMBLER_MAX_KEYS; i++) {
       tk = &dr->dr_keys[i];
       tk->key_index = 0xff;
@@ -493,17 +647,67 @@ descrambler_service_stop ( service_t *t )
   tvh_mutex_unlock(&t->s_stream_mutex);
   free(p);
   if (dr) {
+    mtimer_disarm(&dr->dr_csa_timer);
     for (i = 0; i < DESCRAMBLER_MAX_KEYS; i++) {
       tk = &dr->dr_keys[i];
+      if (tk->key_csa.csa_wait_count)
+        tvhdebug(LS_DESCRAMBLER, "%s: cluster wait avg %"PRId64"ms max %"PRId64"ms (%u clusters)",
+                 t->s_nicename,
+                 mono2ms(tk->key_csa.csa_wait_sum / tk->key_csa.csa_wait_count),
+                 mono2ms(tk->key_csa.csa_wait_max), tk->key_csa.csa_wait_count);
       tvhcsa_destroy(&tk->key_csa);
       if (!dr->dr_key_multipid) break;
     }
+    if (dr->dr_queue_drops)
+      tvhdebug(LS_DESCRAMBLER, "%s: %"PRIu64" packets dropped from the queue (peak %u)",
+               t->s_nicename, dr->dr_queue_drops, dr->dr_queue_peak / 188);
     while ((dd = TAILQ_FIRST(&dr->dr_queue)) != NULL)
       descrambler_data_destroy(dr, dd, 0);
+    while ((dd = TAILQ_FIRST(&dr->dr_queue_free)) != NULL) {
+      TAILQ_REMOVE(&dr->dr_queue_free, dd, dd_link);
+      memoryinfo_remove(&descrambler_queue_memoryinfo, sizeof(*dd));
+      free(dd);
+    }
+    descrambler_data_release(dr);
     free(dr);
   }
 }
 
+/*
+ * CSA cluster wait statistics, called with s_stream_mutex held
+ */
+htsmsg_t *
+descrambler_csa_stats ( service_t *t )
+{
+  th_descrambler_runtime_t *dr = t->s_descramble;
+  tvhcsa_t *csa;
+  uint64_t sum = 0;
+  uint32_t count = 0, max = 0;
+  htsmsg_t *m;
+  int i;
+
+  if (dr == NULL)
+    return NULL;
+  for (i = 0; i < DESCRAMBLER_MAX_KEYS; i++) {
+    csa = &dr->dr_keys[i].key_csa;
+    sum += csa->csa_wait_sum;
+    count += csa->csa_wait_count;
+    max = MAX(max, csa->csa_wait_max);
+    if (!dr->dr_key_multipid) break;
+  }
+  if (count == 0 && dr->dr_queue_peak == 0)
+    return NULL;
+  m = htsmsg_create_map();
+  if (count) {
+    htsmsg_add_u32(m, "clusters", count);
+    htsmsg_add_u32(m, "wait_avg_ms", mono2ms(sum / count));
+    htsmsg_add_u32(m, "wait_max_ms", mono2ms(max));
+  }
+  htsmsg_add_u32(m, "queue_peak", dr->dr_queue_peak / 188);
+  htsmsg_add_s64(m, "queue_drops", dr->dr_queue_drops);
+  return m;
+}
+
 void
 descrambler_caid_changed ( service_t *t )
 {
@@ -1031,11 +1235,11 @@ descrambler_pass ( service_t *t,
   return 1;
 }
 
-int
-descrambler_descramble ( service_t *t,
-                         elementary_stream_t *st,
-                         const uint8_t *tsb,
-                         int len )
+static int
+descrambler_descramble_ ( service_t *t,
+                          elementary_stream_t *st,
+                          const uint8_t *tsb,
+                          int len )
 {
   th_descrambler_runtime_t *dr = t->s_descramble;
   th_descrambler_key_t *tk;
@@ -1045,7 +1249,7 @@ descrambler_descramble ( service_t *t,
   const uint8_t *tsb2;
   int64_t now;
   uint_fast8_t ki;
-  sbuf_t *sb;
+  const uint8_t *tsb0;
 
   lock_assert(&t->s_stream_mutex);
 
@@ -1060,6 +1264,10 @@ descrambler_descramble ( service_t *t,
   if (dr->dr_descramble)
     return dr->dr_descramble(t, st, tsb, len);
 
+  if (dr->dr_ring && dr->dr_queue_total == 0 &&
+      dr->dr_ring_used + sec2mono(60) < mclk())
+    descrambler_data_release(dr);
+
   if (!dr->dr_key_multipid) {
     tk = &dr->dr_keys[0];
   } else {
@@ -1086,9 +1294,8 @@ descrambler_descramble ( service_t *t,
     /* process the queued TS packets or key updates */
     for (dd = TAILQ_FIRST(&dr->dr_queue); dd; dd = dd_next) {
       dd_next = TAILQ_NEXT(dd, dd_link);
-      sb = &dd->dd_sbuf;
-      tsb2 = sb->sb_data;
-      len2 = sb->sb_ptr;
+      tsb0 = tsb2 = descrambler_data_ptr(dr, dd);
+      len2 = dd->dd_len;
       if (dd->dd_key) {
         key_flush(dr, dd->dd_key, dd->dd_key_changed, t);
         dd->dd_key = NULL;
@@ -1144,7 +1351,7 @@ descrambler_descramble ( service_t *t,
             r = descrambler_data_analyze(dr, dd, ki);
             if (r == 0) {
               /* wait for more data to decide */
-              descrambler_data_cut(dr, tsb2 - sb->sb_data);
+              descrambler_data_cut(dr, tsb2 - tsb0);
               descrambler_data_append(dr, tsb, len);
               goto end;
             } else if (r == 2)
@@ -1158,7 +1365,7 @@ descrambler_descramble ( service_t *t,
               r = ecm_reset(t, dr);
               tvh_mutex_lock(&t->s_stream_mutex);
               if (r) {
-                descrambler_data_cut(dr, tsb2 - sb->sb_data);
+                descrambler_data_cut(dr, tsb2 - tsb0);
                 flush_data = 1;
                 goto queue;
               }
@@ -1287,6 +1494,65 @@ end:
   return dr->dr_ca_count;
 }
 
+/*
+ * CSA flush deadline timer, a partial cluster is not kept forever
+ * when the input stops
+ */
+static void descrambler_csa_timer_arm ( th_descrambler_runtime_t *dr );
+
+static void
+descrambler_csa_timer_cb ( void *aux )
+{
+  th_descrambler_runtime_t *dr = aux;
+  service_t *t = dr->dr_service;
+  int64_t now;
+  int i;
+
+  tvh_mutex_lock(&t->s_stream_mutex);
+  dr->dr_csa_deadline = 0;
+  now = getfastmonoclock();
+  for (i = 0; i < DESCRAMBLER_MAX_KEYS; i++) {
+    tvhcsa_deadline(&dr->dr_keys[i].key_csa, (mpegts_service_t *)t, now);
+    if (!dr->dr_key_multipid) break;
+  }
+  descrambler_csa_timer_arm(dr);
+  tvh_mutex_unlock(&t->s_stream_mutex);
+}
+
+static void
+descrambler_csa_timer_arm ( th_descrambler_runtime_t *dr )
+{
+  int64_t deadline = 0, d;
+  int i;
+
+  for (i = 0; i < DESCRAMBLER_MAX_KEYS; i++) {
+    d = dr->dr_keys[i].key_csa.csa_deadline;
+    if (d && (deadline == 0 || d < deadline))
+      deadline = d;
+    if (!dr->dr_key_multipid) break;
+  }
+  if (deadline == 0 ||
+      (dr->dr_csa_deadline && dr->dr_csa_deadline <= deadline))
+    return;
+  dr->dr_csa_deadline = deadline;
+  mtimer_arm_rel(&dr->dr_csa_timer, descrambler_csa_timer_cb, dr,
+                 deadline - getfastmonoclock());
+}
+
+int
+descrambler_descramble ( service_t *t,
+                         elementary_stream_t *st,
+                         const uint8_t *tsb,
+                         int len )
+{
+  th_descrambler_runtime_t *dr;
+  int r = descrambler_descramble_(t, st, tsb, len);
+
+  if ((dr = t->s_descramble) != NULL && dr->dr_descramble == NULL)
+    descrambler_csa_timer_arm(dr);
+  return r;
+}
+
 static int
 descrambler_table_callback
   (mpegts_table_t *mt, const uint8_t *ptr, int len, int tableid)
@@ -109,9 +109,18 @@ typedef struct th_descrambler_runtime {
   th_descrambler_key_t dr_keys[DESCRAMBLER_MAX_KEYS];
   th_descrambler_key_t *dr_key_last;
   TAILQ_HEAD(, th_descrambler_data) dr_queue;
+  TAILQ_HEAD(, th_descrambler_data) dr_queue_free;
+  uint8_t *dr_ring;
+  uint32_t dr_ring_size;
+  uint32_t dr_ring_head;
+  int64_t  dr_ring_used;
   uint32_t dr_queue_total;
+  uint32_t dr_queue_peak;
+  uint64_t dr_queue_drops;
   uint32_t dr_paritycheck;
   uint32_t dr_initial_paritycheck;
+  mtimer_t dr_csa_timer;
+  int64_t  dr_csa_deadline;
   tvhlog_limit_t dr_loglimit_key;
 } th_descrambler_runtime_t;
 
@@ -185,12 +194,16 @@ LIST_HEAD(caid_list, caid);
 
 void descrambler_init          ( void );
 void descrambler_done          ( void );
+void descrambler_standby_init  ( void );
+void descrambler_standby_done  ( void );
+int  descrambler_standby_allowed ( struct service *t );
 void descrambler_change_keystate ( th_descrambler_t *t, th_descrambler_keystate_t state, int lock );
 const char *descrambler_keystate2str( th_descrambler_keystate_t keystate );
 const char *descrambler_keytype2str( th_descrambler_keystate_t keytype );
 void descrambler_service_start ( struct service *t );
 void descrambler_service_stop  ( struct service *t );
 void descrambler_caid_changed  ( struct service *t );
+htsmsg_t *descrambler_csa_stats ( struct service *t );
 int  descrambler_resolved      ( struct service *t, th_descrambler_t *ignore );
 int  descrambler_multi_pid     ( th_descrambler_t *t );
 void descrambler_keys          ( th_descrambler_t *t, int type, uint16_t pid,
@@ -623,7 +623,7 @@ update_pid:
     mm = ((mpegts_service_t *)t)->s_dvb_mux;
     mi = mm->mm_active ? mm->mm_active->mmi_input : NULL;
     if (mi) {
-      tvh_mutex_lock(&mi->mi_output_lock);
+      tvh_mutex_lock(&mm->mm_output_lock);
       tvh_mutex_lock(&t->s_stream_mutex);
       mpegts_input_open_pid(mi, mm, DVB_CAT_PID, MPS_SERVICE | MPS_NOPOSTDEMUX,
                             MPS_WEIGHT_CAT, t, 0);
@@ -634,7 +634,7 @@ update_pid:
       for (i = 0; i < ecm_to_close.count; i++)
         mpegts_input_close_pid(mi, mm, ecm_to_close.pids[i].pid, MPS_SERVICE, t);
       tvh_mutex_unlock(&t->s_stream_mutex);
-      tvh_mutex_unlock(&mi->mi_output_lock);
+      tvh_mutex_unlock(&mm->mm_output_lock);
       mpegts_mux_update_pids(mm);
     }
   }
@@ -738,7 +738,7 @@ dvbcam_cat_update(caclient_t *cac, mpegts_mux_t *mux, const uint8_t *data, int l
   if (services_count > 0) {
     mi = mux->mm_active ? mux->mm_active->mmi_input : NULL;
     if (mi) {
-      tvh_mutex_lock(&mi->mi_output_lock);
+      tvh_mutex_lock(&mux->mm_output_lock);
       for (i = 0; i < services_count; i++) {
         sp = &services[i];
         tvh_mutex_lock(&sp->service->s_stream_mutex);
@@ -752,7 +752,7 @@ dvbcam_cat_update(caclient_t *cac, mpegts_mux_t *mux, const uint8_t *data, int l
         mpegts_pid_done(&sp->to_open);
         mpegts_pid_done(&sp->to_close);
       }
-      tvh_mutex_unlock(&mi->mi_output_lock);
+      tvh_mutex_unlock(&mux->mm_output_lock);
       mpegts_mux_update_pids(mux);
     }
   }
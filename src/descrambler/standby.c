@@ -0,0 +1,287 @@
+/*
+ *  Tvheadend - descrambler standby (predictive pre-descrambling)
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The scrambled services which are likely to be subscribed soon (the
+ * channel neighbours of the watched channels and the upcoming DVR
+ * entries) get a low weight subscription without output. The service
+ * runs, so the ECM filters stay open and the control words are kept
+ * fresh (also in the caclient ECM cache). A real subscription joins the
+ * running service and does not wait for the ECM round-trip.
+ *
+ * Only the muxes which are tuned for the real subscriptions are used,
+ * the standby subscriptions never tune an input.
+ */
+
+#include "tvheadend.h"
+#include "config.h"
+#include "subscriptions.h"
+#include "channels.h"
+#include "descrambler.h"
+#include "input.h"
+#include "dvr/dvr.h"
+
+#define STANDBY_INTERVAL  sec2mono(5)
+#define STANDBY_DVR_AHEAD (5*60)     /* seconds */
+#define STANDBY_MAX       32
+
+typedef struct descrambler_standby {
+  LIST_ENTRY(descrambler_standby) ds_link;
+  service_t          *ds_service;
+  th_subscription_t  *ds_sub;
+  int                 ds_keep;
+} descrambler_standby_t;
+
+typedef struct descrambler_standby_cand {
+  mpegts_service_t *dc_service;
+  mpegts_input_t   *dc_input;
+  int64_t           dc_score;         /* lower is better */
+} descrambler_standby_cand_t;
+
+static LIST_HEAD(, descrambler_standby) descrambler_standby_list;
+static mtimer_t descrambler_standby_timer;
+
+/*
+ *
+ */
+static descrambler_standby_t *
+descrambler_standby_find_sub(th_subscription_t *s)
+{
+  descrambler_standby_t *ds;
+
+  LIST_FOREACH(ds, &descrambler_standby_list, ds_link)
+    if (ds->ds_sub == s)
+      return ds;
+  return NULL;
+}
+
+static descrambler_standby_t *
+descrambler_standby_find_service(service_t *t)
+{
+  descrambler_standby_t *ds;
+
+  LIST_FOREACH(ds, &descrambler_standby_list, ds_link)
+    if (ds->ds_service == t)
+      return ds;
+  return NULL;
+}
+
+static void
+descrambler_standby_stop(descrambler_standby_t *ds)
+{
+  tvhdebug(LS_DESCRAMBLER, "standby stop for \"%s\"", ds->ds_service->s_nicename);
+  LIST_REMOVE(ds, ds_link);
+  if (ds->ds_sub)
+    subscription_unsubscribe(ds->ds_sub, UNSUBSCRIBE_FINAL);
+  service_unref(ds->ds_service);
+  free(ds);
+}
+
+static void
+descrambler_standby_start(descrambler_standby_cand_t *dc)
+{
+  descrambler_standby_t *ds;
+  profile_chain_t prch;
+  service_t *t = (service_t *)dc->dc_service;
+
+  memset(&prch, 0, sizeof(prch));
+  prch.prch_id = t;
+  ds = calloc(1, sizeof(*ds));
+  ds->ds_sub = subscription_create_from_service(&prch, (tvh_input_t *)dc->dc_input,
+                                                SUBSCRIPTION_PRIO_KEEP,
+                                                "descrambler standby",
+                                                SUBSCRIPTION_NONE,
+                                                NULL, NULL, "standby", NULL);
+  if (ds->ds_sub == NULL) {
+    free(ds);
+    return;
+  }
+  tvhdebug(LS_DESCRAMBLER, "standby start for \"%s\" (score %"PRId64")",
+           t->s_nicename, dc->dc_score);
+  service_ref(t);
+  ds->ds_service = t;
+  ds->ds_keep = 1;
+  LIST_INSERT_HEAD(&descrambler_standby_list, ds, ds_link);
+}
+
+/*
+ * Add a candidate, the list is sorted by score
+ */
+static int
+descrambler_standby_add
+  (descrambler_standby_cand_t *cand, int count, int max,
+   mpegts_service_t *s, mpegts_input_t *mi, int64_t score)
+{
+  int i, j;
+
+  if (s->s_status == SERVICE_RUNNING &&
+      descrambler_standby_find_service((service_t *)s) == NULL)
+    return count; /* already used */
+  if (!s->s_is_enabled((service_t *)s, 0) ||
+      !service_is_encrypted((service_t *)s) ||
+      !descrambler_standby_allowed((service_t *)s))
+    return count;
+  for (i = 0; i < count; i++)
+    if (cand[i].dc_service == s) {
+      if (score >= cand[i].dc_score)
+        return count;
+      memmove(&cand[i], &cand[i + 1], (count - i - 1) * sizeof(*cand));
+      count--;
+      break;
+    }
+  for (i = 0; i < count; i++)
+    if (score < cand[i].dc_score)
+      break;
+  if (i >= max)
+    return count;
+  j = MIN(count, max - 1);
+  memmove(&cand[i + 1], &cand[i], (j - i) * sizeof(*cand));
+  cand[i].dc_service = s;
+  cand[i].dc_input = mi;
+  cand[i].dc_score = score;
+  return MIN(count + 1, max);
+}
+
+/*
+ * Active mux of a real subscription
+ */
+static mpegts_input_t *
+descrambler_standby_input(mpegts_mux_t *mm, mpegts_mux_t **muxes, int nmuxes)
+{
+  int i;
+
+  for (i = 0; i < nmuxes; i++)
+    if (muxes[i] == mm)
+      return mm->mm_active ? mm->mm_active->mmi_input : NULL;
+  return NULL;
+}
+
+static void
+descrambler_standby_timer_cb(void *aux)
+{
+  descrambler_standby_cand_t cand[STANDBY_MAX];
+  mpegts_mux_t *muxes[STANDBY_MAX];
+  descrambler_standby_t *ds, *ds_next;
+  th_subscription_t *s;
+  mpegts_service_t *ms, *ms2;
+  mpegts_input_t *mi;
+  idnode_list_mapping_t *ilm, *ilm2;
+  channel_t *ch;
+  dvr_entry_t *de;
+  int64_t num, num2;
+  time_t start, now = gclk();
+  int i, count = 0, nmuxes = 0;
+  int max = MIN(config.descrambler_standby, STANDBY_MAX);
+
+  if (max <= 0)
+    goto update;
+
+  /* the muxes tuned for the real subscriptions */
+  LIST_FOREACH(s, &subscriptions, ths_global_link) {
+    if (descrambler_standby_find_sub(s))
+      continue;
+    if (s->ths_service == NULL || s->ths_service->s_type != STYPE_STD)
+      continue;
+    ms = (mpegts_service_t *)s->ths_service;
+    if (ms->s_dvb_mux == NULL || ms->s_dvb_mux->mm_active == NULL)
+      continue;
+    for (i = 0; i < nmuxes; i++)
+      if (muxes[i] == ms->s_dvb_mux)
+        break;
+    if (i >= nmuxes && nmuxes < STANDBY_MAX)
+      muxes[nmuxes++] = ms->s_dvb_mux;
+
+    /* the channel neighbours on the same mux */
+    LIST_FOREACH(ilm, &ms->s_channels, ilm_in1_link) {
+      num = channel_get_number((channel_t *)ilm->ilm_in2);
+      LIST_FOREACH(ms2, &ms->s_dvb_mux->mm_services, s_dvb_mux_link) {
+        if (ms2 == ms) continue;
+        LIST_FOREACH(ilm2, &ms2->s_channels, ilm_in1_link) {
+          ch = (channel_t *)ilm2->ilm_in2;
+          if (!ch->ch_enabled) continue;
+          num2 = channel_get_number(ch);
+          count = descrambler_standby_add(cand, count, max, ms2,
+                                          ms->s_dvb_mux->mm_active->mmi_input,
+                                          num2 > num ? num2 - num : num - num2);
+        }
+      }
+    }
+  }
+
+  /* the upcoming recordings, these are preferred */
+  LIST_FOREACH(de, &dvrentries, de_global_link) {
+    if (!dvr_entry_is_upcoming(de) || (ch = de->de_channel) == NULL)
+      continue;
+    start = dvr_entry_get_start_time(de, 1);
+    if (start < now || start > now + STANDBY_DVR_AHEAD)
+      continue;
+    LIST_FOREACH(ilm, &ch->ch_services, ilm_in2_link) {
+      ms = (mpegts_service_t *)ilm->ilm_in1;
+      if (ms->s_type != STYPE_STD || ms->s_dvb_mux == NULL)
+        continue;
+      mi = descrambler_standby_input(ms->s_dvb_mux, muxes, nmuxes);
+      if (mi)
+        count = descrambler_standby_add(cand, count, max, ms, mi,
+                                        -1 - (STANDBY_DVR_AHEAD - (start - now)));
+    }
+  }
+
+update:
+  /* update the standby subscriptions */
+  LIST_FOREACH(ds, &descrambler_standby_list, ds_link)
+    ds->ds_keep = 0;
+  for (i = 0; i < count; i++) {
+    ds = descrambler_standby_find_service((service_t *)cand[i].dc_service);
+    if (ds)
+      ds->ds_keep = 1;
+    else
+      descrambler_standby_start(&cand[i]);
+  }
+  for (ds = LIST_FIRST(&descrambler_standby_list); ds; ds = ds_next) {
+    ds_next = LIST_NEXT(ds, ds_link);
+    if (!ds->ds_keep || ds->ds_service->s_status == SERVICE_ZOMBIE)
+      descrambler_standby_stop(ds);
+  }
+
+  mtimer_arm_rel(&descrambler_standby_timer, descrambler_standby_timer_cb,
+                 NULL, STANDBY_INTERVAL);
+}
+
+/*
+ *
+ */
+void
+descrambler_standby_init(void)
+{
+  LIST_INIT(&descrambler_standby_list);
+  mtimer_arm_rel(&descrambler_standby_timer, descrambler_standby_timer_cb,
+                 NULL, STANDBY_INTERVAL);
+}
+
+void
+descrambler_standby_done(void)
+{
+  descrambler_standby_t *ds;
+
+  tvh_mutex_lock(&global_lock);
+  mtimer_disarm(&descrambler_standby_timer);
+  while ((ds = LIST_FIRST(&descrambler_standby_list)) != NULL)
+    descrambler_standby_stop(ds);
+  tvh_mutex_unlock(&global_lock);
+}
@@ -23,6 +23,7 @@
 
 #include "tvhcsa.h"
 #include "input.h"
+#include "config.h"
 #include "input/mpegts/tsdemux.h"
 
 #include "descrambler/algo/libaesdec.h"
@@ -52,10 +53,7 @@ static void
 tvhcsa_aes128_ecb_descramble
   ( tvhcsa_t *csa, struct mpegts_service *s, const uint8_t *tsb, int len )
 {
-  const uint8_t *tsb2, *end2;
-
-  for (tsb2 = tsb, end2 = tsb + len; tsb2 < end2; tsb2 += 188)
-    aes128_decrypt_packet(csa->csa_priv, tsb2);
+  aes128_decrypt_packets(csa->csa_priv, tsb, len);
   ts_recv_packet2(s, tsb, len);
 }
 
@@ -70,6 +68,299 @@ tvhcsa_des_ncb_descramble
   ts_recv_packet2(s, tsb, len);
 }
 
+#if ENABLE_DVBCSA
+
+/*
+ * Descrambler worker pool
+ *
+ * In the pipelined mode, the full CSA clusters are handed to a shared
+ * pool of workers. The jobs of one tvhcsa_t are delivered in the submit
+ * order by the thread holding s_stream_mutex (the next descramble call
+ * or a flush), so the workers never touch the service. The key changes
+ * are preceded by csa_flush(), which waits for all jobs, so a job always
+ * uses the keys which were set when it was submitted.
+ */
+
+#define TVHCSA_JOBS_MAX 8       /* undelivered jobs per tvhcsa_t */
+
+enum {
+  CJ_QUEUED,
+  CJ_RUNNING,
+  CJ_DONE
+};
+
+struct tvhcsa_job {
+  TAILQ_ENTRY(tvhcsa_job) cj_link;      /* csa_jobs or csa_jobs_free */
+  TAILQ_ENTRY(tvhcsa_job) cj_run_link;
+  tvhcsa_t *cj_csa;
+  int       cj_state;
+  uint8_t  *cj_tsbcluster;
+  int       cj_fill;
+  struct dvbcsa_bs_batch_s *cj_tsbbatch_even;
+  struct dvbcsa_bs_batch_s *cj_tsbbatch_odd;
+  int       cj_fill_even;
+  int       cj_fill_odd;
+};
+
+static tvh_mutex_t tvhcsa_pool_lock = TVH_THREAD_MUTEX_INITIALIZER;
+static tvh_cond_t  tvhcsa_pool_cond;
+static tvh_cond_t  tvhcsa_pool_done_cond;
+static TAILQ_HEAD(, tvhcsa_job) tvhcsa_pool_runq;
+static pthread_t  *tvhcsa_pool_tids;
+static int         tvhcsa_pool_count;
+static int         tvhcsa_pool_running;
+
+static void
+tvhcsa_csa_cbc_decrypt
+  ( tvhcsa_t *csa,
+    struct dvbcsa_bs_batch_s *even, int fill_even,
+    struct dvbcsa_bs_batch_s *odd, int fill_odd )
+{
+  if (fill_even) {
+    even[fill_even].data = NULL;
+    dvbcsa_bs_decrypt(csa->csa_key_even, even, 184);
+  }
+  if (fill_odd) {
+    odd[fill_odd].data = NULL;
+    dvbcsa_bs_decrypt(csa->csa_key_odd, odd, 184);
+  }
+}
+
+static void *
+tvhcsa_pool_thread ( void *aux )
+{
+  tvhcsa_job_t *j;
+
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  while (tvhcsa_pool_running) {
+    j = TAILQ_FIRST(&tvhcsa_pool_runq);
+    if (j == NULL) {
+      tvh_cond_wait(&tvhcsa_pool_cond, &tvhcsa_pool_lock);
+      continue;
+    }
+    TAILQ_REMOVE(&tvhcsa_pool_runq, j, cj_run_link);
+    j->cj_state = CJ_RUNNING;
+    tvh_mutex_unlock(&tvhcsa_pool_lock);
+    tvhcsa_csa_cbc_decrypt(j->cj_csa, j->cj_tsbbatch_even, j->cj_fill_even,
+                           j->cj_tsbbatch_odd, j->cj_fill_odd);
+    tvh_mutex_lock(&tvhcsa_pool_lock);
+    j->cj_state = CJ_DONE;
+    tvh_cond_signal(&tvhcsa_pool_done_cond, 1);
+  }
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+  return NULL;
+}
+
+static int
+tvhcsa_pool_start ( void )
+{
+  int i;
+
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  if (tvhcsa_pool_tids == NULL && config.descrambler_tpool_count > 0) {
+    tvhcsa_pool_count = MINMAX(config.descrambler_tpool_count, 1, 64);
+    TAILQ_INIT(&tvhcsa_pool_runq);
+    tvh_cond_init(&tvhcsa_pool_cond, 1);
+    tvh_cond_init(&tvhcsa_pool_done_cond, 1);
+    tvhcsa_pool_running = 1;
+    tvhcsa_pool_tids = calloc(tvhcsa_pool_count, sizeof(pthread_t));
+    for (i = 0; i < tvhcsa_pool_count; i++)
+      tvh_thread_create(&tvhcsa_pool_tids[i], NULL, tvhcsa_pool_thread,
+                        NULL, "tvhcsa");
+    tvhinfo(LS_CSA, "Using %d descrambler thread(s)", tvhcsa_pool_count);
+  }
+  i = tvhcsa_pool_tids != NULL && tvhcsa_pool_running;
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+  return i;
+}
+
+/*
+ * A cluster leaves the batch, account the time its oldest packet waited
+ */
+static inline void
+tvhcsa_csa_cbc_account ( tvhcsa_t *csa )
+{
+  int64_t wait = getfastmonoclock() - csa->csa_fill_start;
+
+  if (wait < 0)
+    wait = 0;
+  csa->csa_wait_sum += wait;
+  csa->csa_wait_count++;
+  if (wait > csa->csa_wait_max)
+    csa->csa_wait_max = wait;
+}
+
+static tvhcsa_job_t *
+tvhcsa_job_alloc ( tvhcsa_t *csa )
+{
+  tvhcsa_job_t *j = calloc(1, sizeof(*j));
+
+  j->cj_csa           = csa;
+  j->cj_tsbcluster    = malloc(csa->csa_fill_size * 188);
+  j->cj_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
+                               sizeof(struct dvbcsa_bs_batch_s));
+  j->cj_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
+                               sizeof(struct dvbcsa_bs_batch_s));
+  return j;
+}
+
+static void
+tvhcsa_job_free ( tvhcsa_job_t *j )
+{
+  free(j->cj_tsbcluster);
+  free(j->cj_tsbbatch_even);
+  free(j->cj_tsbbatch_odd);
+  free(j);
+}
+
+/*
+ * Deliver the finished jobs in order, wait for the first 'wait' jobs
+ */
+static void
+tvhcsa_pool_deliver ( tvhcsa_t *csa, struct mpegts_service *s, int wait )
+{
+  tvhcsa_job_t *j;
+  int state;
+
+  while ((j = TAILQ_FIRST(&csa->csa_jobs)) != NULL) {
+    tvh_mutex_lock(&tvhcsa_pool_lock);
+    if (wait > 0) {
+      while (j->cj_state != CJ_DONE)
+        tvh_cond_wait(&tvhcsa_pool_done_cond, &tvhcsa_pool_lock);
+      wait--;
+    }
+    state = j->cj_state;
+    tvh_mutex_unlock(&tvhcsa_pool_lock);
+    if (state != CJ_DONE)
+      break;
+    TAILQ_REMOVE(&csa->csa_jobs, j, cj_link);
+    csa->csa_jobs_count--;
+    ts_recv_packet2(s, j->cj_tsbcluster, j->cj_fill * 188);
+    TAILQ_INSERT_HEAD(&csa->csa_jobs_free, j, cj_link);
+  }
+}
+
+/*
+ * Wait for the running jobs, drop the queued ones
+ */
+static void
+tvhcsa_pool_cancel ( tvhcsa_t *csa )
+{
+  tvhcsa_job_t *j;
+
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  TAILQ_FOREACH(j, &csa->csa_jobs, cj_link) {
+    if (j->cj_state == CJ_QUEUED) {
+      TAILQ_REMOVE(&tvhcsa_pool_runq, j, cj_run_link);
+      j->cj_state = CJ_DONE;
+    }
+    while (j->cj_state != CJ_DONE)
+      tvh_cond_wait(&tvhcsa_pool_done_cond, &tvhcsa_pool_lock);
+  }
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+  while ((j = TAILQ_FIRST(&csa->csa_jobs)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_jobs, j, cj_link);
+    tvhcsa_job_free(j);
+  }
+  while ((j = TAILQ_FIRST(&csa->csa_jobs_free)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_jobs_free, j, cj_link);
+    tvhcsa_job_free(j);
+  }
+  csa->csa_jobs_count = 0;
+}
+
+/*
+ * Hand the current cluster to the pool
+ */
+static void
+tvhcsa_csa_cbc_submit ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  tvhcsa_job_t *j;
+  struct dvbcsa_bs_batch_s *b;
+  uint8_t *p;
+
+  if (csa->csa_fill == 0)
+    return;
+  tvhcsa_csa_cbc_account(csa);
+  if (csa->csa_jobs_count >= TVHCSA_JOBS_MAX)
+    tvhcsa_pool_deliver(csa, s, 1);
+  j = TAILQ_FIRST(&csa->csa_jobs_free);
+  if (j)
+    TAILQ_REMOVE(&csa->csa_jobs_free, j, cj_link);
+  else
+    j = tvhcsa_job_alloc(csa);
+
+  /* swap the buffers, the batch pointers refer to the cluster */
+  p = j->cj_tsbcluster;
+  j->cj_tsbcluster = csa->csa_tsbcluster;
+  csa->csa_tsbcluster = p;
+  b = j->cj_tsbbatch_even;
+  j->cj_tsbbatch_even = csa->csa_tsbbatch_even;
+  csa->csa_tsbbatch_even = b;
+  b = j->cj_tsbbatch_odd;
+  j->cj_tsbbatch_odd = csa->csa_tsbbatch_odd;
+  csa->csa_tsbbatch_odd = b;
+  j->cj_fill = csa->csa_fill;
+  j->cj_fill_even = csa->csa_fill_even;
+  j->cj_fill_odd = csa->csa_fill_odd;
+  csa->csa_fill = csa->csa_fill_even = csa->csa_fill_odd = 0;
+
+  TAILQ_INSERT_TAIL(&csa->csa_jobs, j, cj_link);
+  csa->csa_jobs_count++;
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  j->cj_state = CJ_QUEUED;
+  TAILQ_INSERT_TAIL(&tvhcsa_pool_runq, j, cj_run_link);
+  tvh_cond_signal(&tvhcsa_pool_cond, 0);
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+}
+
+/*
+ * The keys are about to change, csa_flush() was called before so this
+ * only guards the jobs which are still decrypting
+ */
+static void
+tvhcsa_pool_wait ( tvhcsa_t *csa )
+{
+  tvhcsa_job_t *j;
+
+  if (!csa->csa_pipelined || !csa->csa_jobs_count)
+    return;
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  TAILQ_FOREACH(j, &csa->csa_jobs, cj_link)
+    while (j->cj_state != CJ_DONE)
+      tvh_cond_wait(&tvhcsa_pool_done_cond, &tvhcsa_pool_lock);
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+}
+
+#endif /* ENABLE_DVBCSA */
+
+void
+tvhcsa_pool_done ( void )
+{
+#if ENABLE_DVBCSA
+  tvhcsa_job_t *j;
+  int i;
+
+  if (tvhcsa_pool_tids == NULL)
+    return;
+
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  tvhcsa_pool_running = 0;
+  tvh_cond_signal(&tvhcsa_pool_cond, 1);
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+  for (i = 0; i < tvhcsa_pool_count; i++)
+    pthread_join(tvhcsa_pool_tids[i], NULL);
+
+  /* The jobs left in the run queue are not decrypted */
+  tvh_mutex_lock(&tvhcsa_pool_lock);
+  while ((j = TAILQ_FIRST(&tvhcsa_pool_runq)) != NULL) {
+    TAILQ_REMOVE(&tvhcsa_pool_runq, j, cj_run_link);
+    j->cj_state = CJ_DONE;
+  }
+  tvh_mutex_unlock(&tvhcsa_pool_lock);
+#endif
+}
+
 static void
 tvhcsa_csa_cbc_flush
   ( tvhcsa_t *csa, struct mpegts_service *s )
@@ -78,17 +369,19 @@ tvhcsa_csa_cbc_flush
   tvhtrace(LS_CSA, "%p: CSA flush - descramble packets for service \"%s\" MAX=%d even=%d odd=%d fill=%d",
            csa,((mpegts_service_t *)s)->s_dvb_svcname, csa->csa_cluster_size,csa->csa_fill_even,csa->csa_fill_odd,csa->csa_fill);
 
-  if(csa->csa_fill_even) {
-    csa->csa_tsbbatch_even[csa->csa_fill_even].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_even, csa->csa_tsbbatch_even, 184);
-    csa->csa_fill_even = 0;
-  }
-  if(csa->csa_fill_odd) {
-    csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = NULL;
-    dvbcsa_bs_decrypt(csa->csa_key_odd, csa->csa_tsbbatch_odd, 184);
-    csa->csa_fill_odd = 0;
+  if (csa->csa_pipelined) {
+    tvhcsa_csa_cbc_submit(csa, s);
+    tvhcsa_pool_deliver(csa, s, INT_MAX);
+    return;
   }
 
+  if (csa->csa_fill)
+    tvhcsa_csa_cbc_account(csa);
+  tvhcsa_csa_cbc_decrypt(csa, csa->csa_tsbbatch_even, csa->csa_fill_even,
+                         csa->csa_tsbbatch_odd, csa->csa_fill_odd);
+  csa->csa_fill_even = 0;
+  csa->csa_fill_odd = 0;
+
   ts_recv_packet2(s, csa->csa_tsbcluster, csa->csa_fill * 188);
 
   csa->csa_fill = 0;
@@ -96,6 +389,84 @@ tvhcsa_csa_cbc_flush
 #endif
 }
 
+#if ENABLE_DVBCSA
+/* a cluster is full */
+static inline void
+tvhcsa_csa_cbc_cluster
+  ( tvhcsa_t *csa, struct mpegts_service *s )
+{
+  if (csa->csa_pipelined)
+    tvhcsa_csa_cbc_submit(csa, s);
+  else
+    tvhcsa_csa_cbc_flush(csa, s);
+}
+
+/*
+ * The cluster flush time budget (monoclock units, configured in ms),
+ * -1 = wait for a full cluster, 0 = flush after each input chunk
+ * (low latency)
+ */
+static inline int64_t
+tvhcsa_csa_cbc_budget ( struct mpegts_service *s )
+{
+  if (s->s_csa_lowlatency)
+    return 0;
+  if (config.descrambler_latency == 0)
+    return -1;
+  return ms2mono(config.descrambler_latency);
+}
+
+/*
+ * Flush a partial cluster when it waited too long or when the input
+ * rate suggests that it will not fill within the budget
+ */
+static void
+tvhcsa_csa_cbc_adapt
+  ( tvhcsa_t *csa, struct mpegts_service *s, int64_t now, int pkts )
+{
+  int64_t budget, age, dt;
+  int need;
+
+  dt = now - csa->csa_rate_clk;
+  csa->csa_rate_pkts += pkts;
+  if (dt >= ms2mono(10)) {
+    if (dt < sec2mono(1)) {
+      uint32_t rate = (uint64_t)csa->csa_rate_pkts * MONOCLOCK_RESOLUTION / dt;
+      csa->csa_rate = csa->csa_rate ? (csa->csa_rate * 7 + rate) / 8 : rate;
+    } else {
+      csa->csa_rate = 0;
+    }
+    csa->csa_rate_clk = now;
+    csa->csa_rate_pkts = 0;
+  }
+
+  csa->csa_deadline = 0;
+  budget = tvhcsa_csa_cbc_budget(s);
+  if (budget < 0)
+    return;
+  if (csa->csa_fill == 0) {
+    /* decrypted clusters are delivered with the next input chunk */
+    if (csa->csa_pipelined && csa->csa_jobs_count)
+      csa->csa_deadline = now + MAX(budget, ms2mono(1));
+    return;
+  }
+  if (budget > 0) {
+    age = now - csa->csa_fill_start;
+    if (age < budget && csa->csa_rate) {
+      need = csa->csa_cluster_size - MAX(csa->csa_fill_even, csa->csa_fill_odd);
+      need = MIN(need, csa->csa_fill_size - csa->csa_fill);
+      age += (int64_t)need * MONOCLOCK_RESOLUTION / csa->csa_rate;
+    }
+    if (age < budget) {
+      /* the input may stop, the caller arms a timer for the rest */
+      csa->csa_deadline = csa->csa_fill_start + budget;
+      return;
+    }
+  }
+  tvhcsa_csa_cbc_flush(csa, s);
+}
+#endif
+
 static void
 tvhcsa_csa_cbc_descramble
   ( tvhcsa_t *csa, struct mpegts_service *s, const uint8_t *tsb, int tsb_len )
@@ -109,9 +480,15 @@ tvhcsa_csa_cbc_descramble
   int_fast8_t ev_od;
   int_fast16_t len;
   int_fast16_t offset;
+  int64_t now = getfastmonoclock();
+
+  if (csa->csa_pipelined && csa->csa_jobs_count)
+    tvhcsa_pool_deliver(csa, s, 0);
 
   for ( ; tsb < tsb_end; tsb += 188) {
 
+   if (csa->csa_fill == 0)
+     csa->csa_fill_start = now;
    pkt = csa->csa_tsbcluster + csa->csa_fill * 188;
    memcpy(pkt, tsb, 188);
    csa->csa_fill++;
@@ -141,24 +518,40 @@ tvhcsa_csa_cbc_descramble
        csa->csa_tsbbatch_even[csa->csa_fill_even].len = len;
        csa->csa_fill_even++;
        if(csa->csa_fill_even == csa->csa_cluster_size)
-         tvhcsa_csa_cbc_flush(csa, s);
+         tvhcsa_csa_cbc_cluster(csa, s);
      } else {
        csa->csa_tsbbatch_odd[csa->csa_fill_odd].data = pkt + offset;
        csa->csa_tsbbatch_odd[csa->csa_fill_odd].len = len;
        csa->csa_fill_odd++;
        if(csa->csa_fill_odd == csa->csa_cluster_size)
-         tvhcsa_csa_cbc_flush(csa, s);
+         tvhcsa_csa_cbc_cluster(csa, s);
      }
    } while(0);
 
    if(csa->csa_fill == csa->csa_fill_size )
-     tvhcsa_csa_cbc_flush(csa, s);
+     tvhcsa_csa_cbc_cluster(csa, s);
 
   }
 
+  tvhcsa_csa_cbc_adapt(csa, s, now, tsb_len / 188);
+
 #endif
 }
 
+/*
+ * The flush deadline timer, the packets still waiting for a cluster
+ * are delivered when the deadline passed (no input)
+ */
+void
+tvhcsa_deadline ( tvhcsa_t *csa, struct mpegts_service *s, int64_t now )
+{
+  if (csa->csa_deadline == 0 || csa->csa_deadline > now)
+    return;
+  csa->csa_deadline = 0;
+  if (csa->csa_flush)
+    csa->csa_flush(csa, s);
+}
+
 #if ENABLE_DEMULTI2
 #include "demulti2/demulti2.h"
 
@@ -204,6 +597,9 @@ tvhcsa_set_type( tvhcsa_t *csa, struct mpegts_service *s, int type )
                                     sizeof(struct dvbcsa_bs_batch_s));
     csa->csa_key_even      = dvbcsa_bs_key_alloc();
     csa->csa_key_odd       = dvbcsa_bs_key_alloc();
+    TAILQ_INIT(&csa->csa_jobs);
+    TAILQ_INIT(&csa->csa_jobs_free);
+    csa->csa_pipelined     = tvhcsa_pool_start();
 #endif
     break;
   case DESCRAMBLER_DES_NCB:
@@ -245,6 +641,7 @@ void tvhcsa_set_key_even( tvhcsa_t *csa, const uint8_t *even )
   switch (csa->csa_type) {
   case DESCRAMBLER_CSA_CBC:
 #if ENABLE_DVBCSA
+    tvhcsa_pool_wait(csa);
     dvbcsa_bs_key_set(even, csa->csa_key_even);
 #endif
     break;
@@ -273,6 +670,7 @@ void tvhcsa_set_key_odd( tvhcsa_t *csa, const uint8_t *odd )
   switch (csa->csa_type) {
   case DESCRAMBLER_CSA_CBC:
 #if ENABLE_DVBCSA
+    tvhcsa_pool_wait(csa);
     dvbcsa_bs_key_set(odd, csa->csa_key_odd);
 #endif
     break;
@@ -306,6 +704,8 @@ void
 tvhcsa_destroy ( tvhcsa_t *csa )
 {
 #if ENABLE_DVBCSA
+  if (csa->csa_pipelined)
+    tvhcsa_pool_cancel(csa);
   if (csa->csa_key_odd)
     dvbcsa_bs_key_free(csa->csa_key_odd);
   if (csa->csa_key_even)
@@ -28,6 +28,9 @@ struct elementary_stream;
 #include <dvbcsa/dvbcsa.h>
 #endif
 #include "tvhlog.h"
+#include "queue.h"
+
+typedef struct tvhcsa_job tvhcsa_job_t;
 
 typedef struct tvhcsa
 {
@@ -48,6 +51,15 @@ typedef struct tvhcsa
   int      csa_fill;
   int      csa_fill_size;
 
+  /* cluster wait statistics (monoclock units) */
+  int64_t  csa_fill_start;   /*< arrival of the oldest packet in the cluster */
+  uint64_t csa_wait_sum;
+  uint32_t csa_wait_count;
+  uint32_t csa_wait_max;
+
+  /* flush deadline of the pending packets, 0 = none (see tvhcsa_deadline) */
+  int64_t  csa_deadline;
+
 #if ENABLE_DVBCSA
   struct dvbcsa_bs_batch_s *csa_tsbbatch_even;
   struct dvbcsa_bs_batch_s *csa_tsbbatch_odd;
@@ -56,6 +68,17 @@ typedef struct tvhcsa
 
   struct dvbcsa_bs_key_s *csa_key_even;
   struct dvbcsa_bs_key_s *csa_key_odd;
+
+  /* input rate estimate for the adaptive cluster flush */
+  int64_t  csa_rate_clk;
+  uint32_t csa_rate_pkts;
+  uint32_t csa_rate;         /*< packets per second */
+
+  /* pipelined mode, the clusters are decrypted by the worker pool */
+  int csa_pipelined;
+  TAILQ_HEAD(, tvhcsa_job) csa_jobs;      /* submitted, in order */
+  TAILQ_HEAD(, tvhcsa_job) csa_jobs_free;
+  int csa_jobs_count;
 #endif
   void *csa_priv;
   tvhlog_limit_t tvhcsa_loglimit;
@@ -72,6 +95,10 @@ void tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *odd );
 void tvhcsa_init    ( tvhcsa_t *csa );
 void tvhcsa_destroy ( tvhcsa_t *csa );
 
+void tvhcsa_deadline( tvhcsa_t *csa, struct mpegts_service *s, int64_t now );
+
+void tvhcsa_pool_done ( void );
+
 #else
 
 static inline int tvhcsa_set_type( tvhcsa_t *csa, struct mpegts_service *s, int type ) { return -1; }
@@ -82,6 +109,10 @@ static inline void tvhcsa_set_key_odd ( tvhcsa_t *csa, const uint8_t *odd ) { };
 static inline void tvhcsa_init ( tvhcsa_t *csa ) { };
 static inline void tvhcsa_destroy ( tvhcsa_t *csa ) { };
 
+static inline void tvhcsa_deadline( tvhcsa_t *csa, struct mpegts_service *s, int64_t now ) { };
+
+static inline void tvhcsa_pool_done ( void ) { };
+
 #endif
 
 #endif /* __TVH_CSA_H__ */
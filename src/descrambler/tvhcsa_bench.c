@@ -0,0 +1,1055 @@
+/*
+ *  Tvheadend - descrambler throughput benchmark
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Standalone benchmark of the tvhcsa backends, build with
+ * 'make tvhcsa-bench'. The TS packets (a recorded scrambled file or
+ * generated packets) are fed in chunks like the input path does
+ * (descrambler_descramble -> csa_descramble), the key changes are
+ * applied like key_flush() does (csa_flush, then set_key).
+ *
+ * With -d, the chunks go through descrambler_descramble() of a service
+ * runtime started by descrambler_service_start(). The packets are
+ * queued in the key ring until the first keys arrive (-w), the keys
+ * are passed by descrambler_keys() like a client does, the partial
+ * clusters are flushed by the deadline timer (emulated between the
+ * chunks and after the input ends). The key wait and the replay of the
+ * queued packets are reported on a separate line.
+ *
+ * Each run is verified: the output is compared with the packets
+ * decrypted one by one by the plain (not batched) primitive of the
+ * backend, or with the known plaintext given by -p.
+ *
+ * Usage: tvhcsa-bench [options]
+ *   -a <algo>      csa, des, aes, aes128, multi2 or all (default all
+ *                  except aes, its 64-bit AES keys are refused by OpenSSL)
+ *   -i <file>      scrambled TS file (default generated packets), the
+ *                  tsdebugcw key packets in the file are the key changes
+ *   -p <file>      clear TS file, the expected output of -i
+ *   -n <packets>   number of generated packets (default 200000)
+ *   -k <even:odd>  control words in hex (default a constant key)
+ *   -K <file>      constcw client config (caclient/<uuid>), or key
+ *                  changes, lines '<packet> <even> <odd>' in hex
+ *   -c <sizes>     CSA cluster sizes, comma separated (default batch size)
+ *   -C <packets>   input chunk size (default 7)
+ *   -r <mbit>      pace the input at this rate (default unpaced)
+ *   -l <ms>        descrambler latency budget (default 250, 0 = off)
+ *   -t <threads>   descrambler threads (default 0 = inline)
+ *   -d             feed descrambler_descramble() (see above)
+ *   -w <packets>   -d: packets queued before the first keys (default 2000)
+ */
+
+#define TVHCSA_BENCH 1
+
+#include "tvhcsa.c"
+#include "descrambler.c"
+#include "tsscan.h"
+
+#include <ctype.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+/*
+ * Environment
+ */
+
+config_t config;
+int64_t __mdispatch_clock;
+int tvhlog_level = LOG_INFO;
+#if ENABLE_TRACE
+int tvh_thread_debug;
+#endif
+
+void
+_tvhlog(const char *file, int line, int severity,
+        int subsys, const char *fmt, ...)
+{
+  va_list args;
+
+  if ((severity & ~LOG_TVH_NOTIFY) > LOG_WARNING)
+    return;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+#if ENABLE_TRACE
+int
+tvh__mutex_lock(tvh_mutex_t *mutex, const char *filename, int lineno)
+{
+  return pthread_mutex_lock(&mutex->mutex);
+}
+
+int
+tvh__mutex_unlock(tvh_mutex_t *mutex)
+{
+  return pthread_mutex_unlock(&mutex->mutex);
+}
+#endif
+
+int
+tvh_cond_init(tvh_cond_t *cond, int monotonic)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  if (monotonic)
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  return pthread_cond_init(&cond->cond, &attr);
+}
+
+int
+tvh_cond_signal(tvh_cond_t *cond, int broadcast)
+{
+  if (broadcast)
+    return pthread_cond_broadcast(&cond->cond);
+  return pthread_cond_signal(&cond->cond);
+}
+
+int
+tvh_cond_wait(tvh_cond_t *cond, tvh_mutex_t *mutex)
+{
+  return pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+int
+tvh_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+                  void *(*start_routine) (void *), void *arg,
+                  const char *name)
+{
+  return pthread_create(thread, attr, start_routine, arg);
+}
+
+void
+tvh_mutex_not_held(const char *file, int line)
+{
+  fprintf(stderr, "mutex not held at %s:%d\n", file, line);
+  abort();
+}
+
+/*
+ * The descrambler.c environment, the tables, EMM, CAT and the hints
+ * are not used by the bench
+ */
+
+tvh_mutex_t global_lock;
+struct memoryinfo_list memoryinfo_entries;
+const idclass_t memoryinfo_class;
+
+void _tvhlog_hexdump(const char *file, int line, int severity,
+                     int subsys, const uint8_t *data, ssize_t len) { }
+void caclient_init(void) { }
+void caclient_done(void) { }
+void caclient_caid_update(struct mpegts_mux *mux, uint16_t caid,
+                          uint32_t prov, uint16_t pid, int valid) { }
+void caclient_cat_update(struct mpegts_mux *mux,
+                         const uint8_t *data, int len) { }
+void descrambler_standby_init(void) { }
+void descrambler_standby_done(void) { }
+void dvb_cat_decode(const uint8_t *data, int len,
+                    void (*add_emm)(void *aux, uint16_t caid, uint32_t prov, uint16_t pid),
+                    void *aux) { }
+htsmsg_t *hts_settings_load(const char *pathfmt, ...) { return NULL; }
+htsmsg_t *htsmsg_create_map(void) { return NULL; }
+void htsmsg_destroy(htsmsg_t *msg) { }
+void htsmsg_add_s64(htsmsg_t *msg, const char *name, int64_t s64) { }
+htsmsg_t *htsmsg_field_get_map(htsmsg_field_t *f) { return NULL; }
+htsmsg_t *htsmsg_get_list(const htsmsg_t *msg, const char *name) { return NULL; }
+const char *htsmsg_get_str(htsmsg_t *msg, const char *name) { return NULL; }
+int htsmsg_get_bool_or_default(htsmsg_t *msg, const char *name, int def) { return def; }
+int32_t htsmsg_get_s32_or_default(htsmsg_t *msg, const char *name,
+                                  int32_t def) { return def; }
+int idnode_insert(idnode_t *in, const char *uuid,
+                  const idclass_t *idc, int flags) { return 0; }
+void idnode_unlink(idnode_t *in) { }
+mpegts_table_t *mpegts_table_add
+  (mpegts_mux_t *mm, int tableid, int mask,
+   mpegts_table_callback_t callback, void *opaque,
+   const char *name, int subsys, int flags, int pid, int weight)
+  { return NULL; }
+void mpegts_table_destroy(mpegts_table_t *mt) { }
+
+void
+service_set_streaming_status_flags_(service_t *t, int flag)
+{
+  t->s_streaming_status = flag;
+}
+
+/* only the descramble info (no key) is sent */
+streaming_message_t *
+streaming_msg_create_data(streaming_message_type_t type, void *data)
+{
+  free(data);
+  return NULL;
+}
+
+void
+streaming_service_deliver(service_t *t, streaming_message_t *sm)
+{
+}
+
+/*
+ * The CSA flush deadline timer (dr_csa_timer), the callback is called
+ * by bench_timer_run() between the input chunks
+ */
+static mtimer_t *bench_timer;
+static uint32_t  bench_timer_fires;
+
+void
+GTIMER_FCN(mtimer_arm_rel)
+  (GTIMER_TRACEID_ mtimer_t *mti, mti_callback_t *callback, void *opaque, int64_t delta)
+{
+  mti->mti_callback = callback;
+  mti->mti_opaque = opaque;
+  mti->mti_expire = mclk() + delta;
+  bench_timer = mti;
+}
+
+void
+mtimer_disarm(mtimer_t *mti)
+{
+  if (bench_timer == mti)
+    bench_timer = NULL;
+}
+
+static inline void
+bench_tick(void)
+{
+  atomic_set_s64(&__mdispatch_clock, getfastmonoclock());
+}
+
+static void
+bench_timer_run(void)
+{
+  mtimer_t *mti = bench_timer;
+
+  bench_tick();
+  if (mti == NULL || mti->mti_expire > mclk())
+    return;
+  bench_timer = NULL;
+  bench_timer_fires++;
+  mti->mti_callback(mti->mti_opaque);
+}
+
+/* the client of the service, the keys are passed by the bench */
+static int
+bench_td_ecm_reset(th_descrambler_t *td)
+{
+  return 1;
+}
+
+static void
+bench_td_stop(th_descrambler_t *td)
+{
+  LIST_REMOVE(td, td_service_link);
+  td->td_service = NULL;
+}
+
+static th_descrambler_t bench_td = {
+  .td_nicename  = (char *)"bench",
+  .td_stop      = bench_td_stop,
+  .td_ecm_reset = bench_td_ecm_reset,
+};
+
+void
+caclient_start(service_t *t)
+{
+  bench_td.td_service = t;
+  bench_td.td_keystate = DS_INIT;
+  LIST_INSERT_HEAD(&t->s_descramblers, &bench_td, td_service_link);
+  descrambler_change_keystate(&bench_td, DS_READY, 1);
+}
+
+typedef struct bench_key {
+  uint32_t bk_packet;
+  uint8_t  bk_even[16];
+  uint8_t  bk_odd[16];
+} bench_key_t;
+
+static int64_t  *bench_in_time;
+static int64_t  *bench_lat;
+static uint8_t  *bench_outbuf;
+static uint32_t  bench_out;
+static uint32_t  bench_packets;
+static uint32_t  bench_skipped;
+static uint64_t  bench_batches;
+static uint64_t  bench_batch_fill;
+static int       bench_dr;
+static uint32_t  bench_wait = 2000;
+static uint32_t  bench_replay_mark;  /* the packets fed before the keys */
+static int64_t   bench_replay_end;
+
+static inline int64_t
+bench_clock(void)
+{
+  return getmonoclock();
+}
+
+static void
+bench_deliver(const uint8_t *tsb, int len)
+{
+  int64_t now = bench_clock();
+  uint32_t i, n = len / 188;
+
+  for (i = 0; i < n && bench_out < bench_packets; i++, bench_out++) {
+    bench_lat[bench_out] = now - bench_in_time[bench_out];
+    memcpy(bench_outbuf + (size_t)bench_out * 188, tsb + i * 188, 188);
+  }
+  if (bench_replay_mark && !bench_replay_end && bench_out >= bench_replay_mark)
+    bench_replay_end = now;
+}
+
+void
+ts_recv_packet2(mpegts_service_t *t, const uint8_t *tsb, int len)
+{
+  bench_batches++;
+  bench_batch_fill += len / 188;
+  bench_deliver(tsb, len);
+}
+
+/* the clear packets passed while the keys are not known */
+void
+ts_recv_packet0(mpegts_service_t *t, elementary_stream_t *st,
+                const uint8_t *tsb, int len)
+{
+  bench_deliver(tsb, len);
+}
+
+void
+ts_skip_packet2(mpegts_service_t *t, const uint8_t *tsb, int len)
+{
+  bench_skipped += len / 188;
+}
+
+/*
+ * Input
+ */
+
+static inline int
+bench_nibble(char c)
+{
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static int
+bench_hex(const char *s, uint8_t *dst, int maxlen)
+{
+  int l = 0;
+
+  while (s[0] && s[1] && l < maxlen) {
+    if (s[0] == ':') {
+      s++;
+      continue;
+    }
+    if (!isxdigit(s[0]) || !isxdigit(s[1]))
+      break;
+    dst[l++] = (bench_nibble(s[0]) << 4) | bench_nibble(s[1]);
+    s += 2;
+  }
+  return l;
+}
+
+static uint8_t *
+bench_load(const char *filename, uint32_t *_packets)
+{
+  FILE *f = fopen(filename, "rb");
+  uint8_t *buf = NULL, *p;
+  size_t size = 0, alloc = 0, r;
+
+  if (f == NULL) {
+    fprintf(stderr, "unable to open '%s': %s\n", filename, strerror(errno));
+    exit(1);
+  }
+  do {
+    if (size + 65536 > alloc) {
+      alloc = alloc ? alloc * 2 : 1024 * 1024;
+      buf = realloc(buf, alloc);
+    }
+    r = fread(buf + size, 1, alloc - size, f);
+    size += r;
+  } while (r > 0);
+  fclose(f);
+  /* resync on the first sync byte */
+  for (p = buf; p + 188 * 2 < buf + size; p++)
+    if (p[0] == 0x47 && p[188] == 0x47)
+      break;
+  size -= p - buf;
+  memmove(buf, p, size);
+  *_packets = size / 188;
+  return buf;
+}
+
+/*
+ * The tsdebugcw key packets (see tsdebug_encode_keys) are removed from
+ * the stream, each one changes the keys from its position
+ */
+static void
+bench_tsdebug_keys(uint8_t *buf, uint32_t *_packets,
+                   bench_key_t **_keys, int *nkeys)
+{
+  uint8_t *src, *dst, *end = buf + (size_t)*_packets * 188;
+  bench_key_t *keys = NULL, *k;
+  uint32_t keylen, pos;
+  int count = 0;
+
+  for (src = dst = buf; src < end; src += 188) {
+    if (src[1] != 0x1f || src[2] != 0xff ||
+        memcmp(src + 4, "TVHeadendDescramblerKeys", 24)) {
+      if (dst != src)
+        memmove(dst, src, 188);
+      dst += 188;
+      continue;
+    }
+    keylen = src[4 + 24 + 1];
+    pos = 4 + 24 + 6 + 2 * keylen;
+    if (keylen > 16 || pos + 4 > 188)
+      continue;
+    keys = realloc(keys, (count + 1) * sizeof(*keys));
+    k = &keys[count++];
+    memset(k, 0, sizeof(*k));
+    k->bk_packet = (dst - buf) / 188;
+    memcpy(k->bk_even, src + 4 + 24 + 6, keylen);
+    memcpy(k->bk_odd, src + 4 + 24 + 6 + keylen, keylen);
+  }
+  *_packets = (dst - buf) / 188;
+  if (count) {
+    *_keys = keys;
+    *nkeys = count;
+  }
+}
+
+static uint8_t *
+bench_generate(uint32_t packets, bench_key_t *keys, int nkeys)
+{
+  uint8_t *buf = malloc((size_t)packets * 188), *p;
+  uint32_t i, seed = 12345, parity = 0x80;
+  int k = 0;
+
+  for (i = 0, p = buf; i < packets; i++, p += 188) {
+    while (k < nkeys && keys[k].bk_packet <= i) {
+      parity ^= 0x40;
+      k++;
+    }
+    p[0] = 0x47;
+    p[1] = 0x01;
+    p[2] = 0x00;
+    p[3] = parity | 0x10 | (i & 0x0f);
+    for (int j = 4; j < 188; j++) {
+      seed = seed * 1103515245 + 12345;
+      p[j] = seed >> 16;
+    }
+  }
+  return buf;
+}
+
+/* "key_even": "01:02:..." from a constcw client config */
+static int
+bench_json_key(const char *json, const char *name, uint8_t *dst)
+{
+  const char *p = strstr(json, name);
+
+  if (p == NULL || (p = strchr(p + strlen(name), ':')) == NULL ||
+      (p = strchr(p, '"')) == NULL)
+    return 0;
+  return bench_hex(p + 1, dst, 16);
+}
+
+static int
+bench_load_keys(const char *filename, bench_key_t **_keys, int *nkeys)
+{
+  FILE *f = fopen(filename, "r");
+  char line[256], even[64], odd[64], json[4096];
+  unsigned long packet;
+  bench_key_t *keys = NULL;
+  size_t l;
+  int count = 0;
+
+  if (f == NULL) {
+    fprintf(stderr, "unable to open '%s': %s\n", filename, strerror(errno));
+    return -1;
+  }
+  l = fread(json, 1, sizeof(json) - 1, f);
+  json[l] = '\0';
+  if (json[strspn(json, " \t\r\n")] == '{') {
+    fclose(f);
+    keys = calloc(1, sizeof(*keys));
+    if (!bench_json_key(json, "\"key_even\"", keys->bk_even) ||
+        !bench_json_key(json, "\"key_odd\"", keys->bk_odd)) {
+      fprintf(stderr, "'%s': no constcw keys\n", filename);
+      free(keys);
+      return -1;
+    }
+    *_keys = keys;
+    *nkeys = 1;
+    return 0;
+  }
+  rewind(f);
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || sscanf(line, "%lu %63s %63s", &packet, even, odd) != 3)
+      continue;
+    keys = realloc(keys, (count + 1) * sizeof(*keys));
+    memset(&keys[count], 0, sizeof(*keys));
+    keys[count].bk_packet = packet;
+    bench_hex(even, keys[count].bk_even, 16);
+    bench_hex(odd, keys[count].bk_odd, 16);
+    count++;
+  }
+  fclose(f);
+  *_keys = keys;
+  *nkeys = count;
+  return 0;
+}
+
+/*
+ * Verification
+ */
+
+static void
+bench_reference(int type, uint8_t *ts, uint32_t packets,
+                bench_key_t *keys, int nkeys)
+{
+#if ENABLE_DVBCSA
+  struct dvbcsa_key_s *ckeys[2] = { NULL, NULL };
+#endif
+  void *priv = NULL;
+  uint8_t *pkt;
+  uint32_t i;
+  int k = -1, offset;
+
+  for (i = 0, pkt = ts; i < packets; i++, pkt += 188) {
+    if (k < 0 || (k + 1 < nkeys && keys[k + 1].bk_packet <= i)) {
+      k++;
+      switch (type) {
+#if ENABLE_DVBCSA
+      case DESCRAMBLER_CSA_CBC:
+        if (ckeys[0] == NULL) {
+          ckeys[0] = dvbcsa_key_alloc();
+          ckeys[1] = dvbcsa_key_alloc();
+        }
+        dvbcsa_key_set(keys[k].bk_even, ckeys[0]);
+        dvbcsa_key_set(keys[k].bk_odd, ckeys[1]);
+        break;
+#endif
+      case DESCRAMBLER_DES_NCB:
+        if (priv == NULL) priv = des_get_priv_struct();
+        des_set_control_words(priv, keys[k].bk_even, keys[k].bk_odd);
+        break;
+      case DESCRAMBLER_AES_ECB:
+        if (priv == NULL) priv = aes_get_priv_struct();
+        aes_set_control_words(priv, keys[k].bk_even, keys[k].bk_odd);
+        break;
+      case DESCRAMBLER_AES128_ECB:
+        if (priv == NULL) priv = aes128_get_priv_struct();
+        aes128_set_control_words(priv, keys[k].bk_even, keys[k].bk_odd);
+        break;
+#if ENABLE_DEMULTI2
+      case DESCRAMBLER_MULTI2:
+        if (priv == NULL) priv = multi2_get_priv_struct();
+        multi2_set_control_words(priv, keys[k].bk_even, keys[k].bk_odd);
+        break;
+#endif
+      }
+    }
+    switch (type) {
+#if ENABLE_DVBCSA
+    case DESCRAMBLER_CSA_CBC:
+      if ((pkt[3] & 0x80) == 0)
+        break;
+      offset = (pkt[3] & 0x40) != 0;
+      pkt[3] &= 0x3f;
+      if (pkt[3] & 0x20) {
+        if (!(pkt[3] & 0x10))
+          break;
+        if (4 + pkt[4] + 1 >= 188)
+          break;
+        dvbcsa_decrypt(ckeys[offset], pkt + 4 + pkt[4] + 1, 188 - (4 + pkt[4] + 1));
+      } else {
+        dvbcsa_decrypt(ckeys[offset], pkt + 4, 184);
+      }
+      break;
+#endif
+    case DESCRAMBLER_DES_NCB:
+      des_decrypt_packet(priv, pkt);
+      break;
+    case DESCRAMBLER_AES_ECB:
+      aes_decrypt_packet(priv, pkt);
+      break;
+    case DESCRAMBLER_AES128_ECB:
+      aes128_decrypt_packet(priv, pkt);
+      break;
+#if ENABLE_DEMULTI2
+    case DESCRAMBLER_MULTI2:
+      multi2_decrypt_packet(priv, pkt);
+      break;
+#endif
+    }
+  }
+#if ENABLE_DVBCSA
+  if (ckeys[0]) {
+    dvbcsa_key_free(ckeys[0]);
+    dvbcsa_key_free(ckeys[1]);
+  }
+#endif
+  switch (type) {
+  case DESCRAMBLER_DES_NCB:    des_free_priv_struct(priv);    break;
+  case DESCRAMBLER_AES_ECB:    aes_free_priv_struct(priv);    break;
+  case DESCRAMBLER_AES128_ECB: aes128_free_priv_struct(priv); break;
+#if ENABLE_DEMULTI2
+  case DESCRAMBLER_MULTI2:     multi2_free_priv_struct(priv); break;
+#endif
+  }
+}
+
+static uint32_t
+bench_verify(const uint8_t *ref, uint32_t packets)
+{
+  uint32_t i, bad = packets - bench_out;
+
+  for (i = 0; i < bench_out; i++)
+    if (memcmp(bench_outbuf + (size_t)i * 188, ref + (size_t)i * 188, 188))
+      bad++;
+  return bad;
+}
+
+static int
+bench_pkt_cmp(const void *a, const void *b)
+{
+  return memcmp(a, b, 188);
+}
+
+/*
+ * The clear packets are passed before the queued ones when the keys
+ * are not known, the order is not compared
+ */
+static uint32_t
+bench_verify_unordered(const uint8_t *ref, uint32_t packets)
+{
+  uint8_t *a = malloc((size_t)packets * 188), *b = malloc((size_t)bench_out * 188);
+  uint32_t i = 0, j = 0, ok = 0;
+  int c;
+
+  memcpy(a, ref, (size_t)packets * 188);
+  memcpy(b, bench_outbuf, (size_t)bench_out * 188);
+  qsort(a, packets, 188, bench_pkt_cmp);
+  qsort(b, bench_out, 188, bench_pkt_cmp);
+  while (i < packets && j < bench_out) {
+    c = memcmp(a + (size_t)i * 188, b + (size_t)j * 188, 188);
+    if (c == 0) {
+      ok++; i++; j++;
+    } else if (c < 0) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  free(a);
+  free(b);
+  return packets - ok;
+}
+
+/*
+ * Run
+ */
+
+static int
+bench_cmp(const void *a, const void *b)
+{
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+bench_report(const char *name, int cluster, uint32_t packets,
+             int64_t t, uint32_t lat_from, uint32_t bad, int reference)
+{
+  int64_t *lat = bench_lat + lat_from;
+  uint32_t n = bench_out > lat_from ? bench_out - lat_from : 0;
+
+  qsort(lat, n, sizeof(int64_t), bench_cmp);
+  t = MAX(t, 1);
+  printf("%-7s %7d %10.1f %10.0f %8.1f %9"PRId64" %9"PRId64" %9"PRId64" %9"PRId64" %s%s\n",
+         name, cluster,
+         (double)packets * 188 * 8 / t,
+         (double)packets * MONOCLOCK_RESOLUTION / t,
+         bench_batches ? (double)bench_batch_fill / bench_batches : 0.0,
+         n ? lat[n / 2] : 0,
+         n ? lat[n * 9 / 10] : 0,
+         n ? lat[n * 99 / 100] : 0,
+         n ? lat[n - 1] : 0,
+         bad ? "FAIL" : "ok",
+         bench_out != packets ? " (lost packets)" : "");
+  if (bad)
+    printf("%-7s %7s %u of %u packets differ from the %s\n", name, "-",
+           bad, packets, reference ? "reference decryption" : "plaintext");
+}
+
+/* wait for the input time of the packet i, stamp the chunk */
+static void
+bench_pace(int64_t start, uint32_t i, uint32_t n, int64_t rate)
+{
+  int64_t t = bench_clock();
+  uint32_t j;
+
+  if (rate > 0) {
+    int64_t due = start + (int64_t)i * 188 * 8 * MONOCLOCK_RESOLUTION / rate;
+    while (t < due) {
+      struct timespec ts2 = { 0, (due - t) * 1000 };
+      nanosleep(&ts2, NULL);
+      t = bench_clock();
+    }
+  }
+  for (j = 0; j < n; j++)
+    bench_in_time[i + j] = t;
+}
+
+static int
+bench_run0(const char *name, int type, int cluster,
+          const uint8_t *ts, const uint8_t *plain, uint32_t packets,
+          int chunk, int64_t rate, bench_key_t *keys, int nkeys,
+          mpegts_service_t *s)
+{
+  tvhcsa_t csa;
+  uint8_t *work = malloc((size_t)(packets + 1) * 188); /* the AES tail */
+  uint8_t *ref = NULL;
+  int64_t start, end;
+  uint32_t i, n, bad;
+  int k = 0;
+
+  memcpy(work, ts, (size_t)packets * 188);
+  memset(&csa, 0, sizeof(csa));
+  tvhcsa_init(&csa);
+  if (tvhcsa_set_type(&csa, s, type) < 0 || csa.csa_descramble == NULL) {
+    free(work);
+    return 0;
+  }
+  if (plain == NULL) {
+    ref = malloc((size_t)packets * 188);
+    memcpy(ref, ts, (size_t)packets * 188);
+    bench_reference(type, ref, packets, keys, nkeys);
+    plain = ref;
+  }
+#if ENABLE_DVBCSA
+  if (type == DESCRAMBLER_CSA_CBC && cluster > 0 &&
+      cluster < csa.csa_cluster_size)
+    csa.csa_cluster_size = cluster; /* smaller batches fit the buffers */
+#endif
+  tvhcsa_set_key_even(&csa, keys[0].bk_even);
+  tvhcsa_set_key_odd(&csa, keys[0].bk_odd);
+  k = 1;
+
+  bench_out = 0;
+  bench_packets = packets;
+  bench_batches = bench_batch_fill = 0;
+  start = bench_clock();
+  for (i = 0; i < packets; i += n) {
+    n = MIN(chunk, packets - i);
+    if (k < nkeys && keys[k].bk_packet < i + n) {
+      if (keys[k].bk_packet > i)
+        n = keys[k].bk_packet - i;
+      else {
+        /* like key_flush(): flush the old key data, then set the keys */
+        csa.csa_flush(&csa, s);
+        tvhcsa_set_key_even(&csa, keys[k].bk_even);
+        tvhcsa_set_key_odd(&csa, keys[k].bk_odd);
+        k++;
+        n = 0;
+        continue;
+      }
+    }
+    bench_pace(start, i, n, rate);
+    csa.csa_descramble(&csa, s, work + (size_t)i * 188, n * 188);
+  }
+  csa.csa_flush(&csa, s);
+  end = bench_clock();
+
+  bad = bench_verify(plain, packets);
+  bench_report(name, type == DESCRAMBLER_CSA_CBC ? csa.csa_cluster_size : 1,
+               packets, end - start, 0, bad, ref != NULL);
+  tvhcsa_destroy(&csa);
+  free(ref);
+  free(work);
+  return bad ? 1 : 0;
+}
+
+/*
+ * The descrambler path (-d), see the top of the file
+ */
+static int
+bench_run_dr0(const char *name, int type, int cluster,
+              const uint8_t *ts, const uint8_t *plain, uint32_t packets,
+              int chunk, int64_t rate, bench_key_t *keys, int nkeys,
+              mpegts_service_t *s)
+{
+  th_descrambler_runtime_t *dr;
+  th_descrambler_key_t *tk;
+  uint8_t *work = malloc((size_t)(packets + 1) * 188); /* the AES tail */
+  uint8_t *ref = NULL;
+  int64_t start, end, t, key_time = 0;
+  uint32_t i, n, pos, bad, wait, queued = 0, peak;
+  int k = 0;
+
+  memcpy(work, ts, (size_t)packets * 188);
+  if (plain == NULL) {
+    ref = malloc((size_t)packets * 188);
+    memcpy(ref, ts, (size_t)packets * 188);
+    bench_reference(type, ref, packets, keys, nkeys);
+    plain = ref;
+  }
+  /* the packets before the next key change are still decryptable */
+  wait = MIN(bench_wait, packets / 2);
+  if (nkeys > 1)
+    wait = MIN(wait, keys[1].bk_packet);
+
+  bench_tick();
+  s->s_start_time = mclk();
+  descrambler_service_start((service_t *)s);
+  if ((dr = s->s_descramble) == NULL) {
+    fprintf(stderr, "%s: no descrambler runtime\n", name);
+    free(ref);
+    free(work);
+    return 1;
+  }
+  tk = &dr->dr_keys[0];
+  /* the ECM was sent, the packets are queued until the keys arrive */
+  dr->dr_ecm_start[0] = dr->dr_ecm_start[1] = mclk();
+
+  bench_out = bench_skipped = 0;
+  bench_packets = packets;
+  bench_batches = bench_batch_fill = 0;
+  bench_replay_mark = 0;
+  bench_replay_end = 0;
+  bench_timer_fires = 0;
+  start = bench_clock();
+  for (i = 0; i < packets; i += n) {
+    n = MIN(chunk, packets - i);
+    bench_timer_run();
+    if (k < nkeys) {
+      pos = k ? keys[k].bk_packet : wait;
+      if (pos >= i + n) {
+        /* nothing */
+      } else if (pos > i) {
+        n = pos - i;
+      } else {
+        if (k == 0) {
+          queued = dr->dr_queue_total / 188;
+          bench_replay_mark = i;
+          key_time = bench_clock();
+        }
+        descrambler_keys(&bench_td, type, 0, keys[k].bk_even, keys[k].bk_odd);
+#if ENABLE_DVBCSA
+        if (k == 0 && type == DESCRAMBLER_CSA_CBC && cluster > 0 &&
+            cluster < tk->key_csa.csa_cluster_size)
+          tk->key_csa.csa_cluster_size = cluster;
+#endif
+        k++;
+        n = 0;
+        continue;
+      }
+    }
+    bench_pace(start, i, n, rate);
+    tvh_mutex_lock(&s->s_stream_mutex);
+    descrambler_descramble((service_t *)s, NULL, work + (size_t)i * 188, n * 188);
+    tvh_mutex_unlock(&s->s_stream_mutex);
+  }
+  /* the input stopped, the rest is flushed by the deadline timer */
+  while (bench_timer && bench_out < packets) {
+    t = bench_timer->mti_expire - mclk();
+    if (t > 0) {
+      struct timespec ts2 = { t / MONOCLOCK_RESOLUTION,
+                              (t % MONOCLOCK_RESOLUTION) * 1000 };
+      nanosleep(&ts2, NULL);
+    }
+    bench_timer_run();
+  }
+  end = bench_clock();
+  if (bench_out < packets) {
+    /* no deadline (-l 0), flush like key_flush() */
+    tvh_mutex_lock(&s->s_stream_mutex);
+    tk->key_csa.csa_flush(&tk->key_csa, s);
+    tvh_mutex_unlock(&s->s_stream_mutex);
+  }
+  peak = dr->dr_queue_peak / 188;
+
+  bad = bench_verify_unordered(plain, packets);
+  bench_report(name, type == DESCRAMBLER_CSA_CBC ? tk->key_csa.csa_cluster_size : 1,
+               packets, end - start, wait, bad, ref != NULL);
+  printf("%-7s %7s key wait %u packets (%u queued, peak %u, %u skipped), "
+         "replay %.1fms, %u deadline flushes\n",
+         name, "-", wait, queued, peak, bench_skipped,
+         bench_replay_end > key_time ? (bench_replay_end - key_time) / 1000.0 : 0.0,
+         bench_timer_fires);
+  descrambler_service_stop((service_t *)s);
+  free(ref);
+  free(work);
+  return bad ? 1 : 0;
+}
+
+/*
+ * Each run is done in a child, a crashing backend is reported
+ * and the other ones are still measured
+ */
+static int
+bench_run(const char *name, int type, int cluster,
+          const uint8_t *ts, const uint8_t *plain, uint32_t packets,
+          int chunk, int64_t rate, bench_key_t *keys, int nkeys,
+          mpegts_service_t *s)
+{
+  pid_t pid;
+  int status, r;
+
+  fflush(stdout);
+  if ((pid = fork()) == 0) {
+    r = (bench_dr ? bench_run_dr0 : bench_run0)
+          (name, type, cluster, ts, plain, packets, chunk, rate,
+           keys, nkeys, s);
+    tvhcsa_pool_done();
+    fflush(stdout);
+    _exit(r);
+  }
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    fprintf(stderr, "%s: unable to run: %s\n", name, strerror(errno));
+    return 1;
+  }
+  if (WIFSIGNALED(status)) {
+    printf("%-7s %7s failed (signal %d)\n", name, "-", WTERMSIG(status));
+    return 1;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
+
+int
+main(int argc, char **argv)
+{
+  static const struct {
+    const char *name;
+    int         type;
+    int         all;
+  } algos[] = {
+    { "csa",    DESCRAMBLER_CSA_CBC,    1 },
+    { "des",    DESCRAMBLER_DES_NCB,    1 },
+    { "aes",    DESCRAMBLER_AES_ECB,    0 },
+    { "aes128", DESCRAMBLER_AES128_ECB, 1 },
+#if ENABLE_DEMULTI2
+    { "multi2", DESCRAMBLER_MULTI2,     1 },
+#endif
+  };
+  const char *algo = "all", *input = NULL, *keyfile = NULL, *clusters = NULL;
+  const char *plainfile = NULL;
+  uint32_t packets = 200000, plain_packets;
+  int chunk = 7, c, nkeys = 1, i, r = 0;
+  int64_t rate = 0;
+  bench_key_t defkey, *keys = &defkey;
+  mpegts_service_t *s;
+  uint8_t *ts, *plain = NULL;
+  char *p, *saveptr, *str;
+
+  memset(&defkey, 0, sizeof(defkey));
+  memcpy(defkey.bk_even, "\x11\x22\x33\x66\x44\x55\x66\xff\x11\x22\x33\x44\x55\x66\x77\x88", 16);
+  memcpy(defkey.bk_odd, "\x88\x77\x66\x55\x44\x33\x22\x11\x99\xaa\xbb\xcc\xdd\xee\xff\x00", 16);
+  config.descrambler_latency = 250;
+  config.descrambler_buffer = 9000;
+
+  while ((c = getopt(argc, argv, "a:i:p:n:k:K:c:C:r:l:t:dw:h")) != -1) {
+    switch (c) {
+    case 'a': algo = optarg; break;
+    case 'i': input = optarg; break;
+    case 'p': plainfile = optarg; break;
+    case 'n': packets = atoi(optarg); break;
+    case 'k':
+      if ((p = strchr(optarg, ':')) == NULL)
+        goto usage;
+      bench_hex(optarg, defkey.bk_even, 16);
+      bench_hex(p + 1, defkey.bk_odd, 16);
+      break;
+    case 'K': keyfile = optarg; break;
+    case 'c': clusters = optarg; break;
+    case 'C': chunk = MAX(atoi(optarg), 1); break;
+    case 'r': rate = atoll(optarg) * 1000000LL; break;
+    case 'l': config.descrambler_latency = atoi(optarg); break;
+    case 't': config.descrambler_tpool_count = atoi(optarg); break;
+    case 'd': bench_dr = 1; break;
+    case 'w': bench_wait = atoi(optarg); break;
+    default:
+usage:
+      fprintf(stderr, "usage: %s [-a algo] [-i file] [-p file] [-n packets] [-k even:odd] "
+                      "[-K keyfile] [-c sizes] [-C chunk] [-r mbit] [-l ms] "
+                      "[-t threads] [-d] [-w packets]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (keyfile && bench_load_keys(keyfile, &keys, &nkeys))
+    return 1;
+  if (input) {
+    ts = bench_load(input, &packets);
+    if (ts)
+      bench_tsdebug_keys(ts, &packets, &keys, &nkeys);
+  }
+  if (nkeys == 0) {
+    keys = &defkey;
+    nkeys = 1;
+  }
+  if (!input)
+    ts = bench_generate(packets, keys, nkeys);
+  if (packets == 0) {
+    fprintf(stderr, "no packets\n");
+    return 1;
+  }
+  if (plainfile) {
+    plain = bench_load(plainfile, &plain_packets);
+    if (plain == NULL || plain_packets < packets) {
+      fprintf(stderr, "'%s': expected %u packets\n", plainfile, packets);
+      return 1;
+    }
+  }
+  bench_in_time = malloc(packets * sizeof(int64_t));
+  bench_lat = malloc(packets * sizeof(int64_t));
+  bench_outbuf = malloc((size_t)packets * 188);
+  s = calloc(1, sizeof(*s));
+  s->s_dvb_svcname = (char *)"bench";
+  s->s_nicename = (char *)"bench";
+  if (bench_dr) {
+    tsscan_init();
+    pthread_mutex_init(&s->s_stream_mutex.mutex, NULL);
+    s->s_dvb_mux = calloc(1, sizeof(*s->s_dvb_mux));
+    s->s_dvb_forcecaid = 0x0100; /* no hints, the default key interval */
+  }
+
+  printf("%u packets, chunk %d, %d key(s)%s%s\n", packets, chunk, nkeys,
+         rate ? ", paced" : "", bench_dr ? ", descrambler path" : "");
+  printf("%-7s %7s %10s %10s %8s %9s %9s %9s %9s %s\n",
+         "algo", "cluster", "Mbit/s", "pkt/s", "fill",
+         "p50(us)", "p90(us)", "p99(us)", "max(us)", "verify");
+  for (i = 0; i < ARRAY_SIZE(algos); i++) {
+    if (strcmp(algo, "all") ? strcmp(algo, algos[i].name) : !algos[i].all)
+      continue;
+    if (algos[i].type == DESCRAMBLER_CSA_CBC && clusters) {
+      str = strdup(clusters);
+      for (p = strtok_r(str, ",", &saveptr); p; p = strtok_r(NULL, ",", &saveptr))
+        r |= bench_run(algos[i].name, algos[i].type, atoi(p), ts, plain, packets,
+                       chunk, rate, keys, nkeys, s);
+      free(str);
+    } else {
+      r |= bench_run(algos[i].name, algos[i].type, 0, ts, plain, packets,
+                     chunk, rate, keys, nkeys, s);
+    }
+  }
+  return r;
+}
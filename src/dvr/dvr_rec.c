@@ -1668,14 +1668,12 @@ dvr_thread(void *aux)
 
   TAILQ_INIT(&backlog);
 
-  tvh_mutex_lock(&sq->sq_mutex);
   while(run) {
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_get(sq);
     if(sm == NULL) {
-      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      streaming_queue_wait(sq, 0);
       continue;
     }
-    streaming_queue_remove(sq, sm);
 
     old_epg_running = epg_running;
     if (running_disabled) {
@@ -1704,8 +1702,6 @@ dvr_thread(void *aux)
       tvhtrace(LS_DVR, "%s - running flag changed from %d to %d",
                idnode_uuid_as_str(&de->de_id, ubuf), old_epg_running, epg_running);
 
-    tvh_mutex_unlock(&sq->sq_mutex);
-
     switch(sm->sm_type) {
 
     case SMT_PACKET:
@@ -1747,6 +1743,10 @@ dvr_thread(void *aux)
       }
 
       muxing = 1;
+      /*
+       * the timestamps are rebased to dts_offset taken from the same
+       * chain, so the chain delta (sm_ts_delta) cancels out here
+       */
       while ((sm2 = TAILQ_FIRST(&backlog)) != NULL) {
         TAILQ_REMOVE(&backlog, sm2, sm_link);
         pkt2 = sm2->sm_data;
@@ -1759,7 +1759,7 @@ dvr_thread(void *aux)
             if (pkt3->pkt_pts != PTS_UNSET)
               pkt3->pkt_pts -= dts_offset;
             dvr_thread_pkt_stats(de, pkt3, 1);
-            muxer_write_pkt(prch->prch_muxer, sm2->sm_type, pkt3);
+            muxer_write_pkt(prch->prch_muxer, sm2->sm_type, pkt3, 0);
           } else {
             dvr_thread_pkt_stats(de, pkt2, 0);
           }
@@ -1774,7 +1774,7 @@ dvr_thread(void *aux)
         if (pkt3->pkt_pts != PTS_UNSET)
           pkt3->pkt_pts -= dts_offset;
         dvr_thread_pkt_stats(de, pkt3, 1);
-        muxer_write_pkt(prch->prch_muxer, sm->sm_type, pkt3);
+        muxer_write_pkt(prch->prch_muxer, sm->sm_type, pkt3, 0);
       } else {
         dvr_thread_pkt_stats(de, pkt, 0);
       }
@@ -1819,12 +1819,12 @@ dvr_thread(void *aux)
       while ((sm2 = TAILQ_FIRST(&backlog)) != NULL) {
         TAILQ_REMOVE(&backlog, sm2, sm_link);
         dvr_thread_mpegts_stats(de, sm2->sm_data);
-        muxer_write_pkt(prch->prch_muxer, sm2->sm_type, sm2->sm_data);
+        muxer_write_pkt(prch->prch_muxer, sm2->sm_type, sm2->sm_data, 0);
         sm2->sm_data = NULL;
         streaming_msg_free(sm2);
       }
       dvr_thread_mpegts_stats(de, sm->sm_data);
-      muxer_write_pkt(prch->prch_muxer, sm->sm_type, sm->sm_data);
+      muxer_write_pkt(prch->prch_muxer, sm->sm_type, sm->sm_data, 0);
       sm->sm_data = NULL;
       dvr_notify(de);
       packets++;
@@ -1920,9 +1920,7 @@ fin:
     }
 
     streaming_msg_free(sm);
-    tvh_mutex_lock(&sq->sq_mutex);
   }
-  tvh_mutex_unlock(&sq->sq_mutex);
 
   streaming_queue_clear(&backlog);
 
@@ -1559,6 +1559,24 @@ _eit_process_immediate(void *m, const void *ptr, uint32_t len, eit_data_t *ed)
     epg_updated();
 }
 
+static int
+_eit_cached
+  (mpegts_table_t *mt, const uint8_t *ptr, int len, int tableid)
+{
+  epggrab_ota_map_t *map = mt->mt_opaque;
+  epggrab_module_ota_t *mod = map->om_module;
+  eit_private_t *priv = mod->opaque;
+
+  if (priv == NULL || epggrab_ota_cached_section(mt, ptr, len, tableid))
+    return -1;
+
+  /* Register interest */
+  if (tableid == 0x4e || (tableid >= 0x50 && tableid < 0x60) ||
+      (priv->hacks & EIT_HACK_INTEREST4E) != 0 /* uk_freesat hack */)
+    epggrab_ota_register(mod, NULL, mt->mt_mux);
+  return 0;
+}
+
 static int
 _eit_callback
   (mpegts_table_t *mt, const uint8_t *ptr, int len, int tableid)
@@ -1641,7 +1659,7 @@ _eit_callback
     mm = mpegts_network_find_mux(mm->mm_network, onid, tsid, 1);
   }
   if(!mm)
-    goto done;
+    goto nocache;
 
   /* Get transport stream */
   // Note: tableid=0x4f,0x60-0x6f is other TS
@@ -1660,7 +1678,7 @@ _eit_callback
     }
   }
   if(!mm)
-    goto done;
+    goto nocache;
 
   /* Get service */
   svc = mpegts_mux_find_service(mm, sid);
@@ -1673,7 +1691,7 @@ _eit_callback
     }
 
     tvhtrace(LS_TBL_EIT, "sid %i not found", sid);
-    goto done;
+    goto nocache;
   }
 
 svc_ok:
@@ -1688,10 +1706,10 @@ svc_ok:
 
   /* No point processing */
   if (!LIST_FIRST(&svc->s_channels))
-    goto done;
+    goto nocache;
 
   if (svc->s_dvb_ignore_eit)
-    goto done;
+    goto nocache;
 
   /* Queue events */
   len -= 11;
@@ -1731,6 +1749,11 @@ svc_ok:
     }
   }
 
+  goto done;
+
+nocache:
+  /* the result may change without the section, see mpegts_table_dispatch */
+  dvb_table_nocache((mpegts_psi_table_t *)mt);
 done:
   r = dvb_table_end((mpegts_psi_table_t *)mt, st, sect);
 complete:
@@ -1755,6 +1778,7 @@ static void _eit_install_one_handler
 {
   epggrab_module_ota_t *m = map->om_module;
   eit_private_t *priv = m->opaque;
+  mpegts_table_t *mt;
   int pid = priv->pid;
   int opts = 0;
 
@@ -1764,8 +1788,10 @@ static void _eit_install_one_handler
     opts = MT_RECORD;
   }
 
-  mpegts_table_add(dm, 0, 0, _eit_callback, map, map->om_module->id, LS_TBL_EIT,
-                   MT_CRC | opts, pid, MPS_WEIGHT_EIT);
+  mt = mpegts_table_add(dm, 0, 0, _eit_callback, map, map->om_module->id,
+                        LS_TBL_EIT, MT_CRC | opts, pid, MPS_WEIGHT_EIT);
+  if (mt)
+    mt->mt_cached = _eit_cached;
   tvhdebug(m->subsys, "%s: installed table handler (pid %d)", m->id, pid);
 }
 
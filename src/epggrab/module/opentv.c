@@ -690,6 +690,8 @@ opentv_table_callback
   /* Complete */
 done:
   if (!r) {
+    /* time window, do not cache the section */
+    dvb_table_nocache((mpegts_psi_table_t *)mt);
     sta->os_map->om_first = 0; /* valid data mark */
     tvhtrace(mt->mt_subsys, "%s: pid %d complete remain %d",
              mt->mt_name, mt->mt_pid, sta->os_refcount-1);
@@ -765,6 +767,7 @@ opentv_bat_callback
                              mod->id, LS_OPENTV, MT_CRC, *t++,
                              MPS_WEIGHT_EIT);
       if (mt2) {
+        mt2->mt_cached = epggrab_ota_cached_section;
         if (!mt2->mt_destroy) {
           sta->os_refcount++;
           mt2->mt_destroy = opentv_status_destroy;
@@ -784,6 +787,7 @@ opentv_bat_callback
                              MPS_WEIGHT_EIT);
       if (mt2) {
         sta->os_refcount++;
+        mt2->mt_cached = epggrab_ota_cached_section;
         mt2->mt_destroy = opentv_status_destroy;
       }
     }
@@ -833,6 +837,7 @@ static int _opentv_start
                           MPS_WEIGHT_EIT);
     if (mt) {
       mt->mt_mux_cb = bat_desc;
+      mt->mt_cached = epggrab_ota_cached_section;
       if (!mt->mt_destroy) {
         sta->os_refcount++;
         mt->mt_destroy = opentv_status_destroy;
@@ -161,6 +161,7 @@ psip_activate_table(psip_status_t *ps, psip_table_t *pt)
     abort();
   }
   ps->ps_refcount++;
+  mt->mt_cached = epggrab_ota_cached_section;
   mt->mt_destroy = psip_status_destroy;
   pt->pt_start = mclk();
   pt->pt_table = mt;
@@ -713,6 +714,7 @@ static int _psip_start
                         DVB_ATSC_MGT_PID, MPS_WEIGHT_MGT);
   if (mt && !mt->mt_destroy) {
     ps->ps_refcount++;
+    mt->mt_cached = epggrab_ota_cached_section;
     mt->mt_destroy = psip_status_destroy;
     tvhdebug(mt->mt_subsys, "%s: installed table handlers", mt->mt_name);
   }
@@ -325,6 +325,8 @@ epggrab_ota_start ( epggrab_ota_mux_t *om, mpegts_mux_t *mm )
       }
   }
   epggrab_ota_free_eit_plist(om);
+  /* the modules expect to see the tables again */
+  mpegts_table_scache_flush(mm);
   LIST_FOREACH(map, &om->om_modules, om_link) {
     omod = map->om_module;
     map->om_first = 1;
@@ -434,6 +436,26 @@ epggrab_ota_register
   return ota;
 }
 
+/*
+ * Section cache hit - the table callback is skipped, keep the statistics
+ */
+int
+epggrab_ota_cached_section
+  ( mpegts_table_t *mt, const uint8_t *ptr, int len, int tableid )
+{
+  th_subscription_t *ths;
+
+  if (!atomic_get(&epggrab_ota_running))
+    return -1;
+
+  ths = mpegts_mux_find_subscription_by_name(mt->mt_mux, "epggrab");
+  if (ths) {
+    subscription_add_bytes_in(ths, len);
+    subscription_add_bytes_out(ths, len);
+  }
+  return 0;
+}
+
 void
 epggrab_ota_complete
   ( epggrab_module_ota_t *mod, epggrab_ota_mux_t *ota )
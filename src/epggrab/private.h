@@ -20,6 +20,7 @@
 #define __EPGGRAB_PRIVATE_H__
 
 struct mpegts_mux;
+struct mpegts_table;
 
 /* **************************************************************************
  * Generic module routines
@@ -161,6 +162,9 @@ epggrab_ota_mux_t *epggrab_ota_register
   ( epggrab_module_ota_t *mod, epggrab_ota_mux_t *ota,
     struct mpegts_mux *mux );
 
+int epggrab_ota_cached_section
+  ( struct mpegts_table *mt, const uint8_t *ptr, int len, int tableid );
+
 /*
  * State change
  */
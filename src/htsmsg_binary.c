@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "htsmsg_binary.h"
 #include "memoryinfo.h"
@@ -258,10 +259,51 @@ htsmsg_binary_count(htsmsg_t *msg)
 }
 
 /*
- *
+ * I/O vector state, the big binary fields are referenced (not copied)
+ */
+typedef struct htsmsg_binary_iov {
+  struct iovec *hi_iov;
+  int           hi_count;
+  size_t        hi_binmin;
+  uint8_t      *hi_start;   /* buffer data not yet added to the vector */
+} htsmsg_binary_iov_t;
+
+static void
+htsmsg_binary_iov_ref(htsmsg_binary_iov_t *hi, uint8_t *ptr,
+                      const void *data, size_t len)
+{
+  if (ptr != hi->hi_start) {
+    hi->hi_iov[hi->hi_count].iov_base = hi->hi_start;
+    hi->hi_iov[hi->hi_count++].iov_len = ptr - hi->hi_start;
+  }
+  hi->hi_iov[hi->hi_count].iov_base = (void *)data;
+  hi->hi_iov[hi->hi_count++].iov_len = len;
+  hi->hi_start = ptr;
+}
+
+/*
+ * Count the binary fields which will be referenced
  */
 static void
-htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
+htsmsg_binary_count_refs(htsmsg_t *msg, size_t binmin, int *count, size_t *len)
+{
+  htsmsg_field_t *f;
+
+  TAILQ_FOREACH(f, &msg->hm_fields, hmf_link) {
+    if (f->hmf_type == HMF_MAP || f->hmf_type == HMF_LIST) {
+      htsmsg_binary_count_refs(f->hmf_msg, binmin, count, len);
+    } else if (f->hmf_type == HMF_BIN && f->hmf_binsize >= binmin) {
+      (*count)++;
+      *len += f->hmf_binsize;
+    }
+  }
+}
+
+/*
+ *
+ */
+static uint8_t *
+htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr, htsmsg_binary_iov_t *hi)
 {
   htsmsg_field_t *f;
   uint64_t u64;
@@ -317,14 +359,18 @@ htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
     switch(f->hmf_type) {
     case HMF_MAP:
     case HMF_LIST:
-      htsmsg_binary_write(f->hmf_msg, ptr);
-      break;
+      ptr = htsmsg_binary_write(f->hmf_msg, ptr, hi);
+      continue;
 
     case HMF_STR:
       memcpy(ptr, f->hmf_str, l);
       break;
 
     case HMF_BIN:
+      if (hi && l >= hi->hi_binmin) {
+        htsmsg_binary_iov_ref(hi, ptr, f->hmf_bin, l);
+        continue;
+      }
       memcpy(ptr, f->hmf_bin, l);
       break;
 
@@ -343,6 +389,7 @@ htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
     }
     ptr += l;
   }
+  return ptr;
 }
 
 /*
@@ -360,7 +407,7 @@ htsmsg_binary_serialize0(htsmsg_t *msg, void **datap, size_t *lenp, int maxlen)
 
   data = malloc(len);
 
-  htsmsg_binary_write(msg, data);
+  htsmsg_binary_write(msg, data, NULL);
   *datap = data;
   *lenp  = len;
   return 0;
@@ -386,8 +433,48 @@ htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp, int maxlen)
   data[2] = len >> 8;
   data[3] = len;
 
-  htsmsg_binary_write(msg, data + 4);
+  htsmsg_binary_write(msg, data + 4, NULL);
   *datap = data;
   *lenp  = len + 4;
   return 0;
 }
+
+/*
+ * Serialize (with the length prefix) to an I/O vector. The binary fields
+ * with size >= binmin are referenced, the rest is written to buf.
+ * On input *buflen is the buffer size, on output the used size.
+ * Returns the number of used iovecs or -1 when buf or iov is too small.
+ */
+int
+htsmsg_binary_serialize_iov(htsmsg_t *msg, struct iovec *iov, int iovmax,
+                            void *buf, size_t *buflen, size_t binmin)
+{
+  htsmsg_binary_iov_t hi;
+  size_t len, rlen = 0;
+  uint8_t *data = buf, *ptr;
+  int rcount = 0;
+
+  len = htsmsg_binary_count(msg);
+  if (len > INT32_MAX)
+    return -1;
+  htsmsg_binary_count_refs(msg, binmin, &rcount, &rlen);
+  if (len + 4 - rlen > *buflen || rcount * 2 + 1 > iovmax)
+    return -1;
+
+  data[0] = len >> 24;
+  data[1] = len >> 16;
+  data[2] = len >> 8;
+  data[3] = len;
+
+  hi.hi_iov = iov;
+  hi.hi_count = 0;
+  hi.hi_binmin = binmin;
+  hi.hi_start = data;
+  ptr = htsmsg_binary_write(msg, data + 4, &hi);
+  if (ptr != hi.hi_start) {
+    iov[hi.hi_count].iov_base = hi.hi_start;
+    iov[hi.hi_count++].iov_len = ptr - hi.hi_start;
+  }
+  *buflen = ptr - data;
+  return hi.hi_count;
+}
@@ -36,4 +36,8 @@ int htsmsg_binary_serialize0(htsmsg_t *msg, void **datap, size_t *lenp,
 int htsmsg_binary_serialize(htsmsg_t *msg, void **datap, size_t *lenp,
 			    int maxlen);
 
+struct iovec;
+int htsmsg_binary_serialize_iov(htsmsg_t *msg, struct iovec *iov, int iovmax,
+                                void *buf, size_t *buflen, size_t binmin);
+
 #endif /* HTSMSG_BINARY_H_ */
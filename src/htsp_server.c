@@ -18,6 +18,7 @@
 
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "tvheadend.h"
 #include "atomic.h"
@@ -26,6 +27,7 @@
 #include "channels.h"
 #include "subscriptions.h"
 #include "tcp.h"
+#include "tvhpoll.h"
 #include "packet.h"
 #include "access.h"
 #include "htsp_server.h"
@@ -76,6 +78,7 @@ static void htsp_streaming_input(void *opaque, streaming_message_t *sm);
 static htsmsg_t *htsp_streaming_input_info(void *opaque, htsmsg_t *list);
 const char * _htsp_get_subscription_status(int smcode);
 static void htsp_epg_send_waiting(struct htsp_connection *, int64_t mintime);
+static void htsp_io_schedule(struct htsp_connection *);
 
 static streaming_ops_t htsp_streaming_input_ops = {
   .st_cb   = htsp_streaming_input,
@@ -112,6 +115,16 @@ typedef struct htsp_msg_q {
   int hmq_dead;
 } htsp_msg_q_t;
 
+/**
+ * I/O thread (event mode)
+ */
+typedef struct htsp_io {
+  pthread_t  hio_thread;
+  tvhpoll_t *hio_poll;
+  th_pipe_t  hio_pipe;
+  uint8_t   *hio_arena;
+} htsp_io_t;
+
 /**
  *
  */
@@ -155,6 +168,31 @@ typedef struct htsp_connection {
   htsp_msg_q_t htsp_hmq_epg;
   htsp_msg_q_t htsp_hmq_qstatus;
 
+  void *htsp_tcp_id;
+  int htsp_streaming;
+
+  /**
+   * Event mode (htsp_io != NULL), the I/O thread replaces the reader
+   * and writer threads, the state is protected by htsp_out_mutex
+   */
+  htsp_io_t *htsp_io;
+  TAILQ_ENTRY(htsp_connection) htsp_work_link;
+  htsp_msg_q_t htsp_hmq_in;     /* received requests */
+  int htsp_io_events;           /* polled events */
+  int htsp_io_queued;           /* queued or processed by a worker */
+  int htsp_io_closed;           /* removed from the I/O thread */
+  int htsp_io_opened;           /* worker only */
+  int htsp_io_stop;             /* worker only, ignore the requests */
+  htsmsg_t *htsp_noaccess;      /* delayed reply, the requests wait */
+  mtimer_t htsp_noaccess_timer;
+  uint8_t htsp_rhdr[4];         /* I/O thread only */
+  uint8_t *htsp_rbuf;
+  uint32_t htsp_rlen;
+  uint32_t htsp_roff;
+  uint8_t *htsp_wbuf;
+  size_t htsp_wlen;
+  size_t htsp_woff;
+
   struct htsp_subscription_list htsp_subscriptions;
   struct htsp_subscription_list htsp_dead_subscriptions;
   struct htsp_file_list htsp_files;
@@ -221,6 +259,40 @@ typedef struct htsp_file {
 
 #define HTSP_DEFAULT_QUEUE_DEPTH 500000
 
+/*
+ * The writer takes several queued messages and sends them with one
+ * writev(). The message headers are serialized to the arena, the
+ * payloads (>= HTSP_WRITE_BINMIN bytes) are referenced, not copied.
+ */
+#define HTSP_WRITE_BATCH  64
+#define HTSP_WRITE_BYTES  (512*1024)
+#define HTSP_WRITE_ARENA  (32*1024)
+#define HTSP_WRITE_IOV    128
+#define HTSP_WRITE_BINMIN 256
+
+/*
+ * Event mode: the connections are multiplexed by config.htsp_io_threads
+ * I/O threads, the requests are processed by config.htsp_io_workers
+ * worker threads
+ */
+#define HTSP_IO_WORKERS   4     /* default */
+#define HTSP_IO_EVENTS    64
+#define HTSP_IO_READS     16    /* reads per event */
+#define HTSP_IO_BATCHES   4     /* write batches per event */
+#define HTSP_IO_REQ_MAX   32    /* queued requests, then the reading stops */
+
+static htsp_io_t *htsp_io_threads;
+static int htsp_io_count;
+static int htsp_io_next;
+static int htsp_io_connections;
+static int htsp_io_running;
+static pthread_t *htsp_workers;
+static int htsp_work_count;
+static tvh_mutex_t htsp_work_mutex;
+static tvh_cond_t htsp_work_cond;
+static TAILQ_HEAD(, htsp_connection) htsp_work_queue;
+static int htsp_work_run;
+
 /* **************************************************************************
  * Support routines
  * *************************************************************************/
@@ -408,6 +480,28 @@ htsp_subscription_free(htsp_connection_t *htsp, htsp_subscription_t *hs)
   free(hs);
 }
 
+/**
+ * Update the polled events (event mode)
+ */
+static void
+htsp_io_update(htsp_connection_t *htsp)
+{
+  int events = TVHPOLL_HUP | TVHPOLL_ERR;
+
+  lock_assert(&htsp->htsp_out_mutex);
+
+  if (htsp->htsp_io_closed)
+    return;
+  if (htsp->htsp_hmq_in.hmq_length < HTSP_IO_REQ_MAX)
+    events |= TVHPOLL_IN;
+  if (htsp->htsp_wlen || !TAILQ_EMPTY(&htsp->htsp_active_output_queues))
+    events |= TVHPOLL_OUT;
+  if (events != htsp->htsp_io_events) {
+    htsp->htsp_io_events = events;
+    tvhpoll_add1(htsp->htsp_io->hio_poll, htsp->htsp_fd, events, htsp);
+  }
+}
+
 /**
  *
  */
@@ -441,7 +535,10 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
 
   hmq->hmq_length++;
   hmq->hmq_payload += payloadsize;
-  tvh_cond_signal(&htsp->htsp_out_cond, 0);
+  if (htsp->htsp_io)
+    htsp_io_update(htsp);
+  else
+    tvh_cond_signal(&htsp->htsp_out_cond, 0);
   tvh_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
@@ -3241,20 +3338,16 @@ htsp_server_status ( void *opaque, htsmsg_t *m )
 }
 
 /**
- *
+ * Session start, returns non-zero when the connection is refused
+ * (negative on error)
  */
 static int
-htsp_read_loop(htsp_connection_t *htsp)
+htsp_connection_open(htsp_connection_t *htsp)
 {
-  htsmsg_t *m = NULL, *reply;
-  int run = 1, r = 0, i, streaming = 0;
-  const char *method;
-  void *tcp_id = NULL;;
-
   if(htsp_generate_challenge(htsp)) {
     tvherror(LS_HTSP, "%s: Unable to generate challenge",
 	     htsp->htsp_logname);
-    return 1;
+    return -1;
   }
 
   tvh_mutex_lock(&global_lock);
@@ -3262,126 +3355,204 @@ htsp_read_loop(htsp_connection_t *htsp)
   htsp->htsp_granted_access = access_get_by_addr(htsp->htsp_peer);
   htsp->htsp_granted_access->aa_rights |= ACCESS_HTSP_INTERFACE;
 
-  tcp_id = tcp_connection_launch(htsp->htsp_fd, streaming, htsp_server_status,
-                                 htsp->htsp_granted_access);
+  htsp->htsp_tcp_id = tcp_connection_launch(htsp->htsp_fd, 0, htsp_server_status,
+                                            htsp->htsp_granted_access);
 
   tvh_mutex_unlock(&global_lock);
 
-  if (tcp_id == NULL)
-    return 0;
+  if (htsp->htsp_tcp_id == NULL)
+    return 1;
 
   tvhinfo(LS_HTSP, "Got connection from %s", htsp->htsp_logname);
+  return 0;
+}
 
-  /* Session main loop */
+/**
+ *
+ */
+static void
+htsp_connection_close(htsp_connection_t *htsp)
+{
+  tvh_mutex_lock(&global_lock);
+  tcp_connection_land(htsp->htsp_tcp_id);
+  htsp->htsp_tcp_id = NULL;
+  tvh_mutex_unlock(&global_lock);
+}
 
-  while(run && tvheadend_is_running()) {
-readmsg:
-    reply = NULL;
+/**
+ * Send the delayed noaccess reply, then continue with the requests
+ */
+static void
+htsp_noaccess_cb(void *aux)
+{
+  htsp_connection_t *htsp = aux;
+  htsmsg_t *reply;
 
-    if((r = htsp_read_message(htsp, &m, 0)) != 0)
-      break;
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  reply = htsp->htsp_noaccess;
+  htsp->htsp_noaccess = NULL;
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
 
-    tvh_mutex_lock(&global_lock);
-    if (htsp_authenticate(htsp, m)) {
-      tcp_connection_land(tcp_id);
-      tcp_id = tcp_connection_launch(htsp->htsp_fd, streaming, htsp_server_status,
-                                     htsp->htsp_granted_access);
-      if (tcp_id == NULL) {
-        reply = htsmsg_create_map();
-        htsmsg_add_u32(reply, "noaccess", 1);
-        htsmsg_add_u32(reply, "connlimit", 1);
-        run = 0;
-        goto send_reply_with_unlock;
-      }
-    }
+  if (reply)
+    htsp_send_message(htsp, reply, NULL);
 
-    if((method = htsmsg_get_str(m, "method")) != NULL) {
-      tvhtrace(LS_HTSP, "%s - method %s", htsp->htsp_logname, method);
-      if (tvhtrace_enabled())
-        htsp_trace(htsp, LS_HTSP_REQ, "request", m);
-      for(i = 0; i < NUM_METHODS; i++) {
-        if(!strcmp(method, htsp_methods[i].name)) {
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  if (htsp->htsp_hmq_in.hmq_length)
+    htsp_io_schedule(htsp);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+}
 
-          if((htsp->htsp_granted_access->aa_rights &
-              htsp_methods[i].privmask) !=
-                htsp_methods[i].privmask) {
+/**
+ * Event mode: delay the noaccess reply and the next requests
+ */
+static void
+htsp_noaccess_delay(htsp_connection_t *htsp, htsmsg_t *in, htsmsg_t *out)
+{
+  uint32_t seq;
 
-      	    tvh_mutex_unlock(&global_lock);
-            /* Classic authentication failed delay */
-            tvh_safe_usleep(250000);
+  lock_assert(&global_lock);
 
-            reply = htsmsg_create_map();
-            htsmsg_add_u32(reply, "noaccess", 1);
-            htsp_reply(htsp, m, reply);
+  if(!htsmsg_get_u32(in, "seq", &seq))
+    htsmsg_add_u32(out, "seq", seq);
 
-            htsmsg_destroy(m);
-            goto readmsg;
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsmsg_destroy(htsp->htsp_noaccess);
+  htsp->htsp_noaccess = out;
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+  mtimer_arm_rel(&htsp->htsp_noaccess_timer, htsp_noaccess_cb, htsp,
+                 ms2mono(250));
+}
+
+/**
+ * Process one request, returns zero when the session should end
+ */
+static int
+htsp_process_message(htsp_connection_t *htsp, htsmsg_t *m)
+{
+  htsmsg_t *reply = NULL;
+  int run = 1, i;
+  const char *method;
+
+  tvh_mutex_lock(&global_lock);
+  if (htsp_authenticate(htsp, m)) {
+    tcp_connection_land(htsp->htsp_tcp_id);
+    htsp->htsp_tcp_id = tcp_connection_launch(htsp->htsp_fd, htsp->htsp_streaming,
+                                              htsp_server_status,
+                                              htsp->htsp_granted_access);
+    if (htsp->htsp_tcp_id == NULL) {
+      reply = htsmsg_create_map();
+      htsmsg_add_u32(reply, "noaccess", 1);
+      htsmsg_add_u32(reply, "connlimit", 1);
+      run = 0;
+      goto send_reply_with_unlock;
+    }
+  }
 
+  if((method = htsmsg_get_str(m, "method")) != NULL) {
+    tvhtrace(LS_HTSP, "%s - method %s", htsp->htsp_logname, method);
+    if (tvhtrace_enabled())
+      htsp_trace(htsp, LS_HTSP_REQ, "request", m);
+    for(i = 0; i < NUM_METHODS; i++) {
+      if(!strcmp(method, htsp_methods[i].name)) {
+
+        if((htsp->htsp_granted_access->aa_rights &
+            htsp_methods[i].privmask) !=
+              htsp_methods[i].privmask) {
+
+          reply = htsmsg_create_map();
+          htsmsg_add_u32(reply, "noaccess", 1);
+
+          /* Classic authentication failed delay */
+          if (htsp->htsp_io) {
+            /* Do not block the shared worker, the timer sends the reply */
+            htsp_noaccess_delay(htsp, m, reply);
+            tvh_mutex_unlock(&global_lock);
           } else {
-            if (!strcmp(method, "subscribe") && !streaming) {
-              tcp_connection_land(tcp_id);
-              tcp_id = tcp_connection_launch(htsp->htsp_fd, 1, htsp_server_status,
-                                             htsp->htsp_granted_access);
-              if (tcp_id == NULL) {
-                reply = htsmsg_create_map();
-                htsmsg_add_u32(reply, "noaccess", 1);
-                htsmsg_add_u32(reply, "connlimit", 1);
-                goto send_reply_with_unlock;
-              }
-              streaming = 1;
+            tvh_mutex_unlock(&global_lock);
+            tvh_safe_usleep(250000);
+            htsp_reply(htsp, m, reply);
+          }
+
+          htsmsg_destroy(m);
+          return 1;
+
+        } else {
+          if (!strcmp(method, "subscribe") && !htsp->htsp_streaming) {
+            tcp_connection_land(htsp->htsp_tcp_id);
+            htsp->htsp_tcp_id = tcp_connection_launch(htsp->htsp_fd, 1,
+                                                      htsp_server_status,
+                                                      htsp->htsp_granted_access);
+            if (htsp->htsp_tcp_id == NULL) {
+              reply = htsmsg_create_map();
+              htsmsg_add_u32(reply, "noaccess", 1);
+              htsmsg_add_u32(reply, "connlimit", 1);
+              goto send_reply_with_unlock;
             }
-            reply = htsp_methods[i].fn(htsp, m);
+            htsp->htsp_streaming = 1;
           }
-          break;
+          reply = htsp_methods[i].fn(htsp, m);
         }
+        break;
       }
+    }
 
-      if(i == NUM_METHODS) {
-        reply = htsp_error(htsp, N_("Method not found"));
-      }
-
-    } else {
-      reply = htsp_error(htsp, N_("Invalid arguments"));
+    if(i == NUM_METHODS) {
+      reply = htsp_error(htsp, N_("Method not found"));
     }
 
+  } else {
+    reply = htsp_error(htsp, N_("Invalid arguments"));
+  }
+
 send_reply_with_unlock:
-    tvh_mutex_unlock(&global_lock);
+  tvh_mutex_unlock(&global_lock);
+
+  if(reply != NULL) /* Methods can do all the replying inline */
+    htsp_reply(htsp, m, reply);
+
+  htsmsg_destroy(m);
+  return run;
+}
+
+/**
+ *
+ */
+static int
+htsp_read_loop(htsp_connection_t *htsp)
+{
+  htsmsg_t *m = NULL;
+  int run = 1, r = 0;
+
+  if ((r = htsp_connection_open(htsp)) != 0)
+    return r < 0;
 
-    if(reply != NULL) /* Methods can do all the replying inline */
-      htsp_reply(htsp, m, reply);
+  /* Session main loop */
 
-    htsmsg_destroy(m);
+  while(run && tvheadend_is_running()) {
+    if((r = htsp_read_message(htsp, &m, 0)) != 0)
+      break;
+    run = htsp_process_message(htsp, m);
   }
 
-  tvh_mutex_lock(&global_lock);
-  tcp_connection_land(tcp_id);
-  tvh_mutex_unlock(&global_lock);
+  htsp_connection_close(htsp);
   return tvheadend_is_running() ? r : 0;
 }
 
 /**
- *
+ * Take a batch of messages, the queue scheduling is kept per message
  */
-static void *
-htsp_write_scheduler(void *aux)
+static int
+htsp_write_dequeue(htsp_connection_t *htsp, htsp_msg_t **hms)
 {
-  htsp_connection_t *htsp = aux;
   htsp_msg_q_t *hmq;
   htsp_msg_t *hm;
-  void *dptr;
-  size_t dlen;
-  int r;
+  size_t bytes = 0;
+  int n = 0;
 
-  tvh_mutex_lock(&htsp->htsp_out_mutex);
-
-  while(htsp->htsp_writer_run) {
-
-    if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL) {
-      /* Nothing to be done, go to sleep */
-      tvh_cond_wait(&htsp->htsp_out_cond, &htsp->htsp_out_mutex);
-      continue;
-    }
+  lock_assert(&htsp->htsp_out_mutex);
 
+  while (n < HTSP_WRITE_BATCH && bytes < HTSP_WRITE_BYTES &&
+         (hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) != NULL) {
     hm = TAILQ_FIRST(&hmq->hmq_q);
     TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
     hmq->hmq_length--;
@@ -3396,22 +3567,169 @@ htsp_write_scheduler(void *aux)
         TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
       }
     }
+    hms[n++] = hm;
+    bytes += hm->hm_payloadsize;
+  }
+  return n;
+}
 
-    tvh_mutex_unlock(&htsp->htsp_out_mutex);
+/**
+ * Non-blocking write for the event mode, the rest which cannot be
+ * written now is copied to the connection buffer
+ */
+static int
+htsp_io_writev(htsp_connection_t *htsp, struct iovec *iov, int cnt)
+{
+  ssize_t r;
+  size_t len;
+  uint8_t *p;
+  int i;
 
-    if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
-      tvhwarn(LS_HTSP, "%s: failed to serialize data", htsp->htsp_logname);
-      htsp_msg_destroy(hm);
-      tvh_mutex_lock(&htsp->htsp_out_mutex);
+  while (cnt > 0 && htsp->htsp_wlen == 0) {
+    r = writev(htsp->htsp_fd, iov, cnt);  /* cnt <= HTSP_WRITE_IOV */
+    if (r < 0) {
+      if (ERRNO_AGAIN(errno))
+        break;
+      return 1;
+    }
+    while (cnt > 0 && (size_t)r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  for (i = 0, len = 0; i < cnt; i++)
+    len += iov[i].iov_len;
+  if (len == 0)
+    return 0;
+  if ((p = realloc(htsp->htsp_wbuf, htsp->htsp_wlen + len)) == NULL) {
+    errno = ENOMEM;
+    return 1;
+  }
+  htsp->htsp_wbuf = p;
+  for (i = 0, p += htsp->htsp_wlen; i < cnt; i++) {
+    memcpy(p, iov[i].iov_base, iov[i].iov_len);
+    p += iov[i].iov_len;
+  }
+  htsp->htsp_wlen += len;
+  return 0;
+}
+
+/**
+ * Write the I/O vector, then release the messages (the vector
+ * references their payloads) and the separately serialized data
+ */
+static int
+htsp_write_iov(htsp_connection_t *htsp, struct iovec *iov, int cnt,
+               htsp_msg_t **hms, int n, void **dptr, int ndptr)
+{
+  int r = 0, err;
+
+  if (cnt > 0)
+    r = htsp->htsp_io ? htsp_io_writev(htsp, iov, cnt) :
+                        tvh_writev(htsp->htsp_fd, iov, cnt);
+  err = errno;
+  while (n > 0)
+    htsp_msg_destroy(hms[--n]);
+  while (ndptr > 0)
+    free(dptr[--ndptr]);
+  errno = err;
+  return r;
+}
+
+/**
+ * Serialize and write the batch, the messages are released
+ */
+static int
+htsp_write_batch(htsp_connection_t *htsp, uint8_t *arena,
+                 htsp_msg_t **hms, int n)
+{
+  htsp_msg_t *hm;
+  struct iovec iov[HTSP_WRITE_IOV];
+  void *dptr[HTSP_WRITE_BATCH], *d;
+  size_t dlen, used = 0;
+  int i, k, r = 0, cnt = 0, done = 0, ndptr = 0;
+
+  for (i = 0; i < n; i++) {
+    hm = hms[i];
+    dlen = HTSP_WRITE_ARENA - used;
+    k = arena ? htsmsg_binary_serialize_iov(hm->hm_msg, iov + cnt,
+                                            HTSP_WRITE_IOV - cnt,
+                                            arena + used, &dlen,
+                                            HTSP_WRITE_BINMIN) : -1;
+    if (k < 0 && cnt > 0) {
+      /* The arena or the vector is full */
+      r = htsp_write_iov(htsp, iov, cnt, hms + done, i - done, dptr, ndptr);
+      cnt = ndptr = 0;
+      used = 0;
+      done = i;
+      if (r)
+        break;
+      dlen = HTSP_WRITE_ARENA;
+      k = arena ? htsmsg_binary_serialize_iov(hm->hm_msg, iov,
+                                              HTSP_WRITE_IOV, arena, &dlen,
+                                              HTSP_WRITE_BINMIN) : -1;
+    }
+    if (k < 0) {
+      /* Too big for the arena */
+      if (htsmsg_binary_serialize(hm->hm_msg, &d, &dlen, INT32_MAX) != 0) {
+        tvhwarn(LS_HTSP, "%s: failed to serialize data", htsp->htsp_logname);
+        continue;
+      }
+      dptr[ndptr++] = d;
+      iov[cnt].iov_base = d;
+      iov[cnt++].iov_len = dlen;
       continue;
     }
+    if (cnt > 0 && (uint8_t *)iov[cnt-1].iov_base + iov[cnt-1].iov_len ==
+                   (uint8_t *)iov[cnt].iov_base) {
+      /* Continues the previous message in the arena */
+      iov[cnt-1].iov_len += iov[cnt].iov_len;
+      memmove(iov + cnt, iov + cnt + 1, (k - 1) * sizeof(*iov));
+      k--;
+    }
+    cnt += k;
+    used += dlen;
+  }
 
-    htsp_msg_destroy(hm);
+  k = htsp_write_iov(htsp, iov, r ? 0 : cnt, hms + done, n - done,
+                     dptr, ndptr);
+  return r ?: k;
+}
+
+/**
+ *
+ */
+static void *
+htsp_write_scheduler(void *aux)
+{
+  htsp_connection_t *htsp = aux;
+  htsp_msg_t *hms[HTSP_WRITE_BATCH];
+  uint8_t arena[HTSP_WRITE_ARENA];  /* lives as long as the writer */
+  int n, r;
+
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+
+  while(htsp->htsp_writer_run) {
+
+    if(TAILQ_EMPTY(&htsp->htsp_active_output_queues)) {
+      /* Nothing to be done, go to sleep */
+      tvh_cond_wait(&htsp->htsp_out_cond, &htsp->htsp_out_mutex);
+      continue;
+    }
+
+    n = htsp_write_dequeue(htsp, hms);
+
+    tvh_mutex_unlock(&htsp->htsp_out_mutex);
+
+    r = htsp_write_batch(htsp, arena, hms, n);
 
-    r = tvh_write(htsp->htsp_fd, dptr, dlen);
-    free(dptr);
     tvh_mutex_lock(&htsp->htsp_out_mutex);
-    
+
     if (r) {
       tvhinfo(LS_HTSP, "%s: Write error -- %s",
               htsp->htsp_logname, strerror(errno));
@@ -3429,112 +3747,549 @@ htsp_write_scheduler(void *aux)
  *
  */
 static void
-htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
-	   struct sockaddr_storage *self)
+htsp_connection_init(htsp_connection_t *htsp, int fd,
+                     struct sockaddr_storage *source)
 {
-  htsp_connection_t htsp;
   char buf[50];
-  htsp_subscription_t *s;
-  
-  // Note: global_lock held on entry
+
+  lock_assert(&global_lock);
 
   if (config.dscp >= 0)
     socket_set_dscp(fd, config.dscp, NULL, 0);
 
   tcp_get_str_from_ip(source, buf, 50);
 
-  memset(&htsp, 0, sizeof(htsp_connection_t));
-  *opaque = &htsp;
-
-  TAILQ_INIT(&htsp.htsp_active_output_queues);
-
-  htsp_init_queue(&htsp.htsp_hmq_ctrl, 0);
-  htsp_init_queue(&htsp.htsp_hmq_qstatus, 1);
-  htsp_init_queue(&htsp.htsp_hmq_epg, 0);
+  TAILQ_INIT(&htsp->htsp_active_output_queues);
 
-  htsp.htsp_peername = strdup(buf);
-  htsp_update_logname(&htsp);
+  htsp_init_queue(&htsp->htsp_hmq_ctrl, 0);
+  htsp_init_queue(&htsp->htsp_hmq_qstatus, 1);
+  htsp_init_queue(&htsp->htsp_hmq_epg, 0);
+  htsp_init_queue(&htsp->htsp_hmq_in, 0);
 
-  htsp.htsp_fd = fd;
-  htsp.htsp_peer = source;
-  htsp.htsp_writer_run = 1;
+  htsp->htsp_peername = strdup(buf);
+  htsp_update_logname(htsp);
 
-  tvh_mutex_init(&htsp.htsp_out_mutex, NULL);
+  htsp->htsp_fd = fd;
+  htsp->htsp_peer = source;
+  htsp->htsp_writer_run = 1;
 
-  LIST_INSERT_HEAD(&htsp_connections, &htsp, htsp_link);
-  tvh_mutex_unlock(&global_lock);
+  tvh_mutex_init(&htsp->htsp_out_mutex, NULL);
 
-  tvh_thread_create(&htsp.htsp_writer_thread, NULL,
-                    htsp_write_scheduler, &htsp, "htsp-write");
-
-  /**
-   * Reader loop
-   */
-
-  htsp_read_loop(&htsp);
+  LIST_INSERT_HEAD(&htsp_connections, htsp, htsp_link);
+}
 
-  tvhinfo(LS_HTSP, "%s: Disconnected", htsp.htsp_logname);
+/**
+ * Ok, we're back, other end disconnected. Clean up stuff.
+ * Returns with global_lock held.
+ */
+static void
+htsp_connection_done(htsp_connection_t *htsp)
+{
+  htsp_subscription_t *s;
+  htsp_msg_q_t *hmq;
+  htsp_msg_t *hm;
+  htsp_file_t *hf;
 
-  /**
-   * Ok, we're back, other end disconnected. Clean up stuff.
-   */
+  tvhinfo(LS_HTSP, "%s: Disconnected", htsp->htsp_logname);
 
   tvh_mutex_lock(&global_lock);
 
   /* no async notifications from now */
-  if(htsp.htsp_async_mode)
-    LIST_REMOVE(&htsp, htsp_async_link);
+  if(htsp->htsp_async_mode)
+    LIST_REMOVE(htsp, htsp_async_link);
 
-  mtimer_disarm(&htsp.htsp_epg_timer);
+  mtimer_disarm(&htsp->htsp_epg_timer);
+  mtimer_disarm(&htsp->htsp_noaccess_timer);
+  htsmsg_destroy(htsp->htsp_noaccess);
+  htsp->htsp_noaccess = NULL;
 
   /* deregister this client */
-  LIST_REMOVE(&htsp, htsp_link);
+  LIST_REMOVE(htsp, htsp_link);
 
   /* Beware! Closing subscriptions will invoke a lot of callbacks
      down in the streaming code. So we do this as early as possible
      to avoid any weird lockups */
-  while((s = LIST_FIRST(&htsp.htsp_subscriptions)) != NULL)
-    htsp_subscription_destroy(&htsp, s);
+  while((s = LIST_FIRST(&htsp->htsp_subscriptions)) != NULL)
+    htsp_subscription_destroy(htsp, s);
 
   tvh_mutex_unlock(&global_lock);
 
-  tvh_mutex_lock(&htsp.htsp_out_mutex);
-  htsp.htsp_writer_run = 0;
-  tvh_cond_signal(&htsp.htsp_out_cond, 0);
-  tvh_mutex_unlock(&htsp.htsp_out_mutex);
-
-  pthread_join(htsp.htsp_writer_thread, NULL);
+  if (htsp->htsp_io == NULL) {
+    tvh_mutex_lock(&htsp->htsp_out_mutex);
+    htsp->htsp_writer_run = 0;
+    tvh_cond_signal(&htsp->htsp_out_cond, 0);
+    tvh_mutex_unlock(&htsp->htsp_out_mutex);
 
-  while((s = LIST_FIRST(&htsp.htsp_dead_subscriptions)) != NULL)
-    htsp_subscription_free(&htsp, s);
+    pthread_join(htsp->htsp_writer_thread, NULL);
+  }
 
-  htsp_msg_q_t *hmq;
+  while((s = LIST_FIRST(&htsp->htsp_dead_subscriptions)) != NULL)
+    htsp_subscription_free(htsp, s);
 
-  TAILQ_FOREACH(hmq, &htsp.htsp_active_output_queues, hmq_link) {
-    htsp_msg_t *hm;
+  TAILQ_FOREACH(hmq, &htsp->htsp_active_output_queues, hmq_link) {
     while((hm = TAILQ_FIRST(&hmq->hmq_q)) != NULL) {
       TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
       htsp_msg_destroy(hm);
     }
   }
 
-  htsp_file_t *hf;
-  while((hf = LIST_FIRST(&htsp.htsp_files)) != NULL)
+  while((hm = TAILQ_FIRST(&htsp->htsp_hmq_in.hmq_q)) != NULL) {
+    TAILQ_REMOVE(&htsp->htsp_hmq_in.hmq_q, hm, hm_link);
+    htsp_msg_destroy(hm);
+  }
+
+  while((hf = LIST_FIRST(&htsp->htsp_files)) != NULL)
     htsp_file_destroy(hf);
 
-  close(fd);
-  
+  close(htsp->htsp_fd);
+
   /* Free memory (leave lock in place, for parent method) */
   tvh_mutex_lock(&global_lock);
-  free(htsp.htsp_logname);
-  free(htsp.htsp_peername);
-  free(htsp.htsp_username);
-  free(htsp.htsp_clientname);
-  free(htsp.htsp_language);
-  access_destroy(htsp.htsp_granted_access);
+  free(htsp->htsp_logname);
+  free(htsp->htsp_peername);
+  free(htsp->htsp_username);
+  free(htsp->htsp_clientname);
+  free(htsp->htsp_language);
+  free(htsp->htsp_wbuf);
+  free(htsp->htsp_rbuf);
+  access_destroy(htsp->htsp_granted_access);
+}
+
+/**
+ *
+ */
+static void
+htsp_serve(int fd, void **opaque, struct sockaddr_storage *source,
+	   struct sockaddr_storage *self)
+{
+  htsp_connection_t htsp;
+
+  // Note: global_lock held on entry
+
+  memset(&htsp, 0, sizeof(htsp_connection_t));
+  *opaque = &htsp;
+
+  htsp_connection_init(&htsp, fd, source);
+  tvh_mutex_unlock(&global_lock);
+
+  tvh_thread_create(&htsp.htsp_writer_thread, NULL,
+                    htsp_write_scheduler, &htsp, "htsp-write");
+
+  /**
+   * Reader loop
+   */
+
+  htsp_read_loop(&htsp);
+
+  htsp_connection_done(&htsp);
   *opaque = NULL;
 }
 
+/* **************************************************************************
+ * Event mode
+ *
+ * The sockets are non-blocking and multiplexed by a fixed number of I/O
+ * threads. The I/O thread reads the requests to the connection input
+ * queue and writes the output queues (same scheduling as the writer
+ * thread). The requests are processed by the worker threads, one
+ * worker at a time per connection, so the request order is kept.
+ * The connection is always closed by its I/O thread (the workers and
+ * the cancel callback only shut down the socket), then the worker
+ * cleans it up.
+ * *************************************************************************/
+
+/**
+ * Queue the connection for a worker
+ */
+static void
+htsp_io_schedule(htsp_connection_t *htsp)
+{
+  lock_assert(&htsp->htsp_out_mutex);
+
+  if (htsp->htsp_io_queued)
+    return;
+  htsp->htsp_io_queued = 1;
+  tvh_mutex_lock(&htsp_work_mutex);
+  TAILQ_INSERT_TAIL(&htsp_work_queue, htsp, htsp_work_link);
+  tvh_cond_signal(&htsp_work_cond, 0);
+  tvh_mutex_unlock(&htsp_work_mutex);
+}
+
+/**
+ * Read the requests, returns non-zero when the connection should be closed
+ */
+static int
+htsp_io_read(htsp_connection_t *htsp)
+{
+  htsp_msg_t *hm;
+  htsmsg_t *m;
+  ssize_t r;
+  uint32_t len;
+  int i;
+
+  for (i = 0; i < HTSP_IO_READS; i++) {
+    if (htsp->htsp_rbuf == NULL) {
+      r = read(htsp->htsp_fd, htsp->htsp_rhdr + htsp->htsp_roff,
+               4 - htsp->htsp_roff);
+    } else {
+      r = read(htsp->htsp_fd, htsp->htsp_rbuf + htsp->htsp_roff,
+               htsp->htsp_rlen - htsp->htsp_roff);
+    }
+    if (r < 0)
+      return ERRNO_AGAIN(errno) ? 0 : errno;
+    if (r == 0 && (htsp->htsp_rbuf == NULL || htsp->htsp_rlen > 0))
+      return ECONNRESET;
+    htsp->htsp_roff += r;
+
+    if (htsp->htsp_rbuf == NULL) {
+      if (htsp->htsp_roff < 4)
+        continue;
+      len = (htsp->htsp_rhdr[0] << 24) | (htsp->htsp_rhdr[1] << 16) |
+            (htsp->htsp_rhdr[2] << 8) | htsp->htsp_rhdr[3];
+      if (len > 1024 * 1024)
+        return EMSGSIZE;
+      if ((htsp->htsp_rbuf = malloc(len)) == NULL)
+        return ENOMEM;
+      htsp->htsp_rlen = len;
+      htsp->htsp_roff = 0;
+    }
+    if (htsp->htsp_roff < htsp->htsp_rlen)
+      continue;
+
+    /* buf will be tied to the message (on success) */
+    /* bellow fcn calls free(buf) (on failure) */
+    m = htsmsg_binary_deserialize0(htsp->htsp_rbuf, htsp->htsp_rlen,
+                                   htsp->htsp_rbuf);
+    htsp->htsp_rbuf = NULL;
+    htsp->htsp_rlen = htsp->htsp_roff = 0;
+    if (m == NULL)
+      return EBADMSG;
+
+    hm = calloc(1, sizeof(*hm));
+    hm->hm_msg = m;
+    tvh_mutex_lock(&htsp->htsp_out_mutex);
+    TAILQ_INSERT_TAIL(&htsp->htsp_hmq_in.hmq_q, hm, hm_link);
+    htsp->htsp_hmq_in.hmq_length++;
+    htsp_io_schedule(htsp);
+    if (htsp->htsp_hmq_in.hmq_length >= HTSP_IO_REQ_MAX) {
+      /* Too many requests, stop reading */
+      htsp_io_update(htsp);
+      tvh_mutex_unlock(&htsp->htsp_out_mutex);
+      break;
+    }
+    tvh_mutex_unlock(&htsp->htsp_out_mutex);
+  }
+  return 0;
+}
+
+/**
+ * Write the output queues, returns non-zero when the connection
+ * should be closed
+ */
+static int
+htsp_io_write(htsp_io_t *hio, htsp_connection_t *htsp)
+{
+  htsp_msg_t *hms[HTSP_WRITE_BATCH];
+  ssize_t r;
+  int i, n;
+
+  if (htsp->htsp_wlen) {
+    r = write(htsp->htsp_fd, htsp->htsp_wbuf + htsp->htsp_woff,
+              htsp->htsp_wlen - htsp->htsp_woff);
+    if (r < 0) {
+      if (ERRNO_AGAIN(errno))
+        return 0;
+      goto error;
+    }
+    htsp->htsp_woff += r;
+    if (htsp->htsp_woff < htsp->htsp_wlen)
+      return 0;
+    free(htsp->htsp_wbuf);
+    htsp->htsp_wbuf = NULL;
+    htsp->htsp_wlen = htsp->htsp_woff = 0;
+  }
+
+  for (i = 0; i < HTSP_IO_BATCHES; i++) {
+    tvh_mutex_lock(&htsp->htsp_out_mutex);
+    n = htsp_write_dequeue(htsp, hms);
+    if (n == 0) {
+      /* All written, stop polling for output */
+      htsp_io_update(htsp);
+      tvh_mutex_unlock(&htsp->htsp_out_mutex);
+      return 0;
+    }
+    tvh_mutex_unlock(&htsp->htsp_out_mutex);
+    if (htsp_write_batch(htsp, hio->hio_arena, hms, n))
+      goto error;
+    if (htsp->htsp_wlen)
+      return 0;
+  }
+  return 0;
+
+error:
+  tvhinfo(LS_HTSP, "%s: Write error -- %s",
+          htsp->htsp_logname, strerror(errno));
+  return errno ?: EIO;
+}
+
+/**
+ * The connection is removed from the I/O thread, the worker cleans it up
+ */
+static void
+htsp_io_close(htsp_io_t *hio, htsp_connection_t *htsp)
+{
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_io_closed = 1;   /* no poll updates from now */
+  tvhpoll_rem1(hio->hio_poll, htsp->htsp_fd);
+  shutdown(htsp->htsp_fd, SHUT_RDWR);
+  htsp_io_schedule(htsp);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
+/**
+ *
+ */
+static void *
+htsp_io_thread(void *aux)
+{
+  htsp_io_t *hio = aux;
+  htsp_connection_t *htsp;
+  tvhpoll_event_t ev[HTSP_IO_EVENTS];
+  int i, n, r;
+  char c;
+
+  while (atomic_get(&htsp_io_running)) {
+    n = tvhpoll_wait(hio->hio_poll, ev, HTSP_IO_EVENTS, -1);
+    if (n < 0) {
+      if (ERRNO_AGAIN(errno))
+        continue;
+      tvherror(LS_HTSP, "htsp_io_thread: tvhpoll_wait: %s", strerror(errno));
+      continue;
+    }
+    for (i = 0; i < n; i++) {
+      if (ev[i].ptr == &hio->hio_pipe) {
+        while (read(hio->hio_pipe.rd, &c, 1) > 0);
+        continue;
+      }
+      htsp = ev[i].ptr;
+      r = 0;
+      if (ev[i].events & (TVHPOLL_IN | TVHPOLL_HUP | TVHPOLL_ERR))
+        r = htsp_io_read(htsp);
+      if (r == 0 && (ev[i].events & (TVHPOLL_HUP | TVHPOLL_ERR)))
+        r = ECONNRESET;
+      if (r == 0 && (ev[i].events & TVHPOLL_OUT))
+        r = htsp_io_write(hio, htsp);
+      if (r)
+        htsp_io_close(hio, htsp);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Process the connection (the first request, the session start
+ * or the cleanup), the caller is the only worker for the connection
+ */
+static void
+htsp_io_work(htsp_connection_t *htsp)
+{
+  htsp_msg_t *hm;
+  htsmsg_t *m = NULL;
+
+  if (!htsp->htsp_io_opened) {
+    htsp->htsp_io_opened = 1;
+    if (htsp_connection_open(htsp)) {
+      htsp->htsp_io_stop = 1;
+      shutdown(htsp->htsp_fd, SHUT_RDWR);
+    }
+  }
+
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  if (htsp->htsp_io_closed) {
+    tvh_mutex_unlock(&htsp->htsp_out_mutex);
+    if (htsp->htsp_tcp_id)
+      htsp_connection_close(htsp);
+    htsp_connection_done(htsp);
+    tcp_server_detach(htsp);
+    htsp_io_connections--;
+    tvh_mutex_unlock(&global_lock);
+    tvh_mutex_destroy(&htsp->htsp_out_mutex);
+    free(htsp);
+    return;
+  }
+  if (htsp->htsp_noaccess == NULL &&
+      (hm = TAILQ_FIRST(&htsp->htsp_hmq_in.hmq_q)) != NULL) {
+    TAILQ_REMOVE(&htsp->htsp_hmq_in.hmq_q, hm, hm_link);
+    if (htsp->htsp_hmq_in.hmq_length-- == HTSP_IO_REQ_MAX)
+      htsp_io_update(htsp);
+    m = hm->hm_msg;
+    free(hm);
+  }
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+
+  if (m) {
+    if (htsp->htsp_io_stop || !tvheadend_is_running()) {
+      htsmsg_destroy(m);
+    } else if (!htsp_process_message(htsp, m)) {
+      htsp->htsp_io_stop = 1;
+      shutdown(htsp->htsp_fd, SHUT_RDWR);
+    }
+  }
+
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp->htsp_io_queued = 0;
+  if (htsp->htsp_io_closed ||
+      (htsp->htsp_hmq_in.hmq_length && htsp->htsp_noaccess == NULL))
+    htsp_io_schedule(htsp);
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+}
+
+/**
+ *
+ */
+static void *
+htsp_io_worker(void *aux)
+{
+  htsp_connection_t *htsp;
+
+  tvh_mutex_lock(&htsp_work_mutex);
+  while (htsp_work_run) {
+    if ((htsp = TAILQ_FIRST(&htsp_work_queue)) == NULL) {
+      tvh_cond_wait(&htsp_work_cond, &htsp_work_mutex);
+      continue;
+    }
+    TAILQ_REMOVE(&htsp_work_queue, htsp, htsp_work_link);
+    tvh_mutex_unlock(&htsp_work_mutex);
+    htsp_io_work(htsp);
+    tvh_mutex_lock(&htsp_work_mutex);
+  }
+  tvh_mutex_unlock(&htsp_work_mutex);
+  return NULL;
+}
+
+/**
+ * New connection for the event mode
+ */
+static int
+htsp_attach(int fd, void **opaque, struct sockaddr_storage *source,
+            struct sockaddr_storage *self)
+{
+  htsp_connection_t *htsp;
+  int flags;
+
+  lock_assert(&global_lock);
+
+  if (htsp_io_count == 0)
+    return -1;
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -1;
+
+  htsp = calloc(1, sizeof(*htsp));
+  htsp_connection_init(htsp, fd, source);
+  htsp->htsp_io = &htsp_io_threads[htsp_io_next++ % htsp_io_count];
+  htsp_io_connections++;
+  *opaque = htsp;
+
+  tvh_mutex_lock(&htsp->htsp_out_mutex);
+  htsp_io_update(htsp);
+  htsp_io_schedule(htsp);     /* the session start */
+  tvh_mutex_unlock(&htsp->htsp_out_mutex);
+  return 0;
+}
+
+/**
+ *
+ */
+static void
+htsp_io_init(void)
+{
+  htsp_io_t *hio;
+  int i;
+
+  htsp_io_count = MINMAX(config.htsp_io_threads, 0, 64);
+  if (htsp_io_count == 0)
+    return;
+
+  TAILQ_INIT(&htsp_work_queue);
+  tvh_mutex_init(&htsp_work_mutex, NULL);
+  tvh_cond_init(&htsp_work_cond, 1);
+  htsp_work_run = 1;
+  atomic_set(&htsp_io_running, 1);
+
+  htsp_io_threads = calloc(htsp_io_count, sizeof(htsp_io_t));
+  for (i = 0; i < htsp_io_count; i++) {
+    hio = &htsp_io_threads[i];
+    hio->hio_arena = malloc(HTSP_WRITE_ARENA);
+    hio->hio_poll = tvhpoll_create(HTSP_IO_EVENTS);
+    tvh_pipe(O_NONBLOCK, &hio->hio_pipe);
+    tvhpoll_add1(hio->hio_poll, hio->hio_pipe.rd, TVHPOLL_IN, &hio->hio_pipe);
+    tvh_thread_create(&hio->hio_thread, NULL, htsp_io_thread, hio, "htsp-io");
+  }
+  htsp_work_count = MINMAX(config.htsp_io_workers ?: HTSP_IO_WORKERS, 1, 64);
+  htsp_workers = calloc(htsp_work_count, sizeof(pthread_t));
+  for (i = 0; i < htsp_work_count; i++)
+    tvh_thread_create(&htsp_workers[i], NULL, htsp_io_worker, NULL, "htsp-work");
+
+  tvhinfo(LS_HTSP, "event mode with %d I/O threads and %d workers",
+          htsp_io_count, htsp_work_count);
+}
+
+/**
+ *
+ */
+static void
+htsp_io_done(void)
+{
+  htsp_connection_t *htsp;
+  htsp_io_t *hio;
+  int64_t t;
+  char c = 'E';
+  int i;
+
+  if (htsp_io_count == 0)
+    return;
+
+  tvh_mutex_lock(&global_lock);
+  LIST_FOREACH(htsp, &htsp_connections, htsp_link)
+    if (htsp->htsp_io)
+      shutdown(htsp->htsp_fd, SHUT_RDWR);
+  t = mclk();
+  while (htsp_io_connections > 0) {
+    if (t + sec2mono(5) < mclk())
+      tvhtrace(LS_HTSP, "%d connections active too long", htsp_io_connections);
+    tvh_mutex_unlock(&global_lock);
+    tvh_safe_usleep(20000);
+    tvh_mutex_lock(&global_lock);
+  }
+  tvh_mutex_unlock(&global_lock);
+
+  atomic_set(&htsp_io_running, 0);
+  for (i = 0; i < htsp_io_count; i++) {
+    hio = &htsp_io_threads[i];
+    tvh_write(hio->hio_pipe.wr, &c, 1);
+    pthread_join(hio->hio_thread, NULL);
+    tvhpoll_destroy(hio->hio_poll);
+    tvh_pipe_close(&hio->hio_pipe);
+    free(hio->hio_arena);
+  }
+
+  tvh_mutex_lock(&htsp_work_mutex);
+  htsp_work_run = 0;
+  tvh_cond_signal(&htsp_work_cond, 1);
+  tvh_mutex_unlock(&htsp_work_mutex);
+  for (i = 0; i < htsp_work_count; i++)
+    pthread_join(htsp_workers[i], NULL);
+  free(htsp_workers);
+  htsp_workers = NULL;
+  htsp_work_count = 0;
+
+  free(htsp_io_threads);
+  htsp_io_threads = NULL;
+  htsp_io_count = 0;
+}
+
 /*
  * Cancel callback
  */
@@ -3557,7 +4312,8 @@ htsp_init(const char *bindaddr)
   static tcp_server_ops_t ops = {
     .start  = htsp_serve,
     .stop   = NULL,
-    .cancel = htsp_server_cancel
+    .cancel = htsp_server_cancel,
+    .attach = htsp_attach
   };
   if (tvheadend_htsp_port > 0)
     htsp_server = tcp_server_create(LS_HTSP, "HTSP", bindaddr, tvheadend_htsp_port, &ops, NULL);
@@ -3571,6 +4327,7 @@ htsp_init(const char *bindaddr)
 void
 htsp_register(void)
 {
+  htsp_io_init();
   if (htsp_server)
     tcp_server_register(htsp_server);
   if (htsp_server_2)
@@ -3589,6 +4346,7 @@ htsp_done(void)
   if (htsp_server)
     tcp_server_delete(htsp_server);
   tvh_mutex_unlock(&global_lock);
+  htsp_io_done();
 }
 
 /* **************************************************************************
@@ -4023,7 +4781,7 @@ static const char frametypearray[PKT_NTYPES] = {
  * Build a htsmsg from a th_pkt and enqueue it on our HTSP service
  */
 static void
-htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
+htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt, int64_t ts_delta)
 {
   htsmsg_t *m;
   htsp_msg_t *hm;
@@ -4067,12 +4825,14 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
   htsmsg_add_u32(m, "com", pkt->pkt_commercial);
 
   if(pkt->pkt_pts != PTS_UNSET) {
-    int64_t pts = hs->hs_90khz ? pkt->pkt_pts : ts_rescale(pkt->pkt_pts, 1000000);
+    int64_t pts = pkt->pkt_pts - ts_delta;
+    pts = hs->hs_90khz ? pts : ts_rescale(pts, 1000000);
     htsmsg_add_s64(m, "pts", pts);
   }
 
   if(pkt->pkt_dts != PTS_UNSET) {
-    int64_t dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
+    int64_t dts = pkt->pkt_dts - ts_delta;
+    dts = hs->hs_90khz ? dts : ts_rescale(dts, 1000000);
     htsmsg_add_s64(m, "dts", dts);
   }
 
@@ -4500,7 +5260,7 @@ htsp_streaming_input(void *opaque, streaming_message_t *sm)
     if (!hs->hs_first)
       tvhdebug(LS_HTSP, "%s - first packet", hs->hs_htsp->htsp_logname);
     hs->hs_first = 1;
-    htsp_stream_deliver(hs, sm->sm_data);
+    htsp_stream_deliver(hs, sm->sm_data, sm->sm_ts_delta);
     // reference is transfered
     sm->sm_data = NULL;
     break;
@@ -24,6 +24,8 @@ struct mpegts_listeners mpegts_listeners;
 
 extern memoryinfo_t mpegts_input_queue_memoryinfo;
 extern memoryinfo_t mpegts_input_table_memoryinfo;
+extern memoryinfo_t mpegts_input_ring_memoryinfo;
+extern memoryinfo_t mpegts_table_scache_memoryinfo;
 
 void
 mpegts_init ( int linuxdvb_mask, int nosatip, str_list_t *satip_client,
@@ -39,6 +41,8 @@ mpegts_init ( int linuxdvb_mask, int nosatip, str_list_t *satip_client,
   /* Memory info */
   memoryinfo_register(&mpegts_input_queue_memoryinfo);
   memoryinfo_register(&mpegts_input_table_memoryinfo);
+  memoryinfo_register(&mpegts_input_ring_memoryinfo);
+  memoryinfo_register(&mpegts_table_scache_memoryinfo);
 
   /* FastScan init */
   dvb_fastscan_init();
@@ -113,6 +117,7 @@ mpegts_done ( void )
 #if ENABLE_TSFILE
   tvhftrace(LS_MAIN, tsfile_done);
 #endif
+  tvhftrace(LS_MAIN, mpegts_input_demux_pool_done);
   dvb_fastscan_done();
 }
 
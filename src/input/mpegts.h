@@ -25,6 +25,7 @@
 #endif
 
 #include "atomic.h"
+#include "bitops.h"
 #include "tprofile.h"
 #include "sbuf.h"
 #include "input.h"
@@ -42,6 +43,8 @@
 typedef struct mpegts_apid          mpegts_apid_t;
 typedef struct mpegts_apids         mpegts_apids_t;
 typedef struct mpegts_table         mpegts_table_t;
+typedef struct mpegts_table_pid     mpegts_table_pid_t;
+typedef struct mpegts_table_scache  mpegts_table_scache_t;
 typedef struct mpegts_network       mpegts_network_t;
 typedef struct mpegts_mux           mpegts_mux_t;
 typedef struct mpegts_service       mpegts_service_t;
@@ -51,6 +54,9 @@ typedef struct mpegts_input         mpegts_input_t;
 typedef struct mpegts_table_feed    mpegts_table_feed_t;
 typedef struct mpegts_network_link  mpegts_network_link_t;
 typedef struct mpegts_packet        mpegts_packet_t;
+typedef struct mpegts_pid_dispatch  mpegts_pid_dispatch_t;
+typedef struct mpegts_input_slot    mpegts_input_slot_t;
+typedef struct mpegts_input_ring    mpegts_input_ring_t;
 typedef struct mpegts_pcr           mpegts_pcr_t;
 typedef struct mpegts_buffer        mpegts_buffer_t;
 
@@ -133,6 +139,34 @@ struct mpegts_packet
   uint8_t                     mp_data[0];
 };
 
+/*
+ * Input ring
+ *
+ * Preallocated single-producer / single-consumer ring of fixed-size
+ * TS slots between the frontend (mpegts_input_recv_packets) and the
+ * input thread. The producer side is serialized by mi_input_lock,
+ * the consumer walks the published slots without any lock and parks
+ * on mi_input_cond only when the ring and the overflow queue are empty.
+ */
+#define MPEGTS_INPUT_SLOT_SIZE  (100*188)
+#define MPEGTS_INPUT_RING_SLOTS 128 /* power of two */
+
+struct mpegts_input_slot
+{
+  mpegts_mux_t               *mis_mux;
+  uint32_t                    mis_len;
+  uint8_t                     mis_cc_restart;
+  uint8_t                     mis_data[MPEGTS_INPUT_SLOT_SIZE];
+} __attribute__((aligned(64)));
+
+struct mpegts_input_ring
+{
+  int                         mir_head __attribute__((aligned(64)));
+  int                         mir_parked;
+  int                         mir_tail __attribute__((aligned(64)));
+  mpegts_input_slot_t         mir_slots[MPEGTS_INPUT_RING_SLOTS];
+};
+
 struct mpegts_pcr {
   int64_t  pcr_first;
   int64_t  pcr_last;
@@ -207,6 +241,22 @@ typedef struct mpegts_pid
   RB_ENTRY(mpegts_pid)     mp_link;
 } mpegts_pid_t;
 
+/*
+ * Flat PID dispatch table (per active mux)
+ *
+ * Directly indexed by PID (including the pseudo fullmux/tables PIDs),
+ * the bitmap marks the real 13-bit PIDs which have subscribers so the
+ * demux loop can skip the rest without touching the pointer array.
+ * This is the only PID lookup, mm_pids is kept for the ordered walks.
+ * Both are changed in mpegts_mux_find_pid_() / mpegts_mux_del_pid()
+ * only and protected by mm_output_lock.
+ */
+struct mpegts_pid_dispatch
+{
+  bitops_ulong_t           mpd_subscribed[8192 / BITS_PER_LONG];
+  mpegts_pid_t            *mpd_pids[MPEGTS_TABLES_PID + 1];
+};
+
 struct mpegts_table
 {
   mpegts_psi_table_t;
@@ -249,11 +299,21 @@ struct mpegts_table
   TAILQ_ENTRY(mpegts_table) mt_defer_link;
   mpegts_mux_t *mt_mux;
 
+  /**
+   * Per-PID index (mm_table_pids), protected by mm_tables_lock
+   */
+  LIST_ENTRY(mpegts_table) mt_pid_link;
+  mpegts_table_pid_t *mt_pid_index;
+
   void *mt_bat;
   mpegts_table_callback_t mt_callback;
+  /* called instead of mt_callback for a section cache hit, for the
+     side effects the skipped callback would have (statistics etc.) */
+  mpegts_table_callback_t mt_cached;
 
   uint8_t mt_subscribed;
   uint8_t mt_defer_cmd;
+  uint8_t mt_linked;
 
 #define MT_DEFER_OPEN_PID  1
 #define MT_DEFER_CLOSE_PID 2
@@ -262,6 +322,18 @@ struct mpegts_table
 
   int mt_count;
 
+  /*
+   * Section cache (see mpegts_table_dispatch), used only by the
+   * thread dispatching the table
+   */
+  mpegts_table_scache_t *mt_scache;
+  int      mt_scache_bits;
+  int      mt_scache_count;
+  uint32_t mt_scache_gen;
+  int      mt_scache_reset;
+  uint64_t mt_scache_hits;
+  uint64_t mt_scache_misses;
+
   int mt_id;
  
   int mt_destroyed; // Refcounting
@@ -295,6 +367,32 @@ struct mpegts_table_feed {
 
 #define MPEGTS_MTF_ALLOC_CHUNK (21*188)
 
+/**
+ * Tables listening on one PID, split to the slow (table thread)
+ * and fast (input thread) tables, see MT_FAST
+ */
+
+struct mpegts_table_pid {
+  RB_ENTRY(mpegts_table_pid) mtp_link;
+  int mtp_pid;
+  int mtp_count[2];
+  LIST_HEAD(, mpegts_table) mtp_tables[2];
+};
+
+/**
+ * Section cache entry, a long section which did not change the table
+ * state, keyed on table id, extension, section number, version and CRC
+ */
+
+struct mpegts_table_scache {
+  uint32_t sce_key;
+  uint32_t sce_crc;
+  uint32_t sce_gen;
+  uint8_t  sce_ver;
+  uint8_t  sce_used;
+  int8_t   sce_ret;
+};
+
 /* **************************************************************************
  * Logical network
  * *************************************************************************/
@@ -450,6 +548,20 @@ struct mpegts_mux
   int                     mm_update_pids_flag;
   mtimer_t                mm_update_pids_timer;
 
+  /*
+   * Demux
+   *
+   * mm_output_lock protects the per-mux demux state (PIDs, PID
+   * subscriptions, active transports), the demux runs under it.
+   * The work queue fields are protected by the global demux pool lock.
+   */
+
+  tvh_mutex_t                 mm_output_lock;
+  TAILQ_ENTRY(mpegts_mux)     mm_demux_link;
+  TAILQ_HEAD(,mpegts_packet)  mm_demux_queue;
+  uint64_t                    mm_demux_queue_size;
+  int                         mm_demux_state;
+
   /*
    * Services
    */
@@ -496,12 +608,12 @@ struct mpegts_mux
 
   uint64_t                    mm_input_pos;
   RB_HEAD(, mpegts_pid)       mm_pids;
+  mpegts_pid_dispatch_t      *mm_pid_dispatch;
   LIST_HEAD(, mpegts_pid_sub) mm_all_subs;
-  int                         mm_last_pid;
-  mpegts_pid_t               *mm_last_mp;
 
   int                         mm_num_tables;
   LIST_HEAD(, mpegts_table)   mm_tables;
+  RB_HEAD(, mpegts_table_pid) mm_table_pids;
   TAILQ_HEAD(, mpegts_table)  mm_defer_tables;
   tvh_mutex_t                 mm_tables_lock;
   TAILQ_HEAD(, mpegts_table)  mm_table_queue;
@@ -577,6 +689,7 @@ struct mpegts_service
   char    *s_dvb_charset;
   uint16_t s_dvb_prefcapid;
   int      s_dvb_prefcapid_lock;
+  int      s_csa_lowlatency;
   time_t   s_dvb_created;
   time_t   s_dvb_last_seen;
   time_t   s_dvb_check_seen;
@@ -703,26 +816,33 @@ struct mpegts_input
 
   /* Data input */
   // Note: this section is protected by mi_input_lock
+  //       (the ring consumer side is lock-free)
   pthread_t                       mi_input_tid;
   mtimer_t                        mi_input_thread_start;
   tvh_mutex_t                     mi_input_lock;
   tvh_cond_t                      mi_input_cond;
-  TAILQ_HEAD(,mpegts_packet)      mi_input_queue;
+  mpegts_input_ring_t            *mi_input_ring;
+  TAILQ_HEAD(,mpegts_packet)      mi_input_queue; /* ring overflow */
   uint64_t                        mi_input_queue_size;
   tvhlog_limit_t                  mi_input_queue_loglimit;
   qprofile_t                      mi_qprofile;
   int                             mi_remove_scrambled_bits;
 
+  int                             mi_demux_pool;  /* per-mux queues, shared workers */
+
   /* Data processing/output */
-  // Note: this lock (mi_output_lock) protects all the remaining
-  //       data fields (excluding the callback functions)
+  // Note: this lock (mi_output_lock) protects the input-wide data
+  //       (active sources), the per-mux demux state is protected
+  //       by mm_output_lock (lock order: mi_output_lock, mm_output_lock)
   tvh_mutex_t                     mi_output_lock;
 
   /* Active sources */
   LIST_HEAD(,mpegts_mux_instance) mi_mux_active;
 
   /* Table processing */
+  // Note: this section is protected by mi_table_lock
   pthread_t                       mi_table_tid;
+  tvh_mutex_t                     mi_table_lock;
   tvh_cond_t                      mi_table_cond;
   mpegts_table_feed_queue_t       mi_table_queue;
   uint64_t                        mi_table_queue_size;
@@ -972,14 +1092,27 @@ static inline int mpegts_mux_scan_state_set ( mpegts_mux_t *m, int state )
   { return mpegts_mux_class_scan_state_set ( m, &state ); }
 
 mpegts_pid_t *mpegts_mux_find_pid_(mpegts_mux_t *mm, int pid, int create);
+void mpegts_mux_del_pid(mpegts_mux_t *mm, mpegts_pid_t *mp);
 
 static inline mpegts_pid_t *
 mpegts_mux_find_pid(mpegts_mux_t *mm, int pid, int create)
 {
-  if (mm->mm_last_pid != pid)
-    return mpegts_mux_find_pid_(mm, pid, create);
-  else
-    return mm->mm_last_mp;
+  mpegts_pid_t *mp = NULL;
+  if (mm->mm_pid_dispatch && pid >= 0 && pid <= MPEGTS_TABLES_PID)
+    mp = mm->mm_pid_dispatch->mpd_pids[pid];
+  if (mp == NULL && create)
+    mp = mpegts_mux_find_pid_(mm, pid, create);
+  return mp;
+}
+
+/* demux fast path - only real 13-bit PIDs */
+static inline mpegts_pid_t *
+mpegts_mux_dispatch_pid(mpegts_mux_t *mm, uint16_t pid)
+{
+  mpegts_pid_dispatch_t *mpd = mm->mm_pid_dispatch;
+  if (mpd == NULL || !test_bit(pid, mpd->mpd_subscribed))
+    return NULL;
+  return mpd->mpd_pids[pid];
 }
 
 void mpegts_mux_update_pids ( mpegts_mux_t *mm );
@@ -1004,6 +1137,8 @@ void mpegts_input_save ( mpegts_input_t *mi, htsmsg_t *c );
 
 void mpegts_input_flush_mux ( mpegts_input_t *mi, mpegts_mux_t *mm );
 
+void mpegts_input_demux_pool_done ( void );
+
 mpegts_pid_t * mpegts_input_open_pid
   ( mpegts_input_t *mi, mpegts_mux_t *mm, int pid, int type, int weight,
     void *owner, int reopen );
@@ -1061,6 +1196,10 @@ void mpegts_table_destroy(mpegts_table_t *mt);
 static inline void mpegts_table_reset(mpegts_table_t *mt)
   { dvb_table_reset((mpegts_psi_table_t *)mt); }
 void mpegts_table_consistency_check(mpegts_mux_t *mm);
+void mpegts_table_link(mpegts_mux_t *mm, mpegts_table_t *mt);
+void mpegts_table_unlink(mpegts_mux_t *mm, mpegts_table_t *mt);
+mpegts_table_pid_t *mpegts_table_pid_find(mpegts_mux_t *mm, int pid);
+void mpegts_table_scache_flush(mpegts_mux_t *mm);
 
 void dvb_bat_destroy(struct mpegts_table *mt);
 
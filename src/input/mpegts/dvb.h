@@ -341,6 +341,14 @@ typedef struct mpegts_psi_table
   int     mt_incomplete;
   uint8_t mt_finished;
 
+  /*
+   * mt_state_gen is bumped whenever the section state changes,
+   * mt_sect_skip is set by dvb_table_begin() when the current section
+   * was skipped by the state alone (see mpegts_table_dispatch)
+   */
+  uint32_t mt_state_gen;
+  uint8_t  mt_sect_skip;
+
   mpegts_psi_section_t mt_sect;
 
   tvhlog_limit_t mt_err_log;
@@ -366,6 +374,10 @@ int dvb_table_begin
 void dvb_table_reset (mpegts_psi_table_t *mt);
 void dvb_table_release (mpegts_psi_table_t *mt);
 
+/* the callback did more than the state check, do not cache the section */
+static inline void dvb_table_nocache (mpegts_psi_table_t *mt)
+  { mt->mt_sect_skip = 0; }
+
 /* all-in-one parser */
 
 typedef void (*mpegts_psi_parse_callback_t)
@@ -227,6 +227,7 @@ mpegts_table_state_reset
   ( mpegts_psi_table_t *mt, mpegts_psi_table_state_t *st, int last )
 {
   int i;
+  mt->mt_state_gen++;
   mt->mt_finished = 0;
   st->complete = 0;
   st->version = MPEGTS_PSI_VERSION_NONE;
@@ -302,6 +303,7 @@ dvb_table_end
   uint32_t rem;
   if (st && !st->complete) {
     assert(sect >= 0 && sect <= 255);
+    mt->mt_state_gen++;
     sa = sect / 32;
     sb = sect % 32;
     st->sections[sa] &= ~(0x1 << (31 - sb));
@@ -341,8 +343,10 @@ dvb_table_begin
   }
 
   /* Ignore next */
-  if((ptr[2] & 1) == 0)
+  if((ptr[2] & 1) == 0) {
+    mt->mt_sect_skip = 1;
     return -1;
+  }
 
   tvhtrace(mt->mt_subsys, "%s: pid %02X tableid %02X extraid %016" PRIx64 " len %d",
            mt->mt_name, mt->mt_pid, tableid, extraid, len);
@@ -391,8 +395,10 @@ dvb_table_begin
       if (st->complete == 1) {
         st->complete = 2;
         mt->mt_complete++;
+        mt->mt_state_gen++;
         return dvb_table_complete(mt);
       } else if (st->complete == 2) {
+        mt->mt_sect_skip = !interval;
         return dvb_table_complete(mt);
       }
       assert(0);
@@ -403,6 +409,7 @@ dvb_table_begin
     sb = *sect % 32;
     if (!(st->sections[sa] & (0x1 << (31 - sb)))) {
       tvhtrace(mt->mt_subsys, "%s:  skip, already seen", mt->mt_name);
+      mt->mt_sect_skip = !interval;
       return -1;
     }
   }
@@ -421,6 +428,7 @@ dvb_table_reset(mpegts_psi_table_t *mt)
   mpegts_psi_table_state_t *st;
 
   tvhtrace(mt->mt_subsys, "%s: pid %02X complete reset", mt->mt_name, mt->mt_pid);
+  mt->mt_state_gen++;
   mt->mt_incomplete = 0;
   mt->mt_complete   = 0;
   mt->mt_last_complete = 0;
@@ -1219,6 +1219,7 @@ iptv_create_input ( void *tpool )
   input->mi_get_priority   = iptv_input_get_priority;
   input->mi_display_name   = iptv_input_display_name;
   input->mi_enabled        = 1;
+  input->mi_demux_pool     = 1;
 
   input->mi_tpool          = tpool;
 
@@ -22,14 +22,30 @@
 #include "access.h"
 #include "notify.h"
 #include "dbus.h"
+#include "config.h"
 #include "memoryinfo.h"
+#include "tsscan.h"
 
 memoryinfo_t mpegts_input_queue_memoryinfo = { .my_name = "MPEG-TS input queue" };
 memoryinfo_t mpegts_input_table_memoryinfo = { .my_name = "MPEG-TS table queue" };
+memoryinfo_t mpegts_input_ring_memoryinfo = { .my_name = "MPEG-TS input ring" };
 
 static void
 mpegts_input_del_network ( mpegts_network_link_t *mnl );
 
+static mpegts_input_ring_t *
+mpegts_input_ring_create ( void );
+
+static void
+mpegts_input_demux_pool_start ( void );
+
+static void
+mpegts_input_demux_queue
+  ( mpegts_mux_instance_t *mmi, const uint8_t *tsb, int len, int flags );
+
+static void
+mpegts_input_demux_flush ( mpegts_mux_t *mm );
+
 /*
  * DBUS
  */
@@ -511,7 +527,7 @@ mpegts_input_open_pid
          (((type & MPS_STREAM) ? 1 : 0) +
           ((type & MPS_SERVICE) ? 1 : 0) +
           ((type & MPS_RAW) ? 1 : 0)) == 1);
-  lock_assert(&mi->mi_output_lock);
+  lock_assert(&mm->mm_output_lock);
 
   if (pid == MPEGTS_FULLMUX_PID)
     mpegts_input_close_pids(mi, mm, owner, 1);
@@ -568,7 +584,7 @@ mpegts_input_close_pid
   mpegts_pid_t *mp;
   int mask;
   assert(owner != NULL);
-  lock_assert(&mi->mi_output_lock);
+  lock_assert(&mm->mm_output_lock);
   if (!(mp = mpegts_mux_find_pid(mm, pid, 0)))
     return -1;
   if (pid == MPEGTS_FULLMUX_PID || pid == MPEGTS_TABLES_PID) {
@@ -592,10 +608,6 @@ mpegts_input_close_pid
     skel.mps_weight = -1;
     skel.mps_owner  = owner;
     mps = RB_FIND(&mp->mp_subs, &skel, mps_link, mpegts_mps_cmp);
-    if (pid == mm->mm_last_pid) {
-      mm->mm_last_pid = -1;
-      mm->mm_last_mp = NULL;
-    }
     if (mps) {
       tvhdebug(LS_MPEGTS, "%s - close PID %04X (%d) [%d/%p]",
                mm->mm_nicename, mp->mp_pid, mp->mp_pid, type, owner);
@@ -609,12 +621,7 @@ mpegts_input_close_pid
     }
   }
   if (!RB_FIRST(&mp->mp_subs)) {
-    if (mm->mm_last_pid == mp->mp_pid) {
-      mm->mm_last_pid = -1;
-      mm->mm_last_mp = NULL;
-    }
-    RB_REMOVE(&mm->mm_pids, mp, mp_link);
-    free(mp);
+    mpegts_mux_del_pid(mm, mp);
     return 1;
   } else {
     type = 0;
@@ -633,7 +640,7 @@ mpegts_input_update_pid_weight
   mpegts_pid_sub_t *mps, skel;
   mpegts_pid_t *mp;
   assert(owner != NULL);
-  lock_assert(&mi->mi_output_lock);
+  lock_assert(&mm->mm_output_lock);
   if (!(mp = mpegts_mux_find_pid(mm, pid, 0)))
     return NULL;
   if (pid == MPEGTS_FULLMUX_PID || pid == MPEGTS_TABLES_PID) {
@@ -768,7 +775,7 @@ mpegts_input_cat_pass_callback
   mi = mm->mm_active ? mm->mm_active->mmi_input : NULL;
   if (mi == NULL) goto fin;
 
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mm->mm_output_lock);
   tvh_mutex_lock(&s->s_stream_mutex);
 
   TAILQ_FOREACH(es, &s->s_components.set_all, es_link) {
@@ -798,7 +805,7 @@ mpegts_input_cat_pass_callback
   }
 
   tvh_mutex_unlock(&s->s_stream_mutex);
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mm->mm_output_lock);
 
   /* Finish */
 fin:
@@ -841,6 +848,7 @@ mpegts_input_open_service
 
   /* Add to list */
   tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mm->mm_output_lock);
   if (!s->s_dvb_active_input) {
     LIST_INSERT_HEAD(&mm->mm_transports, ((service_t*)s), s_active_link);
     s->s_dvb_active_input = mi;
@@ -891,6 +899,7 @@ mpegts_input_open_service
 
 no_pids:
   tvh_mutex_unlock(&s->s_stream_mutex);
+  tvh_mutex_unlock(&mm->mm_output_lock);
   tvh_mutex_unlock(&mi->mi_output_lock);
 
   /* Add PMT monitor */
@@ -921,6 +930,7 @@ mpegts_input_close_service ( mpegts_input_t *mi, mpegts_service_t *s )
 
   /* Remove from list */
   tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mm->mm_output_lock);
   if (s->s_dvb_active_input != NULL) {
     LIST_REMOVE(((service_t*)s), s_active_link);
     s->s_dvb_active_input = NULL;
@@ -954,6 +964,7 @@ mpegts_input_close_service ( mpegts_input_t *mi, mpegts_service_t *s )
 
 no_pids:
   tvh_mutex_unlock(&s->s_stream_mutex);
+  tvh_mutex_unlock(&mm->mm_output_lock);
   tvh_mutex_unlock(&mi->mi_output_lock);
 
   mpegts_mux_update_pids(mm);
@@ -983,6 +994,18 @@ mpegts_input_started_mux
   /* Deliver first TS packets as fast as possible */
   atomic_set_s64(&mi->mi_last_dispatch, 0);
 
+  /* Allocate the input ring on demand (idle inputs do not need it) */
+  if (mi->mi_demux_pool) {
+    mpegts_input_demux_pool_start();
+  } else if (mi->mi_input_ring == NULL) {
+    tvh_mutex_lock(&mi->mi_input_lock);
+    mi->mi_input_ring = mpegts_input_ring_create();
+    tvh_cond_signal(&mi->mi_input_cond, 0);
+    tvh_mutex_unlock(&mi->mi_input_lock);
+    if (mi->mi_input_ring == NULL)
+      tvherror(LS_MPEGTS, "%s - unable to allocate the input ring", mi->mi_name ?: "");
+  }
+
   /* Arm timer */
   if (LIST_FIRST(&mi->mi_mux_active) == NULL)
     mtimer_arm_rel(&mi->mi_status_timer, mpegts_input_status_timer, mi, sec2mono(1));
@@ -1002,11 +1025,11 @@ mpegts_input_stopping_mux
 {
   assert(mmi->mmi_mux->mm_active);
 
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mmi->mmi_mux->mm_output_lock);
   tvh_mutex_lock(&mi->mi_input_lock);
   mmi->mmi_mux->mm_active = NULL;
   tvh_mutex_unlock(&mi->mi_input_lock);
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mmi->mmi_mux->mm_output_lock);
 }
 
 static void
@@ -1040,7 +1063,7 @@ mpegts_input_has_subscription ( mpegts_input_t *mi, mpegts_mux_t *mm )
   int ret = 0;
   const service_t *t;
   const th_subscription_t *ths;
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mm->mm_output_lock);
   LIST_FOREACH(t, &mm->mm_transports, s_active_link) {
     if (t->s_type == STYPE_RAW) {
       LIST_FOREACH(ths, &t->s_subscriptions, ths_service_link)
@@ -1050,7 +1073,7 @@ mpegts_input_has_subscription ( mpegts_input_t *mi, mpegts_mux_t *mm )
     ret = 1;
     break;
   }
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mm->mm_output_lock);
   return ret;
 }
 
@@ -1058,14 +1081,14 @@ static void
 mpegts_input_error ( mpegts_input_t *mi, mpegts_mux_t *mm, int tss_flags )
 {
   service_t *t, *t_next;
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mm->mm_output_lock);
   for (t = LIST_FIRST(&mm->mm_transports); t; t = t_next) {
     t_next = LIST_NEXT(t, s_active_link);
     tvh_mutex_lock(&t->s_stream_mutex);
     service_set_streaming_status_flags(t, tss_flags);
     tvh_mutex_unlock(&t->s_stream_mutex);
   }
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mm->mm_output_lock);
 }
 
 /* **************************************************************************
@@ -1093,18 +1116,17 @@ static void mpegts_input_analyze_table_queue ( mpegts_input_t *mi )
 }
 
 #if 0
-static int data_noise ( mpegts_packet_t *mp )
+static int data_noise ( uint8_t *data, uint32_t *rlen )
 {
   static uint64_t off = 0, win = 4096, limit = 2*1024*1024;
-  uint8_t *data = mp->mp_data;
-  uint32_t i, p, s, len = mp->mp_len;
+  uint32_t i, p, s, len = *rlen;
   for (p = 0; p < len; p += 188) {
     off += 188;
     if (off >= limit && off < limit + win) {
       if ((off & 3) == 1) {
         memmove(data + p, data + p + 188, len - (p + 188));
         p -= 188;
-        mp->mp_len -= 188;
+        *rlen -= 188;
         return 1;
       }
       s = ((data[2] + data[3] + data[4]) & 3) + 1;
@@ -1119,7 +1141,7 @@ static int data_noise ( mpegts_packet_t *mp )
   return 0;
 }
 #else
-static inline int data_noise( mpegts_packet_t *mp ) { return 0; }
+static inline int data_noise( uint8_t *data, uint32_t *rlen ) { return 0; }
 #endif
 
 static inline int
@@ -1144,56 +1166,150 @@ get_pcr ( const uint8_t *tsb, int64_t *rpcr )
   return 1;
 }
 
-static inline int
-ts_sync_count ( const uint8_t *tsb, int len )
-{
-  const uint8_t *start = tsb;
-  while (len >= 188) {
-    if (len >= 1880 &&
-        tsb[0*188] == 0x47 && tsb[1*188] == 0x47 &&
-        tsb[2*188] == 0x47 && tsb[3*188] == 0x47 &&
-        tsb[4*188] == 0x47 && tsb[5*188] == 0x47 &&
-        tsb[6*188] == 0x47 && tsb[7*188] == 0x47 &&
-        tsb[8*188] == 0x47 && tsb[9*188] == 0x47) {
-      len -= 1880;
-      tsb += 1880;
-    } else if (*tsb == 0x47) {
-      len -= 188;
-      tsb += 188;
-    } else {
-      break;
+static mpegts_input_ring_t *
+mpegts_input_ring_create ( void )
+{
+  mpegts_input_ring_t *ring;
+
+  if (posix_memalign((void **)&ring, 64, sizeof(*ring)))
+    return NULL;
+  ring->mir_head = ring->mir_tail = 0;
+  ring->mir_parked = 0;
+  memoryinfo_alloc(&mpegts_input_ring_memoryinfo, sizeof(*ring));
+  return ring;
+}
+
+static void
+mpegts_input_ring_destroy ( mpegts_input_ring_t *ring )
+{
+  if (ring == NULL)
+    return;
+  memoryinfo_free(&mpegts_input_ring_memoryinfo, sizeof(*ring));
+  free(ring);
+}
+
+/*
+ * Drop all queued data (ring and overflow), must be called with
+ * mi_input_lock held and the consumer stopped
+ */
+static void
+mpegts_input_queue_flush ( mpegts_input_t *mi )
+{
+  mpegts_input_ring_t *ring = mi->mi_input_ring;
+  mpegts_input_slot_t *slot;
+  mpegts_packet_t *mp;
+  uint32_t tail, head;
+
+  if (ring) {
+    head = atomic_get(&ring->mir_head);
+    for (tail = ring->mir_tail; tail != head; tail++) {
+      slot = &ring->mir_slots[tail & (MPEGTS_INPUT_RING_SLOTS - 1)];
+      memoryinfo_free(&mpegts_input_queue_memoryinfo, slot->mis_len);
+      if (slot->mis_mux)
+        mpegts_mux_release(slot->mis_mux);
+      slot->mis_mux = NULL;
     }
+    atomic_set(&ring->mir_tail, head);
   }
-  return tsb - start;
+  while ((mp = TAILQ_FIRST(&mi->mi_input_queue))) {
+    memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
+    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
+    if (mp->mp_mux)
+      mpegts_mux_release(mp->mp_mux);
+    free(mp);
+  }
+  atomic_set_u64(&mi->mi_input_queue_size, 0);
 }
 
+/*
+ * Copy the synced TS data straight to the ring slots. The malloc'ed
+ * overflow queue is used only when the ring is full (and until it is
+ * drained to keep the order), so the 50MB limit covers both.
+ */
 static void
 mpegts_input_queue_packets
-  ( mpegts_mux_instance_t *mmi, mpegts_packet_t *mp )
+  ( mpegts_mux_instance_t *mmi, const uint8_t *tsb, int len, int flags )
 {
   mpegts_input_t *mi = mmi->mmi_input;
+  mpegts_mux_t *mm = mmi->mmi_mux;
+  mpegts_input_ring_t *ring;
+  mpegts_input_slot_t *slot;
+  mpegts_packet_t *mp;
   const char *id = SRCLINEID();
-  int len = mp->mp_len;
+  uint8_t *data, *tmp, *end;
+  uint32_t head, tail, l;
+  int cc_restart = (flags & MPEGTS_DATA_CC_RESTART) ? 1 : 0;
+  int remove_scrambled = mi->mi_remove_scrambled_bits ||
+                         (flags & MPEGTS_DATA_REMOVE_SCRAMBLED) != 0;
+
+  if (mi->mi_demux_pool) {
+    mpegts_input_demux_queue(mmi, tsb, len, flags);
+    return;
+  }
 
   tvh_mutex_lock(&mi->mi_input_lock);
-  if (mmi->mmi_mux->mm_active == mmi) {
-    if (mi->mi_input_queue_size < 50*1024*1024) {
-      mi->mi_input_queue_size += len;
-      memoryinfo_alloc(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + len);
-      mpegts_mux_grab(mp->mp_mux);
-      TAILQ_INSERT_TAIL(&mi->mi_input_queue, mp, mp_link);
-      tprofile_queue_add(&mi->mi_qprofile, id, len);
-      tprofile_queue_set(&mi->mi_qprofile, id, mi->mi_input_queue_size);
-      tvh_cond_signal(&mi->mi_input_cond, 0);
+  ring = mi->mi_input_ring;
+  if (mm->mm_active != mmi || ring == NULL)
+    goto unlock;
+  if (atomic_get_u64(&mi->mi_input_queue_size) >= 50*1024*1024) {
+    if (tvhlog_limit(&mi->mi_input_queue_loglimit, 10))
+      tvhwarn(LS_MPEGTS, "too much queued input data (over 50MB) for %s, discarding new", mi->mi_name);
+    tprofile_queue_drop(&mi->mi_qprofile, id, len);
+    goto unlock;
+  }
+
+  head = ring->mir_head;
+  tail = atomic_get(&ring->mir_tail);
+  do {
+    l = MIN(len, MPEGTS_INPUT_SLOT_SIZE);
+    if (head - tail >= MPEGTS_INPUT_RING_SLOTS)
+      tail = atomic_get(&ring->mir_tail);
+    if (TAILQ_EMPTY(&mi->mi_input_queue) &&
+        head - tail < MPEGTS_INPUT_RING_SLOTS) {
+      slot = &ring->mir_slots[head & (MPEGTS_INPUT_RING_SLOTS - 1)];
+      mp = NULL;
+      data = slot->mis_data;
     } else {
-      if (tvhlog_limit(&mi->mi_input_queue_loglimit, 10))
-        tvhwarn(LS_MPEGTS, "too much queued input data (over 50MB) for %s, discarding new", mi->mi_name);
-      tprofile_queue_drop(&mi->mi_qprofile, id, len);
+      slot = NULL;
+      mp = malloc(sizeof(mpegts_packet_t) + l);
+      data = mp->mp_data;
+    }
+    memcpy(data, tsb, l);
+    tsb += l;
+    len -= l;
+    if (remove_scrambled)
+      for (tmp = data, end = data + l; tmp < end; tmp += 188)
+        tmp[3] &= ~0xc0;
+    if (!cc_restart && data_noise(data, &l)) {
       free(mp);
+      continue;
     }
-  } else {
-    free(mp);
+    mpegts_mux_grab(mm);
+    atomic_add_u64(&mi->mi_input_queue_size, l);
+    if (slot) {
+      slot->mis_mux        = mm;
+      slot->mis_len        = l;
+      slot->mis_cc_restart = cc_restart;
+      memoryinfo_alloc(&mpegts_input_queue_memoryinfo, l);
+      atomic_set(&ring->mir_head, ++head);
+    } else {
+      mp->mp_mux        = mm;
+      mp->mp_len        = l;
+      mp->mp_cc_restart = cc_restart;
+      memoryinfo_alloc(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + l);
+      TAILQ_INSERT_TAIL(&mi->mi_input_queue, mp, mp_link);
+    }
+    tprofile_queue_add(&mi->mi_qprofile, id, l);
+    cc_restart = 0;
+  } while (len > 0);
+  tprofile_queue_set(&mi->mi_qprofile, id, atomic_get_u64(&mi->mi_input_queue_size));
+
+  /* Wake the consumer only when it is parked */
+  if (ring->mir_parked) {
+    ring->mir_parked = 0;
+    tvh_cond_signal(&mi->mi_input_cond, 0);
   }
+unlock:
   tvh_mutex_unlock(&mi->mi_input_lock);
 }
 
@@ -1204,7 +1320,6 @@ mpegts_input_recv_packets
 {
   mpegts_input_t *mi = mmi->mmi_input;
   int len, len2, off;
-  mpegts_packet_t *mp;
   uint8_t *tsb;
 #define MIN_TS_PKT 100
 #define MIN_TS_SYN (5*188)
@@ -1265,31 +1380,12 @@ retry:
 
   /* Pass */
   if (len2 >= MIN_TS_SYN || (flags & MPEGTS_DATA_CC_RESTART)) {
-    mp = malloc(sizeof(mpegts_packet_t) + len2);
-    mp->mp_mux        = mmi->mmi_mux;
-    mp->mp_len        = len2;
-    mp->mp_cc_restart = (flags & MPEGTS_DATA_CC_RESTART) ? 1 : 0;
-
-    memcpy(mp->mp_data, tsb, len2);
-    if (mi->mi_remove_scrambled_bits || (flags & MPEGTS_DATA_REMOVE_SCRAMBLED) != 0) {
-      uint8_t *tmp, *end;
-      for (tmp = mp->mp_data, end = mp->mp_data + len2; tmp < end; tmp += 188)
-        tmp[3] &= ~0xc0;
-    }
-
+    mpegts_input_queue_packets(mmi, tsb, len2, flags);
     len -= len2;
     off += len2;
-
-    if ((flags & MPEGTS_DATA_CC_RESTART) == 0 && data_noise(mp)) {
-      free(mp);
-      goto end;
-    }
-
-    mpegts_input_queue_packets(mmi, mp);
   }
 
   /* Adjust buffer */
-end:
   if (len && (flags & MPEGTS_DATA_CC_RESTART) == 0) {
     sbuf_cut(sb, off); // cut off the bottom
     if (sb->sb_ptr >= MIN_TS_PKT * 188)
@@ -1302,22 +1398,24 @@ static void
 mpegts_input_table_dispatch
   ( mpegts_mux_t *mm, const char *logprefix, const uint8_t *tsb, int tsb_len, int fast )
 {
-  int i, len = 0, c = 0;
+  int i, len = 0;
   const uint8_t *tsb2, *tsb2_end;
   uint16_t pid = ((tsb[1] & 0x1f) << 8) | tsb[2];
+  mpegts_table_pid_t *mtp;
   mpegts_table_t *mt, **vec;
 
+  fast = fast ? 1 : 0;
+
   /* Collate - tables may be removed during callbacks */
   tvh_mutex_lock(&mm->mm_tables_lock);
-  i = mm->mm_num_tables;
+  mtp = mpegts_table_pid_find(mm, pid);
+  if (mtp == NULL || (i = mtp->mtp_count[fast]) == 0) {
+    tvh_mutex_unlock(&mm->mm_tables_lock);
+    return;
+  }
   vec = alloca(i * sizeof(mpegts_table_t *));
-  LIST_FOREACH(mt, &mm->mm_tables, mt_link) {
-    c++;
-    if (mt->mt_destroyed || !mt->mt_subscribed || mt->mt_pid != pid)
-      continue;
-    if (fast && (mt->mt_flags & MT_FAST) == 0)
-      continue;
-    if (!fast && (mt->mt_flags & MT_FAST) != 0)
+  LIST_FOREACH(mt, &mtp->mtp_tables[fast], mt_pid_link) {
+    if (mt->mt_destroyed || !mt->mt_subscribed)
       continue;
     mpegts_table_grab(mt);
     tprofile_start(&mt->mt_profile, "dispatch");
@@ -1325,10 +1423,6 @@ mpegts_input_table_dispatch
       vec[len++] = mt;
   }
   tvh_mutex_unlock(&mm->mm_tables_lock);
-  if (i != c) {
-    tvherror(LS_TBL, "tables count inconsistency (num %d, list %d)", i, c);
-    assert(0);
-  }
 
   /* Process */
   for (i = 0; i < len; i++) {
@@ -1416,19 +1510,19 @@ mpegts_input_table_waiting ( mpegts_input_t *mi, mpegts_mux_t *mm )
 
 static int
 mpegts_input_process
-  ( mpegts_input_t *mi, mpegts_packet_t *mpkt )
+  ( mpegts_input_t *mi, mpegts_mux_t *mm, int cc_restart,
+    uint8_t *data, int len )
 {
   uint16_t pid, pid2;
-  uint8_t cc, cc2;
-  uint8_t *tsb = mpkt->mp_data, *tsb2, *tsb2_end;
-  int len = mpkt->mp_len, llen;
+  uint8_t cc;
+  uint8_t *tsb = data;
+  int llen, ccerr;
   int type = 0, f;
   mpegts_pid_t *mp;
   mpegts_pid_sub_t *mps;
   service_t *s;
   elementary_stream_t *st;
   int table_wakeup = 0;
-  mpegts_mux_t *mm = mpkt->mp_mux;
   mpegts_mux_instance_t *mmi;
   mpegts_table_feed_t *mtf;
   uint64_t tspos;
@@ -1438,7 +1532,7 @@ mpegts_input_process
 
   assert(mm == mmi->mmi_mux);
 
-  if (mpkt->mp_cc_restart) {
+  if (cc_restart) {
     LIST_FOREACH(s, &mm->mm_transports, s_active_link)
       TAILQ_FOREACH(st, &s->s_components.set_all, es_link)
         st->es_cc = -1;
@@ -1447,8 +1541,10 @@ mpegts_input_process
       if (mp->mp_type & MPS_FTABLE) {
         mpegts_input_table_restart(mm, mm->mm_nicename, 1);
       } else {
+        tvh_mutex_lock(&mi->mi_table_lock);
         mtf = mpegts_input_table_feed_create(mi, mm, NULL, 0);
         mtf->mtf_cc_restart = 1;
+        tvh_mutex_unlock(&mi->mi_table_lock);
       }
     }
   }
@@ -1467,9 +1563,21 @@ mpegts_input_process
      *  3 - 0xC0 - scrambled
      *  3 - 0x10 - CC check
      */
-    llen = mpegts_word_count(tsb, len, 0xFF9FFFD0);
-
     pid = (tsb[1] << 8) | tsb[2];
+    mp = (pid & 0x1FFF) != 0x1FFF ? mpegts_mux_dispatch_pid(mm, pid & 0x1FFF) : NULL;
+
+    /* Run length + low level CC check in one pass */
+    if (mp && (tsb[3] & 0x10)) {
+      cc = mp->mp_cc;
+      llen = mpegts_word_count_cc(tsb, len, 0xFF9FFFD0, &cc, &ccerr);
+      mp->mp_cc = cc;
+      if (ccerr) {
+        tvhtrace(LS_MPEGTS, "%s: pid %04X %d cc err(s)", mm->mm_nicename, pid & 0x1FFF, ccerr);
+        atomic_add(&mmi->tii_stats.cc, ccerr);
+      }
+    } else {
+      llen = mpegts_word_count(tsb, len, 0xFF9FFFD0);
+    }
 
     /* Transport error */
     if (pid & 0x8000) {
@@ -1486,22 +1594,8 @@ mpegts_input_process
       goto done;
     }
 
-    /* Find PID */
-    if ((mp = mpegts_mux_find_pid(mm, pid, 0))) {
-
-      /* Low level CC check */
-      if (tsb[3] & 0x10) {
-        for (tsb2 = tsb, tsb2_end = tsb + llen, cc2 = mp->mp_cc;
-             tsb2 < tsb2_end; tsb2 += 188) {
-          cc = tsb2[3] & 0x0f;
-          if (cc2 != 0xff && cc2 != cc) {
-            tvhtrace(LS_MPEGTS, "%s: pid %04X cc err %2d != %2d", mm->mm_nicename, pid, cc, cc2);
-            atomic_add(&mmi->tii_stats.cc, 1);
-          }
-          cc2 = (cc + 1) & 0xF;
-        }
-        mp->mp_cc = cc2;
-      }
+    /* Dispatch PID */
+    if (mp) {
 
       type = mp->mp_type;
       
@@ -1543,6 +1637,7 @@ mpegts_input_process
           if (type & MPS_FTABLE)
             mpegts_input_table_dispatch(mm, mm->mm_nicename, tsb, llen, 1);
           if (type & MPS_TABLE) {
+            tvh_mutex_lock(&mi->mi_table_lock);
             if (mi->mi_table_queue_size >= 2*1024*1024) {
               if (tvhlog_limit(&mi->mi_input_queue_loglimit, 10)) {
                 tvhwarn(LS_MPEGTS, "too much queued table input data (over 2MB) for %s, discarding new", mi->mi_name);
@@ -1569,6 +1664,7 @@ mpegts_input_process
                 mpegts_input_table_feed_create(mi, mm, tsb, llen);
               table_wakeup = 1;
             }
+            tvh_mutex_unlock(&mi->mi_table_lock);
           }
         } else {
           //tvhdebug("tsdemux", "%s - SI packet had errors", name);
@@ -1590,11 +1686,11 @@ done:
   }
 
   /* Raw stream */
-  if (tsb != mpkt->mp_data &&
+  if (tsb != data &&
       LIST_FIRST(&mmi->mmi_streaming_pad.sp_targets) != NULL) {
 
     streaming_message_t sm;
-    pktbuf_t *pb = pktbuf_alloc(mpkt->mp_data, tsb - mpkt->mp_data);
+    pktbuf_t *pb = pktbuf_alloc(data, tsb - data);
     memset(&sm, 0, sizeof(sm));
     sm.sm_type = SMT_MPEGTS;
     sm.sm_data = pb;
@@ -1603,11 +1699,14 @@ done:
   }
 
   /* Wake table */
-  if (table_wakeup)
+  if (table_wakeup) {
+    tvh_mutex_lock(&mi->mi_table_lock);
     tvh_cond_signal(&mi->mi_table_cond, 0);
+    tvh_mutex_unlock(&mi->mi_table_lock);
+  }
 
   /* Bandwidth monitoring */
-  llen = tsb - mpkt->mp_data;
+  llen = tsb - data;
   atomic_add(&mmi->tii_stats.bps, llen);
   mm->mm_input_pos += llen;
   return llen;
@@ -1629,8 +1728,10 @@ mpegts_input_postdemux
   elementary_stream_t *st;
   mpegts_mux_instance_t *mmi;
 
-  tvh_mutex_lock(&mi->mi_output_lock);
-  if (mm == NULL || (mmi = mm->mm_active) == NULL)
+  if (mm == NULL)
+    return;
+  tvh_mutex_lock(&mm->mm_output_lock);
+  if ((mmi = mm->mm_active) == NULL)
     goto unlock;
 
   assert(mm == mmi->mmi_mux);
@@ -1659,7 +1760,7 @@ mpegts_input_postdemux
       goto done;
 
     /* Find PID */
-    if ((mp = mpegts_mux_find_pid(mm, pid, 0))) {
+    if ((mp = mpegts_mux_dispatch_pid(mm, pid))) {
 
       type = mp->mp_type;
 
@@ -1693,7 +1794,56 @@ done:
     len -= llen;
   }
 unlock:
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mm->mm_output_lock);
+}
+
+/*
+ * Demux one chunk of the mux data, the caller owns a mux reference
+ */
+static size_t
+mpegts_input_thread_process
+  ( tprofile_t *tprofile, mpegts_mux_t *mm,
+    int cc_restart, uint8_t *data, int len )
+{
+  mpegts_input_t *mi;
+  size_t bytes = 0;
+  int update_pids;
+
+  if (mm == NULL)
+    return 0;
+
+  tvh_mutex_lock(&mm->mm_output_lock);
+  if (mm->mm_active == NULL)
+    goto unlock;
+  mi = mm->mm_active->mmi_input;
+  mpegts_input_table_waiting(mi, mm);
+  if (mm->mm_update_pids_flag) {
+    tvh_mutex_unlock(&mm->mm_output_lock);
+    tvh_mutex_lock(&global_lock);
+    mpegts_mux_update_pids(mm);
+    tvh_mutex_unlock(&global_lock);
+    tvh_mutex_lock(&mm->mm_output_lock);
+  }
+  tprofile_start(tprofile, "input");
+  bytes = mpegts_input_process(mi, mm, cc_restart, data, len);
+  tprofile_finish(tprofile);
+unlock:
+  update_pids = mm->mm_update_pids_flag;
+  tvh_mutex_unlock(&mm->mm_output_lock);
+  if (update_pids) {
+    tvh_mutex_lock(&global_lock);
+    mpegts_mux_update_pids(mm);
+    tvh_mutex_unlock(&global_lock);
+  }
+
+#if ENABLE_TSDEBUG
+  {
+    extern void tsdebugcw_go(void);
+    tsdebugcw_go();
+  }
+#endif
+
+  return bytes;
 }
 
 static void *
@@ -1701,8 +1851,11 @@ mpegts_input_thread ( void * p )
 {
   mpegts_packet_t *mp;
   mpegts_input_t *mi = p;
+  mpegts_input_ring_t *ring = NULL;
+  mpegts_input_slot_t *slot;
+  mpegts_mux_t *mm;
   size_t bytes = 0;
-  int update_pids;
+  uint32_t tail;
   tprofile_t tprofile;
   char buf[256];
 
@@ -1712,70 +1865,58 @@ mpegts_input_thread ( void * p )
 
   tprofile_init(&tprofile, buf);
 
-  tvh_mutex_lock(&mi->mi_input_lock);
   while (atomic_get(&mi->mi_running)) {
 
-    /* Wait for a packet */
-    if (!(mp = TAILQ_FIRST(&mi->mi_input_queue))) {
+    /* Consume the ring slots in place (lock-free) */
+    if (ring && (tail = ring->mir_tail) != (uint32_t)atomic_get(&ring->mir_head)) {
+      slot = &ring->mir_slots[tail & (MPEGTS_INPUT_RING_SLOTS - 1)];
+      mm = atomic_exchange_ptr((atomic_refptr_t)&slot->mis_mux, NULL);
+      bytes += mpegts_input_thread_process(&tprofile, mm, slot->mis_cc_restart,
+                                           slot->mis_data, slot->mis_len);
+      if (mm)
+        mpegts_mux_release(mm);
+      atomic_dec_u64(&mi->mi_input_queue_size, slot->mis_len);
+      memoryinfo_free(&mpegts_input_queue_memoryinfo, slot->mis_len);
+      atomic_set(&ring->mir_tail, tail + 1);
+      continue;
+    }
+
+    /* Ring is empty, check the overflow queue or wait */
+    tvh_mutex_lock(&mi->mi_input_lock);
+    ring = mi->mi_input_ring;
+    if ((mp = TAILQ_FIRST(&mi->mi_input_queue)) != NULL) {
+      atomic_dec_u64(&mi->mi_input_queue_size, mp->mp_len);
+      memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
+      TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
+      tvh_mutex_unlock(&mi->mi_input_lock);
+      bytes += mpegts_input_thread_process(&tprofile, mp->mp_mux, mp->mp_cc_restart,
+                                           mp->mp_data, mp->mp_len);
+      if (mp->mp_mux)
+        mpegts_mux_release(mp->mp_mux);
+      free(mp);
+      continue;
+    }
+    if (atomic_get(&mi->mi_running) &&
+        (ring == NULL || ring->mir_tail == atomic_get(&ring->mir_head))) {
       if (bytes) {
         tvhtrace(LS_MPEGTS, "input %s got %zu bytes", buf, bytes);
         bytes = 0;
       }
+      if (ring)
+        ring->mir_parked = 1;
       tvh_cond_wait(&mi->mi_input_cond, &mi->mi_input_lock);
-      continue;
+      ring = mi->mi_input_ring;
+      if (ring)
+        ring->mir_parked = 0;
     }
-    mi->mi_input_queue_size -= mp->mp_len;
-    memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
-    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
     tvh_mutex_unlock(&mi->mi_input_lock);
-      
-    /* Process */
-    tvh_mutex_lock(&mi->mi_output_lock);
-    mpegts_input_table_waiting(mi, mp->mp_mux);
-    if (mp->mp_mux && mp->mp_mux->mm_update_pids_flag) {
-      tvh_mutex_unlock(&mi->mi_output_lock);
-      tvh_mutex_lock(&global_lock);
-      mpegts_mux_update_pids(mp->mp_mux);
-      tvh_mutex_unlock(&global_lock);
-      tvh_mutex_lock(&mi->mi_output_lock);
-    }
-    tprofile_start(&tprofile, "input");
-    bytes += mpegts_input_process(mi, mp);
-    tprofile_finish(&tprofile);
-    update_pids = mp->mp_mux && mp->mp_mux->mm_update_pids_flag;
-    tvh_mutex_unlock(&mi->mi_output_lock);
-    if (update_pids) {
-      tvh_mutex_lock(&global_lock);
-      mpegts_mux_update_pids(mp->mp_mux);
-      tvh_mutex_unlock(&global_lock);
-    }
-
-    /* Cleanup */
-    if (mp->mp_mux)
-      mpegts_mux_release(mp->mp_mux);
-    free(mp);
-
-#if ENABLE_TSDEBUG
-    {
-      extern void tsdebugcw_go(void);
-      tsdebugcw_go();
-    }
-#endif
-
-    tvh_mutex_lock(&mi->mi_input_lock);
   }
 
   tvhtrace(LS_MPEGTS, "input %s got %zu bytes (finish)", buf, bytes);
 
   /* Flush */
-  while ((mp = TAILQ_FIRST(&mi->mi_input_queue))) {
-    memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
-    TAILQ_REMOVE(&mi->mi_input_queue, mp, mp_link);
-    if (mp->mp_mux)
-      mpegts_mux_release(mp->mp_mux);
-    free(mp);
-  }
-  mi->mi_input_queue_size = 0;
+  tvh_mutex_lock(&mi->mi_input_lock);
+  mpegts_input_queue_flush(mi);
   tvh_mutex_unlock(&mi->mi_input_lock);
 
   tprofile_done(&tprofile);
@@ -1790,18 +1931,18 @@ mpegts_input_table_thread ( void *aux )
   mpegts_input_t *mi = aux;
   mpegts_mux_t *mm = NULL;
 
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mi->mi_table_lock);
   while (atomic_get(&mi->mi_running)) {
 
     /* Wait for data */
     if (!(mtf = TAILQ_FIRST(&mi->mi_table_queue))) {
-      tvh_cond_wait(&mi->mi_table_cond, &mi->mi_output_lock);
+      tvh_cond_wait(&mi->mi_table_cond, &mi->mi_table_lock);
       continue;
     }
     mi->mi_table_queue_size -= mtf->mtf_len;
     memoryinfo_free(&mpegts_input_table_memoryinfo, sizeof(mpegts_table_feed_t) + mtf->mtf_len);
     TAILQ_REMOVE(&mi->mi_table_queue, mtf, mtf_link);
-    tvh_mutex_unlock(&mi->mi_output_lock);
+    tvh_mutex_unlock(&mi->mi_table_lock);
 
     /* Process */
     tvh_mutex_lock(&global_lock);
@@ -1817,7 +1958,7 @@ mpegts_input_table_thread ( void *aux )
 
     /* Cleanup */
     free(mtf);
-    tvh_mutex_lock(&mi->mi_output_lock);
+    tvh_mutex_lock(&mi->mi_table_lock);
   }
 
   /* Flush */
@@ -1827,17 +1968,283 @@ mpegts_input_table_thread ( void *aux )
     free(mtf);
   }
   mi->mi_table_queue_size = 0;
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mi->mi_table_lock);
 
   return NULL;
 }
 
+/* **************************************************************************
+ * Demux worker pool
+ *
+ * Inputs carrying many muxes (mi_demux_pool) do not use the per-input
+ * thread. Each mux has its own work queue and the muxes with pending
+ * data are scheduled to a shared pool of workers. A mux is owned by
+ * one worker at a time, so the data order within the mux is kept while
+ * the different muxes are demuxed in parallel (under mm_output_lock).
+ * *************************************************************************/
+
+#define MPEGTS_DEMUX_BATCH      16                /* chunks per turn */
+#define MPEGTS_DEMUX_QUEUE_MAX  (20*1024*1024)    /* per mux */
+
+enum {
+  MM_DEMUX_IDLE,
+  MM_DEMUX_QUEUED,
+  MM_DEMUX_RUNNING
+};
+
+static tvh_mutex_t        mpegts_demux_lock = TVH_THREAD_MUTEX_INITIALIZER;
+static tvh_cond_t         mpegts_demux_cond;
+static mpegts_mux_queue_t mpegts_demux_runq;
+static pthread_t         *mpegts_demux_tids;
+static int                mpegts_demux_count;
+static int                mpegts_demux_running;
+
+static void
+mpegts_input_demux_queue
+  ( mpegts_mux_instance_t *mmi, const uint8_t *tsb, int len, int flags )
+{
+  mpegts_input_t *mi = mmi->mmi_input;
+  mpegts_mux_t *mm = mmi->mmi_mux;
+  TAILQ_HEAD(,mpegts_packet) q;
+  mpegts_packet_t *mp;
+  uint8_t *tmp, *end;
+  uint32_t l;
+  uint64_t size = 0;
+  int cc_restart = (flags & MPEGTS_DATA_CC_RESTART) ? 1 : 0;
+  int remove_scrambled = mi->mi_remove_scrambled_bits ||
+                         (flags & MPEGTS_DATA_REMOVE_SCRAMBLED) != 0;
+
+  /* Copy outside the locks */
+  TAILQ_INIT(&q);
+  do {
+    l = MIN(len, MPEGTS_INPUT_SLOT_SIZE);
+    mp = malloc(sizeof(mpegts_packet_t) + l);
+    memcpy(mp->mp_data, tsb, l);
+    tsb += l;
+    len -= l;
+    if (remove_scrambled)
+      for (tmp = mp->mp_data, end = mp->mp_data + l; tmp < end; tmp += 188)
+        tmp[3] &= ~0xc0;
+    if (!cc_restart && data_noise(mp->mp_data, &l)) {
+      free(mp);
+      continue;
+    }
+    mp->mp_mux        = mm;
+    mp->mp_len        = l;
+    mp->mp_cc_restart = cc_restart;
+    TAILQ_INSERT_TAIL(&q, mp, mp_link);
+    size += l;
+    cc_restart = 0;
+  } while (len > 0);
+
+  if (TAILQ_EMPTY(&q))
+    return;
+
+  tvh_mutex_lock(&mi->mi_input_lock);
+  if (mm->mm_active != mmi)
+    goto drop;
+  tvh_mutex_lock(&mpegts_demux_lock);
+  if (!mpegts_demux_running) {
+    tvh_mutex_unlock(&mpegts_demux_lock);
+    goto drop;
+  }
+  if (mm->mm_demux_queue_size >= MPEGTS_DEMUX_QUEUE_MAX) {
+    tvh_mutex_unlock(&mpegts_demux_lock);
+    if (tvhlog_limit(&mi->mi_input_queue_loglimit, 10))
+      tvhwarn(LS_MPEGTS, "too much queued input data (over %dMB) for %s, discarding new",
+              MPEGTS_DEMUX_QUEUE_MAX / (1024*1024), mm->mm_nicename);
+    goto drop;
+  }
+  while ((mp = TAILQ_FIRST(&q)) != NULL) {
+    TAILQ_REMOVE(&q, mp, mp_link);
+    memoryinfo_alloc(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
+    TAILQ_INSERT_TAIL(&mm->mm_demux_queue, mp, mp_link);
+  }
+  mm->mm_demux_queue_size += size;
+  if (mm->mm_demux_state == MM_DEMUX_IDLE) {
+    mpegts_mux_grab(mm);
+    mm->mm_demux_state = MM_DEMUX_QUEUED;
+    TAILQ_INSERT_TAIL(&mpegts_demux_runq, mm, mm_demux_link);
+    tvh_cond_signal(&mpegts_demux_cond, 0);
+  }
+  tvh_mutex_unlock(&mpegts_demux_lock);
+  tvh_mutex_unlock(&mi->mi_input_lock);
+  return;
+
+drop:
+  tvh_mutex_unlock(&mi->mi_input_lock);
+  while ((mp = TAILQ_FIRST(&q)) != NULL) {
+    TAILQ_REMOVE(&q, mp, mp_link);
+    free(mp);
+  }
+}
+
+/*
+ * Drop the queued data, must be called with mpegts_demux_lock held,
+ * returns the number of the mux references to release
+ */
+static int
+mpegts_input_demux_flush0 ( mpegts_mux_t *mm )
+{
+  mpegts_packet_t *mp;
+
+  while ((mp = TAILQ_FIRST(&mm->mm_demux_queue)) != NULL) {
+    memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
+    TAILQ_REMOVE(&mm->mm_demux_queue, mp, mp_link);
+    free(mp);
+  }
+  mm->mm_demux_queue_size = 0;
+  if (mm->mm_demux_state == MM_DEMUX_QUEUED) {
+    TAILQ_REMOVE(&mpegts_demux_runq, mm, mm_demux_link);
+    mm->mm_demux_state = MM_DEMUX_IDLE;
+    return 1;
+  }
+  return 0;
+}
+
+static void
+mpegts_input_demux_flush ( mpegts_mux_t *mm )
+{
+  int release;
+
+  tvh_mutex_lock(&mpegts_demux_lock);
+  release = mpegts_input_demux_flush0(mm);
+  tvh_mutex_unlock(&mpegts_demux_lock);
+  if (release)
+    mpegts_mux_release(mm);
+}
+
+static void *
+mpegts_input_demux_thread ( void *aux )
+{
+  TAILQ_HEAD(,mpegts_packet) q;
+  mpegts_packet_t *mp;
+  mpegts_mux_t *mm;
+  tprofile_t tprofile;
+  size_t bytes;
+  char buf[32];
+  int i;
+
+  snprintf(buf, sizeof(buf), "demux %d", (int)(intptr_t)aux);
+  tprofile_init(&tprofile, buf);
+
+  tvh_mutex_lock(&mpegts_demux_lock);
+  while (mpegts_demux_running) {
+
+    if ((mm = TAILQ_FIRST(&mpegts_demux_runq)) == NULL) {
+      tvh_cond_wait(&mpegts_demux_cond, &mpegts_demux_lock);
+      continue;
+    }
+    TAILQ_REMOVE(&mpegts_demux_runq, mm, mm_demux_link);
+    mm->mm_demux_state = MM_DEMUX_RUNNING;
+
+    /* Take a batch, other muxes get their turn after it */
+    TAILQ_INIT(&q);
+    for (i = 0; i < MPEGTS_DEMUX_BATCH; i++) {
+      if ((mp = TAILQ_FIRST(&mm->mm_demux_queue)) == NULL)
+        break;
+      TAILQ_REMOVE(&mm->mm_demux_queue, mp, mp_link);
+      mm->mm_demux_queue_size -= mp->mp_len;
+      memoryinfo_free(&mpegts_input_queue_memoryinfo, sizeof(mpegts_packet_t) + mp->mp_len);
+      TAILQ_INSERT_TAIL(&q, mp, mp_link);
+    }
+    tvh_mutex_unlock(&mpegts_demux_lock);
+
+    bytes = 0;
+    while ((mp = TAILQ_FIRST(&q)) != NULL) {
+      TAILQ_REMOVE(&q, mp, mp_link);
+      bytes += mpegts_input_thread_process(&tprofile, mm, mp->mp_cc_restart,
+                                           mp->mp_data, mp->mp_len);
+      free(mp);
+    }
+    if (bytes)
+      tvhtrace(LS_MPEGTS, "%s %s got %zu bytes", buf, mm->mm_nicename, bytes);
+
+    tvh_mutex_lock(&mpegts_demux_lock);
+    if (!TAILQ_EMPTY(&mm->mm_demux_queue) && mpegts_demux_running) {
+      mm->mm_demux_state = MM_DEMUX_QUEUED;
+      TAILQ_INSERT_TAIL(&mpegts_demux_runq, mm, mm_demux_link);
+    } else {
+      mpegts_input_demux_flush0(mm);
+      mm->mm_demux_state = MM_DEMUX_IDLE;
+      tvh_mutex_unlock(&mpegts_demux_lock);
+      mpegts_mux_release(mm);
+      tvh_mutex_lock(&mpegts_demux_lock);
+    }
+  }
+  tvh_mutex_unlock(&mpegts_demux_lock);
+
+  tprofile_done(&tprofile);
+  return NULL;
+}
+
+static void
+mpegts_input_demux_pool_start ( void )
+{
+  long cpus;
+  int i;
+
+  lock_assert(&global_lock);
+
+  if (mpegts_demux_tids)
+    return;
+
+  mpegts_demux_count = config.demux_tpool_count;
+  if (mpegts_demux_count <= 0) {
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    mpegts_demux_count = cpus > 0 ? cpus : 1;
+  }
+  mpegts_demux_count = MINMAX(mpegts_demux_count, 1, 64);
+
+  TAILQ_INIT(&mpegts_demux_runq);
+  tvh_cond_init(&mpegts_demux_cond, 1);
+  mpegts_demux_running = 1;
+  mpegts_demux_tids = calloc(mpegts_demux_count, sizeof(pthread_t));
+  for (i = 0; i < mpegts_demux_count; i++)
+    tvh_thread_create(&mpegts_demux_tids[i], NULL, mpegts_input_demux_thread,
+                      (void *)(intptr_t)(i + 1), "mi-demux");
+  tvhinfo(LS_MPEGTS, "Using %d demux thread(s)", mpegts_demux_count);
+}
+
+void
+mpegts_input_demux_pool_done ( void )
+{
+  mpegts_mux_t *mm;
+  int i;
+
+  if (mpegts_demux_tids == NULL)
+    return;
+
+  tvh_mutex_lock(&mpegts_demux_lock);
+  mpegts_demux_running = 0;
+  tvh_cond_signal(&mpegts_demux_cond, 1);
+  tvh_mutex_unlock(&mpegts_demux_lock);
+  for (i = 0; i < mpegts_demux_count; i++)
+    pthread_join(mpegts_demux_tids[i], NULL);
+  free(mpegts_demux_tids);
+  mpegts_demux_tids = NULL;
+
+  /* Drop the muxes left in the run queue */
+  tvh_mutex_lock(&mpegts_demux_lock);
+  while ((mm = TAILQ_FIRST(&mpegts_demux_runq)) != NULL) {
+    mpegts_input_demux_flush0(mm);
+    tvh_mutex_unlock(&mpegts_demux_lock);
+    mpegts_mux_release(mm);
+    tvh_mutex_lock(&mpegts_demux_lock);
+  }
+  tvh_mutex_unlock(&mpegts_demux_lock);
+  tvh_cond_destroy(&mpegts_demux_cond);
+}
+
 void
 mpegts_input_flush_mux
   ( mpegts_input_t *mi, mpegts_mux_t *mm )
 {
   mpegts_table_feed_t *mtf;
   mpegts_packet_t *mp;
+  mpegts_input_ring_t *ring;
+  mpegts_input_slot_t *slot;
+  uint32_t tail, head;
 
   lock_assert(&global_lock);
 
@@ -1847,6 +2254,15 @@ mpegts_input_flush_mux
 
   /* Flush input Q */
   tvh_mutex_lock(&mi->mi_input_lock);
+  if ((ring = mi->mi_input_ring) != NULL) {
+    /* the consumer may take a slot at any time, use CAS */
+    head = ring->mir_head;
+    for (tail = atomic_get(&ring->mir_tail); tail != head; tail++) {
+      slot = &ring->mir_slots[tail & (MPEGTS_INPUT_RING_SLOTS - 1)];
+      if (atomic_cas_ptr((atomic_refptr_t)&slot->mis_mux, mm, NULL))
+        mpegts_mux_release(mm);
+    }
+  }
   TAILQ_FOREACH(mp, &mi->mi_input_queue, mp_link) {
     if (mp->mp_mux == mm) {
       mpegts_mux_release(mm);
@@ -1855,13 +2271,17 @@ mpegts_input_flush_mux
   }
   tvh_mutex_unlock(&mi->mi_input_lock);
 
+  /* Flush demux work Q */
+  if (mi->mi_demux_pool)
+    mpegts_input_demux_flush(mm);
+
   /* Flush table Q */
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mi->mi_table_lock);
   TAILQ_FOREACH(mtf, &mi->mi_table_queue, mtf_link) {
     if (mtf->mtf_mux == mm)
       mtf->mtf_mux = NULL;
   }
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mi->mi_table_lock);
   /* mux active must be NULL here */
   /* otherwise the picked mtf might be processed after mux deactivation */
   assert(mm->mm_active == NULL);
@@ -1895,6 +2315,8 @@ mpegts_input_stream_status
   st->max_weight  = w;
 
   st->pids = mpegts_pid_alloc();
+  /* mm_pids is changed under mm_output_lock only */
+  tvh_mutex_lock(&mm->mm_output_lock);
   RB_FOREACH(mp, &mm->mm_pids, mp_link) {
     if (mp->mp_pid == MPEGTS_TABLES_PID)
       continue;
@@ -1903,6 +2325,7 @@ mpegts_input_stream_status
     else
       mpegts_pid_add(st->pids, mp->mp_pid, 0);
   }
+  tvh_mutex_unlock(&mm->mm_output_lock);
 
   tvh_mutex_lock(&mmi->tii_stats_mutex);
   st->stats.signal = mmi->tii_stats.signal;
@@ -1996,8 +2419,10 @@ mpegts_input_thread_start ( void *aux )
   
   tvh_thread_create(&mi->mi_table_tid, NULL,
                     mpegts_input_table_thread, mi, "mi-table");
-  tvh_thread_create(&mi->mi_input_tid, NULL,
-                    mpegts_input_thread, mi, "mi-main");
+  /* the demux pool workers consume the per-mux queues */
+  if (!mi->mi_demux_pool)
+    tvh_thread_create(&mi->mi_input_tid, NULL,
+                      mpegts_input_thread, mi, "mi-main");
 }
 
 static void
@@ -2012,9 +2437,9 @@ mpegts_input_thread_stop ( mpegts_input_t *mi )
   tvh_mutex_unlock(&mi->mi_input_lock);
 
   /* Stop table thread */
-  tvh_mutex_lock(&mi->mi_output_lock);
+  tvh_mutex_lock(&mi->mi_table_lock);
   tvh_cond_signal(&mi->mi_table_cond, 0);
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mi->mi_table_lock);
 
   /* Join threads (relinquish lock due to potential deadlock) */
   tvh_mutex_unlock(&global_lock);
@@ -2106,6 +2531,7 @@ mpegts_input_create0
   TAILQ_INIT(&mi->mi_input_queue);
 
   tvh_mutex_init(&mi->mi_output_lock, NULL);
+  tvh_mutex_init(&mi->mi_table_lock, NULL);
   tvh_cond_init(&mi->mi_table_cond, 1);
   TAILQ_INIT(&mi->mi_table_queue);
 
@@ -2167,8 +2593,15 @@ mpegts_input_delete ( mpegts_input_t *mi, int delconf )
   /* Stop threads (will unlock global_lock to join) */
   mpegts_input_thread_stop(mi);
 
+  tvh_mutex_lock(&mi->mi_input_lock);
+  mpegts_input_queue_flush(mi);
+  mpegts_input_ring_destroy(mi->mi_input_ring);
+  mi->mi_input_ring = NULL;
+  tvh_mutex_unlock(&mi->mi_input_lock);
+
   tprofile_queue_done(&mi->mi_qprofile);
   tvh_mutex_destroy(&mi->mi_output_lock);
+  tvh_mutex_destroy(&mi->mi_table_lock);
   tvh_cond_destroy(&mi->mi_table_cond);
   free(mi->mi_name);
   free(mi->mi_linked);
@@ -770,6 +770,9 @@ mpegts_mux_free ( mpegts_mux_t *mm )
   free(mm->mm_charset);
   free(mm->mm_epg_module_id);
   free(mm->mm_nicename);
+  free(mm->mm_pid_dispatch);
+  assert(mm->mm_demux_state == 0 && TAILQ_EMPTY(&mm->mm_demux_queue));
+  tvh_mutex_destroy(&mm->mm_output_lock);
   free(mm);
 }
 
@@ -894,9 +897,7 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
   mpegts_input_flush_mux(mi, mm);
 
   /* Ensure PIDs are cleared */
-  tvh_mutex_lock(&mi->mi_output_lock);
-  mm->mm_last_pid = -1;
-  mm->mm_last_mp = NULL;
+  tvh_mutex_lock(&mm->mm_output_lock);
   while ((mp = RB_FIRST(&mm->mm_pids))) {
     assert(mi);
     if (mp->mp_pid == MPEGTS_FULLMUX_PID ||
@@ -922,10 +923,11 @@ mpegts_mux_stop ( mpegts_mux_t *mm, int force, int reason )
         free(mps);
       }
     }
-    RB_REMOVE(&mm->mm_pids, mp, mp_link);
-    free(mp);
+    mpegts_mux_del_pid(mm, mp);
   }
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  free(mm->mm_pid_dispatch);
+  mm->mm_pid_dispatch = NULL;
+  tvh_mutex_unlock(&mm->mm_output_lock);
 
   /* Scanning */
   mpegts_network_scan_mux_cancel(mm, 1);
@@ -946,10 +948,10 @@ mpegts_mux_update_pids_cb ( void *aux )
   if (mm && mm->mm_active) {
     mi = mm->mm_active->mmi_input;
     if (mi) {
-      tvh_mutex_lock(&mi->mi_output_lock);
+      tvh_mutex_lock(&mm->mm_output_lock);
       mm->mm_update_pids_flag = 0;
       mi->mi_update_pids(mi, mm);
-      tvh_mutex_unlock(&mi->mi_output_lock);
+      tvh_mutex_unlock(&mm->mm_output_lock);
     }
   }
 }
@@ -972,30 +974,27 @@ mpegts_mux_open_table ( mpegts_mux_t *mm, mpegts_table_t *mt, int subscribe )
     return;
   if (!mm->mm_active || !mm->mm_active->mmi_input) {
     mt->mt_subscribed = 0;
-    LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
-    mm->mm_num_tables++;
+    mpegts_table_link(mm, mt);
     return;
   }
   if (mt->mt_flags & MT_DEFER) {
     if (mt->mt_defer_cmd == MT_DEFER_OPEN_PID)
       return;
     mpegts_table_grab(mt); /* thread will release the table */
-    LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
-    mm->mm_num_tables++;
+    mpegts_table_link(mm, mt);
     mt->mt_defer_cmd = MT_DEFER_OPEN_PID;
     TAILQ_INSERT_TAIL(&mm->mm_defer_tables, mt, mt_defer_link);
     return;
   }
   mi = mm->mm_active->mmi_input;
-  LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
-  mm->mm_num_tables++;
+  mpegts_table_link(mm, mt);
   if (subscribe && !mt->mt_subscribed) {
     mpegts_table_grab(mt);
     mt->mt_subscribed = 1;
     tvh_mutex_unlock(&mm->mm_tables_lock);
-    tvh_mutex_lock(&mi->mi_output_lock);
+    tvh_mutex_lock(&mm->mm_output_lock);
     mpegts_input_open_pid(mi, mm, mt->mt_pid, mpegts_table_type(mt), mt->mt_weight, mt, 0);
-    tvh_mutex_unlock(&mi->mi_output_lock);
+    tvh_mutex_unlock(&mm->mm_output_lock);
     tvh_mutex_lock(&mm->mm_tables_lock);
     mpegts_table_release(mt);
   }
@@ -1013,9 +1012,9 @@ mpegts_mux_unsubscribe_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
     mpegts_table_grab(mt);
     mt->mt_subscribed = 0;
     tvh_mutex_unlock(&mm->mm_tables_lock);
-    tvh_mutex_lock(&mi->mi_output_lock);
+    tvh_mutex_lock(&mm->mm_output_lock);
     mpegts_input_close_pid(mi, mm, mt->mt_pid, mpegts_table_type(mt), mt);
-    tvh_mutex_unlock(&mi->mi_output_lock);
+    tvh_mutex_unlock(&mm->mm_output_lock);
     tvh_mutex_lock(&mm->mm_tables_lock);
     mpegts_table_release(mt);
   }
@@ -1039,15 +1038,13 @@ mpegts_mux_close_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
         return;
     }
     mt->mt_subscribed = 0;
-    LIST_REMOVE(mt, mt_link);
-    mm->mm_num_tables--;
+    mpegts_table_unlink(mm, mt);
     return;
   }
   if (mt->mt_flags & MT_DEFER) {
     if (mt->mt_defer_cmd == MT_DEFER_CLOSE_PID)
       return;
-    LIST_REMOVE(mt, mt_link);
-    mm->mm_num_tables--;
+    mpegts_table_unlink(mm, mt);
     if (mt->mt_defer_cmd == MT_DEFER_OPEN_PID) {
       TAILQ_REMOVE(&mm->mm_defer_tables, mt, mt_defer_link);
       mt->mt_defer_cmd = 0;
@@ -1059,8 +1056,7 @@ mpegts_mux_close_table ( mpegts_mux_t *mm, mpegts_table_t *mt )
     TAILQ_INSERT_TAIL(&mm->mm_defer_tables, mt, mt_defer_link);
     return;
   }
-  LIST_REMOVE(mt, mt_link);
-  mm->mm_num_tables--;
+  mpegts_table_unlink(mm, mt);
   mm->mm_unsubscribe_table(mm, mt);
 }
 
@@ -1247,6 +1243,8 @@ mpegts_mux_create0
   mm->mm_open_table          = mpegts_mux_open_table;
   mm->mm_unsubscribe_table   = mpegts_mux_unsubscribe_table;
   mm->mm_close_table         = mpegts_mux_close_table;
+  tvh_mutex_init(&mm->mm_output_lock, NULL);
+  TAILQ_INIT(&mm->mm_demux_queue);
   tvh_mutex_init(&mm->mm_tables_lock, NULL);
   TAILQ_INIT(&mm->mm_table_queue);
   TAILQ_INIT(&mm->mm_defer_tables);
@@ -1255,7 +1253,6 @@ mpegts_mux_create0
   TAILQ_INIT(&mm->mm_descrambler_emms);
   tvh_mutex_init(&mm->mm_descrambler_lock, NULL);
 
-  mm->mm_last_pid            = -1;
   mm->mm_created             = gclk();
 
   /* Configuration */
@@ -1516,31 +1513,45 @@ static int mp_cmp ( mpegts_pid_t *a, mpegts_pid_t *b )
 mpegts_pid_t *
 mpegts_mux_find_pid_ ( mpegts_mux_t *mm, int pid, int create )
 {
-  mpegts_pid_t skel, *mp;
+  mpegts_pid_dispatch_t *mpd;
+  mpegts_pid_t *mp;
+
+  lock_assert(&mm->mm_output_lock);
 
   if (pid < 0 || pid > MPEGTS_TABLES_PID) return NULL;
 
-  skel.mp_pid = pid;
-  mp = RB_FIND(&mm->mm_pids, &skel, mp_link, mp_cmp);
-  if (mp == NULL) {
-    if (create) {
-      mp = calloc(1, sizeof(*mp));
-      mp->mp_pid = pid;
-      if (!RB_INSERT_SORTED(&mm->mm_pids, mp, mp_link, mp_cmp)) {
-        mp->mp_cc = -1;
-      } else {
-        free(mp);
-        mp = NULL;
-      }
-    }
+  /* the dispatch table is the PID index, mm_pids keeps the order only */
+  if ((mpd = mm->mm_pid_dispatch) == NULL) {
+    if (!create) return NULL;
+    mpd = mm->mm_pid_dispatch = calloc(1, sizeof(mpegts_pid_dispatch_t));
   }
-  if (mp) {
-    mm->mm_last_pid = pid;
-    mm->mm_last_mp = mp;
+  mp = mpd->mpd_pids[pid];
+  if (mp == NULL && create) {
+    mp = calloc(1, sizeof(*mp));
+    mp->mp_pid = pid;
+    mp->mp_cc = -1;
+    RB_INSERT_SORTED(&mm->mm_pids, mp, mp_link, mp_cmp);
+    mpd->mpd_pids[pid] = mp;
+    if (pid < 8192)
+      set_bit(pid, mpd->mpd_subscribed);
   }
   return mp;
 }
 
+void
+mpegts_mux_del_pid ( mpegts_mux_t *mm, mpegts_pid_t *mp )
+{
+  mpegts_pid_dispatch_t *mpd = mm->mm_pid_dispatch;
+
+  if (mpd) {
+    mpd->mpd_pids[mp->mp_pid] = NULL;
+    if (mp->mp_pid < 8192)
+      clear_bit(mp->mp_pid, mpd->mpd_subscribed);
+  }
+  RB_REMOVE(&mm->mm_pids, mp, mp_link);
+  free(mp);
+}
+
 /* **************************************************************************
  * Misc
  * *************************************************************************/
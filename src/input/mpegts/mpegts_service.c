@@ -236,6 +236,16 @@ const idclass_t mpegts_service_class =
       .off      = offsetof(mpegts_service_t, s_dvb_forcecaid),
       .opts     = PO_EXPERT | PO_HEXA,
     },
+    {
+      .type     = PT_BOOL,
+      .id       = "csa_lowlatency",
+      .name     = N_("Low latency descrambling"),
+      .desc     = N_("Decrypt the CSA scrambled packets as soon as they "
+                     "arrive instead of batching them. This shortens "
+                     "the zap time at the cost of CPU."),
+      .off      = offsetof(mpegts_service_t, s_csa_lowlatency),
+      .opts     = PO_EXPERT,
+    },
     {
       .type     = PT_INT,
       .id       = "pts_shift",
@@ -788,8 +798,8 @@ mpegts_service_pid_list_ ( service_t *t, void *owner )
   mpegts_pid_t *mp;
 
   if (mi == NULL) return NULL;
-  tvh_mutex_lock(&mi->mi_output_lock);
   mm = ms->s_dvb_mux;
+  tvh_mutex_lock(&mm->mm_output_lock);
   RB_FOREACH(mp, &mm->mm_pids, mp_link) {
     RB_FOREACH(mps, &mp->mp_subs, mps_link) {
       if (owner == NULL || mps->mps_owner == owner) {
@@ -800,7 +810,7 @@ mpegts_service_pid_list_ ( service_t *t, void *owner )
       }
     }
   }
-  tvh_mutex_unlock(&mi->mi_output_lock);
+  tvh_mutex_unlock(&mm->mm_output_lock);
   return pids;
 }
 
@@ -1038,7 +1048,7 @@ mpegts_service_raw_update_pids(mpegts_service_t *t, mpegts_apids_t *pids)
   } else
     p = NULL;
   if (mi && mm) {
-    tvh_mutex_lock(&mi->mi_output_lock);
+    tvh_mutex_lock(&mm->mm_output_lock);
     tvh_mutex_lock(&t->s_stream_mutex);
     x = t->s_pids;
     t->s_pids = p;
@@ -1074,7 +1084,7 @@ mpegts_service_raw_update_pids(mpegts_service_t *t, mpegts_apids_t *pids)
       }
     }
     tvh_mutex_unlock(&t->s_stream_mutex);
-    tvh_mutex_unlock(&mi->mi_output_lock);
+    tvh_mutex_unlock(&mm->mm_output_lock);
     mpegts_mux_update_pids(mm);
   } else {
     tvh_mutex_lock(&t->s_stream_mutex);
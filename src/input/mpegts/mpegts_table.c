@@ -18,30 +18,129 @@
 
 #include "tvheadend.h"
 #include "input.h"
+#include "memoryinfo.h"
 
 #include <assert.h>
 
+memoryinfo_t mpegts_table_scache_memoryinfo = { .my_name = "MPEG-TS section cache" };
+
 void
 mpegts_table_consistency_check ( mpegts_mux_t *mm )
 {
-  int i, c;
+  int i, c, p;
   mpegts_table_t *mt;
+  mpegts_table_pid_t *mtp;
 
   if (!tvhtrace_enabled())
     return;
 
-  c = 0;
+  c = p = 0;
 
   lock_assert(&mm->mm_tables_lock);
 
   i = mm->mm_num_tables;
-  LIST_FOREACH(mt, &mm->mm_tables, mt_link)
+  LIST_FOREACH(mt, &mm->mm_tables, mt_link) {
     c++;
+    if (mt->mt_pid >= 0)
+      p++;
+  }
 
   if (i != c) {
     tvherror(LS_MPEGTS, "table: mux %p count inconsistency (num %d, list %d)", mm, i, c);
     abort();
   }
+
+  RB_FOREACH(mtp, &mm->mm_table_pids, mtp_link)
+    p -= mtp->mtp_count[0] + mtp->mtp_count[1];
+  if (p) {
+    tvherror(LS_MPEGTS, "table: mux %p PID index inconsistency (%d)", mm, p);
+    abort();
+  }
+}
+
+/*
+ * Per-PID table index
+ */
+
+static int
+mpegts_table_pid_cmp ( mpegts_table_pid_t *a, mpegts_table_pid_t *b )
+{
+  return a->mtp_pid - b->mtp_pid;
+}
+
+mpegts_table_pid_t *
+mpegts_table_pid_find ( mpegts_mux_t *mm, int pid )
+{
+  mpegts_table_pid_t skel;
+
+  lock_assert(&mm->mm_tables_lock);
+
+  skel.mtp_pid = pid;
+  return RB_FIND(&mm->mm_table_pids, &skel, mtp_link, mpegts_table_pid_cmp);
+}
+
+static void
+mpegts_table_index_add ( mpegts_mux_t *mm, mpegts_table_t *mt )
+{
+  mpegts_table_pid_t *mtp;
+  int fast = (mt->mt_flags & MT_FAST) != 0;
+
+  if (mt->mt_pid < 0 || mt->mt_pid_index)
+    return;
+  if ((mtp = mpegts_table_pid_find(mm, mt->mt_pid)) == NULL) {
+    mtp = calloc(1, sizeof(*mtp));
+    mtp->mtp_pid = mt->mt_pid;
+    RB_INSERT_SORTED(&mm->mm_table_pids, mtp, mtp_link, mpegts_table_pid_cmp);
+  }
+  LIST_INSERT_HEAD(&mtp->mtp_tables[fast], mt, mt_pid_link);
+  mtp->mtp_count[fast]++;
+  mt->mt_pid_index = mtp;
+}
+
+static void
+mpegts_table_index_del ( mpegts_mux_t *mm, mpegts_table_t *mt )
+{
+  mpegts_table_pid_t *mtp = mt->mt_pid_index;
+  int fast = (mt->mt_flags & MT_FAST) != 0;
+
+  if (mtp == NULL)
+    return;
+  LIST_REMOVE(mt, mt_pid_link);
+  mtp->mtp_count[fast]--;
+  mt->mt_pid_index = NULL;
+  if (mtp->mtp_count[0] == 0 && mtp->mtp_count[1] == 0) {
+    RB_REMOVE(&mm->mm_table_pids, mtp, mtp_link);
+    free(mtp);
+  }
+}
+
+/*
+ * Add / remove the table to / from the mux table list and the PID index
+ */
+void
+mpegts_table_link ( mpegts_mux_t *mm, mpegts_table_t *mt )
+{
+  lock_assert(&mm->mm_tables_lock);
+
+  if (mt->mt_linked)
+    return;
+  mt->mt_linked = 1;
+  LIST_INSERT_HEAD(&mm->mm_tables, mt, mt_link);
+  mm->mm_num_tables++;
+  mpegts_table_index_add(mm, mt);
+}
+
+void
+mpegts_table_unlink ( mpegts_mux_t *mm, mpegts_table_t *mt )
+{
+  lock_assert(&mm->mm_tables_lock);
+
+  if (!mt->mt_linked)
+    return;
+  mt->mt_linked = 0;
+  mpegts_table_index_del(mm, mt);
+  LIST_REMOVE(mt, mt_link);
+  mm->mm_num_tables--;
 }
 
 static void
@@ -78,11 +177,132 @@ mpegts_table_fastswitch ( mpegts_mux_t *mm, mpegts_table_t *mtm )
   mpegts_mux_scan_done(mm, mm->mm_nicename, 1);
 }
 
+/*
+ * Section cache
+ *
+ * The tables repeat every few seconds. A long section which was skipped
+ * by dvb_table_begin() on the state alone gives the same result until
+ * the section or the table state changes, so the callback is not called
+ * again for it. Open addressing with linear probing, all entries expire
+ * at once when the state generation changes.
+ */
+#define MPEGTS_SCACHE_MIN_BITS 6
+#define MPEGTS_SCACHE_MAX_BITS 16
+
+static inline int
+mpegts_table_scache_live ( mpegts_table_t *mt, mpegts_table_scache_t *sce )
+{
+  return sce->sce_used && sce->sce_gen == mt->mt_state_gen;
+}
+
+static mpegts_table_scache_t *
+mpegts_table_scache_find
+  ( mpegts_table_t *mt, uint32_t key, uint32_t crc, uint8_t ver )
+{
+  mpegts_table_scache_t *sce;
+  uint32_t i, mask;
+
+  if (mt->mt_scache == NULL)
+    return NULL;
+  mask = (1 << mt->mt_scache_bits) - 1;
+  i = ((key ^ crc) * 0x9E3779B1) >> (32 - mt->mt_scache_bits);
+  while (1) {
+    sce = &mt->mt_scache[i];
+    if (!mpegts_table_scache_live(mt, sce))
+      return sce;
+    if (sce->sce_key == key && sce->sce_crc == crc && sce->sce_ver == ver)
+      return sce;
+    i = (i + 1) & mask;
+  }
+}
+
+static void
+mpegts_table_scache_resize ( mpegts_table_t *mt, int bits )
+{
+  mpegts_table_scache_t *old = mt->mt_scache, *sce;
+  int i, osize = old ? 1 << mt->mt_scache_bits : 0;
+
+  mt->mt_scache = calloc(1 << bits, sizeof(*sce));
+  mt->mt_scache_bits = bits;
+  memoryinfo_alloc(&mpegts_table_scache_memoryinfo, (1 << bits) * sizeof(*sce));
+  for (i = 0; i < osize; i++)
+    if (mpegts_table_scache_live(mt, &old[i])) {
+      sce = mpegts_table_scache_find(mt, old[i].sce_key, old[i].sce_crc,
+                                     old[i].sce_ver);
+      *sce = old[i];
+    }
+  if (old) {
+    memoryinfo_free(&mpegts_table_scache_memoryinfo, osize * sizeof(*sce));
+    free(old);
+  }
+}
+
+static void
+mpegts_table_scache_store
+  ( mpegts_table_t *mt, uint32_t key, uint32_t crc, uint8_t ver, int ret )
+{
+  mpegts_table_scache_t *sce;
+
+  if (mt->mt_scache_gen != mt->mt_state_gen) {
+    mt->mt_scache_gen = mt->mt_state_gen;
+    mt->mt_scache_count = 0;
+  }
+  if (mt->mt_scache == NULL) {
+    mpegts_table_scache_resize(mt, MPEGTS_SCACHE_MIN_BITS);
+  } else if ((mt->mt_scache_count + 1) * 2 > (1 << mt->mt_scache_bits)) {
+    if (mt->mt_scache_bits >= MPEGTS_SCACHE_MAX_BITS)
+      return;
+    mpegts_table_scache_resize(mt, mt->mt_scache_bits + 1);
+  }
+  sce = mpegts_table_scache_find(mt, key, crc, ver);
+  if (!mpegts_table_scache_live(mt, sce)) {
+    sce->sce_key  = key;
+    sce->sce_crc  = crc;
+    sce->sce_ver  = ver;
+    sce->sce_gen  = mt->mt_state_gen;
+    sce->sce_used = 1;
+    mt->mt_scache_count++;
+  }
+  sce->sce_ret = ret;
+}
+
+static void
+mpegts_table_scache_free ( mpegts_table_t *mt )
+{
+  if (mt->mt_scache_hits || mt->mt_scache_misses)
+    tvhdebug(mt->mt_subsys, "%s: section cache hits %"PRIu64" misses %"PRIu64,
+             mt->mt_name, mt->mt_scache_hits, mt->mt_scache_misses);
+  if (mt->mt_scache) {
+    memoryinfo_free(&mpegts_table_scache_memoryinfo,
+                    (1 << mt->mt_scache_bits) * sizeof(mpegts_table_scache_t));
+    free(mt->mt_scache);
+    mt->mt_scache = NULL;
+  }
+}
+
+/*
+ * Forget the cached sections, the table users are about to start over
+ */
+void
+mpegts_table_scache_flush ( mpegts_mux_t *mm )
+{
+  mpegts_table_t *mt;
+
+  tvh_mutex_lock(&mm->mm_tables_lock);
+  LIST_FOREACH(mt, &mm->mm_tables, mt_link)
+    atomic_set(&mt->mt_scache_reset, 1);
+  tvh_mutex_unlock(&mm->mm_tables_lock);
+}
+
 void
 mpegts_table_dispatch
   ( const uint8_t *sec, size_t r, void *aux )
 {
-  int tid, len, crc_len, ret;
+  int tid, len, plen, crc_len, ret, cache;
+  uint32_t key = 0, crc = 0;
+  uint8_t ver = 0;
+  const uint8_t *ptr;
+  mpegts_table_scache_t *sce;
   mpegts_table_t *mt = aux;
 
   if(mt->mt_destroyed)
@@ -97,13 +317,48 @@ mpegts_table_dispatch
   crc_len = (mt->mt_flags & MT_CRC) ? 4 : 0;
 
   /* Pass with tableid / len in data */
-  if (mt->mt_flags & MT_FULL)
-    ret = mt->mt_callback(mt, sec, len+3-crc_len, tid);
-
+  if (mt->mt_flags & MT_FULL) {
+    ptr = sec;
+    plen = len + 3 - crc_len;
   /* Pass w/out tableid/len in data */
-  else
-    ret = mt->mt_callback(mt, sec+3, len-crc_len, tid);
-  
+  } else {
+    ptr = sec + 3;
+    plen = len - crc_len;
+  }
+
+  /* Section cache (long sections only) */
+  if (atomic_exchange(&mt->mt_scache_reset, 0))
+    mt->mt_state_gen++;
+  cache = (sec[1] & 0x80) && len >= 9;
+  if (cache) {
+    key = (tid << 24) | (sec[3] << 16) | (sec[4] << 8) | sec[6];
+    ver = (sec[5] >> 1) & 0x1f;
+    if (crc_len)
+      crc = ((uint32_t)sec[len-1] << 24) | (sec[len] << 16) |
+            (sec[len+1] << 8) | sec[len+2];
+    else
+      crc = tvh_crc32(sec, len + 3, 0xffffffff);
+    sce = mpegts_table_scache_find(mt, key, crc, ver);
+    if (sce && mpegts_table_scache_live(mt, sce)) {
+      mt->mt_scache_hits++;
+      atomic_add_s64(&mpegts_table_scache_memoryinfo.my_pool_hits, 1);
+      /* the side effects of the callback (statistics, OTA interest) */
+      if (mt->mt_cached)
+        mt->mt_cached(mt, ptr, plen, tid);
+      ret = sce->sce_ret;
+      goto cached;
+    }
+    mt->mt_scache_misses++;
+    atomic_add_s64(&mpegts_table_scache_memoryinfo.my_pool_misses, 1);
+  }
+  mt->mt_sect_skip = 0;
+
+  ret = mt->mt_callback(mt, ptr, plen, tid);
+
+  if (cache && mt->mt_sect_skip && !mt->mt_destroyed)
+    mpegts_table_scache_store(mt, key, crc, ver, ret);
+
+cached:
   /* Good */
   if(ret >= 0)
     mt->mt_count++;
@@ -116,6 +371,7 @@ void
 mpegts_table_release_ ( mpegts_table_t *mt )
 {
   dvb_table_release((mpegts_psi_table_t *)mt);
+  mpegts_table_scache_free(mt);
   tvhtrace(LS_MPEGTS, "table: mux %p free %s %02X/%02X (%d) pid %04X (%d)",
            mt->mt_mux, mt->mt_name, mt->mt_table, mt->mt_mask, mt->mt_table,
            mt->mt_pid, mt->mt_pid);
@@ -219,8 +475,11 @@ mpegts_table_add
     if (mt->mt_pid < 0) {
       if (strcmp(mt->mt_name, name))
         continue;
+      mpegts_table_index_del(mm, mt);
       mt->mt_callback   = callback;
       mt->mt_pid        = pid;
+      if (mt->mt_linked)
+        mpegts_table_index_add(mm, mt);
       mt->mt_weight     = weight;
       mt->mt_table      = tableid;
       mm->mm_open_table(mm, mt, 1);
@@ -303,6 +562,7 @@ mpegts_table_flush_all ( mpegts_mux_t *mm )
   assert(mm->mm_num_tables == 0);
   assert(TAILQ_FIRST(&mm->mm_defer_tables) == NULL);
   assert(LIST_FIRST(&mm->mm_tables) == NULL);
+  assert(RB_FIRST(&mm->mm_table_pids) == NULL);
   tvh_mutex_unlock(&mm->mm_tables_lock);
 }
 
@@ -77,6 +77,8 @@
 #include "memoryinfo.h"
 #include "watchdog.h"
 #include "tprofile.h"
+#include "crc32.h"
+#include "tsscan.h"
 #if CONFIG_LINUXDVB_CA
 #include "input/mpegts/en50221/en50221.h"
 #endif
@@ -1279,6 +1281,8 @@ main(int argc, char **argv)
   en50221_register_apps();
 #endif
 
+  tvhftrace(LS_MAIN, crc32_init);
+  tvhftrace(LS_MAIN, tsscan_init);
   tvhftrace(LS_MAIN, streaming_init);
   tvhftrace(LS_MAIN, tvh_hardware_init);
   tvhftrace(LS_MAIN, dbus_server_init, opt_dbus, opt_dbus_session);
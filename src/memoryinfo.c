@@ -80,6 +80,30 @@ const idclass_t memoryinfo_class = {
       .off      = offsetof(memoryinfo_t, my_peak_count),
       .opts     = PO_RDONLY | PO_NOSAVE,
     },
+    {
+      .type     = PT_S64_ATOMIC,
+      .id       = "pool_size",
+      .name     = N_("Pooled size"),
+      .desc     = N_("Size of the free objects kept for reuse."),
+      .off      = offsetof(memoryinfo_t, my_pool_size),
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_EXPERT,
+    },
+    {
+      .type     = PT_S64_ATOMIC,
+      .id       = "pool_hits",
+      .name     = N_("Pool hits"),
+      .desc     = N_("Number of allocations (or lookups) served from the pool or cache."),
+      .off      = offsetof(memoryinfo_t, my_pool_hits),
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_EXPERT,
+    },
+    {
+      .type     = PT_S64_ATOMIC,
+      .id       = "pool_misses",
+      .name     = N_("Pool misses"),
+      .desc     = N_("Number of allocations (or lookups) not served from the pool or cache."),
+      .off      = offsetof(memoryinfo_t, my_pool_misses),
+      .opts     = PO_RDONLY | PO_NOSAVE | PO_EXPERT,
+    },
     {}
   }
 };
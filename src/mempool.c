@@ -0,0 +1,248 @@
+/*
+ *  Tvheadend - object pools
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "atomic.h"
+#include "memoryinfo.h"
+#include "mempool.h"
+
+#define MEMPOOL_SLOTS        16
+#define MEMPOOL_CACHE_BYTES  (64*1024)
+#define MEMPOOL_DEPOT_BYTES  (4*1024*1024)
+
+typedef struct mempool_slot {
+  void    *ms_free;
+  int      ms_count;
+  int64_t  ms_hits;
+  int64_t  ms_misses;
+} mempool_slot_t;
+
+typedef struct mempool_cache {
+  LIST_ENTRY(mempool_cache) mc_link;
+  mempool_slot_t mc_slots[MEMPOOL_SLOTS];
+} mempool_cache_t;
+
+static tvh_mutex_t mempool_lock = TVH_THREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(, mempool) mempools;
+static LIST_HEAD(, mempool_cache) mempool_caches;
+static mempool_t *mempool_slots[MEMPOOL_SLOTS];
+static int mempool_slots_count;
+static pthread_key_t mempool_key;
+static pthread_once_t mempool_once = PTHREAD_ONCE_INIT;
+
+static __thread mempool_cache_t *mempool_tcache;
+
+/*
+ * Move the objects from the thread cache to the depot
+ */
+static void
+mempool_flush(mempool_t *mp, mempool_slot_t *ms, int count)
+{
+  void *first, *last, *surplus = NULL;
+  int n;
+
+  if (count <= 0 || ms->ms_free == NULL)
+    return;
+  first = last = ms->ms_free;
+  for (n = 1; n < count && *(void **)last; n++)
+    last = *(void **)last;
+  ms->ms_free = *(void **)last;
+  ms->ms_count -= n;
+  tvh_mutex_lock(&mp->mp_lock);
+  if (mp->mp_depot_count + n <= mp->mp_depot_max) {
+    *(void **)last = mp->mp_depot;
+    mp->mp_depot = first;
+    mp->mp_depot_count += n;
+  } else {
+    *(void **)last = NULL;
+    surplus = first;
+  }
+  tvh_mutex_unlock(&mp->mp_lock);
+  while (surplus) {
+    first = surplus;
+    surplus = *(void **)surplus;
+    free(first);
+  }
+}
+
+/*
+ * Move the objects from the depot to the thread cache
+ */
+static void
+mempool_refill(mempool_t *mp, mempool_slot_t *ms, int count)
+{
+  void *first, *last;
+  int n;
+
+  tvh_mutex_lock(&mp->mp_lock);
+  if ((first = mp->mp_depot) != NULL) {
+    last = first;
+    for (n = 1; n < count && *(void **)last; n++)
+      last = *(void **)last;
+    mp->mp_depot = *(void **)last;
+    mp->mp_depot_count -= n;
+    *(void **)last = ms->ms_free;
+    ms->ms_free = first;
+    ms->ms_count += n;
+  }
+  tvh_mutex_unlock(&mp->mp_lock);
+}
+
+static void
+mempool_thread_exit(void *aux)
+{
+  mempool_cache_t *mc = aux;
+  mempool_slot_t *ms;
+  mempool_t *mp;
+  int i;
+
+  tvh_mutex_lock(&mempool_lock);
+  LIST_REMOVE(mc, mc_link);
+  for (i = 0; i < mempool_slots_count; i++) {
+    mp = mempool_slots[i];
+    ms = &mc->mc_slots[i];
+    mempool_flush(mp, ms, ms->ms_count);
+    mp->mp_hits += ms->ms_hits;
+    mp->mp_misses += ms->ms_misses;
+  }
+  tvh_mutex_unlock(&mempool_lock);
+  mempool_tcache = NULL;
+  free(mc);
+}
+
+static void
+mempool_key_init(void)
+{
+  pthread_key_create(&mempool_key, mempool_thread_exit);
+}
+
+static mempool_cache_t *
+mempool_cache_get(mempool_t *mp)
+{
+  mempool_cache_t *mc;
+
+  if (mp->mp_slot == 0) {
+    tvh_mutex_lock(&mempool_lock);
+    if (mp->mp_slot == 0) {
+      if (mempool_slots_count < MEMPOOL_SLOTS) {
+        mp->mp_cache_max = MINMAX(MEMPOOL_CACHE_BYTES / mp->mp_size, 8, 256);
+        mp->mp_depot_max = MAX(MEMPOOL_DEPOT_BYTES / mp->mp_size, 256);
+        mempool_slots[mempool_slots_count++] = mp;
+        LIST_INSERT_HEAD(&mempools, mp, mp_link);
+        atomic_set(&mp->mp_slot, mempool_slots_count);
+      } else {
+        atomic_set(&mp->mp_slot, -1);
+      }
+    }
+    tvh_mutex_unlock(&mempool_lock);
+  }
+  if (mp->mp_slot < 0)
+    return NULL;
+  if ((mc = mempool_tcache) == NULL) {
+    pthread_once(&mempool_once, mempool_key_init);
+    if ((mc = calloc(1, sizeof(*mc))) == NULL)
+      return NULL;
+    tvh_mutex_lock(&mempool_lock);
+    LIST_INSERT_HEAD(&mempool_caches, mc, mc_link);
+    tvh_mutex_unlock(&mempool_lock);
+    pthread_setspecific(mempool_key, mc);
+    mempool_tcache = mc;
+  }
+  return mc;
+}
+
+/*
+ *
+ */
+void *
+mempool_alloc(mempool_t *mp)
+{
+  mempool_cache_t *mc = mempool_tcache;
+  mempool_slot_t *ms;
+  void **p;
+
+  if (mc == NULL || mp->mp_slot <= 0)
+    if ((mc = mempool_cache_get(mp)) == NULL)
+      return malloc(mp->mp_size);
+  ms = &mc->mc_slots[mp->mp_slot - 1];
+  if (ms->ms_free == NULL)
+    mempool_refill(mp, ms, mp->mp_cache_max / 2);
+  if ((p = ms->ms_free) != NULL) {
+    ms->ms_free = *p;
+    ms->ms_count--;
+    ms->ms_hits++;
+    return p;
+  }
+  ms->ms_misses++;
+  return malloc(mp->mp_size);
+}
+
+void
+mempool_free(mempool_t *mp, void *ptr)
+{
+  mempool_cache_t *mc = mempool_tcache;
+  mempool_slot_t *ms;
+
+  if (ptr == NULL)
+    return;
+  if (mc == NULL || mp->mp_slot <= 0)
+    if ((mc = mempool_cache_get(mp)) == NULL) {
+      free(ptr);
+      return;
+    }
+  ms = &mc->mc_slots[mp->mp_slot - 1];
+  *(void **)ptr = ms->ms_free;
+  ms->ms_free = ptr;
+  if (++ms->ms_count > mp->mp_cache_max)
+    mempool_flush(mp, ms, mp->mp_cache_max / 2);
+}
+
+/*
+ * The pool statistics for memoryinfo, the thread caches
+ * are read without locking (approximate values)
+ */
+void
+mempool_memoryinfo_update(memoryinfo_t *my)
+{
+  mempool_cache_t *mc;
+  mempool_slot_t *ms;
+  mempool_t *mp;
+  int64_t size = 0, hits = 0, misses = 0, count;
+
+  tvh_mutex_lock(&mempool_lock);
+  LIST_FOREACH(mp, &mempools, mp_link) {
+    if (mp->mp_memoryinfo != my)
+      continue;
+    tvh_mutex_lock(&mp->mp_lock);
+    count = mp->mp_depot_count;
+    hits += mp->mp_hits;
+    misses += mp->mp_misses;
+    tvh_mutex_unlock(&mp->mp_lock);
+    LIST_FOREACH(mc, &mempool_caches, mc_link) {
+      ms = &mc->mc_slots[mp->mp_slot - 1];
+      count += ms->ms_count;
+      hits += ms->ms_hits;
+      misses += ms->ms_misses;
+    }
+    size += count * mp->mp_size;
+  }
+  tvh_mutex_unlock(&mempool_lock);
+  atomic_set_s64(&my->my_pool_size, size);
+  atomic_set_s64(&my->my_pool_hits, hits);
+  atomic_set_s64(&my->my_pool_misses, misses);
+}
@@ -0,0 +1,58 @@
+/*
+ *  Tvheadend - object pools
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TVHEADEND_MEMPOOL_H
+#define TVHEADEND_MEMPOOL_H
+
+#include "tvh_thread.h"
+
+struct memoryinfo;
+
+/*
+ * Pool of the fixed size objects
+ *
+ * The free objects are cached per thread, the threads exchange them
+ * in batches through the shared depot. The objects are plain malloc()
+ * blocks, the surplus is returned with free().
+ */
+typedef struct mempool {
+  LIST_ENTRY(mempool) mp_link;
+  struct memoryinfo  *mp_memoryinfo;  /* the pool statistics are added here */
+  size_t              mp_size;
+  int                 mp_slot;        /* thread cache slot + 1, -1 = none */
+  int                 mp_cache_max;   /* objects in the thread cache */
+  int                 mp_depot_max;   /* objects in the depot */
+  tvh_mutex_t         mp_lock;
+  void               *mp_depot;
+  int                 mp_depot_count;
+  int64_t             mp_hits;        /* from the exited threads */
+  int64_t             mp_misses;
+} mempool_t;
+
+#define MEMPOOL_INITIALIZER(size, my) { \
+  .mp_memoryinfo = (my), \
+  .mp_size = (size), \
+  .mp_lock = TVH_THREAD_MUTEX_INITIALIZER, \
+}
+
+void *mempool_alloc(mempool_t *mp);
+void mempool_free(mempool_t *mp, void *ptr);
+
+void mempool_memoryinfo_update(struct memoryinfo *my);
+
+#endif /* TVHEADEND_MEMPOOL_H */
@@ -394,6 +394,63 @@ muxer_cache_txt2type(const char *str)
   return r;
 }
 
+/**
+ * Add the data to the gathered writes, returns 1 when
+ * the vector is full and should be written
+ */
+int
+muxer_iov_add(muxer_iov_t *mi, pktbuf_t *pb, void *data, size_t len)
+{
+  int i = mi->mi_count;
+
+  if (i > 0 && mi->mi_pb[i - 1] == pb &&
+      (uint8_t *)mi->mi_iov[i - 1].iov_base + mi->mi_iov[i - 1].iov_len == data) {
+    mi->mi_iov[i - 1].iov_len += len;
+  } else {
+    pktbuf_ref_inc(pb);
+    mi->mi_iov[i].iov_base = data;
+    mi->mi_iov[i].iov_len = len;
+    mi->mi_pb[i] = pb;
+    mi->mi_count = ++i;
+  }
+  mi->mi_bytes += len;
+  return i >= MUXER_IOV_MAX || mi->mi_bytes >= MUXER_IOV_BYTES;
+}
+
+/**
+ * Write the gathered data, returns non-zero on error (errno is set)
+ */
+int
+muxer_iov_write(muxer_t *m, muxer_iov_t *mi, int fd)
+{
+  int r, e;
+
+  if (mi->mi_count == 0)
+    return 0;
+  r = tvh_writev(fd, mi->mi_iov, mi->mi_count);
+  e = errno;
+  m->m_writes++;
+  if (!r)
+    m->m_written += mi->mi_bytes;
+  muxer_iov_clear(mi);
+  errno = e;
+  return r;
+}
+
+/**
+ * Drop the gathered data
+ */
+void
+muxer_iov_clear(muxer_iov_t *mi)
+{
+  int i;
+
+  for (i = 0; i < mi->mi_count; i++)
+    pktbuf_ref_dec(mi->mi_pb[i]);
+  mi->mi_count = 0;
+  mi->mi_bytes = 0;
+}
+
 /**
  * cache scheme
  */
@@ -22,6 +22,8 @@
 #include "streaming.h"
 #include "htsmsg.h"
 
+#include <sys/uio.h>
+
 #define MC_IS_EOS_ERROR(e) ((e) == EPIPE || (e) == ECONNRESET)
 
 #define MC_CAP_ANOTHER_SERVICE (1<<0)	/* I can stream another service (SID must match!) */
@@ -117,16 +119,37 @@ typedef struct muxer {
                                const char *comment);                    /* Append epg data */
   int         (*m_write_pkt)  (struct muxer *,                          /* Append a media packet */
 			       streaming_message_type_t,
-			       void *);
+			       void *,
+			       int64_t);                                  /* timestamp delta (sm_ts_delta) */
   int         (*m_add_marker) (struct muxer *);                         /* Add a marker (or chapter) */
+  int         (*m_flush)      (struct muxer *);                         /* Write the gathered data */
 
   int                    m_eos;        /* End of stream */
   int                    m_errors;     /* Number of errors */
   int                    m_caps;       /* Capabilities */
+  uint64_t               m_writes;     /* Number of write syscalls */
+  uint64_t               m_written;    /* Number of written bytes */
   muxer_config_t         m_config;     /* general configuration */
   muxer_hints_t         *m_hints;      /* other hints */
 } muxer_t;
 
+/*
+ * Gathered writes (one writev() for many packets)
+ */
+#define MUXER_IOV_MAX   64
+#define MUXER_IOV_BYTES (128*1024)
+
+typedef struct muxer_iov {
+  int            mi_count;
+  size_t         mi_bytes;
+  struct iovec   mi_iov[MUXER_IOV_MAX];
+  pktbuf_t      *mi_pb[MUXER_IOV_MAX];   /* references to the data */
+} muxer_iov_t;
+
+int  muxer_iov_add(muxer_iov_t *mi, pktbuf_t *pb, void *data, size_t len);
+int  muxer_iov_write(muxer_t *m, muxer_iov_t *mi, int fd);
+void muxer_iov_clear(muxer_iov_t *mi);
+
 
 /* type <==> string converters */
 const char *           muxer_container_type2txt  (muxer_container_type_t mc);
@@ -174,8 +197,11 @@ static inline int muxer_destroy (muxer_t *m)
 static inline int muxer_write_meta (muxer_t *m, struct epg_broadcast *eb, const char *comment)
   { if (m) return m->m_write_meta(m, eb, comment); return -1; }
 
-static inline int muxer_write_pkt (muxer_t *m, streaming_message_type_t smt, void *data)
-  { if (m && data) return m->m_write_pkt(m, smt, data); return -1; }
+static inline int muxer_write_pkt (muxer_t *m, streaming_message_type_t smt, void *data, int64_t ts_delta)
+  { if (m && data) return m->m_write_pkt(m, smt, data, ts_delta); return -1; }
+
+static inline int muxer_flush (muxer_t *m)
+  { if (m && m->m_flush) return m->m_flush(m); return 0; }
 
 static inline const char* muxer_mime (muxer_t *m, const struct streaming_start *ss)
   { if (m && ss) return m->m_mime(m, ss); return NULL; }
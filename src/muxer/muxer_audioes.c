@@ -42,6 +42,9 @@ typedef struct audioes_muxer {
   int   am_error;
   off_t am_off;
 
+  /* Gathered writes (streaming only) */
+  muxer_iov_t am_iov;
+
   /* Filename is also used for logging */
   char *am_filename;
 } audioes_muxer_t;
@@ -193,11 +196,61 @@ audioes_muxer_open_file(muxer_t *m, const char *filename)
   return 0;
 }
 
+/**
+ * Check the write result
+ */
+static void
+audioes_muxer_write_result(audioes_muxer_t *am, int failed, size_t size)
+{
+  muxer_t *m = (muxer_t *)am;
+
+  if (failed) {
+    am->am_error = errno;
+    if (!MC_IS_EOS_ERROR(errno)) {
+      tvherror(LS_AUDIOES, "%s: Write failed -- %s", am->am_filename,
+               strerror(errno));
+    } else {
+      am->m_eos = 1;
+    }
+    am->m_errors++;
+    if (am->am_seekable) {
+      muxer_cache_update(m, am->am_fd, am->am_off, 0);
+      am->am_off = lseek(am->am_fd, 0, SEEK_CUR);
+    }
+  } else {
+    if (am->am_seekable)
+      muxer_cache_update(m, am->am_fd, am->am_off, 0);
+    am->am_off += size;
+  }
+}
+
+
+/**
+ * Write the gathered data to the file descriptor
+ */
+static void
+audioes_muxer_flush0(audioes_muxer_t *am)
+{
+  size_t size = am->am_iov.mi_bytes;
+
+  if (am->am_iov.mi_count == 0)
+    return;
+  if (am->am_error) {
+    am->m_errors++;
+    muxer_iov_clear(&am->am_iov);
+  } else {
+    audioes_muxer_write_result(am, muxer_iov_write((muxer_t *)am, &am->am_iov,
+                                                   am->am_fd), size);
+  }
+}
+
+
 /**
  * Write a packet to the muxer
  */
 static int
-audioes_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
+audioes_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt,
+                        void *data, int64_t ts_delta)
 {
   th_pkt_t *pkt = (th_pkt_t*)data;
   audioes_muxer_t *am = (audioes_muxer_t*)m;
@@ -216,25 +269,18 @@ audioes_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
     return am->error;
   }
 
-  if (am->am_error) {
-    am->m_errors++;
-  } else if (tvh_write(am->am_fd, pktbuf_ptr(pkt->pkt_payload), size)) {
-    am->am_error = errno;
-    if (!MC_IS_EOS_ERROR(errno)) {
-      tvherror(LS_AUDIOES, "%s: Write failed -- %s", am->am_filename,
-               strerror(errno));
-    } else {
-      am->m_eos = 1;
-    }
+  if (!am->am_seekable) {
+    if (muxer_iov_add(&am->am_iov, pkt->pkt_payload,
+                      pktbuf_ptr(pkt->pkt_payload), size))
+      audioes_muxer_flush0(am);
+  } else if (am->am_error) {
     am->m_errors++;
-    if (am->am_seekable) {
-      muxer_cache_update(m, am->am_fd, am->am_off, 0);
-      am->am_off = lseek(am->am_fd, 0, SEEK_CUR);
-    }
   } else {
-    if (am->am_seekable)
-      muxer_cache_update(m, am->am_fd, am->am_off, 0);
-    am->am_off += size;
+    am->m_writes++;
+    am->m_written += size;
+    audioes_muxer_write_result(am, tvh_write(am->am_fd,
+                                             pktbuf_ptr(pkt->pkt_payload),
+                                             size), size);
   }
 
   pkt_ref_dec(pkt);
@@ -242,6 +288,18 @@ audioes_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
 }
 
 
+/**
+ * Write the gathered data
+ */
+static int
+audioes_muxer_flush(muxer_t *m)
+{
+  audioes_muxer_t *am = (audioes_muxer_t*)m;
+
+  audioes_muxer_flush0(am);
+  return am->am_error;
+}
+
 /**
  * NOP
  */
@@ -261,6 +319,7 @@ audioes_muxer_close(muxer_t *m)
 {
   audioes_muxer_t *am = (audioes_muxer_t*)m;
 
+  audioes_muxer_flush0(am);
   if ((am->am_seekable) && (close(am->am_fd))) {
     am->am_error = errno;
     tvherror(LS_AUDIOES, "%s: Unable to close file -- %s",
@@ -281,6 +340,7 @@ audioes_muxer_destroy(muxer_t *m)
 {
   audioes_muxer_t *am = (audioes_muxer_t*)m;
 
+  muxer_iov_clear(&am->am_iov);
   if (am->am_filename)
     free(am->am_filename);
   muxer_config_free(&am->m_config);
@@ -313,6 +373,7 @@ audioes_muxer_create(const muxer_config_t *m_cfg,
   am->m_reconfigure  = audioes_muxer_reconfigure;
   am->m_write_meta   = audioes_muxer_write_meta;
   am->m_write_pkt    = audioes_muxer_write_pkt;
+  am->m_flush        = audioes_muxer_flush;
   am->m_close        = audioes_muxer_close;
   am->m_destroy      = audioes_muxer_destroy;
 
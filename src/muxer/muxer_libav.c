@@ -426,7 +426,8 @@ lav_muxer_open_file(muxer_t *m, const char *filename)
  * Write a packet to the muxer
  */
 static int
-lav_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
+lav_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt,
+                    void *data, int64_t ts_delta)
 {
   int i;
   AVFormatContext *oc;
@@ -503,9 +504,9 @@ lav_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
 
     packet.stream_index = st->index;
  
-    packet.pts      = av_rescale_q_rnd(pkt->pkt_pts, mpeg_tc, st->time_base,
+    packet.pts      = av_rescale_q_rnd(pkt->pkt_pts - ts_delta, mpeg_tc, st->time_base,
                                        AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
-    packet.dts      = av_rescale_q_rnd(pkt->pkt_dts, mpeg_tc, st->time_base,
+    packet.dts      = av_rescale_q_rnd(pkt->pkt_dts - ts_delta, mpeg_tc, st->time_base,
                                        AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
     packet.duration = av_rescale_q_rnd(pkt->pkt_duration, mpeg_tc, st->time_base,
                                        AV_ROUND_NEAR_INF|AV_ROUND_PASS_MINMAX);
@@ -1007,7 +1007,7 @@ mk_close_cluster(mk_muxer_t *mk)
  *
  */
 static void
-mk_write_frame_i(mk_muxer_t *mk, mk_track_t *t, th_pkt_t *pkt)
+mk_write_frame_i(mk_muxer_t *mk, mk_track_t *t, th_pkt_t *pkt, int64_t ts_delta)
 {
   int64_t pts = pkt->pkt_pts, delta, nxt;
   unsigned char c_delta_flags[3];
@@ -1029,6 +1029,8 @@ mk_write_frame_i(mk_muxer_t *mk, mk_track_t *t, th_pkt_t *pkt)
   if(pts == PTS_UNSET)
     // This is our best guess, it might be wrong but... oh well
     pts = t->nextpts;
+  else
+    pts -= ts_delta;
 
   if(pts != PTS_UNSET) {
     t->nextpts = pts + (pkt->pkt_duration >> (video ? pkt->v.pkt_field : 0));
@@ -1149,7 +1151,7 @@ mk_write_cues(mk_muxer_t *mk)
  * Append a packet to the muxer
  */
 static int
-mk_mux_write_pkt(mk_muxer_t *mk, th_pkt_t *pkt)
+mk_mux_write_pkt(mk_muxer_t *mk, th_pkt_t *pkt, int64_t ts_delta)
 {
   int i, mark;
   mk_track_t *t = NULL;
@@ -1170,6 +1172,15 @@ mk_mux_write_pkt(mk_muxer_t *mk, th_pkt_t *pkt)
       pkt->pkt_type == SCT_DVBSUB &&
       pts_diff(pkt->pkt_pcr, pkt->pkt_pts) > 90000) {
     tvhtrace(LS_MKV, "insert pkt to holdq: pts %"PRId64", pcr %"PRId64", diff %"PRId64"\n", pkt->pkt_pcr, pkt->pkt_pts, pts_diff(pkt->pkt_pcr, pkt->pkt_pts));
+    if (ts_delta) {
+      /* the held packets are compared with the later ones */
+      tpkt = pkt_copy_shallow(pkt);
+      pkt_ref_dec(pkt);
+      tpkt->pkt_pts -= ts_delta;
+      tpkt->pkt_dts -= ts_delta;
+      tpkt->pkt_pcr -= ts_delta;
+      pkt = tpkt;
+    }
     pktref_enqueue_sorted(&mk->holdq, pkt, mk_pktref_cmp);
     return mk->error;
   }
@@ -1177,14 +1188,14 @@ mk_mux_write_pkt(mk_muxer_t *mk, th_pkt_t *pkt)
   mark = 0;
   if(SCT_ISAUDIO(pkt->pkt_type)) {
     while ((opkt = pktref_first(&mk->holdq)) != NULL) {
-      if (pts_diff(pkt->pkt_pts, opkt->pkt_pts) > 90000)
+      if (pts_diff(pkt->pkt_pts - ts_delta, opkt->pkt_pts) > 90000)
         break;
       opkt = pktref_get_first(&mk->holdq);
-      tvhtrace(LS_MKV, "hold push, pts %"PRId64", audio pts %"PRId64"\n", opkt->pkt_pts, pkt->pkt_pts);
+      tvhtrace(LS_MKV, "hold push, pts %"PRId64", audio pts %"PRId64"\n", opkt->pkt_pts, pkt->pkt_pts - ts_delta);
       tpkt = pkt_copy_shallow(opkt);
       pkt_ref_dec(opkt);
       tpkt->pkt_pcr = tpkt->pkt_pts;
-      mk_mux_write_pkt(mk, tpkt);
+      mk_mux_write_pkt(mk, tpkt, 0);
     }
     if(pkt->a.pkt_channels != t->channels &&
        pkt->a.pkt_channels) {
@@ -1226,7 +1237,7 @@ mk_mux_write_pkt(mk_muxer_t *mk, th_pkt_t *pkt)
     pkt_ref_dec(opkt);
   }
 
-  mk_write_frame_i(mk, t, pkt);
+  mk_write_frame_i(mk, t, pkt, ts_delta);
 
   pkt_ref_dec(pkt);
 
@@ -1453,7 +1464,8 @@ mkv_muxer_open_file(muxer_t *m, const char *filename)
  * Write a packet to the muxer
  */
 static int
-mkv_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
+mkv_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt,
+                    void *data, int64_t ts_delta)
 {
   th_pkt_t *pkt = (th_pkt_t*)data;
   mk_muxer_t *mk = (mk_muxer_t*)m;
@@ -1461,7 +1473,7 @@ mkv_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
 
   assert(smt == SMT_PACKET);
 
-  if((r = mk_mux_write_pkt(mk, pkt)) != 0) {
+  if((r = mk_mux_write_pkt(mk, pkt, ts_delta)) != 0) {
     if (MC_IS_EOS_ERROR(r))
       mk->m_eos = 1;
     mk->m_errors++;
@@ -41,6 +41,9 @@ typedef struct pass_muxer {
   int   pm_error;
   int   pm_spawn_pid;
 
+  /* Gathered writes (streaming only) */
+  muxer_iov_t pm_iov;
+
   /* Filename is also used for logging */
   char *pm_filename;
 
@@ -577,16 +580,14 @@ pass_muxer_open_file(muxer_t *m, const char *filename)
 
 
 /**
- * Write data to the file descriptor
+ * Check the write result
  */
 static void
-pass_muxer_write(muxer_t *m, const void *data, size_t size)
+pass_muxer_write_result(pass_muxer_t *pm, int failed, size_t size)
 {
-  pass_muxer_t *pm = (pass_muxer_t*)m;
+  muxer_t *m = (muxer_t *)pm;
 
-  if(pm->pm_error) {
-    pm->m_errors++;
-  } else if(tvh_write(pm->pm_fd, data, size)) {
+  if(failed) {
     pm->pm_error = errno;
     if (!MC_IS_EOS_ERROR(errno))
       tvherror(LS_PASS, "%s: Write failed -- %s", pm->pm_filename,
@@ -607,6 +608,59 @@ pass_muxer_write(muxer_t *m, const void *data, size_t size)
 }
 
 
+/**
+ * Write the gathered data to the file descriptor
+ */
+static void
+pass_muxer_flush0(pass_muxer_t *pm)
+{
+  size_t size = pm->pm_iov.mi_bytes;
+
+  if (pm->pm_iov.mi_count == 0)
+    return;
+  if(pm->pm_error) {
+    pm->m_errors++;
+    muxer_iov_clear(&pm->pm_iov);
+  } else {
+    pass_muxer_write_result(pm, muxer_iov_write((muxer_t *)pm, &pm->pm_iov,
+                                                pm->pm_fd), size);
+  }
+}
+
+
+/**
+ * Write data to the file descriptor
+ */
+static void
+pass_muxer_write(muxer_t *m, const void *data, size_t size)
+{
+  pass_muxer_t *pm = (pass_muxer_t*)m;
+
+  pass_muxer_flush0(pm);
+  if(pm->pm_error) {
+    pm->m_errors++;
+  } else {
+    m->m_writes++;
+    m->m_written += size;
+    pass_muxer_write_result(pm, tvh_write(pm->pm_fd, data, size), size);
+  }
+}
+
+
+/**
+ * Write the packet data (or gather them for the socket streaming)
+ */
+static void
+pass_muxer_queue(pass_muxer_t *pm, pktbuf_t *pb, uint8_t *data, size_t size)
+{
+  if (pm->pm_seekable) {
+    pass_muxer_write((muxer_t *)pm, data, size);
+  } else if (muxer_iov_add(&pm->pm_iov, pb, data, size)) {
+    pass_muxer_flush0(pm);
+  }
+}
+
+
 /**
  * Write TS packets to the file descriptor
  */
@@ -637,7 +691,7 @@ pass_muxer_write_ts(muxer_t *m, pktbuf_t *pb)
 
         /* Flush */
         if (len)
-          pass_muxer_write(m, pkt, len);
+          pass_muxer_queue(pm, pb, pkt, len);
 
         /* Store new start point (after these packets) */
         pkt = tsb + l;
@@ -678,7 +732,7 @@ pass_muxer_write_ts(muxer_t *m, pktbuf_t *pb)
   }
 
   if (len)
-    pass_muxer_write(m, pkt, len);
+    pass_muxer_queue(pm, pb, pkt, len);
 }
 
 
@@ -686,7 +740,8 @@ pass_muxer_write_ts(muxer_t *m, pktbuf_t *pb)
  * Write a packet directly to the file descriptor
  */
 static int
-pass_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
+pass_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt,
+                     void *data, int64_t ts_delta)
 {
   pktbuf_t *pb = (pktbuf_t*)data;
   pass_muxer_t *pm = (pass_muxer_t*)m;
@@ -708,6 +763,19 @@ pass_muxer_write_pkt(muxer_t *m, streaming_message_type_t smt, void *data)
 }
 
 
+/**
+ * Write the gathered data
+ */
+static int
+pass_muxer_flush(muxer_t *m)
+{
+  pass_muxer_t *pm = (pass_muxer_t*)m;
+
+  pass_muxer_flush0(pm);
+  return pm->pm_error;
+}
+
+
 /**
  * NOP
  */
@@ -726,6 +794,7 @@ pass_muxer_close(muxer_t *m)
 {
   pass_muxer_t *pm = (pass_muxer_t*)m;
 
+  pass_muxer_flush0(pm);
   if(pm->pm_spawn_pid > 0)
     spawn_kill(pm->pm_spawn_pid, tvh_kill_to_sig(pm->m_config.u.pass.m_killsig),
                pm->m_config.u.pass.m_killtimeout);
@@ -749,6 +818,8 @@ pass_muxer_destroy(muxer_t *m)
 {
   pass_muxer_t *pm = (pass_muxer_t*)m;
 
+  muxer_iov_clear(&pm->pm_iov);
+
   if(pm->pm_filename)
     free(pm->pm_filename);
 
@@ -787,6 +858,7 @@ pass_muxer_create(const muxer_config_t *m_cfg,
   pm->m_mime         = pass_muxer_mime;
   pm->m_write_meta   = pass_muxer_write_meta;
   pm->m_write_pkt    = pass_muxer_write_pkt;
+  pm->m_flush        = pass_muxer_flush;
   pm->m_close        = pass_muxer_close;
   pm->m_destroy      = pass_muxer_destroy;
   pm->pm_fd          = -1;
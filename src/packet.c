@@ -23,14 +23,80 @@
 #include "string.h"
 #include "atomic.h"
 #include "memoryinfo.h"
+#include "mempool.h"
 
 #ifndef PKTBUF_DATA_ALIGN
 #define PKTBUF_DATA_ALIGN 64
 #endif
 
-memoryinfo_t pkt_memoryinfo = { .my_name = "Packets" };
-memoryinfo_t pktbuf_memoryinfo = { .my_name = "Packet buffers" };
-memoryinfo_t pktref_memoryinfo = { .my_name = "Packet references" };
+memoryinfo_t pkt_memoryinfo = {
+  .my_name = "Packets",
+  .my_update = mempool_memoryinfo_update
+};
+memoryinfo_t pktbuf_memoryinfo = {
+  .my_name = "Packet buffers",
+  .my_update = mempool_memoryinfo_update
+};
+memoryinfo_t pktref_memoryinfo = {
+  .my_name = "Packet references",
+  .my_update = mempool_memoryinfo_update
+};
+
+static mempool_t pkt_pool = MEMPOOL_INITIALIZER(sizeof(th_pkt_t), &pkt_memoryinfo);
+static mempool_t pktref_pool = MEMPOOL_INITIALIZER(sizeof(th_pktref_t), &pktref_memoryinfo);
+static mempool_t pktbuf_pool = MEMPOOL_INITIALIZER(sizeof(pktbuf_t), &pktbuf_memoryinfo);
+
+/*
+ * Size classes for the small payloads (64 - 4096 bytes)
+ */
+#define PKTBUF_POOL_SHIFT 6
+#define PKTBUF_POOLS      7
+#define PKTBUF_OWNED      (-2)
+
+static mempool_t pktbuf_data_pool[PKTBUF_POOLS] = {
+  MEMPOOL_INITIALIZER(64, &pktbuf_memoryinfo),
+  MEMPOOL_INITIALIZER(128, &pktbuf_memoryinfo),
+  MEMPOOL_INITIALIZER(256, &pktbuf_memoryinfo),
+  MEMPOOL_INITIALIZER(512, &pktbuf_memoryinfo),
+  MEMPOOL_INITIALIZER(1024, &pktbuf_memoryinfo),
+  MEMPOOL_INITIALIZER(2048, &pktbuf_memoryinfo),
+  MEMPOOL_INITIALIZER(4096, &pktbuf_memoryinfo),
+};
+
+static inline int
+pktbuf_data_class(size_t size)
+{
+  int i;
+
+  for (i = 0; i < PKTBUF_POOLS; i++)
+    if (size <= (1 << (i + PKTBUF_POOL_SHIFT)))
+      return i;
+  return -1;
+}
+
+static void
+pktbuf_data_free(pktbuf_t *pb)
+{
+  if (pb->pb_pool >= 0) {
+    mempool_free(&pktbuf_data_pool[pb->pb_pool], pb->pb_data);
+  } else if (pb->pb_pool == PKTBUF_OWNED) {
+    pktbuf_owner_ref_dec(pb->pb_owner);
+    pb->pb_owner = NULL;
+  } else {
+    free(pb->pb_data);
+  }
+}
+
+static void
+pktbuf_free(pktbuf_t *pb)
+{
+  if (pb->pb_pool == PKTBUF_OWNED)
+    memoryinfo_free(&pktbuf_memoryinfo, sizeof(*pb));
+  else
+    memoryinfo_free(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
+  pktbuf_data_free(pb);
+  mempool_free(&pktbuf_pool, pb);
+}
 
 /*
  *
@@ -42,7 +108,7 @@ pkt_destroy(th_pkt_t *pkt)
     pktbuf_ref_dec(pkt->pkt_payload);
     pktbuf_ref_dec(pkt->pkt_meta);
 
-    free(pkt);
+    mempool_free(&pkt_pool, pkt);
     memoryinfo_free(&pkt_memoryinfo, sizeof(*pkt));
   }
 }
@@ -67,8 +133,9 @@ pkt_alloc(streaming_component_type_t type, const uint8_t *data, size_t datalen,
     payload = NULL;
   }
 
-  pkt = calloc(1, sizeof(th_pkt_t));
+  pkt = mempool_alloc(&pkt_pool);
   if (pkt) {
+    memset(pkt, 0, sizeof(*pkt));
     pkt->pkt_type = type;
     pkt->pkt_payload = payload;
     pkt->pkt_dts = dts;
@@ -90,7 +157,7 @@ pkt_alloc(streaming_component_type_t type, const uint8_t *data, size_t datalen,
 th_pkt_t *
 pkt_copy_shallow(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = mempool_alloc(&pkt_pool);
 
   if (n) {
     blacklisted_memcpy(n, pkt, sizeof(*pkt));
@@ -113,7 +180,7 @@ pkt_copy_shallow(th_pkt_t *pkt)
 th_pkt_t *
 pkt_copy_nodata(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = mempool_alloc(&pkt_pool);
 
   if (n) {
     blacklisted_memcpy(n, pkt, sizeof(*pkt));
@@ -212,7 +279,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
     while((pr = TAILQ_FIRST(q)) != NULL) {
       TAILQ_REMOVE(q, pr, pr_link);
       pkt_ref_dec(pr->pr_pkt);
-      free(pr);
+      mempool_free(&pktref_pool, pr);
       memoryinfo_free(&pktref_memoryinfo, sizeof(*pr));
     }
   }
@@ -225,7 +292,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
 void
 pktref_enqueue(struct th_pktref_queue *q, th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = mempool_alloc(&pktref_pool);
   if (pr) {
     pr->pr_pkt = pkt;
     TAILQ_INSERT_TAIL(q, pr, pr_link);
@@ -241,7 +308,7 @@ void
 pktref_enqueue_sorted(struct th_pktref_queue *q, th_pkt_t *pkt,
                       int (*cmp)(const void *, const void *))
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = mempool_alloc(&pktref_pool);
   if (pr) {
     pr->pr_pkt = pkt;
     TAILQ_INSERT_SORTED(q, pr, pr_link, cmp);
@@ -260,7 +327,7 @@ pktref_remove(struct th_pktref_queue *q, th_pktref_t *pr)
     if (q)
       TAILQ_REMOVE(q, pr, pr_link);
     pkt_ref_dec(pr->pr_pkt);
-    free(pr);
+    mempool_free(&pktref_pool, pr);
     memoryinfo_free(&pktref_memoryinfo, sizeof(*pr));
   }
 }
@@ -292,7 +359,7 @@ pktref_get_first(struct th_pktref_queue *q)
   if (pr) {
     pkt = pr->pr_pkt;
     TAILQ_REMOVE(q, pr, pr_link);
-    free(pr);
+    mempool_free(&pktref_pool, pr);
     memoryinfo_free(&pktref_memoryinfo, sizeof(*pr));
     return pkt;
   }
@@ -317,7 +384,7 @@ pktref_insert_head(struct th_pktref_queue *q, th_pkt_t *pkt)
 th_pktref_t *
 pktref_create(th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = mempool_alloc(&pktref_pool);
   if (pr) {
     pr->pr_pkt = pkt;
     memoryinfo_alloc(&pktref_memoryinfo, sizeof(*pr));
@@ -332,22 +399,16 @@ pktref_create(th_pkt_t *pkt)
 void
 pktbuf_destroy(pktbuf_t *pb)
 {
-  if (pb) {
-    memoryinfo_free(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
-    free(pb->pb_data);
-    free(pb);
-  }
+  if (pb)
+    pktbuf_free(pb);
 }
 
 void
 pktbuf_ref_dec(pktbuf_t *pb)
 {
   if (pb) {
-    if((atomic_add(&pb->pb_refcount, -1)) == 1) {
-      memoryinfo_free(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
-      free(pb->pb_data);
-      free(pb);
-    }
+    if((atomic_add(&pb->pb_refcount, -1)) == 1)
+      pktbuf_free(pb);
   }
 }
 
@@ -366,23 +427,34 @@ pktbuf_alloc(const uint8_t *data, size_t size)
 {
   pktbuf_t *pb;
   uint8_t *buffer;
+  int pool = pktbuf_data_class(size);
 
-  buffer = size > 0 ? malloc(size) : NULL;
-  if (buffer) {\
+  if (size == 0)
+    buffer = NULL;
+  else if (pool >= 0)
+    buffer = mempool_alloc(&pktbuf_data_pool[pool]);
+  else
+    buffer = malloc(size);
+  if (buffer) {
     if (data != NULL)
       memcpy(buffer, data, size);
   } else if (size > 0) {
     return NULL;
   }
-  pb = malloc(sizeof(pktbuf_t));
+  pb = mempool_alloc(&pktbuf_pool);
   if (pb == NULL) {
-    free(buffer);
+    if (pool >= 0)
+      mempool_free(&pktbuf_data_pool[pool], buffer);
+    else
+      free(buffer);
     return NULL;
   }
   pb->pb_refcount = 1;
   pb->pb_data = buffer;
   pb->pb_size = size;
   pb->pb_err = 0;
+  pb->pb_pool = buffer ? pool : -1;
+  pb->pb_owner = NULL;
   memoryinfo_alloc(&pktbuf_memoryinfo, sizeof(*pb) + size);
   return pb;
 }
@@ -390,23 +462,72 @@ pktbuf_alloc(const uint8_t *data, size_t size)
 pktbuf_t *
 pktbuf_make(void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = mempool_alloc(&pktbuf_pool);
   if (pb) {
     pb->pb_refcount = 1;
+    pb->pb_err = 0;
     pb->pb_size = size;
     pb->pb_data = data;
+    pb->pb_pool = -1;
+    pb->pb_owner = NULL;
     memoryinfo_alloc(&pktbuf_memoryinfo, sizeof(*pb) + pb->pb_size);
   }
   return pb;
 }
 
+/*
+ * The data are not copied, the owner is referenced until
+ * the packet buffer is released
+ */
+pktbuf_t *
+pktbuf_make_owned(pktbuf_owner_t *pbo, void *data, size_t size)
+{
+  pktbuf_t *pb = mempool_alloc(&pktbuf_pool);
+  if (pb) {
+    pb->pb_refcount = 1;
+    pb->pb_err = 0;
+    pb->pb_size = size;
+    pb->pb_data = data;
+    pb->pb_pool = PKTBUF_OWNED;
+    pb->pb_owner = pbo;
+    pktbuf_owner_ref_inc(pbo);
+    memoryinfo_alloc(&pktbuf_memoryinfo, sizeof(*pb));
+  }
+  return pb;
+}
+
+void
+pktbuf_owner_ref_inc(pktbuf_owner_t *pbo)
+{
+  atomic_add(&pbo->pbo_refcount, 1);
+}
+
+void
+pktbuf_owner_ref_dec(pktbuf_owner_t *pbo)
+{
+  if (pbo && atomic_add(&pbo->pbo_refcount, -1) == 1)
+    pbo->pbo_free(pbo);
+}
+
 pktbuf_t *
 pktbuf_append(pktbuf_t *pb, const void *data, size_t size)
 {
   void *ndata;
   if (pb == NULL)
     return pktbuf_alloc(data, size);
-  ndata = realloc(pb->pb_data, pb->pb_size + size);
+  if (pb->pb_pool != -1) {
+    /* move the pooled or owned buffer to the heap */
+    ndata = malloc(pb->pb_size + size);
+    if (ndata) {
+      memcpy(ndata, pb->pb_data, pb->pb_size);
+      if (pb->pb_pool == PKTBUF_OWNED)
+        memoryinfo_append(&pktbuf_memoryinfo, pb->pb_size);
+      pktbuf_data_free(pb);
+      pb->pb_pool = -1;
+    }
+  } else {
+    ndata = realloc(pb->pb_data, pb->pb_size + size);
+  }
   if (ndata) {
     pb->pb_data = ndata;
     memcpy(ndata + pb->pb_size, data, size);
@@ -23,6 +23,15 @@
 
 struct memoryinfo;
 
+/**
+ * Owner of the packet buffer data (refcounted), the packet buffers
+ * may point into a larger memory block held by somebody else
+ */
+typedef struct pktbuf_owner {
+  int pbo_refcount;
+  void (*pbo_free)(struct pktbuf_owner *pbo);
+} pktbuf_owner_t;
+
 /**
  * Packet buffer
  */
@@ -31,6 +40,8 @@ typedef struct pktbuf {
   int pb_err;
   uint8_t *pb_data;
   size_t pb_size;
+  int pb_pool;        /* size class of pb_data, -1 = malloc(), -2 = owner */
+  pktbuf_owner_t *pb_owner;
 } pktbuf_t;
 
 /**
@@ -161,6 +172,12 @@ pktbuf_t *pktbuf_alloc(const uint8_t *data, size_t size);
 
 pktbuf_t *pktbuf_make(void *data, size_t size);
 
+pktbuf_t *pktbuf_make_owned(pktbuf_owner_t *pbo, void *data, size_t size);
+
+void pktbuf_owner_ref_inc(pktbuf_owner_t *pbo);
+
+void pktbuf_owner_ref_dec(pktbuf_owner_t *pbo);
+
 pktbuf_t *pktbuf_append(pktbuf_t *pb, const void *data, size_t size);
 
 static inline size_t   pktbuf_len(pktbuf_t *pb) { return pb ? pb->pb_size : 0; }
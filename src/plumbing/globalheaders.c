@@ -32,6 +32,8 @@ typedef struct globalheaders {
 
   int gh_passthru;
 
+  int64_t gh_ts_delta;  /* for the held packets */
+
 } globalheaders_t;
 
 /* note: there up to 2.5 sec diffs in some sources! */
@@ -310,6 +312,7 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
 
     pktref_enqueue(&gh->gh_holdq, pkt);
 
+    gh->gh_ts_delta = sm->sm_ts_delta;
     streaming_msg_free(sm);
 
     if(!gh_is_audiovideo(ssc->es_type))
@@ -327,6 +330,7 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
     while((pkt = pktref_get_first(&gh->gh_holdq)) != NULL) {
       if (pkt->pkt_payload) {
         sm = streaming_msg_create_pkt(pkt);
+        sm->sm_ts_delta = gh->gh_ts_delta;
         streaming_target_deliver2(gh->gh_output, sm);
       }
       pkt_ref_dec(pkt);
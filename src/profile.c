@@ -765,17 +765,13 @@ profile_sharer_deliver(profile_chain_t *prch, streaming_message_t *sm)
     if (prch->prch_ts_delta == PTS_UNSET)
       prch->prch_ts_delta = MAX(0, pkt->pkt_dts - 10000);
     /*
-     * time correction here
+     * time correction here, the packet is shared with other chains,
+     * the targets reading the timestamps subtract sm_ts_delta
      */
     if (pkt->pkt_pts >= prch->prch_ts_delta &&
         pkt->pkt_dts >= prch->prch_ts_delta &&
         pkt->pkt_pcr >= prch->prch_ts_delta) {
-      th_pkt_t *n = pkt_copy_shallow(pkt);
-      pkt_ref_dec(pkt);
-      n->pkt_pts -= prch->prch_ts_delta;
-      n->pkt_dts -= prch->prch_ts_delta;
-      n->pkt_pcr -= prch->prch_ts_delta;
-      sm->sm_data = n;
+      sm->sm_ts_delta = prch->prch_ts_delta;
     } else {
       pkt_trace(LS_PROFILE, pkt, "packet drop (delta %"PRId64")", prch->prch_ts_delta);
       streaming_msg_free(sm);
@@ -939,6 +935,11 @@ profile_sharer_create(profile_sharer_t *prsh,
   prch->prch_post_share = dst;
   tvh_mutex_lock(&prsh->prsh_queue_mutex);
   prch->prch_ts_delta = LIST_EMPTY(&prsh->prsh_chains) ? 0 : PTS_UNSET;
+#if ENABLE_TIMESHIFT
+  /* the timeshift clients share the buffer time base */
+  if (prch->prch_timeshift)
+    prch->prch_ts_delta = 0;
+#endif
   LIST_INSERT_HEAD(&prsh->prsh_chains, prch, prch_sharer_link);
   prch->prch_sharer = prsh;
   if (!prsh->prsh_master)
@@ -982,6 +983,10 @@ profile_sharer_destroy(profile_chain_t *prch)
 #if ENABLE_LIBAV
     if (prsh->prsh_transcoder)
       transcoder_destroy(prsh->prsh_transcoder);
+#endif
+#if ENABLE_TIMESHIFT
+    if (prsh->prsh_timeshift)
+      timeshift_buffer_destroy(prsh->prsh_timeshift);
 #endif
     if (prsh->prsh_start_msg)
       streaming_start_unref(prsh->prsh_start_msg);
@@ -1208,6 +1213,19 @@ const idclass_t profile_htsp_class =
   }
 };
 
+#if ENABLE_TIMESHIFT
+/*
+ * The timeshift chains share one buffer per channel and profile
+ */
+static int
+profile_htsp_can_share(profile_chain_t *prch,
+                       profile_chain_t *joiner)
+{
+  return prch->prch_pro == joiner->prch_pro &&
+         prch->prch_can_share == joiner->prch_can_share;
+}
+#endif
+
 static int
 profile_htsp_work(profile_chain_t *prch,
                   streaming_target_t *dst,
@@ -1215,6 +1233,11 @@ profile_htsp_work(profile_chain_t *prch,
 {
   profile_sharer_t *prsh;
 
+#if ENABLE_TIMESHIFT
+  if (timeshift_period > 0 && !(flags & PROFILE_WORK_REMOTE_TS))
+    prch->prch_can_share = profile_htsp_can_share;
+#endif
+
   prsh = profile_sharer_find(prch);
   if (!prsh)
     goto fail;
@@ -1229,8 +1252,12 @@ profile_htsp_work(profile_chain_t *prch,
     dst = prch->prch_rtsp = rtsp_st_create(dst, prch);
   else
 #endif
-    if (timeshift_period > 0)
-      dst = prch->prch_timeshift = timeshift_create(dst, timeshift_period);
+    if (timeshift_period > 0) {
+      if (!prsh->prsh_timeshift)
+        prsh->prsh_timeshift = timeshift_buffer_create();
+      dst = prch->prch_timeshift = timeshift_create(dst, timeshift_period,
+                                                    prsh->prsh_timeshift);
+    }
 #endif
 
   dst = prch->prch_gh = globalheaders_create(dst);
@@ -2600,8 +2627,12 @@ profile_transcode_work(profile_chain_t *prch,
   dst = prch->prch_gh = globalheaders_create(dst);
 
 #if ENABLE_TIMESHIFT
-  if (timeshift_period > 0)
-    dst = prch->prch_timeshift = timeshift_create(dst, timeshift_period);
+  if (timeshift_period > 0) {
+    if (!prsh->prsh_timeshift)
+      prsh->prsh_timeshift = timeshift_buffer_create();
+    dst = prch->prch_timeshift = timeshift_create(dst, timeshift_period,
+                                                  prsh->prsh_timeshift);
+  }
 #endif
   if (profile_sharer_create(prsh, prch, dst))
     goto fail;
@@ -163,6 +163,9 @@ typedef struct profile_sharer {
 #if ENABLE_LIBAV
   struct streaming_target  *prsh_transcoder;
 #endif
+#if ENABLE_TIMESHIFT
+  struct timeshift_buffer  *prsh_timeshift;
+#endif
 } profile_sharer_t;
 
 void profile_register(const idclass_t *clazz, profile_builder_t builder);
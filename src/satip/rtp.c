@@ -388,9 +388,8 @@ satip_rtp_thread(void *aux)
   tvhdebug(LS_SATIPS, "RTP streaming to %s:%d open", peername,
            tcp ? ntohs(IP_PORT(rtp->peer)) : rtp->port);
 
-  tvh_mutex_lock(&sq->sq_mutex);
   while (rtp->sq && !fatal) {
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_get(sq);
     if (sm == NULL) {
       if (tcp) {
         r = satip_rtp_flush_tcp_data(rtp);
@@ -401,11 +400,9 @@ satip_rtp_thread(void *aux)
         fatal = 1;
         continue;
       }
-      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      streaming_queue_wait(sq, 0);
       continue;
     }
-    streaming_queue_remove(sq, sm);
-    tvh_mutex_unlock(&sq->sq_mutex);
 
     switch (sm->sm_type) {
     case SMT_MPEGTS:
@@ -448,9 +445,7 @@ satip_rtp_thread(void *aux)
     }
 
     streaming_msg_free(sm);
-    tvh_mutex_lock(&sq->sq_mutex);
   }
-  tvh_mutex_unlock(&sq->sq_mutex);
 
   tvhdebug(LS_SATIPS, "RTP streaming to %s:%d closed (%s request)%s",
            peername,
@@ -621,10 +616,8 @@ void satip_rtp_close(void *_rtp)
   tvhtrace(LS_SATIPS, "rtp close %p", rtp);
   TAILQ_REMOVE(&satip_rtp_sessions, rtp, link);
   sq = rtp->sq;
-  tvh_mutex_lock(&sq->sq_mutex);
   rtp->sq = NULL;
-  tvh_cond_signal(&sq->sq_cond, 0);
-  tvh_mutex_unlock(&sq->sq_mutex);
+  streaming_queue_wakeup(sq);
   tvh_mutex_unlock(&satip_rtp_lock);
   pthread_join(rtp->tid, NULL);
   if (rtp->port == RTSP_TCP_DATA) {
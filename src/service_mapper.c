@@ -438,17 +438,16 @@ service_mapper_thread ( void *aux )
       }
 
       /* Wait for message */
-      tvh_mutex_lock(&sq->sq_mutex);
-      while((sm = TAILQ_FIRST(&sq->sq_queue)) == NULL) {
-        tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      while((sm = streaming_queue_get(sq)) == NULL) {
+        streaming_queue_wait(sq, 0);
         if (!tvheadend_is_running())
           break;
       }
-      if (sm)
-        streaming_queue_remove(sq, sm);
-      tvh_mutex_unlock(&sq->sq_mutex);
-      if (!tvheadend_is_running())
+      if (!tvheadend_is_running()) {
+        if (sm)
+          streaming_msg_free(sm);
         break;
+      }
 
       switch (sm->sm_type) {
       case SMT_GRACE:
@@ -478,9 +477,7 @@ service_mapper_thread ( void *aux )
     if (!tvheadend_is_running())
       break;
 
-    tvh_mutex_lock(&sq->sq_mutex);
-    streaming_queue_clear(&sq->sq_queue);
-    tvh_mutex_unlock(&sq->sq_mutex);
+    streaming_queue_purge(sq);
  
     tvh_mutex_lock(&global_lock);
     subscription_unsubscribe(sub, UNSUBSCRIBE_FINAL);
@@ -25,8 +25,15 @@
 #include "atomic.h"
 #include "service.h"
 #include "timeshift.h"
+#include "mempool.h"
 
-static memoryinfo_t streaming_msg_memoryinfo = { .my_name = "Streaming message" };
+static memoryinfo_t streaming_msg_memoryinfo = {
+  .my_name = "Streaming message",
+  .my_update = mempool_memoryinfo_update
+};
+
+static mempool_t streaming_msg_pool =
+  MEMPOOL_INITIALIZER(sizeof(streaming_message_t), &streaming_msg_memoryinfo);
 
 void
 streaming_pad_init(streaming_pad_t *sp)
@@ -66,6 +73,14 @@ streaming_message_data_size(streaming_message_t *sm)
   return 0;
 }
 
+/*
+ * The streaming queue has multiple producers (the delivering threads)
+ * and one consumer. The producers push the messages to a lock-free LIFO
+ * (sq_push, linked through sm_link.tqe_next), the consumer takes the
+ * whole LIFO at once and reverses it to the ordered sq_queue. The mutex
+ * and the condition are used only when the consumer is parked.
+ */
+
 /**
  *
  */
@@ -73,46 +88,152 @@ static void
 streaming_queue_deliver(void *opauqe, streaming_message_t *sm)
 {
   streaming_queue_t *sq = opauqe;
-
-  tvh_mutex_lock(&sq->sq_mutex);
+  size_t size;
+  void *head;
 
   /* queue size protection */
-  if (sq->sq_maxsize && sq->sq_maxsize < sq->sq_size) {
+  if (sq->sq_maxsize && sq->sq_maxsize < atomic_get_s64(&sq->sq_size)) {
     streaming_msg_free(sm);
-  } else {
-    TAILQ_INSERT_TAIL(&sq->sq_queue, sm, sm_link);
-    sq->sq_size += streaming_message_data_size(sm);
+    return;
   }
 
-  tvh_cond_signal(&sq->sq_cond, 0);
-  tvh_mutex_unlock(&sq->sq_mutex);
+  if ((size = streaming_message_data_size(sm)) > 0)
+    atomic_add_s64(&sq->sq_size, size);
+  do {
+    head = sq->sq_push;
+    sm->sm_link.tqe_next = head;
+  } while (!atomic_cas_ptr(&sq->sq_push, head, sm));
+
+  if (atomic_get(&sq->sq_parked)) {
+    tvh_mutex_lock(&sq->sq_mutex);
+    tvh_cond_signal(&sq->sq_cond, 0);
+    tvh_mutex_unlock(&sq->sq_mutex);
+  }
 }
 
 /**
- *
+ * Move the delivered messages to sq_queue (consumer only)
  */
-static htsmsg_t *
-streaming_queue_info(void *opaque, htsmsg_t *list)
+static int
+streaming_queue_fetch(streaming_queue_t *sq)
 {
-  streaming_queue_t *sq = opaque;
+  streaming_message_t *sm, *next;
+  struct streaming_message_queue q;
+
+  if (sq->sq_push == NULL)
+    return 0;
+  sm = atomic_exchange_ptr(&sq->sq_push, NULL);
+  TAILQ_INIT(&q);
+  for (; sm; sm = next) {
+    next = sm->sm_link.tqe_next;
+    TAILQ_INSERT_HEAD(&q, sm, sm_link);
+  }
+  TAILQ_CONCAT(&sq->sq_queue, &q, sm_link);
+  return 1;
+}
+
+/**
+ * Get the next message (consumer only), NULL if the queue is empty
+ */
+streaming_message_t *
+streaming_queue_get(streaming_queue_t *sq)
+{
+  streaming_message_t *sm;
   size_t size;
-  char buf[256];
+
+  if ((sm = TAILQ_FIRST(&sq->sq_queue)) == NULL) {
+    if (!streaming_queue_fetch(sq))
+      return NULL;
+    sm = TAILQ_FIRST(&sq->sq_queue);
+  }
+  TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+  if ((size = streaming_message_data_size(sm)) > 0)
+    atomic_dec_s64(&sq->sq_size, size);
+  return sm;
+}
+
+/**
+ * Take all queued messages (consumer only)
+ */
+void
+streaming_queue_take(streaming_queue_t *sq, struct streaming_message_queue *q)
+{
+  streaming_message_t *sm;
+  int64_t size = 0;
+
+  streaming_queue_fetch(sq);
+  TAILQ_FOREACH(sm, &sq->sq_queue, sm_link)
+    size += streaming_message_data_size(sm);
+  TAILQ_CONCAT(q, &sq->sq_queue, sm_link);
+  if (size)
+    atomic_dec_s64(&sq->sq_size, size);
+}
+
+/**
+ * Free all queued messages (consumer only)
+ */
+void
+streaming_queue_purge(streaming_queue_t *sq)
+{
+  struct streaming_message_queue q;
+
+  TAILQ_INIT(&q);
+  streaming_queue_take(sq, &q);
+  streaming_queue_clear(&q);
+}
+
+/**
+ * Park the consumer until a message is delivered, the queue is woken up
+ * using streaming_queue_wakeup() or the mono clock deadline (0 = none)
+ * passes. Returns ETIMEDOUT on timeout.
+ */
+int
+streaming_queue_wait(streaming_queue_t *sq, int64_t mono)
+{
+  int r = 0;
+
   tvh_mutex_lock(&sq->sq_mutex);
-  size = sq->sq_size;
+  atomic_add(&sq->sq_parked, 1);
+  while (!sq->sq_wakeup && TAILQ_EMPTY(&sq->sq_queue) &&
+         sq->sq_push == NULL) {
+    if (mono) {
+      r = tvh_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, mono);
+      if (r == ETIMEDOUT)
+        break;
+    } else {
+      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+    }
+  }
+  atomic_dec(&sq->sq_parked, 1);
+  sq->sq_wakeup = 0;
   tvh_mutex_unlock(&sq->sq_mutex);
-  snprintf(buf, sizeof(buf), "streaming queue %p size %zd", sq, size);
-  htsmsg_add_str(list, NULL, buf);
-  return list;
+  return r == ETIMEDOUT ? r : 0;
 }
 
 /**
- *
+ * Wake up the parked consumer
  */
 void
-streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm)
+streaming_queue_wakeup(streaming_queue_t *sq)
 {
-  sq->sq_size -= streaming_message_data_size(sm);
-  TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
+  tvh_mutex_lock(&sq->sq_mutex);
+  sq->sq_wakeup = 1;
+  tvh_cond_signal(&sq->sq_cond, 0);
+  tvh_mutex_unlock(&sq->sq_mutex);
+}
+
+/**
+ *
+ */
+static htsmsg_t *
+streaming_queue_info(void *opaque, htsmsg_t *list)
+{
+  streaming_queue_t *sq = opaque;
+  char buf[256];
+  snprintf(buf, sizeof(buf), "streaming queue %p size %"PRId64,
+           sq, atomic_get_s64(&sq->sq_size));
+  htsmsg_add_str(list, NULL, buf);
+  return list;
 }
 
 /**
@@ -132,8 +253,11 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter, size_t maxsize)
   tvh_cond_init(&sq->sq_cond, 1);
   TAILQ_INIT(&sq->sq_queue);
 
+  sq->sq_parked = 0;
+  sq->sq_wakeup = 0;
   sq->sq_maxsize = maxsize;
   sq->sq_size = 0;
+  sq->sq_push = NULL;
 }
 
 /**
@@ -142,8 +266,8 @@ streaming_queue_init(streaming_queue_t *sq, int reject_filter, size_t maxsize)
 void
 streaming_queue_deinit(streaming_queue_t *sq)
 {
+  streaming_queue_purge(sq);
   sq->sq_size = 0;
-  streaming_queue_clear(&sq->sq_queue);
   tvh_mutex_destroy(&sq->sq_mutex);
   tvh_cond_destroy(&sq->sq_cond);
 }
@@ -201,13 +325,14 @@ streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st)
 streaming_message_t *
 streaming_msg_create(streaming_message_type_t type)
 {
-  streaming_message_t *sm = malloc(sizeof(streaming_message_t));
+  streaming_message_t *sm = mempool_alloc(&streaming_msg_pool);
   memoryinfo_alloc(&streaming_msg_memoryinfo, sizeof(*sm));
   sm->sm_type = type;
 #if ENABLE_TIMESHIFT
   sm->sm_time = 0;
   sm->sm_s = NULL;
 #endif
+  sm->sm_ts_delta = 0;
   return sm;
 }
 
@@ -256,7 +381,7 @@ streaming_msg_create_code(streaming_message_type_t type, int code)
 streaming_message_t *
 streaming_msg_clone(streaming_message_t *src)
 {
-  streaming_message_t *dst = malloc(sizeof(streaming_message_t));
+  streaming_message_t *dst = mempool_alloc(&streaming_msg_pool);
   streaming_start_t *ss;
 
   memoryinfo_alloc(&streaming_msg_memoryinfo, sizeof(*dst));
@@ -266,6 +391,7 @@ streaming_msg_clone(streaming_message_t *src)
   dst->sm_time      = src->sm_time;
   dst->sm_s         = src->sm_s;
 #endif
+  dst->sm_ts_delta  = src->sm_ts_delta;
 
   switch(src->sm_type) {
 
@@ -388,7 +514,7 @@ streaming_msg_free(streaming_message_t *sm)
     abort();
   }
   memoryinfo_free(&streaming_msg_memoryinfo, sizeof(*sm));
-  free(sm);
+  mempool_free(&streaming_msg_pool, sm);
 }
 
 /**
@@ -324,6 +324,8 @@ struct streaming_message {
 #if ENABLE_TIMESHIFT
   int64_t sm_time;
 #endif
+  int64_t sm_ts_delta;   /* SMT_PACKET: chain timestamp correction, subtracted
+                            by the targets reading the timestamps */
   union {
     void *sm_data;
     int sm_code;
@@ -355,13 +357,16 @@ struct streaming_queue {
 
   streaming_target_t sq_st;
 
-  tvh_mutex_t sq_mutex;    /* Protects sp_queue */
-  tvh_cond_t  sq_cond;     /* Condvar for signalling new packets */
+  tvh_mutex_t sq_mutex;    /* Protects the consumer parking */
+  tvh_cond_t  sq_cond;     /* Condvar for waking the parked consumer */
+  int         sq_parked;   /* The consumer waits on sq_cond */
+  int         sq_wakeup;   /* Wakeup request (streaming_queue_wakeup) */
 
   size_t      sq_maxsize;  /* Max queue size (bytes) */
-  size_t      sq_size;     /* Actual queue size (bytes) - only data */
+  int64_t     sq_size;     /* Actual queue size (bytes) - only data */
 
-  struct streaming_message_queue sq_queue;
+  void * volatile sq_push; /* Delivered messages, lock-free LIFO (producers) */
+  struct streaming_message_queue sq_queue; /* In order (consumer only) */
 
 };
 
@@ -433,7 +438,16 @@ void streaming_queue_clear(struct streaming_message_queue *q);
 
 void streaming_queue_deinit(streaming_queue_t *sq);
 
-void streaming_queue_remove(streaming_queue_t *sq, streaming_message_t *sm);
+streaming_message_t *streaming_queue_get(streaming_queue_t *sq);
+
+void streaming_queue_take
+  (streaming_queue_t *sq, struct streaming_message_queue *q);
+
+void streaming_queue_purge(streaming_queue_t *sq);
+
+int streaming_queue_wait(streaming_queue_t *sq, int64_t mono);
+
+void streaming_queue_wakeup(streaming_queue_t *sq);
 
 void streaming_target_connect(streaming_pad_t *sp, streaming_target_t *st);
 
@@ -1095,6 +1095,8 @@ subscription_create_msg(th_subscription_t *s, const char *lang)
   htsmsg_add_u32(m, "out", atomic_get(&s->ths_bytes_out_avg));
   htsmsg_add_s64(m, "total_in", atomic_get_u64(&s->ths_total_bytes_in));
   htsmsg_add_s64(m, "total_out", atomic_get_u64(&s->ths_total_bytes_out));
+  if (s->ths_total_writes_out)
+    htsmsg_add_s64(m, "total_out_writes", atomic_get_u64(&s->ths_total_writes_out));
 
   return m;
 }
@@ -1177,6 +1179,14 @@ void subscription_add_bytes_out(th_subscription_t *s, size_t out)
   atomic_add_u64(&s->ths_total_bytes_out, out);
 }
 
+/**
+ * Update outgoing write syscall count
+ */
+void subscription_add_writes_out(th_subscription_t *s, uint64_t writes)
+{
+  atomic_add_u64(&s->ths_total_writes_out, writes);
+}
+
 /**
  * Change weight
  */
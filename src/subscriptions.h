@@ -101,6 +101,7 @@ typedef struct th_subscription {
   int ths_total_err; /* total errors during entire subscription */
   uint64_t ths_total_bytes_in; /* total bytes since the subscription started */
   uint64_t ths_total_bytes_out; /* total bytes since the subscription started */
+  uint64_t ths_total_writes_out; /* total write syscalls (streaming) */
   uint64_t ths_total_bytes_in_prev; /* total bytes since the subscription started, minus 1 second */
   uint64_t ths_total_bytes_out_prev; /* total bytes since the subscription started, minus 1 second */
   int ths_bytes_in_avg; /* Average bytes in per second */
@@ -233,6 +234,8 @@ void subscription_add_bytes_in(th_subscription_t *s, size_t in);
 
 void subscription_add_bytes_out(th_subscription_t *s, size_t out);
 
+void subscription_add_writes_out(th_subscription_t *s, uint64_t writes);
+
 static inline int subscriptions_active(void)
   { return LIST_FIRST(&subscriptions) != NULL; }
 
@@ -522,6 +522,7 @@ typedef struct tcp_server_launch {
   uint32_t id;
   int fd;
   int streaming;
+  int attached;
   tcp_server_ops_t ops;
   void *opaque;
   char *representative;
@@ -683,13 +684,11 @@ tcp_connection_cancel_all(void)
 /*
  *
  */
-static void *
-tcp_server_start(void *aux)
+static void
+tcp_server_sockopts(tcp_server_launch_t *tsl)
 {
-  tcp_server_launch_t *tsl = aux;
   struct timeval to;
   int val;
-  char c = 'J';
 
   val = 1;
   setsockopt(tsl->fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
@@ -715,6 +714,18 @@ tcp_server_start(void *aux)
   to.tv_sec  = 30;
   to.tv_usec =  0;
   setsockopt(tsl->fd, SOL_SOCKET, SO_SNDTIMEO, &to, sizeof(to));
+}
+
+/*
+ *
+ */
+static void *
+tcp_server_start(void *aux)
+{
+  tcp_server_launch_t *tsl = aux;
+  char c = 'J';
+
+  tcp_server_sockopts(tsl);
 
   /* Start */
   time(&tsl->started);
@@ -733,6 +744,45 @@ tcp_server_start(void *aux)
   return NULL;
 }
 
+/*
+ * Serve the connection without a thread (ops.attach)
+ */
+static int
+tcp_server_attach(tcp_server_launch_t *tsl)
+{
+  lock_assert(&global_lock);
+
+  tcp_server_sockopts(tsl);
+  time(&tsl->started);
+  tsl->id = ++tcp_server_launch_id;
+  if (!tsl->id) tsl->id = ++tcp_server_launch_id;
+  tsl->attached = 1;
+  if (tsl->ops.attach(tsl->fd, &tsl->opaque, &tsl->peer, &tsl->self) == 0)
+    return 0;
+  tsl->attached = 0;
+  return -1;
+}
+
+/*
+ * The attached connection is finished (the caller closes the socket)
+ */
+void
+tcp_server_detach(void *opaque)
+{
+  tcp_server_launch_t *tsl;
+
+  lock_assert(&global_lock);
+
+  LIST_FOREACH(tsl, &tcp_server_active, alink)
+    if (tsl->attached && tsl->opaque == opaque)
+      break;
+  if (tsl == NULL)
+    return;
+  if (tsl->ops.stop) tsl->ops.stop(tsl->opaque);
+  LIST_REMOVE(tsl, alink);
+  free(tsl);
+}
+
 
 /**
  *
@@ -793,6 +843,7 @@ next:
       tsl->opaque         = ts->opaque;
       tsl->status         = NULL;
       tsl->representative = NULL;
+      tsl->attached       = 0;
       slen = sizeof(struct sockaddr_storage);
 
       tsl->fd = accept(ts->serverfd, 
@@ -813,6 +864,10 @@ next:
 
       tvh_mutex_lock(&global_lock);
       LIST_INSERT_HEAD(&tcp_server_active, tsl, alink);
+      if (tsl->ops.attach && tcp_server_attach(tsl) == 0) {
+        tvh_mutex_unlock(&global_lock);
+        continue;
+      }
       tvh_mutex_unlock(&global_lock);
       tvh_thread_create(&tsl->tid, NULL, tcp_server_start, tsl, "tcp-start");
     }
@@ -1197,7 +1252,8 @@ tcp_server_done(void)
       tsl->ops.cancel(tsl->opaque);
     if (tsl->fd >= 0)
       shutdown(tsl->fd, SHUT_RDWR);
-    tvh_thread_kill(tsl->tid, SIGTERM);
+    if (!tsl->attached)
+      tvh_thread_kill(tsl->tid, SIGTERM);
   }
   tvh_mutex_unlock(&global_lock);
 
@@ -54,6 +54,10 @@ typedef struct tcp_server_ops
                      struct sockaddr_storage *self);
   void (*stop)   (void *opaque);
   void (*cancel) (void *opaque);
+  /* optional, the connection is served without a thread when 0 is returned */
+  int  (*attach) (int fd, void **opaque,
+                     struct sockaddr_storage *peer,
+                     struct sockaddr_storage *self);
 } tcp_server_ops_t;
 
 extern int tcp_preferred_address_family;
@@ -129,6 +133,8 @@ void tcp_server_register(void *server);
 
 void tcp_server_delete(void *server);
 
+void tcp_server_detach(void *opaque);
+
 int tcp_default_ip_addr(struct sockaddr_storage *deflt, int family);
 
 int tcp_server_bound(void *server, struct sockaddr_storage *bound, int family);
@@ -39,20 +39,23 @@ static int timeshift_index = 0;
 struct timeshift_conf timeshift_conf;
 
 memoryinfo_t timeshift_memoryinfo = { .my_name = "Timeshift" };
-memoryinfo_t timeshift_memoryinfo_ram = { .my_name = "Timeshift RAM buffer" };
+memoryinfo_t timeshift_memoryinfo_ram = {
+  .my_name = "Timeshift RAM buffer",
+  .my_update = timeshift_ram_memoryinfo_update
+};
 
 /*
  * Packet log
  */
 void
 timeshift_packet_log0
-  ( const char *source, timeshift_t *ts, streaming_message_t *sm )
+  ( const char *source, int id, streaming_message_t *sm )
 {
   th_pkt_t *pkt = sm->sm_data;
   tvhtrace(LS_TIMESHIFT,
            "ts %d pkt %s - stream %d type %c pts %10"PRId64
            " dts %10"PRId64" dur %10d len %6zu time %14"PRId64,
-           ts->id, source,
+           id, source,
            pkt->pkt_componentindex,
            SCT_ISVIDEO(pkt->pkt_type) ? pkt_frametype_to_char(pkt->v.pkt_frametype) : '-',
            ts_rescale(pkt->pkt_pts, 1000000),
@@ -62,6 +65,17 @@ timeshift_packet_log0
            sm->sm_time);
 }
 
+/*
+ * Pass the message to the client output (from the writer or reader)
+ */
+void
+timeshift_deliver ( timeshift_t *ts, streaming_message_t *sm )
+{
+  tvh_mutex_lock(&ts->out_mutex);
+  streaming_target_deliver2(ts->output, sm);
+  tvh_mutex_unlock(&ts->out_mutex);
+}
+
 /*
  * Safe values for RAM configuration
  */
@@ -289,6 +303,16 @@ const idclass_t timeshift_conf_class = {
       .off    = offsetof(timeshift_conf_t, ram_fit),
       .opts   = PO_EXPERT,
     },
+    {
+      .type   = PT_BOOL,
+      .id     = "ram_hugepages",
+      .name   = N_("Use huge pages for RAM"),
+      .desc   = N_("Allocate the RAM buffers from huge pages (when "
+                   "the system provides them). This reduces the memory "
+                   "management overhead for big RAM sizes."),
+      .off    = offsetof(timeshift_conf_t, ram_hugepages),
+      .opts   = PO_EXPERT,
+    },
     {
       .type   = PT_BOOL,
       .id     = "teletext",
@@ -308,7 +332,7 @@ const idclass_t timeshift_conf_class = {
  */
 
 static int
-timeshift_packet( timeshift_t *ts, streaming_message_t *sm )
+timeshift_packet( timeshift_buffer_t *tsb, streaming_message_t *sm )
 {
   th_pkt_t *pkt = sm->sm_data;
   int64_t time;
@@ -316,29 +340,100 @@ timeshift_packet( timeshift_t *ts, streaming_message_t *sm )
   if (pkt->pkt_pts != PTS_UNSET) {
     /* avoid to update last_wr_time for TELETEXT packets */
     if (pkt->pkt_type != SCT_TELETEXT) {
-      time = ts_rescale(pkt->pkt_pts, 1000000);
-      if (ts->last_wr_time < time)
-        ts->last_wr_time = time;
+      time = ts_rescale(pkt->pkt_pts - sm->sm_ts_delta, 1000000);
+      if (tsb->last_wr_time < time)
+        tsb->last_wr_time = time;
     }
   }
-  sm->sm_time = ts->last_wr_time;
-  timeshift_packet_log("wr ", ts, sm);
-  streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
+  sm->sm_time = tsb->last_wr_time;
+  timeshift_packet_log("wr ", tsb->id, sm);
+  streaming_target_deliver2(&tsb->wr_queue.sq_st, sm);
   return 0;
 }
 
+/*
+ * Pass the client message to the writer thread, the writer sends
+ * it to the client output after the data queued before
+ */
+static void
+timeshift_queue( timeshift_buffer_t *tsb, timeshift_t *ts,
+                 streaming_message_t *sm )
+{
+  timeshift_msg_t *tm = malloc(sizeof(*tm));
+
+  lock_assert(&tsb->state_mutex);
+
+  tm->sm = sm;
+  tm->ts = ts;
+  TAILQ_INSERT_TAIL(&tsb->wr_msgs, tm, link);
+  ts->queued++;
+  streaming_target_deliver2(&tsb->wr_queue.sq_st, sm);
+}
+
+/*
+ * Pass the data from the feeder client to the writer thread
+ */
+static void
+timeshift_feed( timeshift_buffer_t *tsb, streaming_message_t *sm )
+{
+  int type = sm->sm_type;
+  timeshift_t *ts;
+
+  /* The joining clients have passed own packets until now */
+  LIST_FOREACH(ts, &tsb->clients, link) {
+    if (!ts->joining)
+      continue;
+    ts->joining = 0;
+    if (type == SMT_PACKET && sm->sm_data == ts->join_pkt) {
+      ts->live_skip = ts->join_pkt;
+    } else if (ts->join_pkt) {
+      pkt_ref_dec(ts->join_pkt);
+    }
+    ts->join_pkt = NULL;
+  }
+
+  if (type == SMT_MPEGTS)
+    tsb->packet_mode = 0;
+
+  if (tsb->packet_mode) {
+    sm->sm_time = tsb->last_wr_time;
+    if (type == SMT_PACKET) {
+      timeshift_packet(tsb, sm);
+      return;
+    }
+  } else {
+    if (tsb->ref_time == 0) {
+      tsb->ref_time = getfastmonoclock();
+      sm->sm_time = 0;
+    } else {
+      sm->sm_time = getfastmonoclock() - tsb->ref_time;
+    }
+  }
+  streaming_target_deliver2(&tsb->wr_queue.sq_st, sm);
+}
+
 /*
  * Receive data
+ *
+ * The live data are sent from the buffer writer, only the feeder
+ * client passes them to the buffer. The other messages are queued
+ * to the writer, too, and sent to the own output in the live mode.
+ *
+ * The packets held by the globalheaders of a joining client are
+ * already fed, so the client passes own packets after the start
+ * until the feeder passes the next data.
  */
 static void timeshift_input
   ( void *opaque, streaming_message_t *sm )
 {
   int type = sm->sm_type;
   timeshift_t *ts = opaque;
-  th_pkt_t *pkt, *pkt2;
+  timeshift_buffer_t *tsb = ts->buffer;
 
-  if (ts->exit)
+  if (ts->exit) {
+    streaming_msg_free(sm);
     return;
+  }
 
   /* Control */
   if (type == SMT_SKIP) {
@@ -349,41 +444,51 @@ static void timeshift_input
     streaming_msg_free(sm);
   } else {
 
-    /* Change PTS/DTS offsets */
-    if (ts->packet_mode && ts->start_pts && type == SMT_PACKET) {
-      pkt = sm->sm_data;
-      pkt2 = pkt_copy_shallow(pkt);
-      pkt_ref_dec(pkt);
-      sm->sm_data = pkt2;
-      if (pkt2->pkt_pts != PTS_UNSET) pkt2->pkt_pts += ts->start_pts;
-      if (pkt2->pkt_dts != PTS_UNSET) pkt2->pkt_dts += ts->start_pts;
-    }
-
-    /* Check for exit */
-    else if (type == SMT_EXIT ||
-        (type == SMT_STOP && sm->sm_code != SM_CODE_SOURCE_RECONFIGURED))
-      ts->exit = 1;
-
-    else if (type == SMT_MPEGTS)
-      ts->packet_mode = 0;
-
-    /* Send to the writer thread */
-    if (ts->packet_mode) {
-      sm->sm_time = ts->last_wr_time;
-      if ((type == SMT_PACKET) && !timeshift_packet(ts, sm))
-        goto _exit;
-    } else {
-      if (ts->ref_time == 0) {
-        ts->ref_time = getfastmonoclock();
-        sm->sm_time = 0;
-      } else {
-        sm->sm_time = getfastmonoclock() - ts->ref_time;
+    tvh_mutex_lock(&tsb->state_mutex);
+    switch (type) {
+    case SMT_PACKET:
+    case SMT_MPEGTS:
+    case SMT_SIGNAL_STATUS:
+      if (ts == tsb->feeder) {
+        timeshift_feed(tsb, sm);
+        sm = NULL;
+      } else if (ts->joining && type == SMT_PACKET) {
+        if (ts->join_pkt)
+          pkt_ref_dec(ts->join_pkt);
+        ts->join_pkt = sm->sm_data;
+        pkt_ref_inc(ts->join_pkt);
+        timeshift_queue(tsb, ts, sm);
+        sm = NULL;
       }
+      break;
+    case SMT_START:
+      if (ts == tsb->feeder)
+        timeshift_feed(tsb, streaming_msg_clone(sm));
+      else
+        ts->joining = 1;
+      timeshift_queue(tsb, ts, sm);
+      sm = NULL;
+      break;
+    case SMT_STOP:
+      /* Check for exit */
+      if (sm->sm_code != SM_CODE_SOURCE_RECONFIGURED)
+        ts->exit = 1;
+      /* fall thru */
+    case SMT_EXIT:
+      if (type == SMT_EXIT)
+        ts->exit = 1;
+      /* fall thru */
+    default:
+      timeshift_queue(tsb, ts, sm);
+      sm = NULL;
+      break;
     }
-    streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
+    tvh_mutex_unlock(&tsb->state_mutex);
+
+    if (sm)
+      streaming_msg_free(sm);
 
     /* Exit/Stop */
-_exit:
     if (ts->exit)
       timeshift_write_exit(ts->rd_pipe.wr);
   }
@@ -401,6 +506,88 @@ static streaming_ops_t timeshift_input_ops = {
   .st_info = timeshift_input_info
 };
 
+/*
+ * Update the buffer period (the longest client period)
+ */
+static void
+timeshift_buffer_update(timeshift_buffer_t *tsb)
+{
+  timeshift_t *ts;
+
+  tsb->max_time = 0;
+  LIST_FOREACH(ts, &tsb->clients, link)
+    if (ts->max_time > tsb->max_time)
+      tsb->max_time = ts->max_time;
+}
+
+/**
+ * Create the shared timeshift buffer
+ *
+ * The caller holds the first reference, each client takes own.
+ */
+timeshift_buffer_t *timeshift_buffer_create(void)
+{
+  timeshift_buffer_t *tsb = calloc(1, sizeof(timeshift_buffer_t));
+
+  memoryinfo_alloc(&timeshift_memoryinfo, sizeof(timeshift_buffer_t));
+
+  /* Must hold global lock */
+  lock_assert(&global_lock);
+
+  /* Setup structure */
+  TAILQ_INIT(&tsb->files);
+  TAILQ_INIT(&tsb->wr_msgs);
+  LIST_INIT(&tsb->clients);
+  tsb->id          = timeshift_index++;
+  tsb->refcount    = 1;
+  tsb->vididx      = -1;
+  tsb->packet_mode = 1;
+  tvh_mutex_init(&tsb->state_mutex, NULL);
+  tvh_cond_init(&tsb->wr_cond, 1);
+
+  /* Initialise writer */
+  streaming_queue_init(&tsb->wr_queue, 0, 0);
+  tvh_thread_create(&tsb->wr_thread, NULL, timeshift_writer, tsb, "tshift-wr");
+
+  return tsb;
+}
+
+/**
+ * Release the buffer reference
+ */
+void
+timeshift_buffer_destroy(timeshift_buffer_t *tsb)
+{
+  /* Must hold global lock */
+  lock_assert(&global_lock);
+
+  assert(tsb->refcount > 0);
+  if (--tsb->refcount > 0)
+    return;
+  assert(LIST_EMPTY(&tsb->clients));
+
+  /* Stop the writer */
+  streaming_target_deliver2(&tsb->wr_queue.sq_st,
+                            streaming_msg_create(SMT_EXIT));
+  pthread_join(tsb->wr_thread, NULL);
+  streaming_queue_deinit(&tsb->wr_queue);
+  assert(TAILQ_EMPTY(&tsb->wr_msgs));
+  tvh_cond_destroy(&tsb->wr_cond);
+  free(tsb->wr_live);
+
+  /* Flush files */
+  timeshift_filemgr_flush(tsb, NULL);
+  timeshift_index_done(tsb);
+
+  if (tsb->smt_start)
+    streaming_start_unref(tsb->smt_start);
+
+  if (tsb->path)
+    free(tsb->path);
+
+  free(tsb);
+  memoryinfo_free(&timeshift_memoryinfo, sizeof(timeshift_buffer_t));
+}
 
 /**
  *
@@ -409,52 +596,50 @@ void
 timeshift_destroy(streaming_target_t *pad)
 {
   timeshift_t *ts = (timeshift_t*)pad;
-  streaming_message_t *sm;
+  timeshift_buffer_t *tsb = ts->buffer;
 
   /* Must hold global lock */
   lock_assert(&global_lock);
 
-  /* Ensure the threads exits */
-  // Note: this is a workaround for the fact the Q might have been flushed
-  //       in reader thread (VERY unlikely)
-  tvh_mutex_lock(&ts->state_mutex);
-  sm = streaming_msg_create(SMT_EXIT);
-  streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
+  /* Detach from the buffer and ensure the reader exits */
+  tvh_mutex_lock(&tsb->state_mutex);
   if (!ts->exit)
     timeshift_write_exit(ts->rd_pipe.wr);
-  tvh_mutex_unlock(&ts->state_mutex);
-
-  /* Wait for all threads */
+  ts->exit = 1;
+  LIST_REMOVE(ts, link);
+  if (tsb->feeder == ts)
+    tsb->feeder = LIST_FIRST(&tsb->clients);
+  timeshift_buffer_update(tsb);
+  /* The writer passes the queued messages (stop) */
+  while (ts->queued > 0)
+    tvh_cond_wait(&tsb->wr_cond, &tsb->state_mutex);
+  if (ts->join_pkt)
+    pkt_ref_dec(ts->join_pkt);
+  if (ts->live_skip)
+    pkt_ref_dec(ts->live_skip);
+  tvh_mutex_unlock(&tsb->state_mutex);
+
+  /* Wait for the reader */
   pthread_join(ts->rd_thread, NULL);
-  pthread_join(ts->wr_thread, NULL);
-
-  /* Shut stuff down */
-  streaming_queue_deinit(&ts->wr_queue);
 
   close(ts->rd_pipe.rd);
   close(ts->rd_pipe.wr);
-
-  /* Flush files */
-  timeshift_filemgr_flush(ts, NULL);
-
-  if (ts->smt_start)
-    streaming_start_unref(ts->smt_start);
-
-  if (ts->path)
-    free(ts->path);
+  tvh_mutex_destroy(&ts->out_mutex);
 
   free(ts);
   memoryinfo_free(&timeshift_memoryinfo, sizeof(timeshift_t));
+
+  timeshift_buffer_destroy(tsb);
 }
 
 /**
- * Create timeshift buffer
+ * Create timeshift client
  *
  * max_period of buffer in seconds (0 = unlimited)
- * max_size   of buffer in bytes   (0 = unlimited)
+ * buffer     shared buffer (from timeshift_buffer_create)
  */
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_time)
+  (streaming_target_t *out, time_t max_time, timeshift_buffer_t *tsb)
 {
   timeshift_t *ts = calloc(1, sizeof(timeshift_t));
 
@@ -464,39 +649,36 @@ streaming_target_t *timeshift_create
   lock_assert(&global_lock);
 
   /* Setup structure */
-  TAILQ_INIT(&ts->files);
   ts->output     = out;
-  ts->path       = NULL;
+  ts->buffer     = tsb;
   ts->max_time   = max_time;
   ts->state      = TS_LIVE;
   ts->exit       = 0;
-  ts->full       = 0;
-  ts->vididx     = -1;
-  ts->id         = timeshift_index;
+  ts->id         = timeshift_index++;
   ts->ondemand   = timeshift_conf.ondemand;
   ts->dobuf      = ts->ondemand ? 0 : 1;
-  ts->packet_mode= 1;
-  ts->last_wr_time = 0;
-  ts->buf_time   = 0;
-  ts->start_pts  = 0;
-  ts->ref_time   = 0;
   ts->seek.file  = NULL;
-  ts->seek.frame = NULL;
-  ts->ram_segments = 0;
-  ts->file_segments = 0;
-  tvh_mutex_init(&ts->state_mutex, NULL);
+  ts->seek.frame = -1;
+  ts->seek.rfd   = -1;
+  tvh_mutex_init(&ts->out_mutex, NULL);
 
   /* Initialise output */
   tvh_pipe(O_NONBLOCK, &ts->rd_pipe);
 
   /* Initialise input */
-  streaming_queue_init(&ts->wr_queue, 0, 0);
   streaming_target_init(&ts->input, &timeshift_input_ops, ts, 0);
-  tvh_thread_create(&ts->wr_thread, NULL, timeshift_writer, ts, "tshift-wr");
-  tvh_thread_create(&ts->rd_thread, NULL, timeshift_reader, ts, "tshift-rd");
 
-  /* Update index */
-  timeshift_index++;
+  /* Attach to the buffer */
+  tsb->refcount++;
+  tvh_mutex_lock(&tsb->state_mutex);
+  LIST_INSERT_HEAD(&tsb->clients, ts, link);
+  if (tsb->feeder == NULL)
+    tsb->feeder = ts;
+  timeshift_buffer_update(tsb);
+  tvh_mutex_unlock(&tsb->state_mutex);
+  tvhdebug(LS_TIMESHIFT, "ts %d attached to buffer %d", ts->id, tsb->id);
+
+  tvh_thread_create(&ts->rd_thread, NULL, timeshift_reader, ts, "tshift-rd");
 
   return &ts->input;
 }
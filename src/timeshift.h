@@ -38,6 +38,7 @@ typedef struct timeshift_conf {
   uint64_t  total_ram_size;
   int       ram_only;
   int       ram_fit;
+  int       ram_hugepages;
   int       teletext;
 } timeshift_conf_t;
 
@@ -47,11 +48,17 @@ extern const idclass_t timeshift_conf_class;
 extern memoryinfo_t timeshift_memoryinfo;
 extern memoryinfo_t timeshift_memoryinfo_ram;
 
+typedef struct timeshift_buffer timeshift_buffer_t;
+
 void timeshift_init ( void );
 void timeshift_term ( void );
 
+timeshift_buffer_t *timeshift_buffer_create(void);
+
+void timeshift_buffer_destroy(timeshift_buffer_t *tsb);
+
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_period);
+  (streaming_target_t *out, time_t max_period, timeshift_buffer_t *tsb);
 
 void timeshift_destroy(streaming_target_t *pad);
 
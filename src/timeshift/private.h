@@ -22,19 +22,58 @@
 #define TIMESHIFT_PLAY_BUF         1000000 //< us to buffer in TX
 #define TIMESHIFT_FILE_PERIOD      60      //< number of secs in each buffer file
 #define TIMESHIFT_BACKLOG_MAX      16      //< maximum elementary streams
+#define TIMESHIFT_WBUF_SIZE        (64*1024)  //< file write-behind buffer
+#define TIMESHIFT_RBUF_SIZE        (256*1024) //< file read chunk
+#define TIMESHIFT_RBUF_ALIGN       4096       //< file read chunk alignment
+#define TIMESHIFT_RECORD_MAX       (4*1024*1024) //< sanity limit for records
+#define TIMESHIFT_RAM_BLOCK_MIN    (4*1024*1024)  //< RAM segment block size
+#define TIMESHIFT_RAM_BLOCK_MAX    (64*1024*1024)
+#define TIMESHIFT_RAM_BLOCK_ALIGN  (2*1024*1024)  //< huge page size
+#define TIMESHIFT_RAM_RESERVE      (512*1024)     //< space for the next record
+#define TIMESHIFT_RAM_IDLE         60             //< secs to keep unused blocks
 
 /**
- * Indexes of import data in the stream
+ * Segment record header (RAM and file segments)
+ *
+ * The record data follows the header, tr_size includes the header.
+ * The zero tr_size marks the end of the segment.
+ */
+typedef struct timeshift_record
+{
+  uint32_t                          tr_size;  ///< Record size
+  uint32_t                          tr_type;  ///< Message type
+  int64_t                           tr_time;  ///< Message time
+} __attribute__((packed)) timeshift_record_t;
+
+/**
+ * Packet record data (followed by the meta and payload bytes)
+ */
+typedef struct timeshift_record_pkt
+{
+  int64_t                           trp_dts;
+  int64_t                           trp_pts;
+  int64_t                           trp_pcr;
+  int32_t                           trp_duration;
+  uint32_t                          trp_meta;       ///< Meta data size
+  uint8_t                           trp_type;
+  uint8_t                           trp_err;
+  uint8_t                           trp_componentindex;
+  uint8_t                           trp_commercial;
+  uint8_t                           trp_frametype;  ///< Covers the audio
+  uint8_t                           trp_field;      ///< fields, too
+  uint16_t                          trp_aspect_num;
+  uint16_t                          trp_aspect_den;
+} __attribute__((packed)) timeshift_record_pkt_t;
+
+/**
+ * Indexes of import data in the stream (array sorted by time)
  */
 typedef struct timeshift_index_iframe
 {
-  off_t                               pos;    ///< Position in the file
   int64_t                             time;   ///< Packet time
-  TAILQ_ENTRY(timeshift_index_iframe) link;   ///< List entry
+  off_t                               pos;    ///< Position in the file
 } timeshift_index_iframe_t;
 
-typedef TAILQ_HEAD(timeshift_index_iframe_list,timeshift_index_iframe) timeshift_index_iframe_list_t;
-
 /**
  * Indexes of import data in the stream
  */
@@ -47,48 +86,84 @@ typedef struct timeshift_index_data
 
 typedef TAILQ_HEAD(timeshift_index_data_list,timeshift_index_data) timeshift_index_data_list_t;
 
+/**
+ * RAM segment data
+ *
+ * The played packets point into this block (no copy), the block is
+ * returned to the pool when the segment is removed and all packets
+ * are gone. The blocks with the oversized records are on the heap.
+ */
+typedef struct timeshift_ram
+{
+  pktbuf_owner_t                tsr_owner;  ///< Reference count (first)
+  TAILQ_ENTRY(timeshift_ram)    tsr_link;   ///< Pool idle list
+  size_t                        tsr_size;   ///< Allocated data size
+  size_t                        tsr_block;  ///< Pool block size (0 = heap)
+  int64_t                       tsr_idle;   ///< Time of the return to the pool
+  uint8_t                       tsr_data[0];
+} timeshift_ram_t;
+
 /**
  * Timeshift file
  */
 typedef struct timeshift_file
 {
   int                           wfd;      ///< Write descriptor
-  int                           rfd;      ///< Read descriptor
   char                          *path;    ///< Full path to file
 
   int64_t                       time;     ///< Files coarse timestamp
   size_t                        size;     ///< Current file size;
   int64_t                       last;     ///< Latest timestamp
-  off_t                         woff;     ///< Write offset
-  off_t                         roff;     ///< Read offset
+  off_t                         woff;     ///< Write offset (published)
+  size_t                        wpend;    ///< Bytes written after woff (writer)
 
-  uint8_t                      *ram;      ///< RAM area
-  int64_t                       ram_size; ///< RAM area size in bytes
+  timeshift_ram_t              *ram;      ///< RAM area
+
+  uint8_t                      *wbuf;     ///< Write-behind buffer (file)
+  size_t                        wbuf_len; ///< Bytes not yet written to file
+  off_t                         wbuf_off; ///< File offset of the buffer
 
   uint8_t                       bad;      ///< File is broken
+  uint8_t                       eof;      ///< File is closed (end written)
 
-  int                           refcount; ///< Reader ref count
+  int                           refcount; ///< Reader ref count (all clients)
 
-  timeshift_index_iframe_list_t iframes;  ///< I-frame indexing
+  timeshift_index_iframe_t     *iframes;  ///< I-frame indexing
+  int                           iframes_count;
+  int                           iframes_alloc;
   timeshift_index_data_list_t   sstart;   ///< Stream start messages
 
   TAILQ_ENTRY(timeshift_file) link;     ///< List entry
 
-  tvh_mutex_t               ram_lock; ///< Mutex for the ram array access
+  tvh_mutex_t               ram_lock; ///< Mutex for the ram and wbuf access
 } timeshift_file_t;
 
 typedef TAILQ_HEAD(timeshift_file_list,timeshift_file) timeshift_file_list_t;
 
 /**
- *
+ * Read cursor (per client)
  */
 typedef struct timeshift_seek {
   timeshift_file_t           *file;
-  timeshift_index_iframe_t   *frame;
+  int                         frame;      ///< I-frame index (-1 = none)
+  off_t                       roff;       ///< Read offset
+  int                         rfd;        ///< Read descriptor
+  uint8_t                    *rbuf;       ///< Read buffer (file)
+  off_t                       rbuf_off;   ///< File offset of the read buffer
+  size_t                      rbuf_len;   ///< Valid bytes in the read buffer
 } timeshift_seek_t;
 
 /**
- *
+ * Client message queued to the writer (kept in the data order)
+ */
+typedef struct timeshift_msg {
+  TAILQ_ENTRY(timeshift_msg)  link;
+  streaming_message_t        *sm;         ///< Message in the writer queue
+  struct timeshift           *ts;         ///< Client
+} timeshift_msg_t;
+
+/**
+ * Timeshift client (own play state and read cursor)
  */
 typedef struct timeshift {
   // Note: input MUST BE FIRST in struct
@@ -96,16 +171,11 @@ typedef struct timeshift {
   streaming_target_t          *output;    ///< Output dest
 
   int                         id;         ///< Reference number
-  char                        *path;      ///< Directory containing buffer
+  timeshift_buffer_t         *buffer;    ///< Shared buffer
+  LIST_ENTRY(timeshift)       link;       ///< Buffer client list
   time_t                      max_time;   ///< Maximum period to shift
   int                         ondemand;   ///< Whether this is an on-demand timeshift
-  int                         packet_mode;///< Packet mode (otherwise MPEG-TS data mode)
   int                         dobuf;      ///< Buffer packets (store)
-  int64_t                     last_wr_time;///< Last write time in us (PTS conversion)
-  int64_t                     start_pts;  ///< Start time for packets (PTS)
-  int64_t                     ref_time;   ///< Start time in us (monoclock)
-  int64_t                     buf_time;   ///< Last buffered time in us (PTS conversion)
-  int                         backlog_max;///< Maximum component index in backlog
 
   enum {
     TS_EXIT,
@@ -113,19 +183,63 @@ typedef struct timeshift {
     TS_PAUSE,
     TS_PLAY,
   }                           state;       ///< Play state
-  tvh_mutex_t             state_mutex; ///< Protect state changes
   uint8_t                     exit;        ///< Exit from the main input thread
-  uint8_t                     full;        ///< Buffer is full
+  uint8_t                     started;     ///< Start message was passed (writer order)
+  uint8_t                     joining;     ///< Own packets passed until the next feed
+  uint8_t                     full;        ///< Moved forward (buffer full)
+  int                         queued;      ///< Writer messages queued or in delivery
+  th_pkt_t                   *join_pkt;    ///< Last own packet passed (joining)
+  th_pkt_t                   *live_skip;   ///< Fed packet already passed (joining)
 
   timeshift_seek_t            seek;       ///< Seek into buffered data
-  
-  streaming_queue_t           wr_queue;   ///< Writer queue
-  pthread_t                   wr_thread;  ///< Writer thread
+
+  tvh_mutex_t                 out_mutex;  ///< Output (writer and reader)
 
   pthread_t                   rd_thread;  ///< Reader thread
   th_pipe_t                   rd_pipe;    ///< Message passing to reader
 
+} timeshift_t;
+
+/**
+ * Timeshift buffer (shared by the clients of one profile sharer)
+ *
+ * The feeder client passes the data to the writer thread, the writer
+ * stores them once and sends the live data to all clients in the live
+ * state. The other messages of the clients (start, stop, status) go
+ * through the writer queue, too, so they keep the order with the data.
+ *
+ * The state is protected by the state_mutex. The file I/O and the
+ * output delivery run without it: the files in use are pinned by the
+ * reference count, the writer publishes the written records (woff)
+ * and takes the live clients in one lock.
+ */
+struct timeshift_buffer {
+  int                         id;         ///< Reference number
+  int                         refcount;   ///< Clients + sharer (global_lock)
+  char                        *path;      ///< Directory containing buffer
+  time_t                      max_time;   ///< Maximum period to shift (all clients)
+  int                         packet_mode;///< Packet mode (otherwise MPEG-TS data mode)
+  int64_t                     last_wr_time;///< Last write time in us (PTS conversion)
+  int64_t                     ref_time;   ///< Start time in us (monoclock)
+  int64_t                     buf_time;   ///< Last buffered time in us (PTS conversion)
+
+  tvh_mutex_t                 state_mutex; ///< Protect state changes
+
+  LIST_HEAD(,timeshift)       clients;    ///< Attached clients
+  timeshift_t                *feeder;     ///< Client passing the data
+
+  streaming_queue_t           wr_queue;   ///< Writer queue
+  pthread_t                   wr_thread;  ///< Writer thread
+  TAILQ_HEAD(,timeshift_msg)  wr_msgs;    ///< Client messages in wr_queue
+  tvh_cond_t                  wr_cond;    ///< Client messages were passed
+  timeshift_t               **wr_live;    ///< Live clients (writer)
+  int                         wr_live_count;
+  int                         wr_live_alloc;
+
   timeshift_file_list_t       files;      ///< List of files
+  timeshift_file_t          **segments;   ///< Files with I-frames (time order)
+  int                         segments_count;
+  int                         segments_alloc;
 
   int                         ram_segments;  ///< Count of segments in RAM
   int                         file_segments; ///< Count of segments in files
@@ -134,7 +248,7 @@ typedef struct timeshift {
 
   streaming_start_t          *smt_start;  ///< Streaming start info
 
-} timeshift_t;
+};
 
 /*
  *
@@ -143,27 +257,30 @@ extern uint64_t timeshift_total_size;
 extern uint64_t timeshift_total_ram_size;
 
 void timeshift_packet_log0
-  ( const char *prefix, timeshift_t *ts, streaming_message_t *sm );
+  ( const char *prefix, int id, streaming_message_t *sm );
 
 static inline void timeshift_packet_log
-  ( const char *prefix, timeshift_t *ts, streaming_message_t *sm )
+  ( const char *prefix, int id, streaming_message_t *sm )
 {
   if (sm->sm_type == SMT_PACKET && tvhtrace_enabled())
-    timeshift_packet_log0(prefix, ts, sm);
+    timeshift_packet_log0(prefix, id, sm);
 }
 
+void timeshift_deliver ( timeshift_t *ts, streaming_message_t *sm );
+
 /*
  * Write functions
  */
 ssize_t timeshift_write_start   ( timeshift_file_t *tsf, int64_t time, streaming_start_t *ss );
 ssize_t timeshift_write_sigstat ( timeshift_file_t *tsf, int64_t time, signal_status_t *ss );
-ssize_t timeshift_write_packet  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt );
+ssize_t timeshift_write_packet  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt, int64_t ts_delta );
 ssize_t timeshift_write_mpegts  ( timeshift_file_t *tsf, int64_t time, void *data );
 ssize_t timeshift_write_skip    ( int fd, streaming_skip_t *skip );
 ssize_t timeshift_write_speed   ( int fd, int speed );
 ssize_t timeshift_write_stop    ( int fd, int code );
 ssize_t timeshift_write_exit    ( int fd );
 ssize_t timeshift_write_eof     ( timeshift_file_t *tsf );
+ssize_t timeshift_write_flush   ( timeshift_file_t *tsf );
 
 /*
  * Threads
@@ -207,26 +324,56 @@ static inline void timeshift_file_put0 ( timeshift_file_t *tsf )
 })
 
 timeshift_file_t *timeshift_filemgr_get
-  ( timeshift_t *ts, int64_t start_time );
+  ( timeshift_buffer_t *tsb, int64_t start_time );
 timeshift_file_t *timeshift_filemgr_oldest
-  ( timeshift_t *ts );
+  ( timeshift_buffer_t *tsb );
 timeshift_file_t *timeshift_filemgr_newest
-  ( timeshift_t *ts );
+  ( timeshift_buffer_t *tsb );
 timeshift_file_t *timeshift_filemgr_prev
   ( timeshift_file_t *ts, int *end, int keep );
 timeshift_file_t *timeshift_filemgr_next
   ( timeshift_file_t *ts, int *end, int keep );
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force );
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end );
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int force );
+void timeshift_filemgr_flush ( timeshift_buffer_t *tsb, timeshift_file_t *end );
+timeshift_file_t *timeshift_filemgr_unpinned
+  ( timeshift_buffer_t *tsb, timeshift_file_t *keep );
+void timeshift_filemgr_advance ( timeshift_buffer_t *tsb, timeshift_file_t *end );
+int timeshift_filemgr_reclaim
+  ( timeshift_buffer_t *tsb, timeshift_file_t *keep );
 void timeshift_filemgr_close ( timeshift_file_t *tsf );
 
-void timeshift_filemgr_dump0 ( timeshift_t *ts );
+void timeshift_filemgr_dump0 ( timeshift_buffer_t *tsb );
+
+/*
+ * I-frame index
+ */
+int  timeshift_index_add
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int64_t time, off_t pos );
+int  timeshift_index_find
+  ( timeshift_buffer_t *tsb, int64_t time, int back, timeshift_file_t **tsf );
+void timeshift_index_done ( timeshift_buffer_t *tsb );
+
+static inline timeshift_index_iframe_t *timeshift_index_frame
+  ( timeshift_seek_t *seek )
+{
+  return seek->frame >= 0 ? &seek->file->iframes[seek->frame] : NULL;
+}
+
+timeshift_ram_t *timeshift_ram_resize
+  ( timeshift_ram_t *ram, size_t size, size_t used );
+void timeshift_ram_memoryinfo_update ( memoryinfo_t *my );
+
+static inline void timeshift_ram_put ( timeshift_ram_t *ram )
+{
+  if (ram)
+    pktbuf_owner_ref_dec(&ram->tsr_owner);
+}
 
-static inline void timeshift_filemgr_dump ( timeshift_t *ts )
+static inline void timeshift_filemgr_dump ( timeshift_buffer_t *tsb )
 {
   if (tvhtrace_enabled())
-    timeshift_filemgr_dump0(ts);
+    timeshift_filemgr_dump0(tsb);
 }
 
 #endif /* __TVH_TIMESHIFT_PRIVATE_H__ */
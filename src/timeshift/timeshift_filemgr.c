@@ -17,6 +17,7 @@
  */
 
 #include <fcntl.h>
+#include <sys/mman.h>
 
 #include "tvheadend.h"
 #include "streaming.h"
@@ -35,6 +36,15 @@ static tvh_cond_t            timeshift_reaper_cond;
 uint64_t                     timeshift_total_size;
 uint64_t                     timeshift_total_ram_size;
 
+static tvh_mutex_t           timeshift_ram_lock = TVH_THREAD_MUTEX_INITIALIZER;
+static TAILQ_HEAD(timeshift_ram_queue, timeshift_ram) timeshift_ram_idle;
+static int64_t               timeshift_ram_idle_size;
+static int64_t               timeshift_ram_pool_size;  ///< Used + idle blocks
+static int64_t               timeshift_ram_hits;
+static int64_t               timeshift_ram_misses;
+
+static void timeshift_ram_trim ( int64_t now );
+
 /* **************************************************************************
  * File reaper thread
  * *************************************************************************/
@@ -43,7 +53,6 @@ static void* timeshift_reaper_callback ( void *p )
 {
   char *dpath;
   timeshift_file_t *tsf;
-  timeshift_index_iframe_t *ti;
   timeshift_index_data_t *tid;
   streaming_message_t *sm;
   tvh_mutex_lock(&timeshift_reaper_lock);
@@ -52,7 +61,12 @@ static void* timeshift_reaper_callback ( void *p )
     /* Get next */
     tsf = TAILQ_FIRST(&timeshift_reaper_list);
     if (!tsf) {
-      tvh_cond_wait(&timeshift_reaper_cond, &timeshift_reaper_lock);
+      tvh_cond_timedwait(&timeshift_reaper_cond, &timeshift_reaper_lock,
+                         mclk() + sec2mono(10));
+      /* Release the unused RAM blocks */
+      tvh_mutex_lock(&timeshift_ram_lock);
+      timeshift_ram_trim(mclk());
+      tvh_mutex_unlock(&timeshift_ram_lock);
       continue;
     }
     TAILQ_REMOVE(&timeshift_reaper_list, tsf, link);
@@ -73,11 +87,9 @@ static void* timeshift_reaper_callback ( void *p )
     }
 
     /* Free memory */
-    while ((ti = TAILQ_FIRST(&tsf->iframes))) {
-      TAILQ_REMOVE(&tsf->iframes, ti, link);
-      memoryinfo_free(&timeshift_memoryinfo, sizeof(*ti));
-      free(ti);
-    }
+    memoryinfo_remove(&timeshift_memoryinfo,
+                      tsf->iframes_alloc * sizeof(timeshift_index_iframe_t));
+    free(tsf->iframes);
     while ((tid = TAILQ_FIRST(&tsf->sstart))) {
       TAILQ_REMOVE(&tsf->sstart, tid, link);
       sm = tid->data;
@@ -85,9 +97,11 @@ static void* timeshift_reaper_callback ( void *p )
       memoryinfo_free(&timeshift_memoryinfo, sizeof(*tid));
       free(tid);
     }
+    if (tsf->wbuf) {
+      memoryinfo_free(&timeshift_memoryinfo, TIMESHIFT_WBUF_SIZE);
+      free(tsf->wbuf);
+    }
     free(tsf->path);
-    memoryinfo_free(&timeshift_memoryinfo_ram, tsf->ram_size);
-    free(tsf->ram);
     memoryinfo_free(&timeshift_memoryinfo, sizeof(*tsf));
     free(tsf);
 
@@ -112,22 +126,298 @@ static void timeshift_reaper_remove ( timeshift_file_t *tsf )
   tvh_mutex_unlock(&timeshift_reaper_lock);
 }
 
+/* **************************************************************************
+ * RAM segments
+ * *************************************************************************/
+
+/*
+ * The segments use the fixed size blocks from the global pool. The
+ * returned blocks are reused (most recent first), the blocks over
+ * the RAM size or unused for TIMESHIFT_RAM_IDLE seconds are released
+ * (least recent first). The blocks are mapped directly to keep them
+ * out of the heap.
+ */
+static size_t timeshift_ram_block ( void )
+{
+  size_t size = MINMAX(timeshift_conf.ram_segment_size,
+                       TIMESHIFT_RAM_BLOCK_MIN, TIMESHIFT_RAM_BLOCK_MAX);
+  return (size + TIMESHIFT_RAM_BLOCK_ALIGN - 1) &
+         ~((size_t)TIMESHIFT_RAM_BLOCK_ALIGN - 1);
+}
+
+static void *timeshift_ram_map ( size_t size )
+{
+  void *p;
+
+#ifdef MAP_HUGETLB
+  if (timeshift_conf.ram_hugepages) {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+      return p;
+  }
+#endif
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  if (timeshift_conf.ram_hugepages)
+    madvise(p, size, MADV_HUGEPAGE);
+#endif
+  return p;
+}
+
+static void timeshift_ram_unmap ( timeshift_ram_t *ram )
+{
+  timeshift_ram_pool_size -= ram->tsr_block;
+  munmap(ram, ram->tsr_block);
+}
+
+static void timeshift_ram_trim ( int64_t now )
+{
+  timeshift_ram_t *ram;
+  size_t block = timeshift_ram_block();
+
+  while ((ram = TAILQ_LAST(&timeshift_ram_idle, timeshift_ram_queue)) != NULL) {
+    if (ram->tsr_block == block &&
+        timeshift_ram_pool_size <= timeshift_conf.ram_size &&
+        now - ram->tsr_idle < sec2mono(TIMESHIFT_RAM_IDLE))
+      break;
+    TAILQ_REMOVE(&timeshift_ram_idle, ram, tsr_link);
+    timeshift_ram_idle_size -= ram->tsr_block;
+    timeshift_ram_unmap(ram);
+  }
+}
+
+static void timeshift_ram_free ( pktbuf_owner_t *pbo )
+{
+  timeshift_ram_t *ram = (timeshift_ram_t *)pbo;
+
+  if (ram->tsr_block == 0) {
+    memoryinfo_free(&timeshift_memoryinfo_ram, ram->tsr_size);
+    free(ram);
+    return;
+  }
+  memoryinfo_free(&timeshift_memoryinfo_ram, ram->tsr_block);
+  tvh_mutex_lock(&timeshift_ram_lock);
+  ram->tsr_idle = mclk();
+  TAILQ_INSERT_HEAD(&timeshift_ram_idle, ram, tsr_link);
+  timeshift_ram_idle_size += ram->tsr_block;
+  timeshift_ram_trim(ram->tsr_idle);
+  tvh_mutex_unlock(&timeshift_ram_lock);
+}
+
+static timeshift_ram_t *timeshift_ram_init
+  ( timeshift_ram_t *ram, size_t size, size_t block )
+{
+  ram->tsr_owner.pbo_refcount = 1;
+  ram->tsr_owner.pbo_free = timeshift_ram_free;
+  ram->tsr_size = size;
+  ram->tsr_block = block;
+  memoryinfo_alloc(&timeshift_memoryinfo_ram, block ?: size);
+  return ram;
+}
+
+static timeshift_ram_t *timeshift_ram_alloc ( void )
+{
+  timeshift_ram_t *ram;
+  size_t block = timeshift_ram_block();
+
+  tvh_mutex_lock(&timeshift_ram_lock);
+  ram = TAILQ_FIRST(&timeshift_ram_idle);
+  if (ram && ram->tsr_block == block) {
+    TAILQ_REMOVE(&timeshift_ram_idle, ram, tsr_link);
+    timeshift_ram_idle_size -= block;
+    timeshift_ram_hits++;
+  } else {
+    ram = timeshift_ram_map(block);
+    if (ram)
+      timeshift_ram_pool_size += block;
+    timeshift_ram_misses++;
+  }
+  tvh_mutex_unlock(&timeshift_ram_lock);
+  if (ram == NULL)
+    return NULL;
+  return timeshift_ram_init(ram, block - sizeof(*ram), block);
+}
+
+/*
+ * Check if the next block fits to the RAM size
+ */
+static int timeshift_ram_avail ( void )
+{
+  return timeshift_conf.ram_size >= 8*1024*1024 &&
+         atomic_get_s64(&timeshift_memoryinfo_ram.my_size) +
+           timeshift_ram_block() <= timeshift_conf.ram_size;
+}
+
+void timeshift_ram_memoryinfo_update ( memoryinfo_t *my )
+{
+  tvh_mutex_lock(&timeshift_ram_lock);
+  atomic_set_s64(&my->my_pool_size, timeshift_ram_idle_size);
+  atomic_set_s64(&my->my_pool_hits, timeshift_ram_hits);
+  atomic_set_s64(&my->my_pool_misses, timeshift_ram_misses);
+  tvh_mutex_unlock(&timeshift_ram_lock);
+}
+
+/*
+ * Resize the segment data, the heap block is moved only when
+ * no packets point into it (otherwise the copy is created
+ * and the old block lives until the packets are released)
+ */
+timeshift_ram_t *timeshift_ram_resize
+  ( timeshift_ram_t *ram, size_t size, size_t used )
+{
+  timeshift_ram_t *nram;
+
+  if (ram->tsr_block == 0 &&
+      atomic_get(&ram->tsr_owner.pbo_refcount) == 1) {
+    nram = realloc(ram, sizeof(*ram) + size);
+    if (nram) {
+      memoryinfo_append(&timeshift_memoryinfo_ram, (int64_t)size - nram->tsr_size);
+      nram->tsr_size = size;
+    }
+    return nram;
+  }
+  nram = malloc(sizeof(*nram) + size);
+  if (nram) {
+    timeshift_ram_init(nram, size, 0);
+    memcpy(nram->tsr_data, ram->tsr_data, MIN(used, size));
+    timeshift_ram_put(ram);
+  }
+  return nram;
+}
+
+/* **************************************************************************
+ * I-frame index
+ * *************************************************************************/
+
+/*
+ * Add the I-frame to the file index, the file is added to
+ * the segment index with the first I-frame
+ */
+int timeshift_index_add
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int64_t time, off_t pos )
+{
+  timeshift_index_iframe_t *ti;
+  timeshift_file_t **segs;
+  int n;
+
+  if (tsf->iframes_count == tsf->iframes_alloc) {
+    n = MAX(64, tsf->iframes_alloc * 2);
+    ti = realloc(tsf->iframes, n * sizeof(*ti));
+    if (ti == NULL)
+      return -1;
+    memoryinfo_append(&timeshift_memoryinfo,
+                      (n - tsf->iframes_alloc) * sizeof(*ti));
+    tsf->iframes = ti;
+    tsf->iframes_alloc = n;
+  }
+  if (tsf->iframes_count == 0) {
+    if (tsb->segments_count == tsb->segments_alloc) {
+      n = MAX(16, tsb->segments_alloc * 2);
+      segs = realloc(tsb->segments, n * sizeof(*segs));
+      if (segs == NULL)
+        return -1;
+      memoryinfo_append(&timeshift_memoryinfo,
+                        (n - tsb->segments_alloc) * sizeof(*segs));
+      tsb->segments = segs;
+      tsb->segments_alloc = n;
+    }
+    tsb->segments[tsb->segments_count++] = tsf;
+  }
+  ti = &tsf->iframes[tsf->iframes_count++];
+  ti->time = time;
+  ti->pos  = pos;
+  return 0;
+}
+
+static void timeshift_index_remove ( timeshift_buffer_t *tsb, timeshift_file_t *tsf )
+{
+  int i;
+
+  if (tsf->iframes_count == 0)
+    return;
+  /* usually the oldest file */
+  for (i = 0; i < tsb->segments_count; i++)
+    if (tsb->segments[i] == tsf) {
+      memmove(tsb->segments + i, tsb->segments + i + 1,
+              (tsb->segments_count - i - 1) * sizeof(*tsb->segments));
+      tsb->segments_count--;
+      break;
+    }
+}
+
+/*
+ * Find the last I-frame at or before the given time (back)
+ * or the first I-frame at or after the given time (forward)
+ *
+ * Returns the I-frame index in the file or -1 if not found.
+ */
+int timeshift_index_find
+  ( timeshift_buffer_t *tsb, int64_t time, int back, timeshift_file_t **_tsf )
+{
+  timeshift_file_t *tsf;
+  int lo, hi, mid;
+
+  /* Segment */
+  lo = 0;
+  hi = tsb->segments_count;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    tsf = tsb->segments[mid];
+    if (back ? tsf->iframes[0].time <= time
+             : tsf->iframes[tsf->iframes_count - 1].time < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (back)
+    lo--;
+  if (lo < 0 || lo >= tsb->segments_count)
+    return -1;
+  tsf = *_tsf = tsb->segments[lo];
+
+  /* I-frame */
+  lo = 0;
+  hi = tsf->iframes_count;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (back ? tsf->iframes[mid].time <= time
+             : tsf->iframes[mid].time < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return back ? lo - 1 : lo;
+}
+
+void timeshift_index_done ( timeshift_buffer_t *tsb )
+{
+  memoryinfo_remove(&timeshift_memoryinfo,
+                    tsb->segments_alloc * sizeof(*tsb->segments));
+  free(tsb->segments);
+  tsb->segments = NULL;
+  tsb->segments_count = tsb->segments_alloc = 0;
+}
+
 /* **************************************************************************
  * File Handling
  * *************************************************************************/
 
 void
-timeshift_filemgr_dump0 ( timeshift_t *ts )
+timeshift_filemgr_dump0 ( timeshift_buffer_t *tsb )
 {
   timeshift_file_t *tsf;
 
-  if (TAILQ_EMPTY(&ts->files)) {
-    tvhtrace(LS_TIMESHIFT, "ts %d file dump - EMPTY", ts->id);
+  if (TAILQ_EMPTY(&tsb->files)) {
+    tvhtrace(LS_TIMESHIFT, "ts %d file dump - EMPTY", tsb->id);
     return;
   }
-  TAILQ_FOREACH(tsf, &ts->files, link) {
-    tvhtrace(LS_TIMESHIFT, "ts %d (full=%d) file dump tsf %p time %4"PRId64" last %10"PRId64" bad %d refcnt %d",
-             ts->id, ts->full, tsf, tsf->time, tsf->last, tsf->bad, tsf->refcount);
+  TAILQ_FOREACH(tsf, &tsb->files, link) {
+    tvhtrace(LS_TIMESHIFT, "ts %d file dump tsf %p time %4"PRId64" last %10"PRId64" eof %d bad %d refcnt %d",
+             tsb->id, tsf, tsf->time, tsf->last, tsf->eof, tsf->bad, tsf->refcount);
   }
 }
 
@@ -164,25 +454,34 @@ int timeshift_filemgr_makedirs ( int index, char *buf, size_t len )
  */
 void timeshift_filemgr_close ( timeshift_file_t *tsf )
 {
-  uint8_t *ram;
-  ssize_t r = timeshift_write_eof(tsf);
+  timeshift_ram_t *ram;
+  ssize_t r;
+
+  if (tsf->eof)
+    return;
+  tsf->eof = 1;
+  r = timeshift_write_eof(tsf);
   if (r > 0) {
+    tsf->woff += tsf->wpend;
+    tsf->wpend = 0;
     tsf->size += r;
     atomic_add_u64(&timeshift_total_size, r);
     if (tsf->ram)
       atomic_add_u64(&timeshift_total_ram_size, r);
   }
-  if (tsf->ram) {
-    /* maintain unused memory block */
-    ram = realloc(tsf->ram, tsf->woff);
-    if (ram) {
-      memoryinfo_append(&timeshift_memoryinfo_ram, tsf->ram_size - tsf->woff);
+  if (tsf->ram && tsf->ram->tsr_block == 0) {
+    /* maintain unused memory block (heap) */
+    tvh_mutex_lock(&tsf->ram_lock);
+    if (atomic_get(&tsf->ram->tsr_owner.pbo_refcount) == 1 &&
+        (ram = timeshift_ram_resize(tsf->ram, tsf->woff, tsf->woff)) != NULL)
       tsf->ram = ram;
-      tsf->ram_size = tsf->woff;
-    }
+    tvh_mutex_unlock(&tsf->ram_lock);
   }
-  if (tsf->wfd >= 0)
+  if (tsf->wfd >= 0) {
+    if (timeshift_write_flush(tsf) < 0)
+      tsf->bad = 1;
     close(tsf->wfd);
+  }
   tsf->wfd = -1;
 }
 
@@ -190,41 +489,115 @@ void timeshift_filemgr_close ( timeshift_file_t *tsf )
  * Remove file
  */
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force )
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int force )
 {
   if (tsf->wfd >= 0)
     close(tsf->wfd);
-  assert(tsf->rfd < 0);
   if (tvhtrace_enabled()) {
     if (tsf->path)
-      tvhdebug(LS_TIMESHIFT, "ts %d remove %s (size %"PRId64")", ts->id, tsf->path, (int64_t)tsf->size);
+      tvhdebug(LS_TIMESHIFT, "ts %d remove %s (size %"PRId64")", tsb->id, tsf->path, (int64_t)tsf->size);
     else
       tvhdebug(LS_TIMESHIFT, "ts %d RAM segment remove time %"PRId64" (size %"PRId64", alloc size %"PRId64")",
-               ts->id, tsf->time, (int64_t)tsf->size, (int64_t)tsf->ram_size);
+               tsb->id, tsf->time, (int64_t)tsf->size, (int64_t)tsf->ram->tsr_size);
   }
-  TAILQ_REMOVE(&ts->files, tsf, link);
+  TAILQ_REMOVE(&tsb->files, tsf, link);
+  timeshift_index_remove(tsb, tsf);
   if (tsf->path) {
-    assert(ts->file_segments > 0);
-    ts->file_segments--;
+    assert(tsb->file_segments > 0);
+    tsb->file_segments--;
   } else {
-    assert(ts->ram_segments > 0);
-    ts->ram_segments--;
+    assert(tsb->ram_segments > 0);
+    tsb->ram_segments--;
   }
   atomic_dec_u64(&timeshift_total_size, tsf->size);
-  if (tsf->ram)
+  if (tsf->ram) {
     atomic_dec_u64(&timeshift_total_ram_size, tsf->size);
+    /* return the block now (the next segment may take it) */
+    timeshift_ram_put(tsf->ram);
+    tsf->ram = NULL;
+  }
   timeshift_reaper_remove(tsf);
 }
 
 /*
- * Flush all files
+ * Get the oldest file not used by a client (except keep)
  */
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end )
+timeshift_file_t *timeshift_filemgr_unpinned
+  ( timeshift_buffer_t *tsb, timeshift_file_t *keep )
 {
   timeshift_file_t *tsf;
-  while ((tsf = TAILQ_FIRST(&ts->files))) {
-    if (tsf == end) break;
-    timeshift_filemgr_remove(ts, tsf, 1);
+
+  TAILQ_FOREACH(tsf, &tsb->files, link)
+    if (tsf != keep && !tsf->refcount)
+      return tsf;
+  return NULL;
+}
+
+/*
+ * Move the clients reading the files up to the given one (paused or
+ * behind) to the first I-frame after it, the files are removed when
+ * released. The buffer writing continues, the other clients are not
+ * affected.
+ */
+void timeshift_filemgr_advance ( timeshift_buffer_t *tsb, timeshift_file_t *end )
+{
+  timeshift_file_t *tsf, *nxt = end;
+  streaming_skip_t skip;
+  timeshift_t *ts;
+
+  while ((nxt = TAILQ_NEXT(nxt, link)) != NULL)
+    if (nxt->iframes_count > 0)
+      break;
+  memset(&skip, 0, sizeof(skip));
+  if (nxt) {
+    skip.type = SMT_SKIP_ABS_TIME;
+    skip.time = ts_rescale_inv(nxt->iframes[0].time, 1000000);
+  } else {
+    skip.type = SMT_SKIP_LIVE;
+  }
+  LIST_FOREACH(ts, &tsb->clients, link) {
+    if (ts->seek.file == NULL || ts->full)
+      continue;
+    TAILQ_FOREACH(tsf, &tsb->files, link)
+      if (tsf == ts->seek.file || tsf == end)
+        break;
+    if (tsf != ts->seek.file)
+      continue;
+    tvhdebug(LS_TIMESHIFT, "ts %d buffer full, skip forward", ts->id);
+    ts->full = 1;
+    timeshift_write_skip(ts->rd_pipe.wr, &skip);
+  }
+}
+
+/*
+ * Remove the oldest file not used by a client (except keep), the
+ * clients reading the older files are moved after it
+ */
+int timeshift_filemgr_reclaim
+  ( timeshift_buffer_t *tsb, timeshift_file_t *keep )
+{
+  timeshift_file_t *tsf = timeshift_filemgr_unpinned(tsb, keep);
+
+  if (tsf == NULL) {
+    if ((tsf = TAILQ_FIRST(&tsb->files)) != NULL)
+      timeshift_filemgr_advance(tsb, tsf);
+    return 0;
+  }
+  if (tsf != TAILQ_FIRST(&tsb->files))
+    timeshift_filemgr_advance(tsb, tsf);
+  timeshift_filemgr_remove(tsb, tsf, 0);
+  return 1;
+}
+
+/*
+ * Flush all files (up to the first file used by a client)
+ */
+void timeshift_filemgr_flush ( timeshift_buffer_t *tsb, timeshift_file_t *end )
+{
+  timeshift_file_t *tsf;
+  while ((tsf = TAILQ_FIRST(&tsb->files))) {
+    if (tsf == end || tsf->refcount) break;
+    timeshift_filemgr_remove(tsb, tsf, 1);
   }
 }
 
@@ -232,7 +605,7 @@ void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end )
  *
  */
 static timeshift_file_t * timeshift_filemgr_file_init
-  ( timeshift_t *ts, int64_t start_time )
+  ( timeshift_buffer_t *tsb, int64_t start_time )
 {
   timeshift_file_t *tsf;
 
@@ -241,10 +614,8 @@ static timeshift_file_t * timeshift_filemgr_file_init
   tsf->time     = mono2sec(start_time) / TIMESHIFT_FILE_PERIOD;
   tsf->last     = start_time;
   tsf->wfd      = -1;
-  tsf->rfd      = -1;
-  TAILQ_INIT(&tsf->iframes);
   TAILQ_INIT(&tsf->sstart);
-  TAILQ_INSERT_TAIL(&ts->files, tsf, link);
+  TAILQ_INSERT_TAIL(&tsb->files, tsf, link);
   tvh_mutex_init(&tsf->ram_lock, NULL);
   return tsf;
 }
@@ -252,10 +623,11 @@ static timeshift_file_t * timeshift_filemgr_file_init
 /*
  * Get current / new file
  */
-timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int64_t start_time )
+timeshift_file_t *timeshift_filemgr_get ( timeshift_buffer_t *tsb, int64_t start_time )
 {
-  int fd;
+  int fd, copy_start;
   timeshift_file_t *tsf_tl, *tsf_hd, *tsf_tmp;
+  timeshift_ram_t *ram;
   timeshift_index_data_t *ti;
   streaming_message_t *sm;
   char path[PATH_MAX];
@@ -263,18 +635,15 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int64_t start_time )
 
   /* Return last file */
   if (start_time < 0)
-    return timeshift_filemgr_newest(ts);
-
-  /* No space */
-  if (ts->full)
-    return NULL;
+    return timeshift_filemgr_newest(tsb);
 
-  /* Store to file */
-  tsf_tl = TAILQ_LAST(&ts->files, timeshift_file_list);
+  /* Store to file (the broken file waits for the next period) */
+  tsf_tl = TAILQ_LAST(&tsb->files, timeshift_file_list);
   time = mono2sec(start_time) / TIMESHIFT_FILE_PERIOD;
   if (!tsf_tl || tsf_tl->time < time ||
-      (tsf_tl->ram && tsf_tl->woff >= timeshift_conf.ram_segment_size)) {
-    tsf_hd = TAILQ_FIRST(&ts->files);
+      (tsf_tl->eof ? !tsf_tl->bad :
+       tsf_tl->ram && tsf_tl->woff + TIMESHIFT_RAM_RESERVE >= tsf_tl->ram->tsr_size)) {
+    tsf_hd = TAILQ_FIRST(&tsb->files);
 
     /* Close existing */
     if (tsf_tl)
@@ -282,16 +651,13 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int64_t start_time )
 
     /* Check period */
     if (!timeshift_conf.unlimited_period &&
-        ts->max_time && tsf_hd && tsf_tl) {
+        tsb->max_time && tsf_hd && tsf_tl) {
       time_t d = (tsf_tl->time - tsf_hd->time) * TIMESHIFT_FILE_PERIOD;
-      if (d > (ts->max_time+5)) {
-        if (!tsf_hd->refcount) {
-          timeshift_filemgr_remove(ts, tsf_hd, 0);
-          tsf_hd = NULL;
-        } else {
-          tvhdebug(LS_TIMESHIFT, "ts %d buffer full", ts->id);
-          ts->full = 1;
-        }
+      if (d > (tsb->max_time+5)) {
+        if (!tsf_hd->refcount)
+          timeshift_filemgr_remove(tsb, tsf_hd, 0);
+        else
+          timeshift_filemgr_advance(tsb, tsf_hd);
       }
     }
 
@@ -299,92 +665,78 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int64_t start_time )
     if (!timeshift_conf.unlimited_size &&
         atomic_pre_add_u64(&timeshift_conf.total_size, 0) >= timeshift_conf.max_size) {
 
-      /* Remove the last file (if we can) */
-      if (tsf_hd && !tsf_hd->refcount) {
-        timeshift_filemgr_remove(ts, tsf_hd, 0);
-
-      /* Full */
-      } else {
-        tvhdebug(LS_TIMESHIFT, "ts %d buffer full", ts->id);
-        ts->full = 1;
-      }
+      /* Remove the oldest unused file */
+      timeshift_filemgr_reclaim(tsb, tsf_tl);
     }
 
     /* Create new file */
     tsf_tmp = NULL;
-    if (!ts->full) {
-
-      tvhtrace(LS_TIMESHIFT, "ts %d RAM total %"PRId64" requested %"PRId64" segment %"PRId64,
-                   ts->id, atomic_pre_add_u64(&timeshift_total_ram_size, 0),
-                   timeshift_conf.ram_size, timeshift_conf.ram_segment_size);
-      while (1) {
-        if (timeshift_conf.ram_size >= 8*1024*1024 &&
-            atomic_pre_add_u64(&timeshift_total_ram_size, 0) <
-              timeshift_conf.ram_size + (timeshift_conf.ram_segment_size / 2)) {
-          tsf_tmp = timeshift_filemgr_file_init(ts, start_time);
-          tsf_tmp->ram_size = MIN(16*1024*1024, timeshift_conf.ram_segment_size);
-          tsf_tmp->ram = malloc(tsf_tmp->ram_size);
-          if (!tsf_tmp->ram) {
-            free(tsf_tmp);
-            tsf_tmp = NULL;
-          } else {
-            tvhtrace(LS_TIMESHIFT, "ts %d create RAM segment with %"PRId64" bytes (time %"PRId64")",
-                     ts->id, tsf_tmp->ram_size, start_time);
-            ts->ram_segments++;
-            memoryinfo_alloc(&timeshift_memoryinfo_ram, tsf_tmp->ram_size);
-          }
-          break;
-        } else {
-          tsf_hd = TAILQ_FIRST(&ts->files);
-          if (timeshift_conf.ram_fit && tsf_hd && !tsf_hd->refcount &&
-              tsf_hd->ram && ts->file_segments == 0) {
-            tvhtrace(LS_TIMESHIFT, "ts %d remove RAM segment %"PRId64" (fit)", ts->id, tsf_hd->time);
-            timeshift_filemgr_remove(ts, tsf_hd, 0);
-          } else {
-            break;
-          }
+    copy_start = tsf_tl != NULL;
+    tvhtrace(LS_TIMESHIFT, "ts %d RAM total %"PRId64" blocks %"PRId64" requested %"PRId64" block %zu",
+                 tsb->id, atomic_pre_add_u64(&timeshift_total_ram_size, 0),
+                 atomic_get_s64(&timeshift_memoryinfo_ram.my_size),
+                 timeshift_conf.ram_size, timeshift_ram_block());
+    while (1) {
+      if (timeshift_ram_avail()) {
+        if ((ram = timeshift_ram_alloc()) != NULL) {
+          tsf_tmp = timeshift_filemgr_file_init(tsb, start_time);
+          tsf_tmp->ram = ram;
+          tvhtrace(LS_TIMESHIFT, "ts %d create RAM segment with %"PRId64" bytes (time %"PRId64")",
+                   tsb->id, (int64_t)tsf_tmp->ram->tsr_size, start_time);
+          tsb->ram_segments++;
         }
+        break;
+      } else {
+        if (!timeshift_conf.ram_fit || tsb->file_segments > 0)
+          break;
+        tvhtrace(LS_TIMESHIFT, "ts %d remove RAM segment (fit)", tsb->id);
+        if (tsf_tl && !tsf_tl->refcount &&
+            timeshift_filemgr_unpinned(tsb, NULL) == tsf_tl)
+          tsf_tl = NULL;
+        if (!timeshift_filemgr_reclaim(tsb, NULL))
+          break;
       }
-      
-      if (!tsf_tmp && !timeshift_conf.ram_only) {
-        /* Create directories */
-        if (!ts->path) {
-          if (timeshift_filemgr_makedirs(ts->id, path, sizeof(path)))
-            return NULL;
-          ts->path = strdup(path);
-        }
+    }
 
-        /* Create File */
-        snprintf(path, sizeof(path), "%s/tvh-%"PRId64, ts->path, start_time);
-        tvhtrace(LS_TIMESHIFT, "ts %d create file %s", ts->id, path);
-        if ((fd = tvh_open(path, O_WRONLY | O_CREAT, 0600)) > 0) {
-          tsf_tmp = timeshift_filemgr_file_init(ts, start_time);
-          tsf_tmp->wfd = fd;
-          tsf_tmp->path = strdup(path);
-          ts->file_segments++;
-        }
+    if (!tsf_tmp && !timeshift_conf.ram_only) {
+      /* Create directories */
+      if (!tsb->path) {
+        if (timeshift_filemgr_makedirs(tsb->id, path, sizeof(path)))
+          return NULL;
+        tsb->path = strdup(path);
+      }
+
+      /* Create File */
+      snprintf(path, sizeof(path), "%s/tvh-%"PRId64, tsb->path, start_time);
+      tvhtrace(LS_TIMESHIFT, "ts %d create file %s", tsb->id, path);
+      if ((fd = tvh_open(path, O_WRONLY | O_CREAT, 0600)) > 0) {
+        tsf_tmp = timeshift_filemgr_file_init(tsb, start_time);
+        tsf_tmp->wfd = fd;
+        tsf_tmp->path = strdup(path);
+        tsb->file_segments++;
       }
+    }
 
-      if (tsf_tmp && tsf_tl) {
-        /* Copy across last start message */
-        if ((ti = TAILQ_LAST(&tsf_tl->sstart, timeshift_index_data_list)) || ts->smt_start) {
-          tvhtrace(LS_TIMESHIFT, "ts %d copy smt_start to new file%s",
-                   ts->id, ti ? " (from last file)" : "");
-          timeshift_index_data_t *ti2 = calloc(1, sizeof(timeshift_index_data_t));
-          if (ti) {
-            memoryinfo_alloc(&timeshift_memoryinfo, sizeof(timeshift_index_data_t));
-            sm = streaming_msg_clone(ti->data);
-          } else {
-            sm = streaming_msg_create(SMT_START);
-            streaming_start_ref(ts->smt_start);
-            sm->sm_data = ts->smt_start;
-          }
-          ti2->data = sm;
-          TAILQ_INSERT_TAIL(&tsf_tmp->sstart, ti2, link);
+    if (tsf_tmp && copy_start) {
+      /* Copy across last start message */
+      ti = tsf_tl ? TAILQ_LAST(&tsf_tl->sstart, timeshift_index_data_list) : NULL;
+      if (ti || tsb->smt_start) {
+        tvhtrace(LS_TIMESHIFT, "ts %d copy smt_start to new file%s",
+                 tsb->id, ti ? " (from last file)" : "");
+        timeshift_index_data_t *ti2 = calloc(1, sizeof(timeshift_index_data_t));
+        memoryinfo_alloc(&timeshift_memoryinfo, sizeof(timeshift_index_data_t));
+        if (ti) {
+          sm = streaming_msg_clone(ti->data);
+        } else {
+          sm = streaming_msg_create(SMT_START);
+          streaming_start_ref(tsb->smt_start);
+          sm->sm_data = tsb->smt_start;
         }
+        ti2->data = sm;
+        TAILQ_INSERT_TAIL(&tsf_tmp->sstart, ti2, link);
       }
     }
-    timeshift_filemgr_dump(ts);
+    timeshift_filemgr_dump(tsb);
     tsf_tl = tsf_tmp;
   }
 
@@ -414,18 +766,18 @@ timeshift_file_t *timeshift_filemgr_prev
 /*
  * Get the oldest file
  */
-timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_oldest ( timeshift_buffer_t *tsb )
 {
-  timeshift_file_t *tsf = TAILQ_FIRST(&ts->files);
+  timeshift_file_t *tsf = TAILQ_FIRST(&tsb->files);
   return timeshift_file_get(tsf);
 }
 
 /*
  * Get the newest file
  */
-timeshift_file_t *timeshift_filemgr_newest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_newest ( timeshift_buffer_t *tsb )
 {
-  timeshift_file_t *tsf = TAILQ_LAST(&ts->files, timeshift_file_list);
+  timeshift_file_t *tsf = TAILQ_LAST(&tsb->files, timeshift_file_list);
   return timeshift_file_get(tsf);
 }
 
@@ -453,6 +805,7 @@ void timeshift_filemgr_init ( void )
   tvh_mutex_init(&timeshift_reaper_lock, NULL);
   tvh_cond_init(&timeshift_reaper_cond, 1);
   TAILQ_INIT(&timeshift_reaper_list);
+  TAILQ_INIT(&timeshift_ram_idle);
   tvh_thread_create(&timeshift_reaper_thread, NULL,
                     timeshift_reaper_callback, NULL, "tshift-reap");
 }
@@ -471,6 +824,11 @@ void timeshift_filemgr_term ( void )
   tvh_mutex_unlock(&timeshift_reaper_lock);
   pthread_join(timeshift_reaper_thread, NULL);
 
+  /* Release the RAM pool */
+  tvh_mutex_lock(&timeshift_ram_lock);
+  timeshift_ram_trim(INT64_MAX);
+  tvh_mutex_unlock(&timeshift_ram_lock);
+
   /* Remove the lot */
   if (!timeshift_filemgr_get_root(path, sizeof(path)))
     rmtree(path);
@@ -45,7 +45,7 @@ static timeshift_seek_t *_seek_reset ( timeshift_seek_t *seek )
 {
   timeshift_file_t *tsf = seek->file;
   seek->file  = NULL;
-  seek->frame = NULL;
+  seek->frame = -1;
   timeshift_file_put(tsf);
   return seek;
 }
@@ -54,17 +54,22 @@ static timeshift_seek_t *_seek_set_file
   ( timeshift_seek_t *seek, timeshift_file_t *tsf, off_t roff )
 {
   seek->file  = tsf;
-  seek->frame = NULL;
-  if (tsf)
-    tsf->roff = roff;
+  seek->frame = -1;
+  seek->roff  = roff;
   return seek;
 }
 
 static timeshift_seek_t *_read_close ( timeshift_seek_t *seek )
 {
-  if (seek->file && seek->file->rfd >= 0) {
-    close(seek->file->rfd);
-    seek->file->rfd = -1;
+  if (seek->rfd >= 0) {
+    close(seek->rfd);
+    seek->rfd = -1;
+  }
+  if (seek->rbuf) {
+    memoryinfo_free(&timeshift_memoryinfo, TIMESHIFT_RBUF_SIZE);
+    free(seek->rbuf);
+    seek->rbuf = NULL;
+    seek->rbuf_len = 0;
   }
   return _seek_reset(seek);
 }
@@ -73,75 +78,35 @@ static timeshift_seek_t *_read_close ( timeshift_seek_t *seek )
  * File Reading
  * *************************************************************************/
 
-static ssize_t _read_buf ( timeshift_file_t *tsf, int fd, void *buf, size_t size )
+/*
+ * Read the control message data
+ */
+static ssize_t _read_buf ( int fd, void *buf, size_t size )
 {
   ssize_t r;
-  size_t ret;
+  size_t ret = 0;
 
-  if (tsf && tsf->ram) {
-    if (tsf->roff == tsf->woff) return 0;
-    if (tsf->roff + size > tsf->woff) return -1;
-    tvh_mutex_lock(&tsf->ram_lock);
-    memcpy(buf, tsf->ram + tsf->roff, size);
-    tsf->roff += size;
-    tvh_mutex_unlock(&tsf->ram_lock);
-    return size;
-  } else {
-    ret = 0;
-    while (size > 0) {
-      r = read(tsf ? tsf->rfd : fd, buf, size);
-      if (r < 0) {
-        if (ERRNO_AGAIN(errno))
-          continue;
-        tvhtrace(LS_TIMESHIFT, "read errno %d", errno);
-        return -1;
-      }
-      if (r > 0) {
-        size -= r;
-        ret += r;
-        buf += r;
-      }
-      if (r == 0)
-        return 0;
+  while (size > 0) {
+    r = read(fd, buf, size);
+    if (r < 0) {
+      if (ERRNO_AGAIN(errno))
+        continue;
+      tvhtrace(LS_TIMESHIFT, "read errno %d", errno);
+      return -1;
     }
-    if (ret > 0 && tsf)
-      tsf->roff += ret;
-    return ret;
+    if (r == 0)
+      return 0;
+    size -= r;
+    ret += r;
+    buf += r;
   }
+  return ret;
 }
 
-static ssize_t _read_pktbuf ( timeshift_file_t *tsf, int fd, pktbuf_t **pktbuf )
-{
-  ssize_t r, cnt = 0;
-  size_t sz;
-
-  /* Size */
-  r = _read_buf(tsf, fd, &sz, sizeof(sz));
-  if (r < 0) return -1;
-  if (r != sizeof(sz)) return 0;
-  cnt += r;
-
-  /* Empty And Sanity Check */
-  if (!sz || sz > 1024 * 1024) {
-    *pktbuf = NULL;
-    return cnt;
-  }
-
-  /* Data */
-  *pktbuf = pktbuf_alloc(NULL, sz);
-  r = _read_buf(tsf, fd, pktbuf_ptr(*pktbuf), sz);
-  if (r != sz) {
-    pktbuf_destroy(*pktbuf);
-    *pktbuf = NULL;
-    return r < 0 ? -1 : 0;
-  }
-  cnt += r;
-
-  return cnt;
-}
-
-
-static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **sm )
+/*
+ * Read the control message
+ */
+static ssize_t _read_msg ( int fd, streaming_message_t **sm )
 {
   ssize_t r, cnt = 0;
   size_t sz;
@@ -154,7 +119,7 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
   *sm = NULL;
 
   /* Size */
-  r = _read_buf(tsf, fd, &sz, sizeof(sz));
+  r = _read_buf(fd, &sz, sizeof(sz));
   if (r < 0) return -1;
   if (r != sizeof(sz)) return 0;
   cnt += r;
@@ -169,13 +134,13 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
   }
 
   /* Type */
-  r = _read_buf(tsf, fd, &type, sizeof(type));
+  r = _read_buf(fd, &type, sizeof(type));
   if (r < 0) return -1;
   if (r != sizeof(type)) return 0;
   cnt += r;
 
   /* Time */
-  r = _read_buf(tsf, fd, &time, sizeof(time));
+  r = _read_buf(fd, &time, sizeof(time));
   if (r < 0) return -1;
   if (r != sizeof(time)) return 0;
   cnt += r;
@@ -187,21 +152,12 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
   /* Standard messages */
   switch (type) {
 
-    /* Unhandled */
-    case SMT_START:
-    case SMT_NOSTART:
-    case SMT_NOSTART_WARN:
-    case SMT_SERVICE_STATUS:
-    case SMT_DESCRAMBLE_INFO:
-      return -1;
-      break;
-
     /* Code */
     case SMT_STOP:
     case SMT_EXIT:
     case SMT_SPEED:
       if (sz != sizeof(code)) return -1;
-      r = _read_buf(tsf, fd, &code, sz);
+      r = _read_buf(fd, &code, sz);
       if (r != sz) {
         if (r < 0) return -1;
         return 0;
@@ -211,36 +167,14 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
 
     /* Data */
     case SMT_SKIP:
-    case SMT_SIGNAL_STATUS:
-    case SMT_MPEGTS:
-    case SMT_PACKET:
       data = malloc(sz);
-      r = _read_buf(tsf, fd, data, sz);
+      r = _read_buf(fd, data, sz);
       if (r != sz) {
         free(data);
         if (r < 0) return -1;
         return 0;
       }
-      if (type == SMT_PACKET) {
-        th_pkt_t *pkt = data;
-        pkt->pkt_payload  = pkt->pkt_meta = NULL;
-        pkt->pkt_refcount = 0;
-        *sm = streaming_msg_create_pkt(pkt);
-        r   = _read_pktbuf(tsf, fd, &pkt->pkt_meta);
-        if (r < 0) {
-          streaming_msg_free(*sm);
-          return r;
-        }
-        cnt += r;
-        r   = _read_pktbuf(tsf, fd, &pkt->pkt_payload);
-        if (r < 0) {
-          streaming_msg_free(*sm);
-          return r;
-        }
-        cnt += r;
-      } else {
-        *sm = streaming_msg_create_data(type, data);
-      }
+      *sm = streaming_msg_create_data(type, data);
       (*sm)->sm_time = time;
       break;
 
@@ -252,110 +186,260 @@ static ssize_t _read_msg ( timeshift_file_t *tsf, int fd, streaming_message_t **
   return cnt;
 }
 
-/* **************************************************************************
- * Utilities
- * *************************************************************************/
+/*
+ * Deliver the message to the output (without the state_mutex)
+ */
+static void _deliver ( timeshift_t *ts, streaming_message_t *sm )
+{
+  timeshift_buffer_t *tsb = ts->buffer;
 
-static int64_t _timeshift_first_time
-  ( timeshift_t *ts, int *active )
-{ 
-  int64_t ret = 0;
-  int end;
-  timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_oldest(ts);
-  while (tsf && !tsi) {
-    if (!(tsi = TAILQ_FIRST(&tsf->iframes)))
-      tsf = timeshift_filemgr_next(tsf, &end, 0);
-  }
-  if (tsi) {
-    *active = 1;
-    ret = tsi->time;
-  }
-  timeshift_file_put(tsf);
-  return ret;
+  tvh_mutex_unlock(&tsb->state_mutex);
+  timeshift_deliver(ts, sm);
+  tvh_mutex_lock(&tsb->state_mutex);
 }
 
-static int _timeshift_skip
-  ( timeshift_t *ts, int64_t req_time, int64_t cur_time,
-    timeshift_seek_t *seek, timeshift_seek_t *nseek )
+/*
+ * Read the segment data at the given offset
+ *
+ * The file data are read in the aligned chunks to the read buffer
+ * (the file is pinned by the seek, the state_mutex is released for
+ * the read), the unflushed tail is taken from the writer buffer.
+ * Returns the number of bytes available (up to size) or -1 on error.
+ */
+static ssize_t _read_at
+  ( timeshift_t *ts, off_t off, void *buf, size_t size )
 {
-  timeshift_index_iframe_t *tsi  = seek->frame;
-  timeshift_file_t         *tsf  = seek->file, *tsf_last;
-  int64_t                   sec  = mono2sec(req_time) / TIMESHIFT_FILE_PERIOD;
-  int                       back = (req_time < cur_time) ? 1 : 0;
-  int                       end  = 0;
-
-  /* Coarse search */
-  if (!tsi) {
-    while (tsf && !end) {
-      if (back) {
-        if ((tsf->time <= sec) &&
-            (tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
-          break;
-        tsf = timeshift_filemgr_prev(tsf, &end, 1);
-      } else {
-        if ((tsf->time >= sec) &&
-            (tsi = TAILQ_FIRST(&tsf->iframes)))
-          break;
-        tsf = timeshift_filemgr_next(tsf, &end, 0);
+  timeshift_buffer_t *tsb = ts->buffer;
+  timeshift_seek_t *seek = &ts->seek;
+  timeshift_file_t *tsf = seek->file;
+  off_t woff = tsf->woff, wbuf_off, start;
+  size_t n, done = 0;
+  ssize_t r;
+
+  if (off >= woff)
+    return 0;
+  if (size > woff - off)
+    size = woff - off;
+  if (tsf->ram) {
+    tvh_mutex_lock(&tsf->ram_lock);
+    memcpy(buf, tsf->ram->tsr_data + off, size);
+    tvh_mutex_unlock(&tsf->ram_lock);
+    return size;
+  }
+  while (done < size) {
+    off_t pos = off + done;
+    tvh_mutex_lock(&tsf->ram_lock);
+    wbuf_off = tsf->wbuf_off;
+    if (pos >= wbuf_off) {
+      n = size - done;
+      memcpy(buf + done, tsf->wbuf + (pos - wbuf_off), n);
+      tvh_mutex_unlock(&tsf->ram_lock);
+    } else {
+      tvh_mutex_unlock(&tsf->ram_lock);
+      if (pos < seek->rbuf_off || pos >= seek->rbuf_off + seek->rbuf_len) {
+        if (seek->rbuf == NULL) {
+          seek->rbuf = malloc(TIMESHIFT_RBUF_SIZE);
+          if (seek->rbuf == NULL)
+            return -1;
+          memoryinfo_alloc(&timeshift_memoryinfo, TIMESHIFT_RBUF_SIZE);
+        }
+        start = pos & ~((off_t)TIMESHIFT_RBUF_ALIGN - 1);
+        n = MIN(TIMESHIFT_RBUF_SIZE, wbuf_off - start);
+        tvh_mutex_unlock(&tsb->state_mutex);
+        do {
+          r = pread(seek->rfd, seek->rbuf, n, start);
+        } while (r < 0 && ERRNO_AGAIN(errno));
+        tvh_mutex_lock(&tsb->state_mutex);
+        if (r <= pos - start) {
+          tvhtrace(LS_TIMESHIFT, "read errno %d", r < 0 ? errno : 0);
+          seek->rbuf_len = 0;
+          return -1;
+        }
+        seek->rbuf_off = start;
+        seek->rbuf_len = r;
       }
-      tsi = NULL;
+      n = MIN(size - done, seek->rbuf_off + seek->rbuf_len - pos);
+      memcpy(buf + done, seek->rbuf + (pos - seek->rbuf_off), n);
     }
+    done += n;
   }
+  return size;
+}
 
-  /* Fine search */
-  if (back) {
-    while (!end && tsf && tsi && (tsi->time > req_time)) {
-      tsi = TAILQ_PREV(tsi, timeshift_index_iframe_list, link);
-      while (!end && tsf && !tsi) {
-        if ((tsf = timeshift_filemgr_prev(tsf, &end, 1)))
-          tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list);
+/*
+ * The RAM segment data are not copied, the packet buffer
+ * holds the segment block reference
+ */
+static int _read_pktbuf
+  ( timeshift_t *ts, off_t off, size_t size, pktbuf_t **pktbuf )
+{
+  timeshift_file_t *tsf = ts->seek.file;
+
+  *pktbuf = NULL;
+  if (size == 0)
+    return 0;
+  if (tsf->ram) {
+    tvh_mutex_lock(&tsf->ram_lock);
+    *pktbuf = pktbuf_make_owned(&tsf->ram->tsr_owner,
+                                tsf->ram->tsr_data + off, size);
+    tvh_mutex_unlock(&tsf->ram_lock);
+    return *pktbuf ? 0 : -1;
+  }
+  *pktbuf = pktbuf_alloc(NULL, size);
+  if (*pktbuf == NULL)
+    return -1;
+  if (_read_at(ts, off, pktbuf_ptr(*pktbuf), size) != size)
+    return -1;
+  return 0;
+}
+
+/*
+ * Read the record at the read offset
+ *
+ * Returns the record size (*sm is NULL at the end of the segment),
+ * zero when no more data are available or -1 on error.
+ */
+static ssize_t _read_record ( timeshift_t *ts, streaming_message_t **sm )
+{
+  timeshift_seek_t *seek = &ts->seek;
+  timeshift_record_t tr;
+  timeshift_record_pkt_t trp;
+  off_t off = seek->roff + sizeof(tr);
+  size_t sz;
+  ssize_t r;
+  void *data;
+  th_pkt_t *pkt;
+
+  /* Clear */
+  *sm = NULL;
+
+  /* Header */
+  r = _read_at(ts, seek->roff, &tr, sizeof(tr));
+  if (r < 0) return -1;
+  if (r != sizeof(tr)) return 0;
+
+  /* EOF */
+  if (tr.tr_size == 0) {
+    seek->roff += sizeof(tr);
+    return sizeof(tr);
+  }
+
+  /* Wrong data size */
+  if (tr.tr_size < sizeof(tr) || tr.tr_size > TIMESHIFT_RECORD_MAX ||
+      seek->roff + tr.tr_size > seek->file->woff) {
+    tvhtrace(LS_TIMESHIFT, "wrong record size (%u/0x%x)", tr.tr_size, tr.tr_size);
+    return -1;
+  }
+  sz = tr.tr_size - sizeof(tr);
+
+  switch (tr.tr_type) {
+
+    /* Data */
+    case SMT_SIGNAL_STATUS:
+    case SMT_MPEGTS:
+      if (tr.tr_type == SMT_SIGNAL_STATUS && sz != sizeof(signal_status_t))
+        return -1;
+      data = malloc(sz);
+      if (_read_at(ts, off, data, sz) != sz) {
+        free(data);
+        return -1;
       }
-    }
-  } else {
-    while (!end && tsf && tsi && (tsi->time < req_time)) {
-      tsi = TAILQ_NEXT(tsi, link);
-      while (!end && tsf && !tsi) {
-        if ((tsf = timeshift_filemgr_next(tsf, &end, 0)))
-          tsi = TAILQ_FIRST(&tsf->iframes);
+      *sm = streaming_msg_create_data(tr.tr_type, data);
+      break;
+
+    /* Packet */
+    case SMT_PACKET:
+      if (sz < sizeof(trp))
+        return -1;
+      if (_read_at(ts, off, &trp, sizeof(trp)) != sizeof(trp))
+        return -1;
+      off += sizeof(trp);
+      sz  -= sizeof(trp);
+      if (trp.trp_meta > sz)
+        return -1;
+      pkt = pkt_alloc(trp.trp_type, NULL, 0, trp.trp_pts, trp.trp_dts, trp.trp_pcr);
+      if (pkt == NULL)
+        return -1;
+      pkt->pkt_duration       = trp.trp_duration;
+      pkt->pkt_err            = trp.trp_err;
+      pkt->pkt_componentindex = trp.trp_componentindex;
+      pkt->pkt_commercial     = trp.trp_commercial;
+      pkt->v.pkt_frametype    = trp.trp_frametype;
+      pkt->v.pkt_field        = trp.trp_field;
+      pkt->v.pkt_aspect_num   = trp.trp_aspect_num;
+      pkt->v.pkt_aspect_den   = trp.trp_aspect_den;
+      *sm = streaming_msg_create_pkt(pkt);
+      pkt_ref_dec(pkt);
+      if (_read_pktbuf(ts, off, trp.trp_meta, &pkt->pkt_meta) ||
+          _read_pktbuf(ts, off + trp.trp_meta, sz - trp.trp_meta,
+                       &pkt->pkt_payload)) {
+        streaming_msg_free(*sm);
+        *sm = NULL;
+        return -1;
       }
-    }
+      break;
+
+    default:
+      return -1;
   }
 
-  /* End */
-  if (!tsf || !tsi)
-    end = 1;
+  /* OK */
+  (*sm)->sm_time = tr.tr_time;
+  seek->roff += tr.tr_size;
+  return tr.tr_size;
+}
+
+/* **************************************************************************
+ * Utilities
+ * *************************************************************************/
+
+static int64_t _timeshift_first_time
+  ( timeshift_buffer_t *tsb, int *active )
+{
+  timeshift_file_t *tsf;
+
+  if (tsb->segments_count == 0)
+    return 0;
+  tsf = tsb->segments[0];
+  *active = 1;
+  return tsf->iframes[0].time;
+}
+
+static int _timeshift_skip
+  ( timeshift_buffer_t *tsb, int64_t req_time, int64_t cur_time,
+    timeshift_seek_t *nseek )
+{
+  timeshift_file_t *tsf = NULL;
+  int               back = (req_time < cur_time) ? 1 : 0;
+  int               end  = 0;
+  int               tsi;
+
+  /* Search */
+  tsi = timeshift_index_find(tsb, req_time, back, &tsf);
 
   /* Find start/end of buffer */
-  if (end) {
-    timeshift_file_put(tsf);
+  if (tsi < 0) {
     if (back) {
-      tsf = tsf_last = timeshift_filemgr_oldest(ts);
-      tsi = NULL;
-      while (tsf && !tsi) {
-        tsf_last = tsf;
-        if (!(tsi = TAILQ_FIRST(&tsf->iframes)))
-          tsf = timeshift_filemgr_next(tsf, &end, 0);
+      if (tsb->segments_count > 0) {
+        tsf = tsb->segments[0];
+        tsi = 0;
+      } else {
+        tsf = TAILQ_FIRST(&tsb->files);
       }
-      if (!tsf)
-        tsf = tsf_last;
       end = -1;
     } else {
-      tsf = tsf_last = timeshift_filemgr_newest(ts);
-      tsi = NULL;
-      while (tsf && !tsi) {
-        tsf_last = tsf;
-        if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
-          tsf = timeshift_filemgr_prev(tsf, &end, 0);
+      if (tsb->segments_count > 0) {
+        tsf = tsb->segments[tsb->segments_count - 1];
+        tsi = tsf->iframes_count - 1;
+      } else {
+        tsf = TAILQ_LAST(&tsb->files, timeshift_file_list);
       }
-      if (!tsf)
-        tsf = tsf_last;
       end = 1;
     }
   }
 
   /* Done */
-  nseek->file  = tsf;
+  nseek->file  = timeshift_file_get(tsf);
   nseek->frame = tsi;
   return end;
 }
@@ -368,34 +452,35 @@ static int _timeshift_do_skip
     timeshift_seek_t *seek )
 {
   timeshift_seek_t nseek;
+  timeshift_index_iframe_t *tsi;
   int end;
 
   tvhdebug(LS_TIMESHIFT, "ts %d skip to %"PRId64" from %"PRId64,
            ts->id, req_time, last_time);
 
-  timeshift_file_get(seek->file);
-
   /* Find */
-  end = _timeshift_skip(ts, req_time, last_time, seek, &nseek);
-  if (nseek.frame)
+  end = _timeshift_skip(ts->buffer, req_time, last_time, &nseek);
+  tsi = nseek.file ? timeshift_index_frame(&nseek) : NULL;
+  if (tsi)
     tvhdebug(LS_TIMESHIFT, "ts %d skip found pkt @ %"PRId64,
-             ts->id, nseek.frame->time);
+             ts->id, tsi->time);
 
   /* File changed (close) */
   if (nseek.file != seek->file)
     _read_close(seek);
-
-  timeshift_file_put(seek->file);
+  else
+    timeshift_file_put(seek->file);
 
   /* Position */
-  *seek = nseek;
-  if (nseek.file != NULL) {
-    if (nseek.frame)
-      nseek.file->roff = nseek.frame->pos;
+  seek->file  = nseek.file;
+  seek->frame = nseek.frame;
+  if (seek->file != NULL) {
+    if (tsi)
+      seek->roff = tsi->pos;
     else
-      nseek.file->roff = req_time > last_time ? nseek.file->size : 0;
+      seek->roff = req_time > last_time ? seek->file->size : 0;
     tvhtrace(LS_TIMESHIFT, "do skip seek->file %p roff %"PRId64,
-             nseek.file, (int64_t)nseek.file->roff);
+             seek->file, (int64_t)seek->roff);
   }
 
   return end;
@@ -411,44 +496,41 @@ static int _timeshift_read
 {
   timeshift_file_t *tsf = seek->file;
   ssize_t r;
-  off_t off = 0;
+  off_t off;
 
   *sm = NULL;
 
   if (tsf) {
 
     /* Open file */
-    if (tsf->rfd < 0 && !tsf->ram) {
-      tsf->rfd = tvh_open(tsf->path, O_RDONLY, 0);
-      tvhtrace(LS_TIMESHIFT, "ts %d open file %s (fd %i)", ts->id, tsf->path, tsf->rfd);
-      if (tsf->rfd < 0)
+    if (seek->rfd < 0 && !tsf->ram) {
+      seek->rfd = tvh_open(tsf->path, O_RDONLY, 0);
+      tvhtrace(LS_TIMESHIFT, "ts %d open file %s (fd %i)", ts->id, tsf->path, seek->rfd);
+      if (seek->rfd < 0)
         return -1;
     }
-    if (tsf->rfd >= 0)
-      if ((off = lseek(tsf->rfd, tsf->roff, SEEK_SET)) != tsf->roff)
-        tvherror(LS_TIMESHIFT, "ts %d seek to %s failed (off %"PRId64" != %"PRId64"): %s",
-                 ts->id, tsf->path, (int64_t)tsf->roff, (int64_t)off, strerror(errno));
 
-    /* Read msg */
-    r = _read_msg(tsf, -1, sm);
+    /* Read record */
+    off = seek->roff;
+    r = _read_record(ts, sm);
     if (r < 0) {
       streaming_message_t *e = streaming_msg_create_code(SMT_STOP, SM_CODE_UNDEFINED_ERROR);
-      streaming_target_deliver2(ts->output, e);
-      tvhtrace(LS_TIMESHIFT, "ts %d seek to %jd (woff %jd) (fd %i)", ts->id, (intmax_t)off, (intmax_t)tsf->woff, tsf->rfd);
+      _deliver(ts, e);
+      tvhtrace(LS_TIMESHIFT, "ts %d seek to %jd (woff %jd) (fd %i)", ts->id, (intmax_t)off, (intmax_t)tsf->woff, seek->rfd);
       tvherror(LS_TIMESHIFT, "ts %d could not read buffer", ts->id);
       return -1;
     }
     tvhtrace(LS_TIMESHIFT, "ts %d seek to %jd (fd %i) read msg %p/%"PRId64" (%"PRId64")",
-             ts->id, (intmax_t)off, tsf->rfd, *sm, *sm ? (*sm)->sm_time : -1, (int64_t)r);
+             ts->id, (intmax_t)off, seek->rfd, *sm, *sm ? (*sm)->sm_time : -1, (int64_t)r);
 
     /* Special case - EOF */
-    if (r <= sizeof(size_t) || tsf->roff > tsf->size || *sm == NULL) {
+    if (*sm == NULL || seek->roff > tsf->size) {
       timeshift_file_get(seek->file); /* _read_close decreases file reference */
       _read_close(seek);
       _seek_set_file(seek, timeshift_filemgr_next(tsf, NULL, 0), 0);
       *wait     = 0;
       tvhtrace(LS_TIMESHIFT, "ts %d eof, seek->file %p (prev %p)", ts->id, seek->file, tsf);
-      timeshift_filemgr_dump(ts);
+      timeshift_filemgr_dump(ts->buffer);
     }
   }
   return 0;
@@ -466,8 +548,8 @@ static int _timeshift_flush_to_live
     if (_timeshift_read(ts, seek, &sm, wait) == -1)
       return -1;
     if (!sm) break;
-    timeshift_packet_log("ouf", ts, sm);
-    streaming_target_deliver2(ts->output, sm);
+    timeshift_packet_log("ouf", ts->id, sm);
+    _deliver(ts, sm);
   }
   return 0;
 }
@@ -478,11 +560,12 @@ static int _timeshift_flush_to_live
 static void timeshift_fill_status
   ( timeshift_t *ts, timeshift_status_t *status, int64_t current_time )
 {
+  timeshift_buffer_t *tsb = ts->buffer;
   int active = 0;
   int64_t start, end;
 
-  start = _timeshift_first_time(ts, &active);
-  end   = ts->buf_time;
+  start = _timeshift_first_time(tsb, &active);
+  end   = tsb->buf_time;
   if (ts->state <= TS_LIVE) {
     current_time = end;
   } else {
@@ -514,7 +597,7 @@ static void timeshift_status
   status = calloc(1, sizeof(timeshift_status_t));
   timeshift_fill_status(ts, status, current_time);
   tsm = streaming_msg_create_data(SMT_TIMESHIFT_STATUS, status);
-  streaming_target_deliver2(ts->output, tsm);
+  _deliver(ts, tsm);
 }
 
 /* **************************************************************************
@@ -528,6 +611,7 @@ static void timeshift_status
 void *timeshift_reader ( void *p )
 {
   timeshift_t *ts = p;
+  timeshift_buffer_t *tsb = ts->buffer;
   int nfds, end, run = 1, wait = -1, state;
   timeshift_seek_t *seek = &ts->seek;
   timeshift_file_t *tmp_file;
@@ -562,9 +646,9 @@ void *timeshift_reader ( void *p )
     mono_now  = getfastmonoclock();
 
     /* Control */
-    tvh_mutex_lock(&ts->state_mutex);
+    tvh_mutex_lock(&tsb->state_mutex);
     if (nfds == 1) {
-      if (_read_msg(NULL, ts->rd_pipe.rd, &ctrl) > 0) {
+      if (_read_msg(ts->rd_pipe.rd, &ctrl) > 0) {
 
         /* Exit */
         if (ctrl->sm_type == SMT_EXIT) {
@@ -602,17 +686,17 @@ void *timeshift_reader ( void *p )
               } else {
                 tvhdebug(LS_TIMESHIFT, "ts %d enter timeshift mode", ts->id);
                 ts->dobuf = 1;
-                _seek_reset(seek);
-                tmp_file = timeshift_filemgr_newest(ts);
+                _read_close(seek);
+                tmp_file = timeshift_filemgr_newest(tsb);
                 if (tmp_file != NULL) {
                   i64 = tmp_file->last;
                   timeshift_file_put(tmp_file);
                 } else {
-                  i64 = ts->buf_time;
+                  i64 = tsb->buf_time;
                 }
-                seek->file = timeshift_filemgr_get(ts, i64);
+                seek->file = timeshift_filemgr_get(tsb, i64);
                 if (seek->file != NULL) {
-                  seek->file->roff = seek->file->size;
+                  seek->roff       = seek->file->size;
                   pause_time       = seek->file->last;
                   last_time        = pause_time;
                 } else {
@@ -628,7 +712,7 @@ void *timeshift_reader ( void *p )
               tvhdebug(LS_TIMESHIFT, "using keyframe mode? %s", keyframe ? "yes" : "no");
               keyframe_mode = keyframe;
               if (keyframe)
-                seek->frame = NULL;
+                seek->frame = -1;
             }
 
             /* Update */
@@ -651,7 +735,7 @@ void *timeshift_reader ( void *p )
 
           /* Send on the message */
           ctrl->sm_code = speed;
-          streaming_target_deliver2(ts->output, ctrl);
+          _deliver(ts, ctrl);
           ctrl = NULL;
 
         /* Skip/Seek */
@@ -661,13 +745,6 @@ void *timeshift_reader ( void *p )
             case SMT_SKIP_LIVE:
               if (ts->state != TS_LIVE) {
 
-                /* Reset */
-                if (ts->full) {
-                  timeshift_filemgr_flush(ts, NULL);
-                  _seek_reset(seek);
-                  ts->full = 0;
-                }
-
                 /* Release */
                 if (sm)
                   streaming_msg_free(sm);
@@ -688,17 +765,17 @@ void *timeshift_reader ( void *p )
 
               /* Live playback (stage1) */
               if (ts->state == TS_LIVE) {
-                _seek_reset(seek);
-                tmp_file = timeshift_filemgr_newest(ts);
+                _read_close(seek);
+                tmp_file = timeshift_filemgr_newest(tsb);
                 if (tmp_file) {
                   i64 = tmp_file->last;
                   timeshift_file_put(tmp_file);
                 }
-                if (tmp_file && (seek->file = timeshift_filemgr_get(ts, i64)) != NULL) {
-                  seek->file->roff = seek->file->size;
+                if (tmp_file && (seek->file = timeshift_filemgr_get(tsb, i64)) != NULL) {
+                  seek->roff       = seek->file->size;
                   last_time        = seek->file->last;
                 } else {
-                  last_time        = ts->buf_time;
+                  last_time        = tsb->buf_time;
                 }
               }
 
@@ -709,7 +786,7 @@ void *timeshift_reader ( void *p )
 
               /* Live (stage2) */
               if (ts->state == TS_LIVE) {
-                if (skip_time >= ts->buf_time - TIMESHIFT_PLAY_BUF) {
+                if (skip_time >= tsb->buf_time - TIMESHIFT_PLAY_BUF) {
                   tvhdebug(LS_TIMESHIFT, "ts %d skip ignored, already live", ts->id);
                   skip = NULL;
                 } else {
@@ -722,10 +799,10 @@ void *timeshift_reader ( void *p )
               /* OK */
               if (skip) {
                 /* seek */
-                seek->frame = NULL;
+                seek->frame = -1;
                 end = _timeshift_do_skip(ts, skip_time, last_time, seek);
-                if (seek->frame) {
-                  pause_time = seek->frame->time;
+                if (seek->frame >= 0) {
+                  pause_time = timeshift_index_frame(seek)->time;
                   tvhtrace(LS_TIMESHIFT, "ts %d skip - play buffer from %"PRId64" last_time %"PRId64,
                            ts->id, pause_time, last_time);
 
@@ -753,8 +830,9 @@ void *timeshift_reader ( void *p )
           /* Error */
           if (!skip) {
             ((streaming_skip_t*)ctrl->sm_data)->type = SMT_SKIP_ERROR;
-            streaming_target_deliver2(ts->output, ctrl);
+            _deliver(ts, ctrl);
             ctrl = NULL;
+            ts->full = 0;
           }
 
         /* Ignore */
@@ -772,7 +850,7 @@ void *timeshift_reader ( void *p )
         timeshift_status(ts, last_time);
         mono_last_status = mono_now;
       }
-      tvh_mutex_unlock(&ts->state_mutex);
+      tvh_mutex_unlock(&tsb->state_mutex);
       continue;
     }
 
@@ -807,7 +885,7 @@ void *timeshift_reader ( void *p )
 
       /* Find packet */
       if (_timeshift_read(ts, seek, &sm, &wait) == -1) {
-        tvh_mutex_unlock(&ts->state_mutex);
+        tvh_mutex_unlock(&tsb->state_mutex);
         break;
       }
     }
@@ -828,7 +906,8 @@ void *timeshift_reader ( void *p )
         skip       = NULL;
         tvhdebug(LS_TIMESHIFT, "ts %d skip failed (%d)", ts->id, sm ? sm->sm_type : -1);
       }
-      streaming_target_deliver2(ts->output, ctrl);
+      _deliver(ts, ctrl);
+      ts->full = 0; /* reported in the skip status */
     } else {
       streaming_msg_free(ctrl);
     }
@@ -842,8 +921,8 @@ void *timeshift_reader ( void *p )
       last_time = sm->sm_time;
       if (!skip && keyframe_mode) /* always send status on keyframe mode */
         timeshift_status(ts, last_time);
-      timeshift_packet_log("out", ts, sm);
-      streaming_target_deliver2(ts->output, sm);
+      timeshift_packet_log("out", ts->id, sm);
+      _deliver(ts, sm);
       sm        = NULL;
       wait      = 0;
 
@@ -868,22 +947,23 @@ void *timeshift_reader ( void *p )
     /* Terminate */
     if (!seek->file || end != 0) {
 
-      /* Back to live (unless buffer is full) */
-      if ((end == 1 && !ts->full) || !seek->file) {
+      /* Back to live */
+      if (end == 1 || !seek->file) {
         tvhdebug(LS_TIMESHIFT, "ts %d eob revert to live mode", ts->id);
         cur_speed = 100;
         ctrl      = streaming_msg_create_code(SMT_SPEED, cur_speed);
-        streaming_target_deliver2(ts->output, ctrl);
+        _deliver(ts, ctrl);
         ctrl      = NULL;
         tvhtrace(LS_TIMESHIFT, "reader - set TS_LIVE");
 
         /* Flush timeshift buffer to live */
         if (_timeshift_flush_to_live(ts, seek, &wait) == -1) {
-          tvh_mutex_unlock(&ts->state_mutex);
+          tvh_mutex_unlock(&tsb->state_mutex);
           break;
         }
 
         ts->state = TS_LIVE;
+        ts->full  = 0;
 
         /* Close file (if open) */
         _read_close(seek);
@@ -908,18 +988,20 @@ void *timeshift_reader ( void *p )
         tvhdebug(LS_TIMESHIFT, "ts %d sob speed %d last time %"PRId64, ts->id, cur_speed, last_time);
         pause_time = last_time;
         ctrl       = streaming_msg_create_code(SMT_SPEED, cur_speed);
-        streaming_target_deliver2(ts->output, ctrl);
+        _deliver(ts, ctrl);
         ctrl       = NULL;
       }
 
     }
 
-    tvh_mutex_unlock(&ts->state_mutex);
+    tvh_mutex_unlock(&tsb->state_mutex);
   }
 
   /* Cleanup */
   tvhpoll_destroy(pd);
+  tvh_mutex_lock(&tsb->state_mutex);
   _read_close(seek);
+  tvh_mutex_unlock(&tsb->state_mutex);
   if (sm)       streaming_msg_free(sm);
   if (ctrl)     streaming_msg_free(ctrl);
   tvhtrace(LS_TIMESHIFT, "ts %d exit reader thread", ts->id);
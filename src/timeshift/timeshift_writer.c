@@ -24,6 +24,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
@@ -54,63 +55,108 @@ static ssize_t _write_fd
   return count == n ? n : -1;
 }
 
-static ssize_t _write
-  ( timeshift_file_t *tsf, const void *buf, size_t count )
+/*
+ * Write the buffered data to file (the readers copy the buffered
+ * data meanwhile, the buffer is released under the ram_lock)
+ */
+ssize_t timeshift_write_flush ( timeshift_file_t *tsf )
 {
-  uint8_t *ram;
-  size_t alloc;
-  ssize_t ret;
+  ssize_t ret = tsf->wbuf_len;
+  if (tsf->wbuf_len == 0)
+    return 0;
+  if (_write_fd(tsf->wfd, tsf->wbuf, tsf->wbuf_len) < 0)
+    return -1;
+  tvh_mutex_lock(&tsf->ram_lock);
+  tsf->wbuf_off += tsf->wbuf_len;
+  tsf->wbuf_len = 0;
+  tvh_mutex_unlock(&tsf->ram_lock);
+  return ret;
+}
+
+/*
+ * Write data vector
+ *
+ * The data are written after the published offset (woff) without
+ * the state_mutex, the readers see them when the record is published.
+ * The file data are collected in the write-behind buffer, the reader
+ * takes the unwritten tail from this buffer.
+ */
+static ssize_t _writev
+  ( timeshift_file_t *tsf, struct iovec *iov, int iovcnt )
+{
+  timeshift_ram_t *ram;
+  size_t count = 0;
+  off_t off;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    count += iov[i].iov_len;
   if (tsf->ram) {
+    off = tsf->woff + tsf->wpend;
     tvh_mutex_lock(&tsf->ram_lock);
-    if (tsf->ram_size < tsf->woff + count) {
-      if (tsf->ram_size >= timeshift_conf.ram_segment_size)
-        alloc = MAX(count, 64*1024);
-      else
-        alloc = MAX(count, 4*1024*1024);
-      ram = realloc(tsf->ram, tsf->ram_size + alloc);
+    if (tsf->ram->tsr_size < off + count) {
+      /* oversized record, move the segment to the heap */
+      ram = timeshift_ram_resize(tsf->ram, off + count + 64*1024, off);
       if (ram == NULL) {
         tvhwarn(LS_TIMESHIFT, "RAM timeshift memalloc failed");
         tvh_mutex_unlock(&tsf->ram_lock);
         return -1;
       }
-      memoryinfo_append(&timeshift_memoryinfo_ram, alloc);
       tsf->ram = ram;
-      tsf->ram_size += alloc;
     }
-    memcpy(tsf->ram + tsf->woff, buf, count);
-    tsf->woff += count;
+    for (i = 0; i < iovcnt; i++) {
+      memcpy(tsf->ram->tsr_data + off, iov[i].iov_base, iov[i].iov_len);
+      off += iov[i].iov_len;
+    }
     tvh_mutex_unlock(&tsf->ram_lock);
+    tsf->wpend += count;
     return count;
   }
-  ret = _write_fd(tsf->wfd, buf, count);
-  if (ret > 0)
-    tsf->woff += ret;
-  return ret;
+  if (tsf->wbuf == NULL) {
+    tsf->wbuf = malloc(TIMESHIFT_WBUF_SIZE);
+    if (tsf->wbuf == NULL)
+      return -1;
+    memoryinfo_alloc(&timeshift_memoryinfo, TIMESHIFT_WBUF_SIZE);
+  }
+  if (tsf->wbuf_len + count > TIMESHIFT_WBUF_SIZE)
+    if (timeshift_write_flush(tsf) < 0)
+      return -1;
+  if (count > TIMESHIFT_WBUF_SIZE) {
+    if (tvh_writev(tsf->wfd, iov, iovcnt))
+      return -1;
+    tvh_mutex_lock(&tsf->ram_lock);
+    tsf->wbuf_off += count;
+    tvh_mutex_unlock(&tsf->ram_lock);
+  } else {
+    /* the readers copy only the published part */
+    for (i = 0; i < iovcnt; i++) {
+      memcpy(tsf->wbuf + tsf->wbuf_len, iov[i].iov_base, iov[i].iov_len);
+      tsf->wbuf_len += iov[i].iov_len;
+    }
+  }
+  tsf->wpend += count;
+  return count;
 }
 
 /*
- * Write message
+ * Write record (iov[0] is reserved for the header)
  */
-static ssize_t _write_msg
+static ssize_t _write_record
   ( timeshift_file_t *tsf, streaming_message_type_t type, int64_t time,
-    const void *buf, size_t len )
+    struct iovec *iov, int iovcnt )
 {
-  size_t len2 = len + sizeof(type) + sizeof(time);
-  ssize_t err, ret;
-  ret = err = _write(tsf, &len2, sizeof(len2));
-  if (err < 0) return err;
-  err = _write(tsf, &type, sizeof(type));
-  if (err < 0) return err;
-  ret += err;
-  err = _write(tsf, &time, sizeof(time));
-  if (err < 0) return err;
-  ret += err;
-  if (len) {
-    err = _write(tsf, buf, len);
-    if (err < 0) return err;
-    ret += err;
-  }
-  return ret;
+  timeshift_record_t tr;
+  size_t size = sizeof(tr);
+  int i;
+
+  for (i = 1; i < iovcnt; i++)
+    size += iov[i].iov_len;
+  tr.tr_size = size;
+  tr.tr_type = type;
+  tr.tr_time = time;
+  iov[0].iov_base = &tr;
+  iov[0].iov_len  = sizeof(tr);
+  return _writev(tsf, iov, iovcnt);
 }
 
 static ssize_t _write_msg_fd
@@ -135,50 +181,53 @@ static ssize_t _write_msg_fd
   return ret;
 }
 
-/*
- * Write packet buffer
- */
-static int _write_pktbuf ( timeshift_file_t *tsf, pktbuf_t *pktbuf )
-{
-  ssize_t ret, err;
-  if (pktbuf) {
-    ret = err = _write(tsf, &pktbuf->pb_size, sizeof(pktbuf->pb_size));
-    if (err < 0) return err;
-    err = _write(tsf, pktbuf_ptr(pktbuf), pktbuf_len(pktbuf));
-    if (err < 0) return err;
-    ret += err;
-  } else {
-    size_t sz = 0;
-    ret = _write(tsf, &sz, sizeof(sz));
-  }
-  return ret;
-}
-
 /*
  * Write signal status
  */
 ssize_t timeshift_write_sigstat
   ( timeshift_file_t *tsf, int64_t time, signal_status_t *sigstat )
 {
-  return _write_msg(tsf, SMT_SIGNAL_STATUS, time, sigstat,
-                    sizeof(signal_status_t));
+  struct iovec iov[2];
+
+  iov[1].iov_base = sigstat;
+  iov[1].iov_len  = sizeof(signal_status_t);
+  return _write_record(tsf, SMT_SIGNAL_STATUS, time, iov, 2);
 }
 
 /*
  * Write packet
  */
-ssize_t timeshift_write_packet ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt )
+ssize_t timeshift_write_packet
+  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt, int64_t ts_delta )
 {
-  ssize_t ret = 0, err;
-  ret = err = _write_msg(tsf, SMT_PACKET, time, pkt, sizeof(th_pkt_t));
-  if (err <= 0) return err;
-  err = _write_pktbuf(tsf, pkt->pkt_meta);
-  if (err <= 0) return err;
-  ret += err;
-  err = _write_pktbuf(tsf, pkt->pkt_payload);
-  if (err <= 0) return err;
-  ret += err;
-  return ret;
+  timeshift_record_pkt_t trp;
+  struct iovec iov[4];
+  int iovcnt = 2;
+
+  trp.trp_dts            = pkt->pkt_dts - ts_delta;
+  trp.trp_pts            = pkt->pkt_pts - ts_delta;
+  trp.trp_pcr            = pkt->pkt_pcr - ts_delta;
+  trp.trp_duration       = pkt->pkt_duration;
+  trp.trp_meta           = pktbuf_len(pkt->pkt_meta);
+  trp.trp_type           = pkt->pkt_type;
+  trp.trp_err            = pkt->pkt_err;
+  trp.trp_componentindex = pkt->pkt_componentindex;
+  trp.trp_commercial     = pkt->pkt_commercial;
+  trp.trp_frametype      = pkt->v.pkt_frametype;
+  trp.trp_field          = pkt->v.pkt_field;
+  trp.trp_aspect_num     = pkt->v.pkt_aspect_num;
+  trp.trp_aspect_den     = pkt->v.pkt_aspect_den;
+  iov[1].iov_base = &trp;
+  iov[1].iov_len  = sizeof(trp);
+  if (trp.trp_meta) {
+    iov[iovcnt].iov_base = pktbuf_ptr(pkt->pkt_meta);
+    iov[iovcnt++].iov_len = trp.trp_meta;
+  }
+  if (pktbuf_len(pkt->pkt_payload)) {
+    iov[iovcnt].iov_base = pktbuf_ptr(pkt->pkt_payload);
+    iov[iovcnt++].iov_len = pktbuf_len(pkt->pkt_payload);
+  }
+  return _write_record(tsf, SMT_PACKET, time, iov, iovcnt);
 }
 
 /*
@@ -186,7 +235,11 @@ ssize_t timeshift_write_packet ( timeshift_file_t *tsf, int64_t time, th_pkt_t *
  */
 ssize_t timeshift_write_mpegts ( timeshift_file_t *tsf, int64_t time, void *data )
 {
-  return _write_msg(tsf, SMT_MPEGTS, time, data, 188);
+  struct iovec iov[2];
+
+  iov[1].iov_base = data;
+  iov[1].iov_len  = 188;
+  return _write_record(tsf, SMT_MPEGTS, time, iov, 2);
 }
 
 /*
@@ -227,26 +280,27 @@ ssize_t timeshift_write_exit ( int fd )
  */
 ssize_t timeshift_write_eof ( timeshift_file_t *tsf )
 {
-  size_t sz = 0;
-  return _write(tsf, &sz, sizeof(sz));
+  timeshift_record_t tr = { 0 };
+  struct iovec iov = { &tr, sizeof(tr) };
+  return _writev(tsf, &iov, 1);
 }
 
 /*
  * Update smt_start
  */
-static void _update_smt_start ( timeshift_t *ts, streaming_start_t *ss )
+static void _update_smt_start ( timeshift_buffer_t *tsb, streaming_start_t *ss )
 {
   int i;
 
-  if (ts->smt_start)
-    streaming_start_unref(ts->smt_start);
+  if (tsb->smt_start)
+    streaming_start_unref(tsb->smt_start);
   streaming_start_ref(ss);
-  ts->smt_start = ss;
+  tsb->smt_start = ss;
 
   /* Update video index */
   for (i = 0; i < ss->ss_num_components; i++)
     if (SCT_ISVIDEO(ss->ss_components[i].es_type)) {
-      ts->vididx = ss->ss_components[i].es_index;
+      tsb->vididx = ss->ss_components[i].es_index;
       break;
     }
 }
@@ -254,7 +308,7 @@ static void _update_smt_start ( timeshift_t *ts, streaming_start_t *ss )
 /*
  * Stream start handling
  */
-static void _handle_sstart ( timeshift_t *ts, timeshift_file_t *tsf, streaming_message_t *sm )
+static void _handle_sstart ( timeshift_file_t *tsf, streaming_message_t *sm )
 {
   timeshift_index_data_t *ti = calloc(1, sizeof(timeshift_index_data_t));
 
@@ -268,55 +322,159 @@ static void _handle_sstart ( timeshift_t *ts, timeshift_file_t *tsf, streaming_m
  * Thread
  * *************************************************************************/
 
+/*
+ * Write the message (without the state_mutex)
+ */
 static inline ssize_t _process_msg0
-  ( timeshift_t *ts, timeshift_file_t *tsf, streaming_message_t *sm )
+  ( timeshift_file_t *tsf, streaming_message_t *sm )
 {
-  ssize_t err;
-
-  if (sm->sm_type == SMT_START) {
-    err = 0;
-    _handle_sstart(ts, tsf, streaming_msg_clone(sm));
-  } else if (sm->sm_type == SMT_SIGNAL_STATUS)
-    err = timeshift_write_sigstat(tsf, sm->sm_time, sm->sm_data);
-  else if (sm->sm_type == SMT_PACKET) {
-    err = timeshift_write_packet(tsf, sm->sm_time, sm->sm_data);
-    if (err > 0) {
-      th_pkt_t *pkt = sm->sm_data;
-
-      /* Index video iframes */
-      if (pkt->pkt_componentindex == ts->vididx &&
-          pkt->v.pkt_frametype    == PKT_I_FRAME) {
-        timeshift_index_iframe_t *ti = calloc(1, sizeof(timeshift_index_iframe_t));
-        memoryinfo_alloc(&timeshift_memoryinfo, sizeof(*ti));
-        ti->pos  = tsf->size;
-        ti->time = sm->sm_time;
-        TAILQ_INSERT_TAIL(&tsf->iframes, ti, link);
-      }
+  if (sm->sm_type == SMT_SIGNAL_STATUS)
+    return timeshift_write_sigstat(tsf, sm->sm_time, sm->sm_data);
+  if (sm->sm_type == SMT_PACKET)
+    return timeshift_write_packet(tsf, sm->sm_time, sm->sm_data,
+                                  sm->sm_ts_delta);
+  if (sm->sm_type == SMT_MPEGTS)
+    return timeshift_write_mpegts(tsf, sm->sm_time, sm->sm_data);
+  return 0;
+}
+
+/*
+ * Publish the written record to the readers (state_mutex)
+ */
+static inline void _process_msg1
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf,
+    streaming_message_t *sm, ssize_t len )
+{
+  th_pkt_t *pkt;
+
+  if (len <= 0)
+    return;
+  tsf->woff += tsf->wpend;
+  tsf->wpend = 0;
+
+  /* Index video iframes */
+  if (sm->sm_type == SMT_PACKET) {
+    pkt = sm->sm_data;
+    if (pkt->pkt_componentindex == tsb->vididx &&
+        pkt->v.pkt_frametype    == PKT_I_FRAME)
+      timeshift_index_add(tsb, tsf, sm->sm_time, tsf->size);
+  }
+
+  tsf->last  = sm->sm_time;
+  tsf->size += len;
+  atomic_add_u64(&timeshift_total_size, len);
+  if (tsf->ram)
+    atomic_add_u64(&timeshift_total_ram_size, len);
+}
+
+/*
+ * Take the live clients for the message (state_mutex), the message
+ * is delivered by _live_deliver without the lock
+ */
+static void _live_clients
+  ( timeshift_buffer_t *tsb, streaming_message_t *sm )
+{
+  timeshift_t *ts, **live;
+  int n;
+
+  tsb->wr_live_count = 0;
+  LIST_FOREACH(ts, &tsb->clients, link) {
+    if (ts->live_skip && sm->sm_data == ts->live_skip) {
+      /* passed by the joining client */
+      pkt_ref_dec(ts->live_skip);
+      ts->live_skip = NULL;
+      continue;
     }
-  } else if (sm->sm_type == SMT_MPEGTS) {
-    err = timeshift_write_mpegts(tsf, sm->sm_time, sm->sm_data);
+    /* the clients take the start message from own chain */
+    if (ts->state != TS_LIVE || !ts->started || sm->sm_type == SMT_START)
+      continue;
+    if (tsb->wr_live_count == tsb->wr_live_alloc) {
+      n = MAX(4, tsb->wr_live_alloc * 2);
+      live = realloc(tsb->wr_live, n * sizeof(*live));
+      if (live == NULL)
+        break;
+      tsb->wr_live = live;
+      tsb->wr_live_alloc = n;
+    }
+    ts->queued++;
+    tsb->wr_live[tsb->wr_live_count++] = ts;
   }
-  else
-    err = 0;
-
-  /* OK */
-  if (err > 0) {
-    tsf->last  = sm->sm_time;
-    tsf->size += err;
-    atomic_add_u64(&timeshift_total_size, err);
-    if (tsf->ram)
-      atomic_add_u64(&timeshift_total_ram_size, err);
+}
+
+static void _live_deliver
+  ( timeshift_buffer_t *tsb, streaming_message_t *sm )
+{
+  timeshift_t *ts;
+  int i;
+
+  if (tsb->wr_live_count == 0)
+    return;
+  for (i = 0; i < tsb->wr_live_count; i++) {
+    ts = tsb->wr_live[i];
+    timeshift_packet_log("liv", ts->id, sm);
+    timeshift_deliver(ts, streaming_msg_clone(sm));
   }
-  return err;
+  tvh_mutex_lock(&tsb->state_mutex);
+  for (i = 0; i < tsb->wr_live_count; i++) {
+    ts = tsb->wr_live[i];
+    if (--ts->queued == 0)
+      tvh_cond_signal(&tsb->wr_cond, 1);
+  }
+  tvh_mutex_unlock(&tsb->state_mutex);
+}
+
+/*
+ * Client message (queued by timeshift_queue)
+ */
+static int _process_client_msg
+  ( timeshift_buffer_t *tsb, streaming_message_t *sm )
+{
+  timeshift_msg_t *tm;
+  timeshift_t *ts;
+
+  tvh_mutex_lock(&tsb->state_mutex);
+  tm = TAILQ_FIRST(&tsb->wr_msgs);
+  if (tm == NULL || tm->sm != sm) {
+    tvh_mutex_unlock(&tsb->state_mutex);
+    return 0;
+  }
+  TAILQ_REMOVE(&tsb->wr_msgs, tm, link);
+  ts = tm->ts;
+  free(tm);
+  if (sm->sm_type == SMT_START)
+    ts->started = 1;
+  else if (sm->sm_type == SMT_STOP || sm->sm_type == SMT_EXIT)
+    ts->started = 0;
+  if (ts->state != TS_LIVE) {
+    streaming_msg_free(sm);
+    sm = NULL;
+  }
+  tvh_mutex_unlock(&tsb->state_mutex);
+
+  if (sm) {
+    timeshift_packet_log("liv", ts->id, sm);
+    timeshift_deliver(ts, sm);
+  }
+
+  tvh_mutex_lock(&tsb->state_mutex);
+  if (--ts->queued == 0)
+    tvh_cond_signal(&tsb->wr_cond, 1);
+  tvh_mutex_unlock(&tsb->state_mutex);
+  return 1;
 }
 
 static void _process_msg
-  ( timeshift_t *ts, streaming_message_t *sm, int *run )
+  ( timeshift_buffer_t *tsb, streaming_message_t *sm, int *run )
 {
-  int err, teletext = 0;
-  timeshift_file_t *tsf;
+  int dobuf, teletext = 0;
+  ssize_t err = 0;
+  timeshift_file_t *tsf = NULL;
+  timeshift_t *ts;
   th_pkt_t *pkt;
 
+  if (_process_client_msg(tsb, sm))
+    return;
+
   /* Process */
   switch (sm->sm_type) {
 
@@ -324,24 +482,6 @@ static void _process_msg
     case SMT_EXIT:
       if (run) *run = 0;
       break;
-    case SMT_STOP:
-      if (sm->sm_code != SM_CODE_SOURCE_RECONFIGURED && run)
-        *run = 0;
-      goto live;
-
-    /* Timeshifting */
-    case SMT_SKIP:
-    case SMT_SPEED:
-      break;
-
-    /* Status */
-    case SMT_GRACE:
-    case SMT_NOSTART:
-    case SMT_NOSTART_WARN:
-    case SMT_SERVICE_STATUS:
-    case SMT_TIMESHIFT_STATUS:
-    case SMT_DESCRAMBLE_INFO:
-      goto live;
 
     /* Store */
     case SMT_PACKET:
@@ -353,73 +493,76 @@ static void _process_msg
     case SMT_SIGNAL_STATUS:
     case SMT_START:
     case SMT_MPEGTS:
-      tvh_mutex_lock(&ts->state_mutex);
+      tvh_mutex_lock(&tsb->state_mutex);
       if (!teletext) /* do not use time from teletext packets */
-        ts->buf_time = sm->sm_time;
-      if (ts->state == TS_LIVE) {
-        streaming_target_deliver2(ts->output, streaming_msg_clone(sm));
-        if (sm->sm_type == SMT_PACKET)
-          timeshift_packet_log("liv", ts, sm);
-      }
+        tsb->buf_time = sm->sm_time;
+      dobuf = 0;
+      LIST_FOREACH(ts, &tsb->clients, link)
+        dobuf |= ts->dobuf;
       if (sm->sm_type == SMT_START)
-        _update_smt_start(ts, (streaming_start_t *)sm->sm_data);
+        _update_smt_start(tsb, (streaming_start_t *)sm->sm_data);
       /* do buffering, but without teletext packets */
-      if (ts->dobuf && !teletext) {
-        if ((tsf = timeshift_filemgr_get(ts, sm->sm_time)) != NULL) {
-          if (tsf->wfd >= 0 || tsf->ram) {
-            if ((err = _process_msg0(ts, tsf, sm)) < 0) {
-              timeshift_filemgr_close(tsf);
-              tsf->bad = 1;
-              ts->full = 1; ///< Stop any more writing
-            } else {
-              timeshift_packet_log("sav", ts, sm);
-            }
+      if (dobuf && !teletext) {
+        if ((tsf = timeshift_filemgr_get(tsb, sm->sm_time)) != NULL) {
+          if (tsf->eof) {
+            timeshift_file_put(tsf);
+            tsf = NULL;
+          } else if (sm->sm_type == SMT_START) {
+            _handle_sstart(tsf, streaming_msg_clone(sm));
           }
-          timeshift_file_put(tsf);
         }
       }
-      tvh_mutex_unlock(&ts->state_mutex);
+      tvh_mutex_unlock(&tsb->state_mutex);
+
+      /* the file is pinned, the readers take the older data meanwhile */
+      if (tsf)
+        err = _process_msg0(tsf, sm);
+
+      tvh_mutex_lock(&tsb->state_mutex);
+      if (tsf) {
+        if (err < 0) {
+          /* continue in the next period, make some space */
+          timeshift_filemgr_close(tsf);
+          tsf->bad = 1;
+          timeshift_filemgr_reclaim(tsb, tsf);
+        } else {
+          _process_msg1(tsb, tsf, sm, err);
+          timeshift_packet_log("sav", tsb->id, sm);
+        }
+        timeshift_file_put(tsf);
+      }
+      _live_clients(tsb, sm);
+      tvh_mutex_unlock(&tsb->state_mutex);
+
+      _live_deliver(tsb, sm);
+      break;
+
+    default:
       break;
   }
 
   /* Next */
   streaming_msg_free(sm);
-  return;
-
-live:
-  tvh_mutex_lock(&ts->state_mutex);
-  if (ts->state == TS_LIVE)
-    streaming_target_deliver2(ts->output, sm);
-  else
-    streaming_msg_free(sm);
-  tvh_mutex_unlock(&ts->state_mutex);
 }
 
 void *timeshift_writer ( void *aux )
 {
   int run = 1;
-  timeshift_t *ts = aux;
-  streaming_queue_t *sq = &ts->wr_queue;
+  timeshift_buffer_t *tsb = aux;
+  streaming_queue_t *sq = &tsb->wr_queue;
   streaming_message_t *sm;
 
-  tvh_mutex_lock(&sq->sq_mutex);
-
   while (run) {
 
     /* Get message */
-    sm = TAILQ_FIRST(&sq->sq_queue);
+    sm = streaming_queue_get(sq);
     if (sm == NULL) {
-      tvh_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      streaming_queue_wait(sq, 0);
       continue;
     }
-    streaming_queue_remove(sq, sm);
-    tvh_mutex_unlock(&sq->sq_mutex);
-
-    _process_msg(ts, sm, &run);
 
-    tvh_mutex_lock(&sq->sq_mutex);
+    _process_msg(tsb, sm, &run);
   }
 
-  tvh_mutex_unlock(&sq->sq_mutex);
   return NULL;
 }
@@ -0,0 +1,353 @@
+/*
+ *  Tvheadend - MPEG-TS header scanning kernels
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "tvh_endian.h"
+#include "tsscan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && ENABLE_SSE2 && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define TSSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && BYTE_ORDER == LITTLE_ENDIAN
+#define TSSCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+static inline uint32_t tsscan_word32( const uint8_t *tsb )
+{
+  return *(uint32_t *)tsb;
+}
+
+static inline uint32_t tsscan_native( uint32_t v )
+{
+#if BYTE_ORDER == LITTLE_ENDIAN
+  return bswap_32(v);
+#else
+  return v;
+#endif
+}
+
+/*
+ * Scalar loop for the remaining packets, the CC state is passed
+ * as the CC of the previous packet (carry)
+ */
+static inline int
+tsscan_tail
+  ( const uint8_t **ptsb, int *plen, uint32_t mask, uint32_t val,
+    uint32_t *carry, int cc )
+{
+  const uint8_t *tsb = *ptsb;
+  uint32_t c, prev = *carry;
+  int len = *plen, err = 0;
+
+  while (len >= 188 && (tsscan_word32(tsb) & mask) == val) {
+    if (cc) {
+      c = tsb[3] & 0x0f;
+      if (((prev + 1) & 0x0f) != c)
+        err++;
+      prev = c;
+    }
+    tsb += 188;
+    len -= 188;
+  }
+  *ptsb = tsb;
+  *plen = len;
+  *carry = prev;
+  return err;
+}
+
+static inline uint32_t
+tsscan_carry_init ( const uint8_t *tsb, int len, uint8_t *rcc )
+{
+  if (rcc == NULL || len < 188)
+    return 0;
+  /* unknown state - the first packet is always accepted */
+  if (*rcc == 0xff)
+    return (tsb[3] - 1) & 0x0f;
+  return (*rcc - 1) & 0x0f;
+}
+
+static inline void
+tsscan_cc_done
+  ( const uint8_t *start, const uint8_t *tsb, uint32_t carry,
+    uint8_t *rcc, int *rccerr, int err )
+{
+  if (rcc == NULL)
+    return;
+  if (tsb != start)
+    *rcc = (carry + 1) & 0x0f;
+  *rccerr = err;
+}
+
+/*
+ * Reference implementation
+ */
+static int
+tsscan_run_scalar
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val,
+    uint8_t *rcc, int *rccerr )
+{
+  const uint8_t *start = tsb;
+  uint8_t cc, cc2;
+  int err = 0;
+
+  while (len >= 188) {
+    if (len >= 4*188 &&
+        (tsscan_word32(tsb+0*188) & mask) == val &&
+        (tsscan_word32(tsb+1*188) & mask) == val &&
+        (tsscan_word32(tsb+2*188) & mask) == val &&
+        (tsscan_word32(tsb+3*188) & mask) == val) {
+      len -= 4*188;
+      tsb += 4*188;
+    } else if ((tsscan_word32(tsb) & mask) == val) {
+      len -= 188;
+      tsb += 188;
+    } else {
+      break;
+    }
+  }
+
+  if (rcc) {
+    cc2 = *rcc;
+    for (len = 0; start + len < tsb; len += 188) {
+      cc = start[len + 3] & 0x0f;
+      if (cc2 != 0xff && cc2 != cc)
+        err++;
+      cc2 = (cc + 1) & 0x0f;
+    }
+    *rcc = cc2;
+    *rccerr = err;
+  }
+
+  return tsb - start;
+}
+
+#if TSSCAN_X86
+
+__attribute__((target("sse2")))
+static int
+tsscan_run_sse2
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val,
+    uint8_t *rcc, int *rccerr )
+{
+  const uint8_t *start = tsb;
+  const __m128i vmask = _mm_set1_epi32(mask);
+  const __m128i vval  = _mm_set1_epi32(val);
+  const __m128i ccm   = _mm_set1_epi32(0x0f);
+  const __m128i one   = _mm_set1_epi32(1);
+  __m128i w, ccv, prev;
+  uint32_t carry = tsscan_carry_init(tsb, len, rcc);
+  int m, n, err = 0, cc = rcc != NULL;
+
+  while (len >= 4*188) {
+    w = _mm_set_epi32(tsscan_word32(tsb+3*188), tsscan_word32(tsb+2*188),
+                      tsscan_word32(tsb+1*188), tsscan_word32(tsb+0*188));
+    m = _mm_movemask_ps(_mm_castsi128_ps(
+          _mm_cmpeq_epi32(_mm_and_si128(w, vmask), vval)));
+    n = m == 0x0f ? 4 : __builtin_ctz(~m);
+    if (n == 0)
+      goto done;
+    if (cc) {
+      /* lane i must be equal to (lane i-1) + 1 */
+      ccv  = _mm_and_si128(_mm_srli_epi32(w, 24), ccm);
+      prev = _mm_or_si128(_mm_slli_si128(ccv, 4), _mm_cvtsi32_si128(carry));
+      prev = _mm_and_si128(_mm_add_epi32(prev, one), ccm);
+      m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(prev, ccv)));
+      err += __builtin_popcount(~m & ((1 << n) - 1));
+      carry = tsb[(n - 1) * 188 + 3] & 0x0f;
+    }
+    tsb += n * 188;
+    len -= n * 188;
+    if (n < 4)
+      goto done;
+  }
+  err += tsscan_tail(&tsb, &len, mask, val, &carry, cc);
+done:
+  tsscan_cc_done(start, tsb, carry, rcc, rccerr, err);
+  return tsb - start;
+}
+
+__attribute__((target("avx2")))
+static int
+tsscan_run_avx2
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val,
+    uint8_t *rcc, int *rccerr )
+{
+  const uint8_t *start = tsb;
+  const __m256i idx   = _mm256_setr_epi32(0*188, 1*188, 2*188, 3*188,
+                                          4*188, 5*188, 6*188, 7*188);
+  const __m256i shift = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i vmask = _mm256_set1_epi32(mask);
+  const __m256i vval  = _mm256_set1_epi32(val);
+  const __m256i ccm   = _mm256_set1_epi32(0x0f);
+  const __m256i one   = _mm256_set1_epi32(1);
+  __m256i w, ccv, prev;
+  uint32_t carry = tsscan_carry_init(tsb, len, rcc);
+  int m, n, err = 0, cc = rcc != NULL;
+
+  while (len >= 8*188) {
+    w = _mm256_i32gather_epi32((const int *)tsb, idx, 1);
+    m = _mm256_movemask_ps(_mm256_castsi256_ps(
+          _mm256_cmpeq_epi32(_mm256_and_si256(w, vmask), vval)));
+    n = m == 0xff ? 8 : __builtin_ctz(~m);
+    if (n == 0)
+      goto done;
+    if (cc) {
+      ccv  = _mm256_and_si256(_mm256_srli_epi32(w, 24), ccm);
+      prev = _mm256_permutevar8x32_epi32(ccv, shift);
+      prev = _mm256_blend_epi32(prev, _mm256_set1_epi32(carry), 0x01);
+      prev = _mm256_and_si256(_mm256_add_epi32(prev, one), ccm);
+      m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(prev, ccv)));
+      err += __builtin_popcount(~m & ((1 << n) - 1));
+      carry = tsb[(n - 1) * 188 + 3] & 0x0f;
+    }
+    tsb += n * 188;
+    len -= n * 188;
+    if (n < 8)
+      goto done;
+  }
+  err += tsscan_tail(&tsb, &len, mask, val, &carry, cc);
+done:
+  tsscan_cc_done(start, tsb, carry, rcc, rccerr, err);
+  return tsb - start;
+}
+
+#endif /* TSSCAN_X86 */
+
+#if TSSCAN_NEON
+
+static int
+tsscan_run_neon
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val,
+    uint8_t *rcc, int *rccerr )
+{
+  static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+  const uint8_t *start = tsb;
+  const uint32x4_t vmask = vdupq_n_u32(mask);
+  const uint32x4_t vval  = vdupq_n_u32(val);
+  const uint32x4_t ccm   = vdupq_n_u32(0x0f);
+  const uint32x4_t one   = vdupq_n_u32(1);
+  const uint32x4_t bits  = vld1q_u32(lanes);
+  uint32x4_t w, ccv, prev;
+  uint32_t words[4], carry = tsscan_carry_init(tsb, len, rcc);
+  int m, n, err = 0, cc = rcc != NULL;
+
+  while (len >= 4*188) {
+    words[0] = tsscan_word32(tsb+0*188);
+    words[1] = tsscan_word32(tsb+1*188);
+    words[2] = tsscan_word32(tsb+2*188);
+    words[3] = tsscan_word32(tsb+3*188);
+    w = vld1q_u32(words);
+    m = vaddvq_u32(vandq_u32(vceqq_u32(vandq_u32(w, vmask), vval), bits));
+    n = m == 0x0f ? 4 : __builtin_ctz(~m);
+    if (n == 0)
+      goto done;
+    if (cc) {
+      ccv  = vandq_u32(vshrq_n_u32(w, 24), ccm);
+      prev = vextq_u32(vdupq_n_u32(carry), ccv, 3);
+      prev = vandq_u32(vaddq_u32(prev, one), ccm);
+      m = vaddvq_u32(vandq_u32(vceqq_u32(prev, ccv), bits));
+      err += __builtin_popcount(~m & ((1 << n) - 1));
+      carry = tsb[(n - 1) * 188 + 3] & 0x0f;
+    }
+    tsb += n * 188;
+    len -= n * 188;
+    if (n < 4)
+      goto done;
+  }
+  err += tsscan_tail(&tsb, &len, mask, val, &carry, cc);
+done:
+  tsscan_cc_done(start, tsb, carry, rcc, rccerr, err);
+  return tsb - start;
+}
+
+#endif /* TSSCAN_NEON */
+
+static const tsscan_kernel_t tsscan_scalar = { "scalar", tsscan_run_scalar };
+#if TSSCAN_X86
+static const tsscan_kernel_t tsscan_sse2   = { "sse2",   tsscan_run_sse2 };
+static const tsscan_kernel_t tsscan_avx2   = { "avx2",   tsscan_run_avx2 };
+#endif
+#if TSSCAN_NEON
+static const tsscan_kernel_t tsscan_neon   = { "neon",   tsscan_run_neon };
+#endif
+
+const tsscan_kernel_t *tsscan_kernel = &tsscan_scalar;
+
+/*
+ * Pick the best kernel for this CPU
+ */
+void
+tsscan_init ( void )
+{
+#if TSSCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    tsscan_kernel = &tsscan_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    tsscan_kernel = &tsscan_sse2;
+#elif TSSCAN_NEON
+  tsscan_kernel = &tsscan_neon;
+#endif
+  tvhdebug(LS_MAIN, "TS scan kernel: %s", tsscan_kernel->name);
+}
+
+/*
+ * Count bytes of the consecutive packets with the sync byte
+ */
+int
+ts_sync_count ( const uint8_t *tsb, int len )
+{
+  if (len < 188 || tsb[0] != 0x47)
+    return 0;
+  return tsscan_kernel->run(tsb, len, tsscan_native(0xFF000000),
+                            tsscan_native(0x47000000), NULL, NULL);
+}
+
+/*
+ * Count bytes of the consecutive packets with the same masked
+ * header word (the mask is in the network byte order)
+ */
+int
+mpegts_word_count ( const uint8_t *tsb, int len, uint32_t mask )
+{
+  if (len < 188)
+    return 0;
+  mask = tsscan_native(mask);
+  return tsscan_kernel->run(tsb, len, mask, tsscan_word32(tsb) & mask,
+                            NULL, NULL);
+}
+
+/*
+ * Same as mpegts_word_count, but check also the continuity counters
+ */
+int
+mpegts_word_count_cc
+  ( const uint8_t *tsb, int len, uint32_t mask, uint8_t *rcc, int *rccerr )
+{
+  *rccerr = 0;
+  if (len < 188)
+    return 0;
+  mask = tsscan_native(mask);
+  return tsscan_kernel->run(tsb, len, mask, tsscan_word32(tsb) & mask,
+                            rcc, rccerr);
+}
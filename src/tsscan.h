@@ -0,0 +1,51 @@
+/*
+ *  Tvheadend - MPEG-TS header scanning kernels
+ *
+ *  Copyright (C) 2026 Tvheadend
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_TSSCAN_H__
+#define __TVH_TSSCAN_H__
+
+#include <stdint.h>
+
+/*
+ * A kernel returns the length (in bytes) of the run of 188-byte packets
+ * whose first header word matches val under mask (both in memory byte
+ * order). When rcc is not NULL, the continuity counters of the run are
+ * checked in the same pass: *rcc holds the expected CC on entry (0xff
+ * = unknown) and the next expected CC on return, *rccerr receives the
+ * number of discontinuities.
+ */
+typedef int (*tsscan_run_t)
+  ( const uint8_t *tsb, int len, uint32_t mask, uint32_t val,
+    uint8_t *rcc, int *rccerr );
+
+typedef struct tsscan_kernel {
+  const char   *name;
+  tsscan_run_t  run;
+} tsscan_kernel_t;
+
+extern const tsscan_kernel_t *tsscan_kernel;
+
+void tsscan_init ( void );
+
+int ts_sync_count ( const uint8_t *tsb, int len );
+
+int mpegts_word_count_cc
+  ( const uint8_t *tsb, int len, uint32_t mask, uint8_t *rcc, int *rccerr );
+
+#endif /* __TVH_TSSCAN_H__ */
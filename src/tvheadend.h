@@ -245,6 +245,9 @@ void tvh_pipe_close(th_pipe_t *pipe);
 
 int tvh_write(int fd, const void *buf, size_t len);
 
+struct iovec;
+int tvh_writev(int fd, struct iovec *iov, int iovcnt);
+
 int tvh_nonblock_write(int fd, const void *buf, size_t len);
 
 FILE *tvh_fopen(const char *filename, const char *mode);
@@ -333,13 +333,17 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
 		const char *name, th_subscription_t *s)
 {
   streaming_message_t *sm;
+  struct streaming_message_queue batch;
   int run = 1, started = 0;
   streaming_queue_t *sq = &prch->prch_sq;
   muxer_t *mux = prch->prch_muxer;
-  int ptimeout, grace = 20, r;
+  int ptimeout, grace = 20;
   struct timeval tp;
   streaming_start_t *ss_copy;
   int64_t lastpkt, mono;
+  uint64_t writes = 0;
+
+  TAILQ_INIT(&batch);
 
   if(muxer_open_stream(mux, hc->hc_fd))
     run = 0;
@@ -354,38 +358,49 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
   lastpkt = mclk();
   ptimeout = prch->prch_pro ? prch->prch_pro->pro_timeout : 5;
 
-  if (hc->hc_no_output) {
-    tvh_mutex_lock(&sq->sq_mutex);
+  if (hc->hc_no_output)
     sq->sq_maxsize = 100000;
-    tvh_mutex_unlock(&sq->sq_mutex);
-  }
 
   while(!hc->hc_shutdown && run && tvheadend_is_running()) {
-    tvh_mutex_lock(&sq->sq_mutex);
-    sm = TAILQ_FIRST(&sq->sq_queue);
+
+    if(mux->m_errors) {
+      if (!mux->m_eos)
+        tvhwarn(LS_WEBUI,  "Stop streaming %s, muxer reported errors", hc->hc_url_orig);
+      run = 0;
+      break;
+    }
+
+    sm = TAILQ_FIRST(&batch);
     if(sm == NULL) {
-      mono = mclk() + sec2mono(1);
-      do {
-        r = tvh_cond_timedwait(&sq->sq_cond, &sq->sq_mutex, mono);
-        if (r == ETIMEDOUT) {
-          /* Check socket status */
-          if (tcp_socket_dead(hc->hc_fd)) {
-            tvhdebug(LS_WEBUI,  "Stop streaming %s, client hung up", hc->hc_url_orig);
-            run = 0;
-          } else if((!started && mclk() - lastpkt > sec2mono(grace)) ||
-                     (started && ptimeout > 0 && mclk() - lastpkt > sec2mono(ptimeout))) {
-            tvhwarn(LS_WEBUI,  "Stop streaming %s, timeout waiting for packets", hc->hc_url_orig);
-            run = 0;
-          }
-          break;
+      /* the batch is processed, write the gathered data */
+      if(started) {
+        muxer_flush(mux);
+        if (mux->m_writes != writes) {
+          subscription_add_writes_out(s, mux->m_writes - writes);
+          writes = mux->m_writes;
         }
-      } while (ERRNO_AGAIN(r));
-      tvh_mutex_unlock(&sq->sq_mutex);
+        if(mux->m_errors)
+          continue;
+      }
+      /* take everything queued in one go */
+      streaming_queue_take(sq, &batch);
+      if(!TAILQ_EMPTY(&batch))
+        continue;
+      if (streaming_queue_wait(sq, mclk() + sec2mono(1)) == ETIMEDOUT) {
+        /* Check socket status */
+        if (tcp_socket_dead(hc->hc_fd)) {
+          tvhdebug(LS_WEBUI,  "Stop streaming %s, client hung up", hc->hc_url_orig);
+          run = 0;
+        } else if((!started && mclk() - lastpkt > sec2mono(grace)) ||
+                   (started && ptimeout > 0 && mclk() - lastpkt > sec2mono(ptimeout))) {
+          tvhwarn(LS_WEBUI,  "Stop streaming %s, timeout waiting for packets", hc->hc_url_orig);
+          run = 0;
+        }
+      }
       continue;
     }
 
-    streaming_queue_remove(sq, sm);
-    tvh_mutex_unlock(&sq->sq_mutex);
+    TAILQ_REMOVE(&batch, sm, sm_link);
 
     switch(sm->sm_type) {
     case SMT_MPEGTS:
@@ -400,7 +415,7 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
         subscription_add_bytes_out(s, len = pktbuf_len(pb));
         if (len > 0)
           lastpkt = mclk();
-        muxer_write_pkt(mux, sm->sm_type, sm->sm_data);
+        muxer_write_pkt(mux, sm->sm_type, sm->sm_data, sm->sm_ts_delta);
         sm->sm_data = NULL;
       }
       break;
@@ -418,6 +433,7 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
 
         if (hc->hc_no_output) {
           streaming_msg_free(sm);
+          streaming_queue_clear(&batch);
           mono = mclk() + sec2mono(2);
           while (mclk() < mono) {
             if (tcp_socket_dead(hc->hc_fd))
@@ -482,16 +498,17 @@ http_stream_run(http_connection_t *hc, profile_chain_t *prch,
     }
 
     streaming_msg_free(sm);
-
-    if(mux->m_errors) {
-      if (!mux->m_eos)
-        tvhwarn(LS_WEBUI,  "Stop streaming %s, muxer reported errors", hc->hc_url_orig);
-      run = 0;
-    }
   }
 
-  if(started)
+  streaming_queue_clear(&batch);
+
+  if(started) {
     muxer_close(mux);
+    subscription_add_writes_out(s, mux->m_writes - writes);
+    tvhdebug(LS_WEBUI, "Streamed %s, %"PRIu64" bytes in %"PRIu64" writes (%.1f writes/MB)",
+             hc->hc_url_orig, mux->m_written, mux->m_writes,
+             mux->m_written ? mux->m_writes * 1048576.0 / mux->m_written : 0.0);
+  }
 }
 
 /*